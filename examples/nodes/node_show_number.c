@@ -239,6 +239,10 @@ static void node_show_number_init(NodeShowNumber *show_number)
 	g_signal_connect(G_OBJECT(priv->input), "socket-incoming",
 			 G_CALLBACK(node_show_number_input), show_number);
 
+	/* a display only needs the newest value, don't slow down the source */
+	gtk_nodes_node_socket_set_delivery(GTKNODES_NODE_SOCKET(priv->input),
+					   GTKNODES_NODE_SOCKET_DELIVER_LATEST);
+
 	/* get original RGBA */
 	gtk_nodes_node_socket_get_rgba(GTKNODES_NODE_SOCKET(priv->input),
 				       &priv->rgba_i);
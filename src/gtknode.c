@@ -81,9 +81,40 @@
  *	</object>
  * </child>
  *
+ * Nodes holding large internal state, e.g. lookup tables or images, should
+ * rather implement export_state() and import_state(). The state is written
+ * to a stream in whatever form the node chooses, so it is never held in
+ * memory as a whole by #GtkNodesNodeView while saving. The node view may
+ * call export_state() while it is writing the file, so it must only write
+ * and not wait for anything else.
+ *
+ * Loading is not incremental in the same way: a file is read and checked
+ * completely before any node is built, so the state of each node is
+ * decoded into memory first and import_state() reads it from there. A
+ * state must therefore fit into memory as a whole, once for every node
+ * being loaded.
+ *
+ *
+ * # Threaded processing #
+ *
+ * Subclasses which implement the process() virtual function have their
+ * computations executed on a shared pool of worker threads. Every payload
+ * arriving on one of the node's sinks is passed to process() along with the
+ * receiving sink, outside of the GTK main thread. The function must therefore
+ * not touch any widgets and only use state that is safe to access from
+ * another thread. Payloads of the same node are processed one after another
+ * in order of arrival, while different nodes are processed concurrently.
+ *
+ * The #GBytes returned by process() is then handed to process_finish() on the
+ * main thread, which is the place to update the user interface. The default
+ * implementation writes the result to all source sockets of the node, so
+ * subclasses overriding it should chain up if they want to keep this
+ * behaviour.
+ *
  */
 
 typedef struct _GtkNodesNodeChild        GtkNodesNodeChild;
+typedef struct _GtkNodesNodeJob          GtkNodesNodeJob;
 
 struct _GtkNodesNodePrivate
 {
@@ -111,6 +142,8 @@ struct _GtkNodesNodePrivate
   GdkRectangle rectangle_func;  /* functional button ("close") */
 
   gchar *icon_name;             /* the name of the icon to display */
+  GdkPixbuf    *icon;           /* the loaded icon, NULL if stale */
+  GtkIconTheme *icon_theme;     /* the theme we watch for changes */
 
   GtkBorder padding;
   GtkBorder margin;
@@ -118,6 +151,10 @@ struct _GtkNodesNodePrivate
   guint activate_id;
 
   gdouble socket_radius;
+
+  GQueue   jobs;                /* payloads waiting for process() */
+  gboolean processing;          /* a job of this node is in the pool */
+  gboolean destroyed;
 };
 
 
@@ -133,6 +170,16 @@ struct _GtkNodesNodeChild
   gint socket_connect_signal;
   gint socket_disconnect_signal;
   gint socket_destroyed_signal;
+  guint socket_process_func;
+};
+
+
+struct _GtkNodesNodeJob
+{
+  GtkNodesNode       *node;
+  GtkNodesNodeSocket *sink;
+  GBytes             *payload;
+  GBytes             *result;
 };
 
 enum {
@@ -166,6 +213,7 @@ enum
 	NODE_SOCKET_CONNECT,
 	NODE_SOCKET_DISCONNECT,
 	NODE_SOCKET_DESTROYED,
+	NODE_EVALUATE,
 	LAST_SIGNAL
 };
 
@@ -180,6 +228,10 @@ static void       gtk_nodes_node_get_property                        (GObject
                                                                       GValue               *value,
                                                                       GParamSpec           *pspec);
 /* widget class basics */
+static void       gtk_nodes_node_destroy                             (GtkWidget            *widget);
+static void       gtk_nodes_node_style_updated                       (GtkWidget            *widget);
+static void       gtk_nodes_node_icon_theme_changed                  (GtkIconTheme         *icon_theme,
+                                                                      GtkNodesNode         *node);
 static void       gtk_nodes_node_map                                 (GtkWidget            *widget);
 static void       gtk_nodes_node_unmap                               (GtkWidget            *widget);
 static void       gtk_nodes_node_realize                             (GtkWidget            *widget);
@@ -248,6 +300,12 @@ static void       gtk_nodes_node_expander_cb                         (GtkExpande
                                                                       GParamSpec           *param_spec,
                                                                       GtkNodesNode         *node);
 static gboolean   gtk_nodes_node_clicked_timeout                     (gpointer              data);
+static void       gtk_nodes_node_socket_process_cb                   (GtkNodesNodeSocket   *socket,
+                                                                      GBytes               *payload,
+                                                                      gpointer              user_data);
+static void       gtk_nodes_node_real_process_finish                 (GtkNodesNode         *node,
+                                                                      GtkNodesNodeSocket   *sink,
+                                                                      GBytes               *result);
 
 
 static guint node_signals[LAST_SIGNAL] = { 0 };
@@ -272,12 +330,14 @@ gtk_nodes_node_class_init (GtkNodesNodeClass *class)
   gobject_class->set_property = gtk_nodes_node_set_property;
 
   /* widget basics */
+  widget_class->destroy       = gtk_nodes_node_destroy;
   widget_class->map           = gtk_nodes_node_map;
   widget_class->unmap         = gtk_nodes_node_unmap;
   widget_class->realize       = gtk_nodes_node_realize;
   widget_class->unrealize     = gtk_nodes_node_unrealize;
   widget_class->size_allocate = gtk_nodes_node_size_allocate;
   widget_class->draw          = gtk_nodes_node_draw;
+  widget_class->style_updated = gtk_nodes_node_style_updated;
 
   /* widget events */
   widget_class->button_press_event   = gtk_nodes_node_button_press;
@@ -296,6 +356,14 @@ gtk_nodes_node_class_init (GtkNodesNodeClass *class)
   /* nodes class function for internal property export */
   class->export_properties = NULL;
 
+  /* internal state is opt-in as well */
+  class->export_state = NULL;
+  class->import_state = NULL;
+
+  /* threaded processing is opt-in */
+  class->process        = NULL;
+  class->process_finish = gtk_nodes_node_real_process_finish;
+
 
 
   /**
@@ -507,6 +575,27 @@ gtk_nodes_node_class_init (GtkNodesNodeClass *class)
                   G_TYPE_NONE,
                   1, GTK_TYPE_WIDGET);
 
+  /**
+   * GtkNodesNode::node-evaluate:
+   * @node: the object which received the signal.
+   *
+   * The ::node-evaluate signal is emitted by a #GtkNodesNodeView with
+   * %GTKNODES_NODE_VIEW_TRANSPORT_SCHEDULED after the latest payloads of all
+   * sinks of the node were delivered in a tick. A node merging several
+   * inputs computes its outputs here rather than on each incoming payload,
+   * so it runs once per tick and sees the current payload on every sink.
+   */
+
+	node_signals[NODE_EVALUATE] =
+    g_signal_new ("node-evaluate",
+                  G_TYPE_FROM_CLASS (gobject_class),
+                  G_SIGNAL_RUN_LAST,
+                  G_STRUCT_OFFSET (GtkNodesNodeClass, node_evaluate),
+                  NULL, NULL,
+                  NULL,
+                  G_TYPE_NONE,
+                  0);
+
 }
 
 
@@ -543,6 +632,8 @@ gtk_nodes_node_init (GtkNodesNode *node)
 
   priv->icon_name = g_strdup_printf("edit-delete-symbolic");
 
+  g_queue_init (&priv->jobs);
+
 
   gtk_box_set_homogeneous(GTK_BOX(node), FALSE);
 
@@ -651,6 +742,78 @@ gtk_nodes_node_get_property (GObject    *object,
 
 /* Widget Methods */
 
+static void
+gtk_nodes_node_job_free (GtkNodesNodeJob *job)
+{
+  g_object_unref (job->node);
+  g_object_unref (job->sink);
+  g_bytes_unref (job->payload);
+
+  if (job->result)
+    g_bytes_unref (job->result);
+
+  g_slice_free (GtkNodesNodeJob, job);
+}
+
+/* stops feeding a socket's payloads to the node, someone else may keep
+ * the socket around after the node is gone
+ */
+static void
+gtk_nodes_node_child_unsubscribe (GtkNodesNodeChild *child)
+{
+  if (!child->socket_process_func)
+    return;
+
+  gtk_nodes_node_socket_remove_incoming_func (GTKNODES_NODE_SOCKET (child->socket),
+                                              child->socket_process_func);
+  child->socket_process_func = 0;
+}
+
+static void
+gtk_nodes_node_destroy (GtkWidget *widget)
+{
+  GtkNodesNodePrivate *priv;
+
+
+  priv = gtk_nodes_node_get_instance_private (GTKNODES_NODE (widget));
+
+  g_list_foreach (priv->children, (GFunc) gtk_nodes_node_child_unsubscribe,
+                  NULL);
+
+  /* a job still running in the pool holds a reference to us and
+   * will notice when it returns
+   */
+  priv->destroyed = TRUE;
+
+  g_queue_foreach (&priv->jobs, (GFunc) gtk_nodes_node_job_free, NULL);
+  g_queue_clear (&priv->jobs);
+
+  if (priv->icon_theme)
+    {
+      g_signal_handlers_disconnect_by_func (priv->icon_theme,
+                                            gtk_nodes_node_icon_theme_changed,
+                                            widget);
+      priv->icon_theme = NULL;
+    }
+
+  g_clear_object (&priv->icon);
+
+  GTK_WIDGET_CLASS (gtk_nodes_node_parent_class)->destroy (widget);
+}
+
+static void
+gtk_nodes_node_style_updated (GtkWidget *widget)
+{
+  GtkNodesNodePrivate *priv;
+
+
+  priv = gtk_nodes_node_get_instance_private (GTKNODES_NODE (widget));
+
+  GTK_WIDGET_CLASS (gtk_nodes_node_parent_class)->style_updated (widget);
+
+  g_clear_object (&priv->icon);
+}
+
 static void
 gtk_nodes_node_map (GtkWidget *widget)
 {
@@ -967,6 +1130,8 @@ gtk_nodes_node_remove (GtkContainer *container,
           continue;
         }
 
+      gtk_nodes_node_child_unsubscribe (child);
+
       gtk_widget_unparent (GTK_WIDGET (child->socket));
       GTK_CONTAINER_CLASS (gtk_nodes_node_parent_class)->remove (container,
                                                                  widget);
@@ -1177,6 +1342,152 @@ gtk_nodes_node_socket_destroyed (GtkWidget    *socket,
 	g_signal_emit (node, node_signals[NODE_SOCKET_DESTROYED], 0, socket);
 }
 
+static void gtk_nodes_node_process_next (GtkNodesNode *node);
+
+static gboolean
+gtk_nodes_node_process_done (gpointer data)
+{
+  GtkNodesNodeJob *job = data;
+  GtkNodesNodePrivate *priv;
+  GtkNodesNodeClass *class;
+
+
+  priv  = gtk_nodes_node_get_instance_private (job->node);
+  class = GTKNODES_NODE_GET_CLASS (job->node);
+
+  priv->processing = FALSE;
+
+  if (!priv->destroyed)
+    {
+      if (class->process_finish)
+        class->process_finish (job->node, job->sink, job->result);
+
+      gtk_nodes_node_process_next (job->node);
+    }
+
+  gtk_nodes_node_job_free (job);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+gtk_nodes_node_process_worker (gpointer data,
+                               gpointer user_data)
+{
+  GtkNodesNodeJob *job = data;
+  GtkNodesNodeClass *class;
+
+
+  class = GTKNODES_NODE_GET_CLASS (job->node);
+
+  job->result = class->process (job->node, job->sink, job->payload);
+
+  /* hand the result back to the main thread */
+  g_main_context_invoke_full (NULL, G_PRIORITY_DEFAULT,
+                              gtk_nodes_node_process_done, job, NULL);
+}
+
+static GThreadPool *
+gtk_nodes_node_get_process_pool (void)
+{
+  static gsize pool = 0;
+
+  /* the pool is shared by all nodes, so payloads travelling down a chain
+   * of nodes are processed on all cores in a pipelined fashion
+   */
+  if (g_once_init_enter (&pool))
+    {
+      GThreadPool *p;
+
+      p = g_thread_pool_new (gtk_nodes_node_process_worker, NULL,
+                             (gint) g_get_num_processors (), FALSE, NULL);
+
+      g_once_init_leave (&pool, (gsize) p);
+    }
+
+  return (GThreadPool *) pool;
+}
+
+static void
+gtk_nodes_node_process_next (GtkNodesNode *node)
+{
+  GtkNodesNodePrivate *priv;
+  GtkNodesNodeJob *job;
+
+
+  priv = gtk_nodes_node_get_instance_private (node);
+
+  /* only one job per node, so process() sees the payloads in order */
+  if (priv->processing)
+    return;
+
+  job = g_queue_pop_head (&priv->jobs);
+
+  if (job == NULL)
+    return;
+
+  priv->processing = TRUE;
+
+  g_thread_pool_push (gtk_nodes_node_get_process_pool (), job, NULL);
+}
+
+static void
+gtk_nodes_node_socket_process_cb (GtkNodesNodeSocket *socket,
+                                  GBytes             *payload,
+                                  gpointer            user_data)
+{
+  GtkNodesNode *node = user_data;
+  GtkNodesNodePrivate *priv;
+  GtkNodesNodeJob *job;
+
+
+  priv = gtk_nodes_node_get_instance_private (node);
+
+  if (priv->destroyed)
+    return;
+
+  job = g_slice_new0 (GtkNodesNodeJob);
+
+  job->node    = g_object_ref (node);
+  job->sink    = g_object_ref (socket);
+  job->payload = g_bytes_ref (payload);
+
+  g_queue_push_tail (&priv->jobs, job);
+
+  gtk_nodes_node_process_next (node);
+}
+
+static void
+gtk_nodes_node_real_process_finish (GtkNodesNode       *node,
+                                    GtkNodesNodeSocket *sink,
+                                    GBytes             *result)
+{
+  GtkNodesNodePrivate *priv;
+  GList *l;
+
+
+  if (result == NULL)
+    return;
+
+  priv = gtk_nodes_node_get_instance_private (node);
+
+  l = priv->children;
+
+  while (l)
+    {
+      GtkNodesNodeChild *child = l->data;
+
+      l = l->next;
+
+      if (gtk_nodes_node_socket_get_io (GTKNODES_NODE_SOCKET (child->socket))
+          != GTKNODES_NODE_SOCKET_SOURCE)
+        continue;
+
+      gtk_nodes_node_socket_write_bytes (GTKNODES_NODE_SOCKET (child->socket),
+                                         result);
+    }
+}
+
 static void
 gtk_nodes_node_expander_cb (GtkExpander   *expander,
                             GParamSpec    *param_spec,
@@ -1322,6 +1633,13 @@ gtk_nodes_node_item_add_real (GtkNodesNode         *node,
                      G_CALLBACK(gtk_nodes_node_socket_destroyed),
                      node);
 
+  /* feed incoming payloads to the worker threads */
+  if (GTKNODES_NODE_GET_CLASS (node)->process != NULL)
+    child_info->socket_process_func =
+      gtk_nodes_node_socket_add_incoming_func (GTKNODES_NODE_SOCKET (child_info->socket),
+                                               gtk_nodes_node_socket_process_cb,
+                                               node, NULL);
+
 
   priv->children = g_list_append (priv->children, child_info);
 
@@ -1333,24 +1651,91 @@ gtk_nodes_node_item_add_real (GtkNodesNode         *node,
   return child_info->socket;
 }
 
+/* all we really want is to draw a frame, so we'll take our
+ * style context from a button; it is shared by all nodes and
+ * rebuilt when the theme changes
+ */
+
+static GtkWidget *style_button;
+
+static void
+gtk_nodes_node_style_reset (GtkSettings *settings,
+                            GParamSpec  *pspec,
+                            gpointer     data)
+{
+  g_clear_object (&style_button);
+}
+
 static GtkStyleContext *
 get_style_node(void)
 {
-  GtkWidget *b;
-  GtkStyleContext *c;
+  static gboolean watching;
+
+
+  if (!watching)
+    {
+      GtkSettings *settings = gtk_settings_get_default ();
+
+      g_signal_connect (settings, "notify::gtk-theme-name",
+                        G_CALLBACK (gtk_nodes_node_style_reset), NULL);
+      g_signal_connect (settings, "notify::gtk-application-prefer-dark-theme",
+                        G_CALLBACK (gtk_nodes_node_style_reset), NULL);
+
+      watching = TRUE;
+    }
+
+  if (style_button == NULL)
+    style_button = g_object_ref_sink (gtk_button_new ());
+
+  return gtk_widget_get_style_context (style_button);
+}
+
+static void
+gtk_nodes_node_icon_theme_changed (GtkIconTheme *icon_theme,
+                                   GtkNodesNode *node)
+{
+  GtkNodesNodePrivate *priv;
+
+
+  priv = gtk_nodes_node_get_instance_private (node);
+
+  g_clear_object (&priv->icon);
+
+  gtk_widget_queue_draw (GTK_WIDGET (node));
+}
+
+static GdkPixbuf *
+gtk_nodes_node_get_icon (GtkNodesNode *node)
+{
+  GtkNodesNodePrivate *priv;
+  GtkIconTheme *it;
 
-  /* all we really want is to draw a frame, so we'll take our
-   * style context from a button
-   */
 
-  b = gtk_button_new();
+  priv = gtk_nodes_node_get_instance_private (node);
+
+  if (priv->icon || !priv->icon_name)
+    return priv->icon;
+
+  it = gtk_icon_theme_get_for_screen (gtk_widget_get_screen (GTK_WIDGET (node)));
+
+  if (it != priv->icon_theme)
+    {
+      if (priv->icon_theme)
+        g_signal_handlers_disconnect_by_func (priv->icon_theme,
+                                              gtk_nodes_node_icon_theme_changed,
+                                              node);
+
+      g_signal_connect_object (it, "changed",
+                               G_CALLBACK (gtk_nodes_node_icon_theme_changed),
+                               node, 0);
 
-  c = gtk_widget_get_style_context(b);
+      priv->icon_theme = it;
+    }
 
-  g_object_ref(c);
-  g_object_ref_sink(b);
+  priv->icon = gtk_icon_theme_load_icon (it, priv->icon_name,
+                                         priv->rectangle_func.height, 0, NULL);
 
-  return c;
+  return priv->icon;
 }
 
 static void
@@ -1360,7 +1745,6 @@ gtk_nodes_node_draw_frame(GtkNodesNode        *node,
 {
   GtkStyleContext *c;
   GdkPixbuf *pb;
-  GtkIconTheme *it;
 
   GtkNodesNodePrivate *priv;
 
@@ -1381,12 +1765,10 @@ gtk_nodes_node_draw_frame(GtkNodesNode        *node,
   priv->rectangle_func.x = allocation->x + allocation->width - 25; /* XXX */
   priv->rectangle_func.y = allocation->y + priv->padding.top;
 
-  if (priv->icon_name)
-    {
-      it = gtk_icon_theme_get_default ();
-      pb = gtk_icon_theme_load_icon (it, priv->icon_name,
-                                     priv->rectangle_func.height, 0, NULL);
+  pb = gtk_nodes_node_get_icon (node);
 
+  if (pb)
+    {
       cairo_save(cr);
       gdk_cairo_set_source_pixbuf (cr,
                                    pb,
@@ -1396,8 +1778,6 @@ gtk_nodes_node_draw_frame(GtkNodesNode        *node,
       cairo_paint (cr);
       cairo_restore (cr);
     }
-
-  g_clear_object (&c);
 }
 
 static void
@@ -1827,6 +2207,23 @@ gtk_nodes_node_unblock_expander (GtkNodesNode *node)
                              priv->last_expanded);
 }
 
+/**
+ * gtk_nodes_node_evaluate
+ * @node: a GtkNodesNode
+ *
+ * Emits #GtkNodesNode::node-evaluate, telling the node that all of its
+ * sinks received their payloads. Called by the scheduler of a
+ * #GtkNodesNodeView, other transports leave it to the application.
+ */
+
+void
+gtk_nodes_node_evaluate (GtkNodesNode *node)
+{
+  g_return_if_fail (GTKNODES_IS_NODE (node));
+
+  g_signal_emit (node, node_signals[NODE_EVALUATE], 0);
+}
+
 /**
  * gtk_nodes_node_get_sinks
  * @node: a GtkNodesNode
@@ -1926,6 +2323,8 @@ gtk_nodes_node_set_icon_name (GtkNodesNode *node,
 
   priv->icon_name = NULL;
 
+  g_clear_object (&priv->icon);
+
   if (icon_name)
     priv->icon_name = g_strdup_printf ("%s", icon_name);
 }
@@ -1956,6 +2355,97 @@ gtk_nodes_node_export_properties (GtkNodesNode *node)
   return NULL;
 }
 
+/**
+ * gtk_nodes_node_export_state: (virtual export_state)
+ * @node: a #GtkNodesNode
+ * @stream: the stream to write the state to
+ * @cancellable: (nullable): a #GCancellable
+ * @error: return location for an error
+ *
+ * Writes the internal state of the node to @stream, so it can be restored
+ * with gtk_nodes_node_import_state(). Nothing is written if the derived
+ * GtkNodesNode subclass did not implement this function. @stream is not
+ * closed.
+ *
+ * Returns: FALSE on error, @error is then always set
+ */
+
+gboolean
+gtk_nodes_node_export_state (GtkNodesNode   *node,
+                             GOutputStream  *stream,
+                             GCancellable   *cancellable,
+                             GError        **error)
+{
+  GtkNodesNodeClass *class;
+  GError *local_error = NULL;
+
+  g_return_val_if_fail (GTKNODES_IS_NODE (node), FALSE);
+  g_return_val_if_fail (G_IS_OUTPUT_STREAM (stream), FALSE);
+
+  class = GTKNODES_NODE_GET_CLASS (node);
+
+  if (class->export_state == NULL ||
+      class->export_state (node, stream, cancellable, &local_error))
+    return TRUE;
+
+  /* a subclass may fail without saying why, callers report the error */
+  if (local_error == NULL)
+    local_error = g_error_new (G_IO_ERROR, G_IO_ERROR_FAILED,
+                               "%s failed to export its state",
+                               G_OBJECT_TYPE_NAME (node));
+
+  g_propagate_error (error, local_error);
+
+  return FALSE;
+}
+
+/**
+ * gtk_nodes_node_import_state: (virtual import_state)
+ * @node: a #GtkNodesNode
+ * @stream: the stream to read the state from
+ * @cancellable: (nullable): a #GCancellable
+ * @error: return location for an error
+ *
+ * Restores the internal state of the node written by
+ * gtk_nodes_node_export_state(). The state may be read in as many pieces
+ * as the derived GtkNodesNode subclass likes. Nothing is read if it did
+ * not implement this function.
+ *
+ * When a #GtkNodesNodeView loads a file, @stream reads from a copy of the
+ * state held in memory, not from the file itself, see the description of
+ * the class above.
+ *
+ * Returns: FALSE on error, @error is then always set
+ */
+
+gboolean
+gtk_nodes_node_import_state (GtkNodesNode   *node,
+                             GInputStream   *stream,
+                             GCancellable   *cancellable,
+                             GError        **error)
+{
+  GtkNodesNodeClass *class;
+  GError *local_error = NULL;
+
+  g_return_val_if_fail (GTKNODES_IS_NODE (node), FALSE);
+  g_return_val_if_fail (G_IS_INPUT_STREAM (stream), FALSE);
+
+  class = GTKNODES_NODE_GET_CLASS (node);
+
+  if (class->import_state == NULL ||
+      class->import_state (node, stream, cancellable, &local_error))
+    return TRUE;
+
+  if (local_error == NULL)
+    local_error = g_error_new (G_IO_ERROR, G_IO_ERROR_FAILED,
+                               "%s failed to import its state",
+                               G_OBJECT_TYPE_NAME (node));
+
+  g_propagate_error (error, local_error);
+
+  return FALSE;
+}
+
 
 /**
  * gtk_nodes_node_item_add:
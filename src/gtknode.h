@@ -72,14 +72,28 @@ struct _GtkNodesNodeClass
                                        GtkWidget *source);
   void   (* node_socket_destroyed)    (GtkWidget *widget,
                                        GtkWidget *socket);
+  void   (* node_evaluate)            (GtkNodesNode *node);
 
   /* vtable */
   gchar* (* export_properties)        (GtkNodesNode *node);
 
-  void (*_gtk_reserved1) (void);
-  void (*_gtk_reserved2) (void);
-  void (*_gtk_reserved3) (void);
-  void (*_gtk_reserved4) (void);
+  /* threaded processing */
+  GBytes* (* process)                 (GtkNodesNode       *node,
+                                       GtkNodesNodeSocket *sink,
+                                       GBytes             *payload);
+  void    (* process_finish)          (GtkNodesNode       *node,
+                                       GtkNodesNodeSocket *sink,
+                                       GBytes             *result);
+
+  /* streamed internal state */
+  gboolean (* export_state)           (GtkNodesNode       *node,
+                                       GOutputStream      *stream,
+                                       GCancellable       *cancellable,
+                                       GError            **error);
+  gboolean (* import_state)           (GtkNodesNode       *node,
+                                       GInputStream       *stream,
+                                       GCancellable       *cancellable,
+                                       GError            **error);
 };
 
 
@@ -128,9 +142,23 @@ GList*         gtk_nodes_node_get_sinks         (GtkNodesNode         *node);
 GDK_AVAILABLE_IN_ALL
 GList*         gtk_nodes_node_get_sources       (GtkNodesNode         *node);
 
+GDK_AVAILABLE_IN_ALL
+void           gtk_nodes_node_evaluate          (GtkNodesNode         *node);
+
 GDK_AVAILABLE_IN_ALL
 gchar*         gtk_nodes_node_export_properties (GtkNodesNode         *node);
 
+GDK_AVAILABLE_IN_ALL
+gboolean       gtk_nodes_node_export_state      (GtkNodesNode         *node,
+                                                 GOutputStream        *stream,
+                                                 GCancellable         *cancellable,
+                                                 GError              **error);
+GDK_AVAILABLE_IN_ALL
+gboolean       gtk_nodes_node_import_state      (GtkNodesNode         *node,
+                                                 GInputStream         *stream,
+                                                 GCancellable         *cancellable,
+                                                 GError              **error);
+
 GDK_AVAILABLE_IN_ALL
 void           gtk_nodes_node_set_icon_name     (GtkNodesNode         *node,
                                                  const gchar          *icon_name);
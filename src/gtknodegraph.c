@@ -0,0 +1,2277 @@
+/* # vim: tabstop=2 shiftwidth=2 expandtab
+ *
+ * Copyright (C) 2019 Armin Luntzer (armin.luntzer@univie.ac.at)
+ *               Department of Astrophysics, University of Vienna
+ *
+ * The initial version of this project was developed as part of the
+ * activities under ESA/PRODEX contract number C4000126224.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "gtknodegraph.h"
+#include "gtknode.h"
+#include "gtknodesocket.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* A reader for the node view files written by gtk_nodes_node_view_save().
+ * The file is parsed as a stream into a plain description of the nodes and
+ * their connections, which the node view then instantiates in one pass.
+ * Node properties are set directly, only content we do not know about
+ * (e.g. the internal children exported by the nodes) is collected and left
+ * to GtkBuilder on a per-node basis.
+ */
+
+#define READ_BUFFER_SIZE (64 * 1024)
+
+#define GZIP_MAGIC_0     0x1f
+#define GZIP_MAGIC_1     0x8b
+
+#define STATE_CHUNK_SIZE (48 * 1024)   /* node state encoded per write */
+
+typedef struct _GtkNodesNodeGraphParser GtkNodesNodeGraphParser;
+
+struct _GtkNodesNodeGraphParser
+{
+  GtkNodesNodeGraph     *graph;
+
+  GtkNodesNodeGraphNode *node;  /* the object being read */
+  gchar                 *property; /* the property whose value is read */
+  GString               *text;
+
+  guint                  depth; /* element nesting */
+  guint                  extra; /* nesting within content for GtkBuilder */
+
+  GByteArray            *state; /* the node state being decoded */
+  gint                   base64_state;
+  guint                  base64_save;
+
+  GtkNodesNodeGraphValue *value; /* the cached value being read */
+};
+
+
+/* A node's state is written through this stream, which encodes it for
+ * embedding in a file as it goes. In XML, the state is base64 encoded.
+ * In the binary format, it is split into chunks, each preceded by its
+ * length, and terminated with an empty chunk, so the length need not be
+ * known up front. The stream below is not closed with it.
+ */
+
+#define GTKNODES_TYPE_NODE_GRAPH_STATE_STREAM (gtk_nodes_node_graph_state_stream_get_type ())
+
+typedef struct _GtkNodesNodeGraphStateStream      GtkNodesNodeGraphStateStream;
+typedef struct _GtkNodesNodeGraphStateStreamClass GtkNodesNodeGraphStateStreamClass;
+
+struct _GtkNodesNodeGraphStateStream
+{
+  GFilterOutputStream parent;
+
+  gboolean chunked;             /* binary framing instead of base64 */
+  gint     state;               /* base64 encoder state */
+  gint     save;
+
+  gchar    buf[(STATE_CHUNK_SIZE / 3 + 1) * 4 + 4];
+};
+
+struct _GtkNodesNodeGraphStateStreamClass
+{
+  GFilterOutputStreamClass parent_class;
+};
+
+static GType gtk_nodes_node_graph_state_stream_get_type (void) G_GNUC_CONST;
+
+G_DEFINE_TYPE (GtkNodesNodeGraphStateStream, gtk_nodes_node_graph_state_stream,
+               G_TYPE_FILTER_OUTPUT_STREAM)
+
+static gssize
+gtk_nodes_node_graph_state_stream_write (GOutputStream  *stream,
+                                         const void     *buffer,
+                                         gsize           count,
+                                         GCancellable   *cancellable,
+                                         GError        **error)
+{
+  GtkNodesNodeGraphStateStream *s;
+  GOutputStream *base;
+  gsize len;
+
+
+  s    = (GtkNodesNodeGraphStateStream *) stream;
+  base = g_filter_output_stream_get_base_stream (G_FILTER_OUTPUT_STREAM (stream));
+
+  if (count == 0)
+    return 0;
+
+  if (s->chunked)
+    {
+      guint32 size;
+
+      count = MIN (count, G_MAXUINT32);
+      size  = GUINT32_TO_LE ((guint32) count);
+
+      if (!g_output_stream_write_all (base, &size, sizeof (size), NULL,
+                                      cancellable, error))
+        return -1;
+
+      if (!g_output_stream_write_all (base, buffer, count, NULL,
+                                      cancellable, error))
+        return -1;
+
+      return count;
+    }
+
+  /* a short write is fine, the writer comes back with the rest */
+  count = MIN (count, STATE_CHUNK_SIZE);
+
+  len = g_base64_encode_step (buffer, count, FALSE, s->buf,
+                              &s->state, &s->save);
+
+  if (!g_output_stream_write_all (base, s->buf, len, NULL, cancellable, error))
+    return -1;
+
+  return count;
+}
+
+static gboolean
+gtk_nodes_node_graph_state_stream_close (GOutputStream  *stream,
+                                         GCancellable   *cancellable,
+                                         GError        **error)
+{
+  GtkNodesNodeGraphStateStream *s;
+  GOutputStream *base;
+  guint32 end = 0;
+  gsize len;
+
+
+  s    = (GtkNodesNodeGraphStateStream *) stream;
+  base = g_filter_output_stream_get_base_stream (G_FILTER_OUTPUT_STREAM (stream));
+
+  if (s->chunked)
+    return g_output_stream_write_all (base, &end, sizeof (end), NULL,
+                                      cancellable, error);
+
+  len = g_base64_encode_close (FALSE, s->buf, &s->state, &s->save);
+
+  return g_output_stream_write_all (base, s->buf, len, NULL, cancellable, error);
+}
+
+static void
+gtk_nodes_node_graph_state_stream_class_init (GtkNodesNodeGraphStateStreamClass *class)
+{
+  GOutputStreamClass *stream_class = G_OUTPUT_STREAM_CLASS (class);
+
+
+  stream_class->write_fn = gtk_nodes_node_graph_state_stream_write;
+  stream_class->close_fn = gtk_nodes_node_graph_state_stream_close;
+}
+
+static void
+gtk_nodes_node_graph_state_stream_init (GtkNodesNodeGraphStateStream *stream)
+{
+}
+
+/* write a node state or a cached payload, either from memory or, if
+ * @bytes is NULL, straight from the node
+ */
+
+static gboolean
+gtk_nodes_node_graph_write_encoded (GBytes         *bytes,
+                                    GtkWidget      *widget,
+                                    GOutputStream  *out,
+                                    gboolean        chunked,
+                                    GError        **error)
+{
+  GtkNodesNodeGraphStateStream *stream;
+  gboolean ok;
+
+
+  stream = g_object_new (GTKNODES_TYPE_NODE_GRAPH_STATE_STREAM,
+                         "base-stream", out,
+                         "close-base-stream", FALSE,
+                         NULL);
+
+  stream->chunked = chunked;
+
+  if (bytes)
+    ok = g_output_stream_write_all (G_OUTPUT_STREAM (stream),
+                                    g_bytes_get_data (bytes, NULL),
+                                    g_bytes_get_size (bytes),
+                                    NULL, NULL, error);
+  else
+    ok = gtk_nodes_node_export_state (GTKNODES_NODE (widget),
+                                      G_OUTPUT_STREAM (stream), NULL, error);
+
+  if (ok)
+    ok = g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, error);
+
+  g_object_unref (stream);
+
+  return ok;
+}
+
+
+static void
+gtk_nodes_node_graph_value_free (gpointer data)
+{
+  GtkNodesNodeGraphValue *value = data;
+
+
+  g_clear_pointer (&value->payload, g_bytes_unref);
+  g_free (value->digest);
+
+  g_slice_free (GtkNodesNodeGraphValue, value);
+}
+
+void
+_gtk_nodes_node_graph_node_free (gpointer data)
+{
+  GtkNodesNodeGraphNode *node = data;
+
+
+  /* taken by _gtk_nodes_node_graph_steal_node() */
+  if (node == NULL)
+    return;
+
+  g_free (node->type_name);
+  g_free (node->id);
+  g_ptr_array_unref (node->properties);
+
+  if (node->markup)
+    g_string_free (node->markup, TRUE);
+
+  g_clear_pointer (&node->state, g_bytes_unref);
+  g_clear_object (&node->widget);
+  g_clear_pointer (&node->values, g_ptr_array_unref);
+
+  g_slice_free (GtkNodesNodeGraphNode, node);
+}
+
+static void
+gtk_nodes_node_graph_connection_free (gpointer data)
+{
+  GtkNodesNodeGraphConnection *con = data;
+
+
+  g_free (con->node_source);
+  g_free (con->node_sink);
+
+  g_slice_free (GtkNodesNodeGraphConnection, con);
+}
+
+GtkNodesNodeGraph *
+_gtk_nodes_node_graph_new (void)
+{
+  GtkNodesNodeGraph *graph;
+
+
+  graph = g_slice_new (GtkNodesNodeGraph);
+
+  graph->nodes       = g_ptr_array_new_with_free_func (_gtk_nodes_node_graph_node_free);
+  graph->connections = g_ptr_array_new_with_free_func (gtk_nodes_node_graph_connection_free);
+
+  return graph;
+}
+
+void
+_gtk_nodes_node_graph_free (GtkNodesNodeGraph *graph)
+{
+  if (graph == NULL)
+    return;
+
+  g_ptr_array_unref (graph->nodes);
+  g_ptr_array_unref (graph->connections);
+
+  g_slice_free (GtkNodesNodeGraph, graph);
+}
+
+/**
+ * _gtk_nodes_node_graph_add_node:
+ * @graph: a graph description
+ * @type_name: the name of the node's type
+ * @id: the object id of the node
+ *
+ * Returns: (transfer none): the new node description
+ */
+
+GtkNodesNodeGraphNode *
+_gtk_nodes_node_graph_add_node (GtkNodesNodeGraph *graph,
+                                const gchar       *type_name,
+                                const gchar       *id)
+{
+  GtkNodesNodeGraphNode *node;
+
+
+  node = g_slice_new0 (GtkNodesNodeGraphNode);
+
+  node->type_name  = g_strdup (type_name);
+  node->id         = g_strdup (id);
+  node->properties = g_ptr_array_new_with_free_func (g_free);
+
+  g_ptr_array_add (graph->nodes, node);
+
+  return node;
+}
+
+void
+_gtk_nodes_node_graph_node_add_property (GtkNodesNodeGraphNode *node,
+                                         const gchar           *name,
+                                         const gchar           *value)
+{
+  g_ptr_array_add (node->properties, g_strdup (name));
+  g_ptr_array_add (node->properties, g_strdup (value));
+}
+
+/**
+ * _gtk_nodes_node_graph_node_add_value:
+ * @node: the description of a node
+ * @socket: the id of the socket within the node
+ * @source: whether the socket is a source
+ * @payload: (nullable): the payload cached on a source
+ * @digest: (nullable): the digest remembered by a sink
+ *
+ * Records the cached value of a socket of the node.
+ */
+
+void
+_gtk_nodes_node_graph_node_add_value (GtkNodesNodeGraphNode *node,
+                                      guint                  socket,
+                                      gboolean               source,
+                                      GBytes                *payload,
+                                      const gchar           *digest)
+{
+  GtkNodesNodeGraphValue *value;
+
+
+  value = g_slice_new0 (GtkNodesNodeGraphValue);
+
+  value->socket = socket;
+  value->source = source;
+
+  if (payload)
+    value->payload = g_bytes_ref (payload);
+
+  value->digest = g_strdup (digest);
+
+  if (node->values == NULL)
+    node->values = g_ptr_array_new_with_free_func (gtk_nodes_node_graph_value_free);
+
+  g_ptr_array_add (node->values, value);
+}
+
+/**
+ * _gtk_nodes_node_graph_node_get_property:
+ * @node: the description of a node
+ * @name: the name of a property
+ *
+ * Returns: (transfer none) (nullable): the value of the property as written
+ *          in the file, or NULL if it is not set
+ */
+
+const gchar *
+_gtk_nodes_node_graph_node_get_property (GtkNodesNodeGraphNode *node,
+                                         const gchar           *name)
+{
+  guint i;
+
+
+  for (i = 0; i + 1 < node->properties->len; i += 2)
+    if (!strcmp (g_ptr_array_index (node->properties, i), name))
+      return g_ptr_array_index (node->properties, i + 1);
+
+  return NULL;
+}
+
+/**
+ * _gtk_nodes_node_graph_steal_node:
+ * @graph: a graph description
+ * @index: the index of the node in @graph
+ *
+ * Takes a node out of the graph, so it outlives it. Its slot is left
+ * empty, so the indices of the other nodes do not change.
+ *
+ * Returns: (transfer full): the node, free with _gtk_nodes_node_graph_node_free()
+ */
+
+GtkNodesNodeGraphNode *
+_gtk_nodes_node_graph_steal_node (GtkNodesNodeGraph *graph,
+                                  guint              index)
+{
+  GtkNodesNodeGraphNode *node;
+
+
+  node = g_ptr_array_index (graph->nodes, index);
+
+  g_ptr_array_index (graph->nodes, index) = NULL;
+
+  return node;
+}
+
+void
+_gtk_nodes_node_graph_add_connection (GtkNodesNodeGraph *graph,
+                                      const gchar       *node_source,
+                                      guint              source,
+                                      const gchar       *node_sink,
+                                      guint              sink)
+{
+  GtkNodesNodeGraphConnection *con;
+
+
+  con = g_slice_new (GtkNodesNodeGraphConnection);
+
+  con->node_source = g_strdup (node_source);
+  con->node_sink   = g_strdup (node_sink);
+  con->source      = source;
+  con->sink        = sink;
+
+  g_ptr_array_add (graph->connections, con);
+}
+
+/* reproduce an element we pass on to GtkBuilder */
+
+static void
+gtk_nodes_node_graph_append_start (GString      *markup,
+                                   const gchar  *element_name,
+                                   const gchar **attribute_names,
+                                   const gchar **attribute_values)
+{
+  guint i;
+
+
+  g_string_append_printf (markup, "<%s", element_name);
+
+  for (i = 0; attribute_names[i]; i++)
+    {
+      gchar *value;
+
+      value = g_markup_escape_text (attribute_values[i], -1);
+      g_string_append_printf (markup, " %s=\"%s\"", attribute_names[i], value);
+      g_free (value);
+    }
+
+  g_string_append_c (markup, '>');
+}
+
+static void
+gtk_nodes_node_graph_start_object (GtkNodesNodeGraphParser  *parser,
+                                   GMarkupParseContext      *context,
+                                   const gchar             **attribute_names,
+                                   const gchar             **attribute_values,
+                                   GError                  **error)
+{
+  const gchar *type_name;
+  const gchar *id;
+
+
+  if (!g_markup_collect_attributes ("object", attribute_names, attribute_values,
+                                    error,
+                                    G_MARKUP_COLLECT_STRING, "class", &type_name,
+                                    G_MARKUP_COLLECT_STRING, "id", &id,
+                                    G_MARKUP_COLLECT_INVALID))
+    return;
+
+  parser->node = _gtk_nodes_node_graph_add_node (parser->graph, type_name, id);
+}
+
+static void
+gtk_nodes_node_graph_start_signal (GtkNodesNodeGraphParser  *parser,
+                                   GMarkupParseContext      *context,
+                                   const gchar             **attribute_names,
+                                   const gchar             **attribute_values,
+                                   GError                  **error)
+{
+  const gchar *name;
+  const gchar *handler;
+  const gchar *object;
+  guint source, sink;
+  gint line, column;
+
+
+  if (!g_markup_collect_attributes ("signal", attribute_names, attribute_values,
+                                    error,
+                                    G_MARKUP_COLLECT_STRING, "name", &name,
+                                    G_MARKUP_COLLECT_STRING, "handler", &handler,
+                                    G_MARKUP_COLLECT_STRING | G_MARKUP_COLLECT_OPTIONAL,
+                                    "object", &object,
+                                    G_MARKUP_COLLECT_STRING | G_MARKUP_COLLECT_OPTIONAL,
+                                    "swapped", NULL,
+                                    G_MARKUP_COLLECT_STRING | G_MARKUP_COLLECT_OPTIONAL,
+                                    "after", NULL,
+                                    G_MARKUP_COLLECT_STRING | G_MARKUP_COLLECT_OPTIONAL,
+                                    "last_modification_time", NULL,
+                                    G_MARKUP_COLLECT_INVALID))
+    return;
+
+  /* there are no handlers to connect other signals to */
+  if (g_strcmp0 (name, "node-socket-connect"))
+    return;
+
+  /* the socket ids are saved in the name of the handler */
+  if (object == NULL || sscanf (handler, "%u_%u", &source, &sink) != 2)
+    {
+      g_markup_parse_context_get_position (context, &line, &column);
+      g_set_error (error, G_MARKUP_ERROR, G_MARKUP_ERROR_INVALID_CONTENT,
+                   "Invalid socket connection at line %d char %d",
+                   line, column);
+      return;
+    }
+
+  _gtk_nodes_node_graph_add_connection (parser->graph, object, source,
+                                        parser->node->id, sink);
+}
+
+static void
+gtk_nodes_node_graph_start_value (GtkNodesNodeGraphParser  *parser,
+                                  GMarkupParseContext      *context,
+                                  const gchar             **attribute_names,
+                                  const gchar             **attribute_values,
+                                  GError                  **error)
+{
+  const gchar *socket;
+  const gchar *io;
+  const gchar *digest;
+  gchar *end;
+  guint64 id;
+  gint line, column;
+
+
+  if (!g_markup_collect_attributes ("value", attribute_names, attribute_values,
+                                    error,
+                                    G_MARKUP_COLLECT_STRING, "socket", &socket,
+                                    G_MARKUP_COLLECT_STRING, "io", &io,
+                                    G_MARKUP_COLLECT_STRING | G_MARKUP_COLLECT_OPTIONAL,
+                                    "sha256", &digest,
+                                    G_MARKUP_COLLECT_STRING | G_MARKUP_COLLECT_OPTIONAL,
+                                    "encoding", NULL,
+                                    G_MARKUP_COLLECT_INVALID))
+    return;
+
+  id = g_ascii_strtoull (socket, &end, 10);
+
+  if (*end || id > G_MAXUINT ||
+      (strcmp (io, "source") && strcmp (io, "sink")))
+    {
+      g_markup_parse_context_get_position (context, &line, &column);
+      g_set_error (error, G_MARKUP_ERROR, G_MARKUP_ERROR_INVALID_CONTENT,
+                   "Invalid socket value at line %d char %d",
+                   line, column);
+      return;
+    }
+
+  /* a sink only has the digest, a source the payload as content */
+  if (!strcmp (io, "sink"))
+    {
+      _gtk_nodes_node_graph_node_add_value (parser->node, (guint) id, FALSE,
+                                            NULL, digest);
+      return;
+    }
+
+  _gtk_nodes_node_graph_node_add_value (parser->node, (guint) id, TRUE,
+                                        NULL, NULL);
+
+  parser->value = g_ptr_array_index (parser->node->values,
+                                     parser->node->values->len - 1);
+
+  parser->state        = g_byte_array_new ();
+  parser->base64_state = 0;
+  parser->base64_save  = 0;
+}
+
+static void
+gtk_nodes_node_graph_start_element (GMarkupParseContext  *context,
+                                    const gchar          *element_name,
+                                    const gchar         **attribute_names,
+                                    const gchar         **attribute_values,
+                                    gpointer              user_data,
+                                    GError              **error)
+{
+  GtkNodesNodeGraphParser *parser = user_data;
+  gint line, column;
+
+
+  parser->depth++;
+
+  if (parser->extra)
+    {
+      parser->extra++;
+      gtk_nodes_node_graph_append_start (parser->node->markup, element_name,
+                                         attribute_names, attribute_values);
+      return;
+    }
+
+  switch (parser->depth)
+    {
+    case 1:
+      if (!strcmp (element_name, "interface"))
+        return;
+      break;
+    case 2:
+      if (!strcmp (element_name, "object"))
+        {
+          gtk_nodes_node_graph_start_object (parser, context, attribute_names,
+                                             attribute_values, error);
+          return;
+        }
+
+      if (!strcmp (element_name, "requires"))
+        return;
+      break;
+    case 3:
+      if (parser->node == NULL)
+        break;
+
+      if (!strcmp (element_name, "property"))
+        {
+          const gchar *name;
+
+          if (!g_markup_collect_attributes ("property", attribute_names,
+                                            attribute_values, error,
+                                            G_MARKUP_COLLECT_STRING, "name", &name,
+                                            G_MARKUP_COLLECT_STRING | G_MARKUP_COLLECT_OPTIONAL,
+                                            "translatable", NULL,
+                                            G_MARKUP_COLLECT_STRING | G_MARKUP_COLLECT_OPTIONAL,
+                                            "comments", NULL,
+                                            G_MARKUP_COLLECT_STRING | G_MARKUP_COLLECT_OPTIONAL,
+                                            "context", NULL,
+                                            G_MARKUP_COLLECT_INVALID))
+            return;
+
+          parser->property = g_strdup (name);
+          g_string_truncate (parser->text, 0);
+          return;
+        }
+
+      if (!strcmp (element_name, "signal"))
+        {
+          gtk_nodes_node_graph_start_signal (parser, context, attribute_names,
+                                             attribute_values, error);
+          return;
+        }
+
+      if (!strcmp (element_name, "state"))
+        {
+          if (!g_markup_collect_attributes ("state", attribute_names,
+                                            attribute_values, error,
+                                            G_MARKUP_COLLECT_STRING | G_MARKUP_COLLECT_OPTIONAL,
+                                            "encoding", NULL,
+                                            G_MARKUP_COLLECT_INVALID))
+            return;
+
+          parser->state        = g_byte_array_new ();
+          parser->base64_state = 0;
+          parser->base64_save  = 0;
+          return;
+        }
+
+      if (!strcmp (element_name, "value"))
+        {
+          gtk_nodes_node_graph_start_value (parser, context, attribute_names,
+                                            attribute_values, error);
+          return;
+        }
+
+      /* anything else inside a node is up to GtkBuilder */
+      if (parser->node->markup == NULL)
+        parser->node->markup = g_string_new (NULL);
+
+      parser->extra = 1;
+      gtk_nodes_node_graph_append_start (parser->node->markup, element_name,
+                                         attribute_names, attribute_values);
+      return;
+    default:
+      break;
+    }
+
+  g_markup_parse_context_get_position (context, &line, &column);
+  g_set_error (error, G_MARKUP_ERROR, G_MARKUP_ERROR_UNKNOWN_ELEMENT,
+               "Unhandled element <%s> at line %d char %d",
+               element_name, line, column);
+}
+
+static void
+gtk_nodes_node_graph_end_element (GMarkupParseContext  *context,
+                                  const gchar          *element_name,
+                                  gpointer              user_data,
+                                  GError              **error)
+{
+  GtkNodesNodeGraphParser *parser = user_data;
+
+
+  parser->depth--;
+
+  if (parser->extra)
+    {
+      parser->extra--;
+      g_string_append_printf (parser->node->markup, "</%s>", element_name);
+      return;
+    }
+
+  if (parser->property)
+    {
+      g_ptr_array_add (parser->node->properties, parser->property);
+      g_ptr_array_add (parser->node->properties,
+                       g_strdup (g_strstrip (parser->text->str)));
+
+      parser->property = NULL;
+      return;
+    }
+
+  if (parser->value)
+    {
+      parser->value->payload = g_byte_array_free_to_bytes (parser->state);
+      parser->value = NULL;
+      parser->state = NULL;
+      return;
+    }
+
+  if (parser->state)
+    {
+      g_clear_pointer (&parser->node->state, g_bytes_unref);
+
+      parser->node->state = g_byte_array_free_to_bytes (parser->state);
+      parser->state = NULL;
+      return;
+    }
+
+  if (parser->depth == 1)
+    parser->node = NULL;
+}
+
+static void
+gtk_nodes_node_graph_text (GMarkupParseContext  *context,
+                           const gchar          *text,
+                           gsize                 text_len,
+                           gpointer              user_data,
+                           GError              **error)
+{
+  GtkNodesNodeGraphParser *parser = user_data;
+
+
+  if (parser->extra)
+    {
+      gchar *escaped;
+
+      escaped = g_markup_escape_text (text, text_len);
+      g_string_append (parser->node->markup, escaped);
+      g_free (escaped);
+      return;
+    }
+
+  if (parser->property)
+    g_string_append_len (parser->text, text, text_len);
+
+  /* decode as we go, the encoded data is never held as a whole */
+  if (parser->state)
+    {
+      guint len;
+
+      len = parser->state->len;
+
+      g_byte_array_set_size (parser->state, len + (text_len / 4) * 3 + 3);
+
+      len += g_base64_decode_step (text, text_len, parser->state->data + len,
+                                   &parser->base64_state, &parser->base64_save);
+
+      g_byte_array_set_size (parser->state, len);
+    }
+}
+
+static const GMarkupParser gtk_nodes_node_graph_parser = {
+  gtk_nodes_node_graph_start_element,
+  gtk_nodes_node_graph_end_element,
+  gtk_nodes_node_graph_text,
+  NULL,
+  NULL
+};
+
+/**
+ * _gtk_nodes_node_graph_open:
+ * @filename: the file to read
+ * @error: return location for an error
+ *
+ * Opens a file for reading. Files starting with the gzip magic bytes are
+ * decompressed on the fly as they are read.
+ *
+ * Returns: (transfer full): the stream to read from or NULL on error
+ */
+
+GInputStream *
+_gtk_nodes_node_graph_open (const gchar  *filename,
+                            GError      **error)
+{
+  GFileInputStream *stream;
+  GInputStream *in;
+  GInputStream *compressed;
+  GConverter *decompressor;
+  GFile *file;
+  const guchar *magic;
+  gsize len;
+
+
+  file = g_file_new_for_path (filename);
+  stream = g_file_read (file, NULL, error);
+  g_object_unref (file);
+
+  if (stream == NULL)
+    return NULL;
+
+  in = g_buffered_input_stream_new_sized (G_INPUT_STREAM (stream),
+                                          READ_BUFFER_SIZE);
+  g_object_unref (stream);
+
+  /* peek at the first bytes without consuming them */
+  if (g_buffered_input_stream_fill (G_BUFFERED_INPUT_STREAM (in), 2,
+                                    NULL, error) < 0)
+    {
+      g_object_unref (in);
+      return NULL;
+    }
+
+  magic = g_buffered_input_stream_peek_buffer (G_BUFFERED_INPUT_STREAM (in), &len);
+
+  if (len < 2 || magic[0] != GZIP_MAGIC_0 || magic[1] != GZIP_MAGIC_1)
+    return in;
+
+  decompressor = G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP));
+
+  compressed = in;
+  in = g_converter_input_stream_new (compressed, decompressor);
+
+  g_object_unref (decompressor);
+  g_object_unref (compressed);
+
+  return in;
+}
+
+/**
+ * _gtk_nodes_node_graph_parse_stream:
+ * @stream: the stream to read
+ * @error: return location for an error
+ *
+ * Reads a node view description in the format written by
+ * _gtk_nodes_node_graph_write_xml() from @stream, which is not closed.
+ * This does not touch any widgets and may be called from any thread.
+ *
+ * If the description holds top level elements other than the nodes, the
+ * error is %G_MARKUP_ERROR_UNKNOWN_ELEMENT.
+ *
+ * Returns: (transfer full): the description of the graph or NULL on error
+ */
+
+GtkNodesNodeGraph *
+_gtk_nodes_node_graph_parse_stream (GInputStream  *stream,
+                                    GError       **error)
+{
+  GtkNodesNodeGraphParser parser = { 0 };
+  GMarkupParseContext *context;
+  gchar *buf;
+  gssize len;
+  gboolean ok = TRUE;
+
+
+  parser.graph = _gtk_nodes_node_graph_new ();
+  parser.text  = g_string_new (NULL);
+
+  context = g_markup_parse_context_new (&gtk_nodes_node_graph_parser,
+                                        G_MARKUP_PREFIX_ERROR_POSITION,
+                                        &parser, NULL);
+
+  buf = g_malloc (READ_BUFFER_SIZE);
+
+  while (ok)
+    {
+      len = g_input_stream_read (stream, buf, READ_BUFFER_SIZE,
+                                 NULL, error);
+
+      if (len < 0)
+        ok = FALSE;
+      else if (len == 0)
+        break;
+      else
+        ok = g_markup_parse_context_parse (context, buf, len, error);
+    }
+
+  if (ok)
+    ok = g_markup_parse_context_end_parse (context, error);
+
+  g_free (buf);
+  g_markup_parse_context_free (context);
+
+  g_free (parser.property);
+  g_string_free (parser.text, TRUE);
+
+  if (parser.state)
+    g_byte_array_unref (parser.state);
+
+  if (!ok)
+    {
+      _gtk_nodes_node_graph_free (parser.graph);
+      return NULL;
+    }
+
+  return parser.graph;
+}
+
+/**
+ * _gtk_nodes_node_graph_parse_file:
+ * @filename: the file to read
+ * @error: return location for an error
+ *
+ * Reads a node view description saved by gtk_nodes_node_view_save(), see
+ * _gtk_nodes_node_graph_parse_stream().
+ *
+ * If the file holds top level elements other than the nodes, the error is
+ * %G_MARKUP_ERROR_UNKNOWN_ELEMENT and the file should be handed to
+ * GtkBuilder as a whole.
+ *
+ * Returns: (transfer full): the description of the graph or NULL on error
+ */
+
+GtkNodesNodeGraph *
+_gtk_nodes_node_graph_parse_file (const gchar  *filename,
+                                  GError      **error)
+{
+  GtkNodesNodeGraph *graph;
+  GInputStream *stream;
+
+
+  stream = _gtk_nodes_node_graph_open (filename, error);
+
+  if (stream == NULL)
+    return NULL;
+
+  graph = _gtk_nodes_node_graph_parse_stream (stream, error);
+
+  g_object_unref (stream);
+
+  return graph;
+}
+
+/* the connections of each node, by the object id of their sink node */
+
+static GHashTable *
+gtk_nodes_node_graph_group_connections (GtkNodesNodeGraph *graph)
+{
+  GHashTable *groups;
+  guint i;
+
+
+  groups = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                  (GDestroyNotify) g_ptr_array_unref);
+
+  for (i = 0; i < graph->connections->len; i++)
+    {
+      GtkNodesNodeGraphConnection *con;
+      GPtrArray *group;
+
+      con = g_ptr_array_index (graph->connections, i);
+
+      group = g_hash_table_lookup (groups, con->node_sink);
+
+      if (group == NULL)
+        {
+          group = g_ptr_array_new ();
+          g_hash_table_insert (groups, con->node_sink, group);
+        }
+
+      g_ptr_array_add (group, con);
+    }
+
+  return groups;
+}
+
+/**
+ * _gtk_nodes_node_graph_write_xml:
+ * @graph: a graph description
+ * @out: the stream to write to
+ * @error: return location for an error
+ *
+ * Writes the graph in the XML format understood by GtkBuilder and
+ * _gtk_nodes_node_graph_parse_file().
+ *
+ * Returns: FALSE on error
+ */
+
+gboolean
+_gtk_nodes_node_graph_write_xml (GtkNodesNodeGraph  *graph,
+                                 GOutputStream      *out,
+                                 GError            **error)
+{
+  GHashTable *groups;
+  GString *buf;
+  gboolean ok = TRUE;
+  guint i, j;
+
+
+  groups = gtk_nodes_node_graph_group_connections (graph);
+
+  buf = g_string_sized_new (4096);
+
+  /* lead in */
+  g_string_append (buf, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                        "<interface>\n");
+
+  for (i = 0; ok && i < graph->nodes->len; i++)
+    {
+      GtkNodesNodeGraphNode *node;
+      GPtrArray *group;
+      gchar *str;
+
+      node = g_ptr_array_index (graph->nodes, i);
+
+      str = g_markup_printf_escaped ("<object class=\"%s\" id=\"%s\">\n",
+                                     node->type_name, node->id);
+      g_string_append (buf, str);
+      g_free (str);
+
+      for (j = 0; j + 1 < node->properties->len; j += 2)
+        {
+          str = g_markup_printf_escaped ("<property name=\"%s\">%s</property>\n",
+                                         (gchar *) g_ptr_array_index (node->properties, j),
+                                         (gchar *) g_ptr_array_index (node->properties, j + 1));
+          g_string_append (buf, str);
+          g_free (str);
+        }
+
+      group = g_hash_table_lookup (groups, node->id);
+
+      /* we'll save the socket ids in the name of the handler, see
+       * gtk_nodes_node_view_connection_mapper()
+       */
+      for (j = 0; group && j < group->len; j++)
+        {
+          GtkNodesNodeGraphConnection *con = g_ptr_array_index (group, j);
+
+          str = g_markup_printf_escaped ("<signal name=\"node-socket-connect\" "
+                                         "handler=\"%u_%u\" object=\"%s\"/>\n",
+                                         con->source, con->sink,
+                                         con->node_source);
+          g_string_append (buf, str);
+          g_free (str);
+        }
+
+      /* the state goes straight to the stream, possibly from the node */
+      if (node->state || node->widget)
+        {
+          g_string_append (buf, "<state encoding=\"base64\">");
+
+          ok = g_output_stream_write_all (out, buf->str, buf->len,
+                                          NULL, NULL, error)        &&
+               gtk_nodes_node_graph_write_encoded (node->state, node->widget,
+                                                   out, FALSE, error);
+
+          g_string_assign (buf, "</state>\n");
+
+          if (!ok)
+            break;
+        }
+
+      for (j = 0; node->values && j < node->values->len; j++)
+        {
+          GtkNodesNodeGraphValue *value = g_ptr_array_index (node->values, j);
+
+          if (!value->source)
+            {
+              str = g_markup_printf_escaped ("<value socket=\"%u\" io=\"sink\" "
+                                             "sha256=\"%s\"/>\n",
+                                             value->socket, value->digest);
+              g_string_append (buf, str);
+              g_free (str);
+              continue;
+            }
+
+          g_string_append_printf (buf, "<value socket=\"%u\" io=\"source\" "
+                                       "encoding=\"base64\">", value->socket);
+
+          ok = g_output_stream_write_all (out, buf->str, buf->len,
+                                          NULL, NULL, error)        &&
+               gtk_nodes_node_graph_write_encoded (value->payload, NULL,
+                                                   out, FALSE, error);
+
+          g_string_assign (buf, "</value>\n");
+
+          if (!ok)
+            break;
+        }
+
+      if (!ok)
+        break;
+
+      if (node->markup)
+        g_string_append_len (buf, node->markup->str, node->markup->len);
+
+      g_string_append (buf, "</object>\n");
+
+      /* hand over in large chunks */
+      if (buf->len >= 4096)
+        {
+          ok = g_output_stream_write_all (out, buf->str, buf->len,
+                                          NULL, NULL, error);
+          g_string_truncate (buf, 0);
+        }
+    }
+
+  /* lead out */
+  g_string_append (buf, "</interface>\n");
+
+  if (ok)
+    ok = g_output_stream_write_all (out, buf->str, buf->len, NULL, NULL, error);
+
+  g_string_free (buf, TRUE);
+  g_hash_table_unref (groups);
+
+  return ok;
+}
+
+
+/* The binary format. All integers are 32 bit little endian.
+ *
+ *   header       magic "GNDG", version, number of nodes, properties,
+ *                sockets and edges, size of the string table, reserved
+ *   nodes        type name, object id, first property, number of
+ *                properties, exported markup, flags (since version 2)
+ *   properties   name, value
+ *   sockets      node index, socket id, BINARY_SOCKET_SINK/SOURCE
+ *   edges        source socket index, sink socket index
+ *   strings      NUL terminated strings, referenced by their offset
+ *   node data    for each node in order, its state if it is flagged with
+ *                BINARY_NODE_STATE (since version 2), then its cached
+ *                socket values if flagged with BINARY_NODE_VALUES (since
+ *                version 3)
+ *
+ * A state is a sequence of chunks, each a length followed by as many bytes,
+ * ending with an empty chunk. The cached values of a node are their number,
+ * followed by a socket id and BINARY_SOCKET_SINK/SOURCE for each. A source
+ * is followed by its payload in chunks like a state, a sink by the
+ * BINARY_DIGEST_SIZE characters of its digest.
+ *
+ * String references are offsets into the string table, BINARY_NONE marks
+ * a missing string.
+ */
+
+#define BINARY_MAGIC          "GNDG"
+#define BINARY_VERSION        3
+#define BINARY_NONE           G_MAXUINT32
+
+#define BINARY_HEADER_SIZE    8
+#define BINARY_NODE_SIZE      6
+#define BINARY_NODE_SIZE_V1   5
+#define BINARY_PROPERTY_SIZE  2
+#define BINARY_SOCKET_SIZE    3
+#define BINARY_EDGE_SIZE      2
+#define BINARY_DIGEST_SIZE    64
+
+#define BINARY_SOCKET_SINK    0
+#define BINARY_SOCKET_SOURCE  1
+
+#define BINARY_NODE_STATE     (1 << 0)
+#define BINARY_NODE_VALUES    (1 << 1)
+
+typedef struct _GtkNodesNodeGraphWriter GtkNodesNodeGraphWriter;
+
+struct _GtkNodesNodeGraphWriter
+{
+  GString    *strings;
+  GHashTable *offsets;          /* string -> offset in the string table */
+
+  GArray     *nodes;
+  GArray     *properties;
+  GArray     *sockets;
+  GArray     *edges;
+
+  GHashTable *node_index;       /* object id -> node index */
+  GHashTable *socket_index;     /* node index and socket id -> index */
+};
+
+static void
+gtk_nodes_node_graph_put (GArray  *table,
+                          guint32  value)
+{
+  value = GUINT32_TO_LE (value);
+  g_array_append_val (table, value);
+}
+
+static guint32
+gtk_nodes_node_graph_intern (GtkNodesNodeGraphWriter *w,
+                             const gchar             *str)
+{
+  gpointer offset;
+
+
+  if (str == NULL)
+    return BINARY_NONE;
+
+  if (g_hash_table_lookup_extended (w->offsets, str, NULL, &offset))
+    return GPOINTER_TO_UINT (offset);
+
+  offset = GUINT_TO_POINTER (w->strings->len);
+
+  /* the terminating NUL goes into the table as well */
+  g_string_append_len (w->strings, str, strlen (str) + 1);
+
+  g_hash_table_insert (w->offsets, (gpointer) str, offset);
+
+  return GPOINTER_TO_UINT (offset);
+}
+
+static guint32
+gtk_nodes_node_graph_socket (GtkNodesNodeGraphWriter *w,
+                             guint32                  node,
+                             guint32                  id,
+                             guint32                  io)
+{
+  gint64 key;
+  gint64 *stored;
+  gpointer index;
+
+
+  key = ((gint64) node << 32) | id;
+
+  if (g_hash_table_lookup_extended (w->socket_index, &key, NULL, &index))
+    return GPOINTER_TO_UINT (index);
+
+  index = GUINT_TO_POINTER (w->sockets->len / BINARY_SOCKET_SIZE);
+
+  gtk_nodes_node_graph_put (w->sockets, node);
+  gtk_nodes_node_graph_put (w->sockets, id);
+  gtk_nodes_node_graph_put (w->sockets, io);
+
+  stored  = g_new (gint64, 1);
+  *stored = key;
+
+  g_hash_table_insert (w->socket_index, stored, index);
+
+  return GPOINTER_TO_UINT (index);
+}
+
+static gboolean
+gtk_nodes_node_graph_write_table (GOutputStream  *out,
+                                  GArray         *table,
+                                  GError        **error)
+{
+  return g_output_stream_write_all (out, table->data,
+                                    table->len * sizeof (guint32),
+                                    NULL, NULL, error);
+}
+
+/* write the cached socket values of a node, see the format above */
+
+static gboolean
+gtk_nodes_node_graph_write_values (GtkNodesNodeGraphNode  *node,
+                                   GOutputStream          *out,
+                                   GError                **error)
+{
+  GArray *table;
+  gboolean ok;
+  guint i;
+
+
+  table = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+  gtk_nodes_node_graph_put (table, node->values->len);
+
+  ok = gtk_nodes_node_graph_write_table (out, table, error);
+
+  for (i = 0; ok && i < node->values->len; i++)
+    {
+      GtkNodesNodeGraphValue *value = g_ptr_array_index (node->values, i);
+      gchar digest[BINARY_DIGEST_SIZE] = { 0 };
+
+      g_array_set_size (table, 0);
+      gtk_nodes_node_graph_put (table, value->socket);
+      gtk_nodes_node_graph_put (table, value->source ? BINARY_SOCKET_SOURCE :
+                                                       BINARY_SOCKET_SINK);
+
+      ok = gtk_nodes_node_graph_write_table (out, table, error);
+
+      if (!ok)
+        break;
+
+      if (value->source)
+        {
+          ok = gtk_nodes_node_graph_write_encoded (value->payload, NULL,
+                                                   out, TRUE, error);
+          continue;
+        }
+
+      if (value->digest)
+        memcpy (digest, value->digest, MIN (strlen (value->digest),
+                                            sizeof (digest)));
+
+      ok = g_output_stream_write_all (out, digest, sizeof (digest),
+                                      NULL, NULL, error);
+    }
+
+  g_array_unref (table);
+
+  return ok;
+}
+
+/**
+ * _gtk_nodes_node_graph_write_binary:
+ * @graph: a graph description
+ * @out: the stream to write to
+ * @error: return location for an error
+ *
+ * Writes the graph in the binary format read by
+ * _gtk_nodes_node_graph_parse_binary().
+ *
+ * Returns: FALSE on error
+ */
+
+gboolean
+_gtk_nodes_node_graph_write_binary (GtkNodesNodeGraph  *graph,
+                                    GOutputStream      *out,
+                                    GError            **error)
+{
+  GtkNodesNodeGraphWriter w;
+  GArray *header;
+  gboolean ok;
+  guint i, j;
+
+
+  w.strings      = g_string_new (NULL);
+  w.offsets      = g_hash_table_new (g_str_hash, g_str_equal);
+  w.nodes        = g_array_new (FALSE, FALSE, sizeof (guint32));
+  w.properties   = g_array_new (FALSE, FALSE, sizeof (guint32));
+  w.sockets      = g_array_new (FALSE, FALSE, sizeof (guint32));
+  w.edges        = g_array_new (FALSE, FALSE, sizeof (guint32));
+  w.node_index   = g_hash_table_new (g_str_hash, g_str_equal);
+  w.socket_index = g_hash_table_new_full (g_int64_hash, g_int64_equal,
+                                          g_free, NULL);
+
+  for (i = 0; i < graph->nodes->len; i++)
+    {
+      GtkNodesNodeGraphNode *node = g_ptr_array_index (graph->nodes, i);
+
+      g_hash_table_insert (w.node_index, node->id, GUINT_TO_POINTER (i));
+
+      gtk_nodes_node_graph_put (w.nodes, gtk_nodes_node_graph_intern (&w, node->type_name));
+      gtk_nodes_node_graph_put (w.nodes, gtk_nodes_node_graph_intern (&w, node->id));
+      gtk_nodes_node_graph_put (w.nodes, w.properties->len / BINARY_PROPERTY_SIZE);
+      gtk_nodes_node_graph_put (w.nodes, node->properties->len / 2);
+      gtk_nodes_node_graph_put (w.nodes,
+                                gtk_nodes_node_graph_intern (&w, node->markup ?
+                                                                 node->markup->str :
+                                                                 NULL));
+      gtk_nodes_node_graph_put (w.nodes,
+                                ((node->state || node->widget) ? BINARY_NODE_STATE : 0) |
+                                ((node->values && node->values->len) ? BINARY_NODE_VALUES : 0));
+
+      for (j = 0; j + 1 < node->properties->len; j += 2)
+        {
+          gtk_nodes_node_graph_put (w.properties,
+                                    gtk_nodes_node_graph_intern (&w, g_ptr_array_index (node->properties, j)));
+          gtk_nodes_node_graph_put (w.properties,
+                                    gtk_nodes_node_graph_intern (&w, g_ptr_array_index (node->properties, j + 1)));
+        }
+    }
+
+  for (i = 0; i < graph->connections->len; i++)
+    {
+      GtkNodesNodeGraphConnection *con;
+      gpointer node_source, node_sink;
+
+      con = g_ptr_array_index (graph->connections, i);
+
+      if (!g_hash_table_lookup_extended (w.node_index, con->node_source,
+                                         NULL, &node_source))
+        continue;
+
+      if (!g_hash_table_lookup_extended (w.node_index, con->node_sink,
+                                         NULL, &node_sink))
+        continue;
+
+      gtk_nodes_node_graph_put (w.edges,
+                                gtk_nodes_node_graph_socket (&w, GPOINTER_TO_UINT (node_source),
+                                                             con->source,
+                                                             BINARY_SOCKET_SOURCE));
+      gtk_nodes_node_graph_put (w.edges,
+                                gtk_nodes_node_graph_socket (&w, GPOINTER_TO_UINT (node_sink),
+                                                             con->sink,
+                                                             BINARY_SOCKET_SINK));
+    }
+
+  header = g_array_sized_new (FALSE, FALSE, sizeof (guint32), BINARY_HEADER_SIZE);
+
+  g_array_append_vals (header, BINARY_MAGIC, 1);
+  gtk_nodes_node_graph_put (header, BINARY_VERSION);
+  gtk_nodes_node_graph_put (header, w.nodes->len      / BINARY_NODE_SIZE);
+  gtk_nodes_node_graph_put (header, w.properties->len / BINARY_PROPERTY_SIZE);
+  gtk_nodes_node_graph_put (header, w.sockets->len    / BINARY_SOCKET_SIZE);
+  gtk_nodes_node_graph_put (header, w.edges->len      / BINARY_EDGE_SIZE);
+  gtk_nodes_node_graph_put (header, w.strings->len);
+  gtk_nodes_node_graph_put (header, 0);
+
+  ok = gtk_nodes_node_graph_write_table (out, header, error)       &&
+       gtk_nodes_node_graph_write_table (out, w.nodes, error)      &&
+       gtk_nodes_node_graph_write_table (out, w.properties, error) &&
+       gtk_nodes_node_graph_write_table (out, w.sockets, error)    &&
+       gtk_nodes_node_graph_write_table (out, w.edges, error)      &&
+       g_output_stream_write_all (out, w.strings->str, w.strings->len,
+                                  NULL, NULL, error);
+
+  /* the node data follows the tables, so it can be streamed */
+  for (i = 0; ok && i < graph->nodes->len; i++)
+    {
+      GtkNodesNodeGraphNode *node = g_ptr_array_index (graph->nodes, i);
+
+      if (node->state || node->widget)
+        ok = gtk_nodes_node_graph_write_encoded (node->state, node->widget,
+                                                 out, TRUE, error);
+
+      if (ok && node->values && node->values->len)
+        ok = gtk_nodes_node_graph_write_values (node, out, error);
+    }
+
+  g_array_unref (header);
+  g_string_free (w.strings, TRUE);
+  g_hash_table_unref (w.offsets);
+  g_array_unref (w.nodes);
+  g_array_unref (w.properties);
+  g_array_unref (w.sockets);
+  g_array_unref (w.edges);
+  g_hash_table_unref (w.node_index);
+  g_hash_table_unref (w.socket_index);
+
+  return ok;
+}
+
+/* look up a string in the mapped string table */
+
+static gboolean
+gtk_nodes_node_graph_string (const gchar  *strings,
+                             guint32       size,
+                             guint32       offset,
+                             const gchar **str,
+                             GError      **error)
+{
+  offset = GUINT32_FROM_LE (offset);
+
+  if (offset == BINARY_NONE)
+    {
+      (* str) = NULL;
+      return TRUE;
+    }
+
+  if (offset >= size)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "String reference out of range");
+      return FALSE;
+    }
+
+  (* str) = strings + offset;
+
+  return TRUE;
+}
+
+/* collect the chunks of a node state, see the format description above */
+
+static GBytes *
+gtk_nodes_node_graph_read_state (GBytes  *bytes,
+                                 gsize   *offset)
+{
+  const guchar *data;
+  GByteArray *state = NULL;
+  GBytes *first = NULL;
+  gsize length;
+
+
+  data = g_bytes_get_data (bytes, &length);
+
+  while (TRUE)
+    {
+      guint32 size;
+
+      if (length - (* offset) < sizeof (size))
+        goto corrupt;
+
+      memcpy (&size, data + (* offset), sizeof (size));
+      size = GUINT32_FROM_LE (size);
+
+      (* offset) += sizeof (size);
+
+      if (size == 0)
+        break;
+
+      if (length - (* offset) < size)
+        goto corrupt;
+
+      /* a state in one piece is referenced in place */
+      if (first == NULL && state == NULL)
+        {
+          first = g_bytes_new_from_bytes (bytes, (* offset), size);
+        }
+      else
+        {
+          if (state == NULL)
+            {
+              state = g_bytes_unref_to_array (first);
+              first = NULL;
+            }
+
+          g_byte_array_append (state, data + (* offset), size);
+        }
+
+      (* offset) += size;
+    }
+
+  if (state)
+    return g_byte_array_free_to_bytes (state);
+
+  if (first)
+    return first;
+
+  return g_bytes_new (NULL, 0);
+
+corrupt:
+  if (state)
+    g_byte_array_unref (state);
+
+  if (first)
+    g_bytes_unref (first);
+
+  return NULL;
+}
+
+/* read an integer of the node data */
+
+static gboolean
+gtk_nodes_node_graph_read_int (GBytes  *bytes,
+                               gsize   *offset,
+                               guint32 *value)
+{
+  const guchar *data;
+  gsize length;
+
+
+  data = g_bytes_get_data (bytes, &length);
+
+  if (length - (* offset) < sizeof (* value))
+    return FALSE;
+
+  memcpy (value, data + (* offset), sizeof (* value));
+  (* value) = GUINT32_FROM_LE (* value);
+
+  (* offset) += sizeof (* value);
+
+  return TRUE;
+}
+
+/* collect the cached socket values of a node, see the format above */
+
+static gboolean
+gtk_nodes_node_graph_read_values (GtkNodesNodeGraphNode *node,
+                                  GBytes                *bytes,
+                                  gsize                 *offset)
+{
+  const guchar *data;
+  gsize length;
+  guint32 n;
+  guint32 i;
+
+
+  data = g_bytes_get_data (bytes, &length);
+
+  if (!gtk_nodes_node_graph_read_int (bytes, offset, &n))
+    return FALSE;
+
+  for (i = 0; i < n; i++)
+    {
+      GBytes *payload;
+      gchar *digest;
+      guint32 socket;
+      guint32 io;
+
+      if (!gtk_nodes_node_graph_read_int (bytes, offset, &socket) ||
+          !gtk_nodes_node_graph_read_int (bytes, offset, &io))
+        return FALSE;
+
+      if (io == BINARY_SOCKET_SOURCE)
+        {
+          payload = gtk_nodes_node_graph_read_state (bytes, offset);
+
+          if (payload == NULL)
+            return FALSE;
+
+          _gtk_nodes_node_graph_node_add_value (node, socket, TRUE,
+                                                payload, NULL);
+          g_bytes_unref (payload);
+          continue;
+        }
+
+      if (io != BINARY_SOCKET_SINK || length - (* offset) < BINARY_DIGEST_SIZE)
+        return FALSE;
+
+      digest = g_strndup ((const gchar *) data + (* offset), BINARY_DIGEST_SIZE);
+      (* offset) += BINARY_DIGEST_SIZE;
+
+      _gtk_nodes_node_graph_node_add_value (node, socket, FALSE, NULL,
+                                            digest[0] ? digest : NULL);
+      g_free (digest);
+    }
+
+  return TRUE;
+}
+
+/* parse the binary format from memory */
+
+static GtkNodesNodeGraph *
+gtk_nodes_node_graph_parse_binary_data (const gchar  *filename,
+                                        GBytes       *bytes,
+                                        GError      **error)
+{
+  GtkNodesNodeGraph *graph = NULL;
+  gconstpointer data;
+  gsize length;
+  gsize offset;
+  guint32 version;
+  guint32 node_size;
+  const guint32 *header;
+  const guint32 *nodes;
+  const guint32 *properties;
+  const guint32 *sockets;
+  const guint32 *edges;
+  const gchar *strings;
+  guint32 n_nodes, n_properties, n_sockets, n_edges, n_strings;
+  guint64 size;
+  guint32 i, j;
+
+
+  data   = g_bytes_get_data (bytes, &length);
+  header = data;
+
+  if (length < BINARY_HEADER_SIZE * sizeof (guint32) ||
+      memcmp (header, BINARY_MAGIC, 4))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "%s is not a binary node graph", filename);
+      goto cleanup;
+    }
+
+  version = GUINT32_FROM_LE (header[1]);
+
+  if (version < 1 || version > BINARY_VERSION)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "Unsupported node graph version %u", version);
+      goto cleanup;
+    }
+
+  node_size = (version == 1) ? BINARY_NODE_SIZE_V1 : BINARY_NODE_SIZE;
+
+  n_nodes      = GUINT32_FROM_LE (header[2]);
+  n_properties = GUINT32_FROM_LE (header[3]);
+  n_sockets    = GUINT32_FROM_LE (header[4]);
+  n_edges      = GUINT32_FROM_LE (header[5]);
+  n_strings    = GUINT32_FROM_LE (header[6]);
+
+  size = BINARY_HEADER_SIZE
+         + (guint64) n_nodes      * node_size
+         + (guint64) n_properties * BINARY_PROPERTY_SIZE
+         + (guint64) n_sockets    * BINARY_SOCKET_SIZE
+         + (guint64) n_edges      * BINARY_EDGE_SIZE;
+
+  size = size * sizeof (guint32) + n_strings;
+
+  /* the node data follows from version 2 on */
+  if (size > length || (version == 1 && size != length))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "%s is truncated or corrupt", filename);
+      goto cleanup;
+    }
+
+  nodes      = header     + BINARY_HEADER_SIZE;
+  properties = nodes      + n_nodes      * node_size;
+  sockets    = properties + n_properties * BINARY_PROPERTY_SIZE;
+  edges      = sockets    + n_sockets    * BINARY_SOCKET_SIZE;
+  strings    = (const gchar *) (edges + n_edges * BINARY_EDGE_SIZE);
+
+  /* all strings must end within the table */
+  if (n_strings && strings[n_strings - 1] != '\0')
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "%s has a corrupt string table", filename);
+      goto cleanup;
+    }
+
+  graph = _gtk_nodes_node_graph_new ();
+
+  offset = size;
+
+  for (i = 0; i < n_nodes; i++)
+    {
+      const guint32 *n = nodes + i * node_size;
+      GtkNodesNodeGraphNode *node;
+      const gchar *type_name, *id, *markup;
+      guint32 first, count;
+
+      if (!gtk_nodes_node_graph_string (strings, n_strings, n[0], &type_name, error) ||
+          !gtk_nodes_node_graph_string (strings, n_strings, n[1], &id, error)        ||
+          !gtk_nodes_node_graph_string (strings, n_strings, n[4], &markup, error))
+        goto fail;
+
+      first = GUINT32_FROM_LE (n[2]);
+      count = GUINT32_FROM_LE (n[3]);
+
+      if (type_name == NULL || id == NULL ||
+          (guint64) first + count > n_properties)
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                       "Corrupt node record %u", i);
+          goto fail;
+        }
+
+      node = _gtk_nodes_node_graph_add_node (graph, type_name, id);
+
+      if (markup)
+        node->markup = g_string_new (markup);
+
+      if (version > 1 && (GUINT32_FROM_LE (n[5]) & BINARY_NODE_STATE))
+        {
+          node->state = gtk_nodes_node_graph_read_state (bytes, &offset);
+
+          if (node->state == NULL)
+            {
+              g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                           "Corrupt state of node record %u", i);
+              goto fail;
+            }
+        }
+
+      if (version > 2 && (GUINT32_FROM_LE (n[5]) & BINARY_NODE_VALUES))
+        {
+          if (!gtk_nodes_node_graph_read_values (node, bytes, &offset))
+            {
+              g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                           "Corrupt socket values of node record %u", i);
+              goto fail;
+            }
+        }
+
+      for (j = first; j < first + count; j++)
+        {
+          const guint32 *p = properties + j * BINARY_PROPERTY_SIZE;
+          const gchar *name, *value;
+
+          if (!gtk_nodes_node_graph_string (strings, n_strings, p[0], &name, error) ||
+              !gtk_nodes_node_graph_string (strings, n_strings, p[1], &value, error))
+            goto fail;
+
+          if (name == NULL || value == NULL)
+            {
+              g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                           "Corrupt property record %u", j);
+              goto fail;
+            }
+
+          _gtk_nodes_node_graph_node_add_property (node, name, value);
+        }
+    }
+
+  for (i = 0; i < n_edges; i++)
+    {
+      const guint32 *e = edges + i * BINARY_EDGE_SIZE;
+      const guint32 *source, *sink;
+      GtkNodesNodeGraphNode *node_source, *node_sink;
+      guint32 s0, s1;
+
+      s0 = GUINT32_FROM_LE (e[0]);
+      s1 = GUINT32_FROM_LE (e[1]);
+
+      if (s0 >= n_sockets || s1 >= n_sockets)
+        goto corrupt_edge;
+
+      source = sockets + s0 * BINARY_SOCKET_SIZE;
+      sink   = sockets + s1 * BINARY_SOCKET_SIZE;
+
+      if (GUINT32_FROM_LE (source[0]) >= n_nodes ||
+          GUINT32_FROM_LE (sink[0])   >= n_nodes ||
+          GUINT32_FROM_LE (source[2]) != BINARY_SOCKET_SOURCE ||
+          GUINT32_FROM_LE (sink[2])   != BINARY_SOCKET_SINK)
+        goto corrupt_edge;
+
+      node_source = g_ptr_array_index (graph->nodes, GUINT32_FROM_LE (source[0]));
+      node_sink   = g_ptr_array_index (graph->nodes, GUINT32_FROM_LE (sink[0]));
+
+      _gtk_nodes_node_graph_add_connection (graph,
+                                            node_source->id,
+                                            GUINT32_FROM_LE (source[1]),
+                                            node_sink->id,
+                                            GUINT32_FROM_LE (sink[1]));
+      continue;
+
+corrupt_edge:
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Corrupt edge record %u", i);
+      goto fail;
+    }
+
+  if (offset != length)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "%s is truncated or corrupt", filename);
+      goto fail;
+    }
+
+  goto cleanup;
+
+fail:
+  _gtk_nodes_node_graph_free (graph);
+  graph = NULL;
+
+cleanup:
+  return graph;
+}
+
+/* binary files must be decompressed in one piece, the tables are read
+ * in random order
+ */
+
+static GBytes *
+gtk_nodes_node_graph_decompress (const gchar  *filename,
+                                 GError      **error)
+{
+  GInputStream *in;
+  GOutputStream *out;
+  GBytes *bytes = NULL;
+
+
+  in = _gtk_nodes_node_graph_open (filename, error);
+
+  if (in == NULL)
+    return NULL;
+
+  out = g_memory_output_stream_new_resizable ();
+
+  if (g_output_stream_splice (out, in,
+                              G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+                              G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+                              NULL, error) >= 0)
+    bytes = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (out));
+
+  g_object_unref (in);
+  g_object_unref (out);
+
+  return bytes;
+}
+
+/**
+ * _gtk_nodes_node_graph_parse_binary:
+ * @filename: the file to read
+ * @error: return location for an error
+ *
+ * Reads a graph saved by _gtk_nodes_node_graph_write_binary(). The file
+ * is mapped into memory and the tables are read in place, unless it is
+ * compressed. This does not touch any widgets and may be called from any
+ * thread.
+ *
+ * Returns: (transfer full): the description of the graph or NULL on error
+ */
+
+GtkNodesNodeGraph *
+_gtk_nodes_node_graph_parse_binary (const gchar  *filename,
+                                    GError      **error)
+{
+  GtkNodesNodeGraph *graph;
+  GMappedFile *mapped;
+  GBytes *bytes;
+  const guchar *data;
+  gsize length;
+
+
+  mapped = g_mapped_file_new (filename, FALSE, error);
+
+  if (mapped == NULL)
+    return NULL;
+
+  /* node states are referenced in place, they keep the mapping alive */
+  bytes = g_mapped_file_get_bytes (mapped);
+  g_mapped_file_unref (mapped);
+
+  data = g_bytes_get_data (bytes, &length);
+
+  if (length >= 2 && data[0] == GZIP_MAGIC_0 && data[1] == GZIP_MAGIC_1)
+    {
+      g_bytes_unref (bytes);
+
+      bytes = gtk_nodes_node_graph_decompress (filename, error);
+
+      if (bytes == NULL)
+        return NULL;
+    }
+
+  graph = gtk_nodes_node_graph_parse_binary_data (filename, bytes, error);
+
+  g_bytes_unref (bytes);
+
+  return graph;
+}
+
+/* set the properties of a node from their string representation */
+
+static gboolean
+gtk_nodes_node_graph_set_properties (GtkNodesNodeGraphNode  *node,
+                                     GObject                *object,
+                                     GtkBuilder             *builder,
+                                     GError                **error)
+{
+  GObjectClass *class;
+  guint i;
+
+
+  class = G_OBJECT_GET_CLASS (object);
+
+  for (i = 0; i + 1 < node->properties->len; i += 2)
+    {
+      const gchar *name  = g_ptr_array_index (node->properties, i);
+      const gchar *value = g_ptr_array_index (node->properties, i + 1);
+      GParamSpec *pspec;
+      GValue gvalue = G_VALUE_INIT;
+
+      pspec = g_object_class_find_property (class, name);
+
+      if (pspec == NULL)
+        {
+          g_set_error (error, GTK_BUILDER_ERROR, GTK_BUILDER_ERROR_INVALID_PROPERTY,
+                       "Invalid property: %s.%s", node->type_name, name);
+          return FALSE;
+        }
+
+      if (!gtk_builder_value_from_string (builder, pspec, value, &gvalue, error))
+        return FALSE;
+
+      g_object_set_property (object, name, &gvalue);
+      g_value_unset (&gvalue);
+    }
+
+  return TRUE;
+}
+
+/* let GtkBuilder create a node with content we do not handle ourselves */
+
+static GObject *
+gtk_nodes_node_graph_build_markup (GtkNodesNodeGraphNode  *node,
+                                   GtkBuilder             *builder,
+                                   GError                **error)
+{
+  GObject *object;
+  GString *markup;
+  gchar *head;
+  gboolean ok;
+
+
+  head = g_markup_printf_escaped ("<interface><object class=\"%s\" id=\"%s\">",
+                                  node->type_name, node->id);
+
+  markup = g_string_new (head);
+  g_string_append (markup, node->markup->str);
+  g_string_append (markup, "</object></interface>");
+
+  ok = gtk_builder_add_from_string (builder, markup->str, markup->len, error);
+
+  g_free (head);
+  g_string_free (markup, TRUE);
+
+  if (!ok)
+    return NULL;
+
+  object = gtk_builder_get_object (builder, node->id);
+
+  return g_object_ref (object);
+}
+
+/* hand a node its state as a stream */
+
+static gboolean
+gtk_nodes_node_graph_import_state (GtkNodesNodeGraphNode  *node,
+                                   GObject                *object,
+                                   GError                **error)
+{
+  GInputStream *in;
+  gboolean ok;
+
+
+  if (node->state == NULL)
+    return TRUE;
+
+  in = g_memory_input_stream_new_from_bytes (node->state);
+
+  ok = gtk_nodes_node_import_state (GTKNODES_NODE (object), in, NULL, error);
+
+  g_object_unref (in);
+
+  return ok;
+}
+
+/* put the cached values back into the sockets they were saved from */
+
+static void
+gtk_nodes_node_graph_restore_values (GtkNodesNodeGraphNode *node,
+                                     GObject               *object)
+{
+  GList *sources;
+  GList *sinks;
+  GList *l;
+  guint i;
+
+
+  if (node->values == NULL)
+    return;
+
+  sources = gtk_nodes_node_get_sources (GTKNODES_NODE (object));
+  sinks   = gtk_nodes_node_get_sinks (GTKNODES_NODE (object));
+
+  for (i = 0; i < node->values->len; i++)
+    {
+      GtkNodesNodeGraphValue *value = g_ptr_array_index (node->values, i);
+
+      for (l = value->source ? sources : sinks; l; l = l->next)
+        {
+          if ((guint) gtk_nodes_node_socket_get_id (l->data) != value->socket)
+            continue;
+
+          gtk_nodes_node_socket_restore_cache (l->data, value->payload,
+                                               value->digest);
+          break;
+        }
+    }
+
+  g_list_free (sources);
+  g_list_free (sinks);
+}
+
+/**
+ * _gtk_nodes_node_graph_validate:
+ * @graph: a graph description
+ * @error: return location for an error
+ *
+ * Checks that the object ids of the nodes are unique, that every
+ * connection refers to nodes of the graph and that no sink is connected
+ * more than once. This does not touch any widgets and may be called from
+ * any thread.
+ *
+ * Returns: FALSE if the graph is inconsistent
+ */
+
+gboolean
+_gtk_nodes_node_graph_validate (GtkNodesNodeGraph  *graph,
+                                GError            **error)
+{
+  GHashTable *ids;
+  GHashTable *sinks;
+  gboolean ok = TRUE;
+  guint i;
+
+
+  ids   = g_hash_table_new (g_str_hash, g_str_equal);
+  sinks = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  for (i = 0; ok && i < graph->nodes->len; i++)
+    {
+      GtkNodesNodeGraphNode *node = g_ptr_array_index (graph->nodes, i);
+
+      if (!g_hash_table_add (ids, node->id))
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                       "Duplicate node id %s", node->id);
+          ok = FALSE;
+        }
+    }
+
+  for (i = 0; ok && i < graph->connections->len; i++)
+    {
+      GtkNodesNodeGraphConnection *con;
+
+      con = g_ptr_array_index (graph->connections, i);
+
+      if (!g_hash_table_contains (ids, con->node_source) ||
+          !g_hash_table_contains (ids, con->node_sink))
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                       "Connection from node %s to node %s refers to a "
+                       "missing node", con->node_source, con->node_sink);
+          ok = FALSE;
+          break;
+        }
+
+      if (!g_hash_table_add (sinks, g_strdup_printf ("%s:%u", con->node_sink,
+                                                     con->sink)))
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                       "Sink %u of node %s is connected more than once",
+                       con->sink, con->node_sink);
+          ok = FALSE;
+        }
+    }
+
+  g_hash_table_unref (ids);
+  g_hash_table_unref (sinks);
+
+  return ok;
+}
+
+/**
+ * _gtk_nodes_node_graph_build_node:
+ * @node: the description of a node
+ * @builder: a #GtkBuilder to convert property values with
+ * @error: return location for an error
+ *
+ * Returns: (transfer full): the new node or NULL on error
+ */
+
+GtkWidget *
+_gtk_nodes_node_graph_build_node (GtkNodesNodeGraphNode  *node,
+                                  GtkBuilder             *builder,
+                                  GError                **error)
+{
+  GObject *object;
+  GType type;
+
+
+  type = gtk_builder_get_type_from_name (builder, node->type_name);
+
+  if (!g_type_is_a (type, GTKNODES_TYPE_NODE))
+    {
+      g_set_error (error, GTK_BUILDER_ERROR, GTK_BUILDER_ERROR_INVALID_VALUE,
+                   "Invalid node type: %s", node->type_name);
+      return NULL;
+    }
+
+  if (node->markup)
+    object = gtk_nodes_node_graph_build_markup (node, builder, error);
+  else
+    object = g_object_ref_sink (g_object_new (type, NULL));
+
+  if (object == NULL)
+    return NULL;
+
+  if (!gtk_nodes_node_graph_set_properties (node, object, builder, error) ||
+      !gtk_nodes_node_graph_import_state (node, object, error))
+    {
+      gtk_widget_destroy (GTK_WIDGET (object));
+      g_object_unref (object);
+      return NULL;
+    }
+
+  gtk_nodes_node_graph_restore_values (node, object);
+
+  return GTK_WIDGET (object);
+}
+
+/* socket id -> socket */
+
+static GHashTable *
+gtk_nodes_node_graph_socket_map (GList *sockets)
+{
+  GHashTable *map;
+  GList *l;
+
+
+  map = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  for (l = sockets; l; l = l->next)
+    {
+      guint id;
+
+      g_object_get (l->data, "id", &id, NULL);
+      g_hash_table_insert (map, GUINT_TO_POINTER (id), l->data);
+    }
+
+  g_list_free (sockets);
+
+  return map;
+}
+
+static GtkNodesNodeSocket *
+gtk_nodes_node_graph_lookup_socket (GHashTable *maps,
+                                    GtkWidget  *node,
+                                    guint       id,
+                                    gboolean    source)
+{
+  GHashTable *map;
+
+
+  map = g_hash_table_lookup (maps, node);
+
+  if (map == NULL)
+    {
+      if (source)
+        map = gtk_nodes_node_graph_socket_map (gtk_nodes_node_get_sources (GTKNODES_NODE (node)));
+      else
+        map = gtk_nodes_node_graph_socket_map (gtk_nodes_node_get_sinks (GTKNODES_NODE (node)));
+
+      g_hash_table_insert (maps, node, map);
+    }
+
+  return g_hash_table_lookup (map, GUINT_TO_POINTER (id));
+}
+
+/**
+ * _gtk_nodes_node_graph_connect:
+ * @graph: the description of a graph
+ * @nodes: the nodes built from it, keyed by their object id
+ *
+ * Connects the sockets of the nodes as described. The sockets of each
+ * node are looked up once, so this is linear in the number of connections
+ * and sockets.
+ */
+
+void
+_gtk_nodes_node_graph_connect (GtkNodesNodeGraph *graph,
+                               GHashTable        *nodes)
+{
+  GHashTable *sources;
+  GHashTable *sinks;
+  guint i;
+
+
+  sources = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                                   (GDestroyNotify) g_hash_table_unref);
+  sinks   = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                                   (GDestroyNotify) g_hash_table_unref);
+
+  for (i = 0; i < graph->connections->len; i++)
+    {
+      GtkNodesNodeGraphConnection *con;
+      GtkNodesNodeSocket *source;
+      GtkNodesNodeSocket *sink;
+      GtkWidget *node_source;
+      GtkWidget *node_sink;
+
+      con = g_ptr_array_index (graph->connections, i);
+
+      node_source = g_hash_table_lookup (nodes, con->node_source);
+      node_sink   = g_hash_table_lookup (nodes, con->node_sink);
+
+      if (node_source == NULL || node_sink == NULL)
+        continue;
+
+      source = gtk_nodes_node_graph_lookup_socket (sources, node_source,
+                                                   con->source, TRUE);
+      sink   = gtk_nodes_node_graph_lookup_socket (sinks, node_sink,
+                                                   con->sink, FALSE);
+
+      if (source == NULL || sink == NULL)
+        continue;
+
+      gtk_nodes_node_socket_connect_sockets (sink, source);
+    }
+
+  g_hash_table_unref (sources);
+  g_hash_table_unref (sinks);
+}
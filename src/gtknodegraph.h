@@ -0,0 +1,141 @@
+/* # vim: tabstop=2 shiftwidth=2 expandtab
+ *
+ * Copyright (C) 2019 Armin Luntzer (armin.luntzer@univie.ac.at)
+ *               Department of Astrophysics, University of Vienna
+ *
+ * The initial version of this project was developed as part of the
+ * activities under ESA/PRODEX contract number C4000126224.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __GTK_NODE_GRAPH_H__
+#define __GTK_NODE_GRAPH_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+/* internal description of a saved node graph, as read from a file */
+
+typedef struct _GtkNodesNodeGraph           GtkNodesNodeGraph;
+typedef struct _GtkNodesNodeGraphNode       GtkNodesNodeGraphNode;
+typedef struct _GtkNodesNodeGraphConnection GtkNodesNodeGraphConnection;
+typedef struct _GtkNodesNodeGraphValue      GtkNodesNodeGraphValue;
+
+struct _GtkNodesNodeGraphNode
+{
+  gchar     *type_name;
+  gchar     *id;                /* object id in the file */
+
+  GPtrArray *properties;        /* property names and values, alternating */
+
+  GString   *markup;            /* content left to GtkBuilder, may be NULL */
+
+  GBytes    *state;             /* exported internal state, may be NULL */
+  GtkWidget *widget;            /* node to stream the state from instead */
+
+  GPtrArray *values;            /* cached socket values, may be NULL */
+};
+
+struct _GtkNodesNodeGraphValue
+{
+  guint     socket;             /* socket id within the node */
+  gboolean  source;
+
+  GBytes   *payload;            /* the payload cached on a source */
+  gchar    *digest;             /* the digest remembered by a sink */
+};
+
+struct _GtkNodesNodeGraphConnection
+{
+  gchar *node_source;           /* object id of the source node */
+  gchar *node_sink;             /* object id of the sink node */
+
+  guint  source;                /* socket ids within the nodes */
+  guint  sink;
+};
+
+struct _GtkNodesNodeGraph
+{
+  GPtrArray *nodes;
+  GPtrArray *connections;
+};
+
+GtkNodesNodeGraph *     _gtk_nodes_node_graph_new            (void);
+
+void                    _gtk_nodes_node_graph_free           (GtkNodesNodeGraph      *graph);
+
+GtkNodesNodeGraphNode * _gtk_nodes_node_graph_add_node       (GtkNodesNodeGraph      *graph,
+                                                              const gchar            *type_name,
+                                                              const gchar            *id);
+
+void                    _gtk_nodes_node_graph_node_add_property (GtkNodesNodeGraphNode *node,
+                                                                 const gchar           *name,
+                                                                 const gchar           *value);
+
+const gchar *           _gtk_nodes_node_graph_node_get_property (GtkNodesNodeGraphNode *node,
+                                                                 const gchar           *name);
+
+void                    _gtk_nodes_node_graph_node_add_value (GtkNodesNodeGraphNode  *node,
+                                                              guint                   socket,
+                                                              gboolean                source,
+                                                              GBytes                 *payload,
+                                                              const gchar            *digest);
+
+void                    _gtk_nodes_node_graph_node_free      (gpointer                data);
+
+GtkNodesNodeGraphNode * _gtk_nodes_node_graph_steal_node     (GtkNodesNodeGraph      *graph,
+                                                              guint                   index);
+
+void                    _gtk_nodes_node_graph_add_connection (GtkNodesNodeGraph      *graph,
+                                                              const gchar            *node_source,
+                                                              guint                   source,
+                                                              const gchar            *node_sink,
+                                                              guint                   sink);
+
+GInputStream *          _gtk_nodes_node_graph_open           (const gchar            *filename,
+                                                              GError                **error);
+
+GtkNodesNodeGraph *     _gtk_nodes_node_graph_parse_stream   (GInputStream           *stream,
+                                                              GError                **error);
+
+GtkNodesNodeGraph *     _gtk_nodes_node_graph_parse_file     (const gchar            *filename,
+                                                              GError                **error);
+
+GtkNodesNodeGraph *     _gtk_nodes_node_graph_parse_binary   (const gchar            *filename,
+                                                              GError                **error);
+
+gboolean                _gtk_nodes_node_graph_write_xml      (GtkNodesNodeGraph      *graph,
+                                                              GOutputStream          *out,
+                                                              GError                **error);
+
+gboolean                _gtk_nodes_node_graph_write_binary   (GtkNodesNodeGraph      *graph,
+                                                              GOutputStream          *out,
+                                                              GError                **error);
+
+gboolean                _gtk_nodes_node_graph_validate       (GtkNodesNodeGraph      *graph,
+                                                              GError                **error);
+
+GtkWidget *             _gtk_nodes_node_graph_build_node     (GtkNodesNodeGraphNode  *node,
+                                                              GtkBuilder             *builder,
+                                                              GError                **error);
+
+void                    _gtk_nodes_node_graph_connect        (GtkNodesNodeGraph      *graph,
+                                                              GHashTable             *nodes);
+
+G_END_DECLS
+
+#endif /* __GTK_NODE_GRAPH_H__ */
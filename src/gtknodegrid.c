@@ -0,0 +1,399 @@
+/* # vim: tabstop=2 shiftwidth=2 expandtab
+ *
+ * Copyright (C) 2019 Armin Luntzer (armin.luntzer@univie.ac.at)
+ *               Department of Astrophysics, University of Vienna
+ *
+ * The initial version of this project was developed as part of the
+ * activities under ESA/PRODEX contract number C4000126224.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "gtknodegrid.h"
+
+/* A uniform grid over the plane: every item is entered into all cells its
+ * rectangle overlaps. Only cells holding items are allocated, so the plane
+ * is unbounded and empty regions cost nothing. Items are found by visiting
+ * the cells overlapped by the query rectangle, so the cost of a query scales
+ * with the size of the queried area and the number of items in it rather
+ * than with the number of items in the grid.
+ *
+ * The grid has no notion of a coordinate space, items and queries must
+ * simply share one. The node view keeps all of its grids in the coordinates
+ * its children are allocated in, queries in widget coordinates have to be
+ * converted first.
+ */
+
+typedef struct _GtkNodesNodeGridCell GtkNodesNodeGridCell;
+typedef struct _GtkNodesNodeGridItem GtkNodesNodeGridItem;
+
+struct _GtkNodesNodeGrid
+{
+  gint        cell_size;
+
+  GHashTable *cells;            /* cell coordinates -> cell */
+  GHashTable *items;            /* user item -> item */
+};
+
+struct _GtkNodesNodeGridCell
+{
+  gint        x, y;             /* cell coordinates */
+  GHashTable *items;            /* set of items overlapping the cell */
+};
+
+struct _GtkNodesNodeGridItem
+{
+  gpointer     data;
+  GdkRectangle rect;
+
+  gint x0, y0;                  /* range of overlapped cells */
+  gint x1, y1;
+};
+
+
+static guint
+gtk_nodes_node_grid_cell_hash (gconstpointer key)
+{
+  const GtkNodesNodeGridCell *c = key;
+
+  return ((guint) c->x * 73856093U) ^ ((guint) c->y * 19349663U);
+}
+
+static gboolean
+gtk_nodes_node_grid_cell_equal (gconstpointer a,
+                                gconstpointer b)
+{
+  const GtkNodesNodeGridCell *ca = a;
+  const GtkNodesNodeGridCell *cb = b;
+
+  return (ca->x == cb->x) && (ca->y == cb->y);
+}
+
+static void
+gtk_nodes_node_grid_cell_free (gpointer data)
+{
+  GtkNodesNodeGridCell *c = data;
+
+  g_hash_table_unref (c->items);
+  g_slice_free (GtkNodesNodeGridCell, c);
+}
+
+static void
+gtk_nodes_node_grid_item_free (gpointer data)
+{
+  g_slice_free (GtkNodesNodeGridItem, data);
+}
+
+/* floor division, so negative coordinates map to their own cells */
+
+static gint
+gtk_nodes_node_grid_cell_of (GtkNodesNodeGrid *grid,
+                             gint              v)
+{
+  if (v >= 0)
+    return v / grid->cell_size;
+
+  return -((-v - 1) / grid->cell_size) - 1;
+}
+
+static void
+gtk_nodes_node_grid_cell_range (GtkNodesNodeGrid   *grid,
+                                const GdkRectangle *rect,
+                                gint               *x0,
+                                gint               *y0,
+                                gint               *x1,
+                                gint               *y1)
+{
+  (* x0) = gtk_nodes_node_grid_cell_of (grid, rect->x);
+  (* y0) = gtk_nodes_node_grid_cell_of (grid, rect->y);
+  (* x1) = gtk_nodes_node_grid_cell_of (grid, rect->x + MAX (rect->width,  1) - 1);
+  (* y1) = gtk_nodes_node_grid_cell_of (grid, rect->y + MAX (rect->height, 1) - 1);
+}
+
+static void
+gtk_nodes_node_grid_link (GtkNodesNodeGrid     *grid,
+                          GtkNodesNodeGridItem *item)
+{
+  GtkNodesNodeGridCell key;
+  GtkNodesNodeGridCell *c;
+
+
+  for (key.y = item->y0; key.y <= item->y1; key.y++)
+    {
+      for (key.x = item->x0; key.x <= item->x1; key.x++)
+        {
+          c = g_hash_table_lookup (grid->cells, &key);
+
+          if (c == NULL)
+            {
+              c = g_slice_new (GtkNodesNodeGridCell);
+
+              c->x     = key.x;
+              c->y     = key.y;
+              c->items = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+              g_hash_table_add (grid->cells, c);
+            }
+
+          g_hash_table_add (c->items, item);
+        }
+    }
+}
+
+static void
+gtk_nodes_node_grid_unlink (GtkNodesNodeGrid     *grid,
+                            GtkNodesNodeGridItem *item)
+{
+  GtkNodesNodeGridCell key;
+  GtkNodesNodeGridCell *c;
+
+
+  for (key.y = item->y0; key.y <= item->y1; key.y++)
+    {
+      for (key.x = item->x0; key.x <= item->x1; key.x++)
+        {
+          c = g_hash_table_lookup (grid->cells, &key);
+
+          if (c == NULL)
+            continue;
+
+          g_hash_table_remove (c->items, item);
+
+          if (!g_hash_table_size (c->items))
+            g_hash_table_remove (grid->cells, c);
+        }
+    }
+}
+
+/**
+ * _gtk_nodes_node_grid_new:
+ * @cell_size: the edge length of the grid cells
+ *
+ * The cell size should be in the order of the typical size of the items,
+ * so most of them overlap only a few cells.
+ *
+ * Returns: a new, empty grid
+ */
+
+GtkNodesNodeGrid *
+_gtk_nodes_node_grid_new (gint cell_size)
+{
+  GtkNodesNodeGrid *grid;
+
+
+  g_return_val_if_fail (cell_size > 0, NULL);
+
+  grid = g_slice_new (GtkNodesNodeGrid);
+
+  grid->cell_size = cell_size;
+  grid->cells     = g_hash_table_new_full (gtk_nodes_node_grid_cell_hash,
+                                           gtk_nodes_node_grid_cell_equal,
+                                           gtk_nodes_node_grid_cell_free,
+                                           NULL);
+  grid->items     = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                           NULL,
+                                           gtk_nodes_node_grid_item_free);
+
+  return grid;
+}
+
+void
+_gtk_nodes_node_grid_free (GtkNodesNodeGrid *grid)
+{
+  if (grid == NULL)
+    return;
+
+  g_hash_table_unref (grid->cells);
+  g_hash_table_unref (grid->items);
+
+  g_slice_free (GtkNodesNodeGrid, grid);
+}
+
+/**
+ * _gtk_nodes_node_grid_insert:
+ * @grid: a #GtkNodesNodeGrid
+ * @item: the item to enter
+ * @rect: the bounding rectangle of the item
+ *
+ * Enters an item into the grid or updates its rectangle if it is already
+ * there. Moves within the same cells are cheap.
+ */
+
+void
+_gtk_nodes_node_grid_insert (GtkNodesNodeGrid   *grid,
+                             gpointer            item,
+                             const GdkRectangle *rect)
+{
+  GtkNodesNodeGridItem *entry;
+  gint x0, y0, x1, y1;
+
+
+  g_return_if_fail (grid != NULL);
+  g_return_if_fail (rect != NULL);
+
+  gtk_nodes_node_grid_cell_range (grid, rect, &x0, &y0, &x1, &y1);
+
+  entry = g_hash_table_lookup (grid->items, item);
+
+  if (entry == NULL)
+    {
+      entry = g_slice_new (GtkNodesNodeGridItem);
+      entry->data = item;
+
+      g_hash_table_insert (grid->items, item, entry);
+    }
+  else if (entry->x0 == x0 && entry->y0 == y0 && entry->x1 == x1 && entry->y1 == y1)
+    {
+      entry->rect = (* rect);
+      return;
+    }
+  else
+    {
+      gtk_nodes_node_grid_unlink (grid, entry);
+    }
+
+  entry->rect = (* rect);
+  entry->x0   = x0;
+  entry->y0   = y0;
+  entry->x1   = x1;
+  entry->y1   = y1;
+
+  gtk_nodes_node_grid_link (grid, entry);
+}
+
+void
+_gtk_nodes_node_grid_remove (GtkNodesNodeGrid *grid,
+                             gpointer          item)
+{
+  GtkNodesNodeGridItem *entry;
+
+
+  g_return_if_fail (grid != NULL);
+
+  entry = g_hash_table_lookup (grid->items, item);
+
+  if (entry == NULL)
+    return;
+
+  gtk_nodes_node_grid_unlink (grid, entry);
+
+  g_hash_table_remove (grid->items, item);
+}
+
+/**
+ * _gtk_nodes_node_grid_lookup:
+ * @grid: a #GtkNodesNodeGrid
+ * @item: the item
+ * @rect: (out) (optional): the rectangle of the item
+ *
+ * Returns: TRUE if the item is in the grid
+ */
+
+gboolean
+_gtk_nodes_node_grid_lookup (GtkNodesNodeGrid *grid,
+                             gpointer          item,
+                             GdkRectangle     *rect)
+{
+  GtkNodesNodeGridItem *entry;
+
+
+  g_return_val_if_fail (grid != NULL, FALSE);
+
+  entry = g_hash_table_lookup (grid->items, item);
+
+  if (entry == NULL)
+    return FALSE;
+
+  if (rect)
+    (* rect) = entry->rect;
+
+  return TRUE;
+}
+
+/**
+ * _gtk_nodes_node_grid_query:
+ * @grid: a #GtkNodesNodeGrid
+ * @rect: the area to search
+ *
+ * Returns: (transfer container): the items intersecting @rect, in no
+ *          particular order
+ */
+
+GPtrArray *
+_gtk_nodes_node_grid_query (GtkNodesNodeGrid   *grid,
+                            const GdkRectangle *rect)
+{
+  GtkNodesNodeGridCell key;
+  GtkNodesNodeGridCell *c;
+  GHashTableIter iter;
+  GPtrArray *result;
+  gpointer value;
+  gint x0, y0, x1, y1;
+
+
+  g_return_val_if_fail (grid != NULL, NULL);
+  g_return_val_if_fail (rect != NULL, NULL);
+
+  result = g_ptr_array_new ();
+
+  gtk_nodes_node_grid_cell_range (grid, rect, &x0, &y0, &x1, &y1);
+
+  /* if the area covers more cells than there are items, looking at the
+   * items directly is cheaper
+   */
+  if ((gint64) (x1 - x0 + 1) * (y1 - y0 + 1) > g_hash_table_size (grid->items))
+    {
+      g_hash_table_iter_init (&iter, grid->items);
+
+      while (g_hash_table_iter_next (&iter, NULL, &value))
+        {
+          GtkNodesNodeGridItem *item = value;
+
+          if (gdk_rectangle_intersect (&item->rect, rect, NULL))
+            g_ptr_array_add (result, item->data);
+        }
+
+      return result;
+    }
+
+  for (key.y = y0; key.y <= y1; key.y++)
+    {
+      for (key.x = x0; key.x <= x1; key.x++)
+        {
+          c = g_hash_table_lookup (grid->cells, &key);
+
+          if (c == NULL)
+            continue;
+
+          g_hash_table_iter_init (&iter, c->items);
+
+          while (g_hash_table_iter_next (&iter, &value, NULL))
+            {
+              GtkNodesNodeGridItem *item = value;
+
+              /* an item spanning several cells is only reported from the
+               * first one both it and the area overlap
+               */
+              if (key.x != MAX (item->x0, x0) || key.y != MAX (item->y0, y0))
+                continue;
+
+              if (gdk_rectangle_intersect (&item->rect, rect, NULL))
+                g_ptr_array_add (result, item->data);
+            }
+        }
+    }
+
+  return result;
+}
@@ -0,0 +1,55 @@
+/* # vim: tabstop=2 shiftwidth=2 expandtab
+ *
+ * Copyright (C) 2019 Armin Luntzer (armin.luntzer@univie.ac.at)
+ *               Department of Astrophysics, University of Vienna
+ *
+ * The initial version of this project was developed as part of the
+ * activities under ESA/PRODEX contract number C4000126224.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __GTK_NODE_GRID_H__
+#define __GTK_NODE_GRID_H__
+
+#include <gdk/gdk.h>
+
+G_BEGIN_DECLS
+
+/* internal uniform grid spatial index over rectangles */
+
+typedef struct _GtkNodesNodeGrid GtkNodesNodeGrid;
+
+GtkNodesNodeGrid * _gtk_nodes_node_grid_new    (gint                cell_size);
+
+void               _gtk_nodes_node_grid_free   (GtkNodesNodeGrid   *grid);
+
+void               _gtk_nodes_node_grid_insert (GtkNodesNodeGrid   *grid,
+                                                gpointer            item,
+                                                const GdkRectangle *rect);
+
+void               _gtk_nodes_node_grid_remove (GtkNodesNodeGrid   *grid,
+                                                gpointer            item);
+
+gboolean           _gtk_nodes_node_grid_lookup (GtkNodesNodeGrid   *grid,
+                                                gpointer            item,
+                                                GdkRectangle       *rect);
+
+GPtrArray *        _gtk_nodes_node_grid_query  (GtkNodesNodeGrid   *grid,
+                                                const GdkRectangle *rect);
+
+G_END_DECLS
+
+#endif /* __GTK_NODE_GRID_H__ */
@@ -0,0 +1,558 @@
+/* # vim: tabstop=2 shiftwidth=2 expandtab
+ *
+ * Copyright (C) 2019 Armin Luntzer (armin.luntzer@univie.ac.at)
+ *               Department of Astrophysics, University of Vienna
+ *
+ * The initial version of this project was developed as part of the
+ * activities under ESA/PRODEX contract number C4000126224.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "gtknodepayload.h"
+
+#include <string.h>
+
+
+/**
+ * SECTION:gtknodepayload
+ * @Short_description: Typed payload descriptors
+ * @Title: GtkNodesPayloadType
+ *
+ * A #GtkNodesPayloadType describes the layout of the payloads passing a
+ * #GtkNodesNodeSocket: the type and byte order of their elements and the
+ * shape of the array they form. The elements of a payload are found by
+ * their strides, i.e. the distance in bytes between two consecutive
+ * elements along each dimension, so a sink can address the data in place
+ * without parsing it.
+ *
+ * A descriptor set on a sink with gtk_nodes_node_socket_set_payload_type()
+ * is checked against the one of a source when the two are connected, see
+ * gtk_nodes_payload_type_accepts(). A source with a descriptor checks the
+ * size of each payload it sends with gtk_nodes_payload_type_check() and
+ * drops those which do not fit, so a connected sink has nothing left to
+ * validate per payload.
+ *
+ * An extent or stride of 0 is a wildcard. On a sink, it accepts any value
+ * in that place. On a source, an extent of 0 in the first dimension means
+ * the number of rows varies from payload to payload, it is then given by
+ * the size of the payload.
+ *
+ * Descriptors are immutable and reference counted.
+ */
+
+struct _GtkNodesPayloadType
+{
+  gint                     ref_count;
+
+  GtkNodesPayloadElement   element;
+  GtkNodesPayloadByteOrder byte_order;
+
+  guint                    n_dims;
+  gsize                    shape[GTKNODES_PAYLOAD_MAX_DIMS];
+  gsize                    strides[GTKNODES_PAYLOAD_MAX_DIMS];
+};
+
+G_DEFINE_BOXED_TYPE (GtkNodesPayloadType, gtk_nodes_payload_type,
+                     gtk_nodes_payload_type_ref,
+                     gtk_nodes_payload_type_unref)
+
+static const gsize element_size[] = {
+  1,                  /* GTKNODES_PAYLOAD_ELEMENT_BYTE */
+  sizeof (gint8),
+  sizeof (guint8),
+  sizeof (gint16),
+  sizeof (guint16),
+  sizeof (gint32),
+  sizeof (guint32),
+  sizeof (gint64),
+  sizeof (guint64),
+  sizeof (gfloat),
+  sizeof (gdouble),
+};
+
+static const gchar *element_name[] = {
+  "byte",
+  "int8",
+  "uint8",
+  "int16",
+  "uint16",
+  "int32",
+  "uint32",
+  "int64",
+  "uint64",
+  "float",
+  "double",
+};
+
+
+/**
+ * gtk_nodes_payload_type_new:
+ * @element: the type of the elements
+ * @n_dims: the number of dimensions, 0 for a single element
+ * @shape: (array length=n_dims) (nullable): the extent of each dimension
+ *
+ * Creates a descriptor for a contiguous array in row-major order and the
+ * byte order of the host.
+ *
+ * Returns: (transfer full): a new #GtkNodesPayloadType
+ */
+
+GtkNodesPayloadType *
+gtk_nodes_payload_type_new (GtkNodesPayloadElement  element,
+                            guint                   n_dims,
+                            const gsize            *shape)
+{
+  return gtk_nodes_payload_type_new_full (element,
+                                          GTKNODES_PAYLOAD_NATIVE_ENDIAN,
+                                          n_dims, shape, NULL);
+}
+
+/**
+ * gtk_nodes_payload_type_new_full:
+ * @element: the type of the elements
+ * @byte_order: the byte order of the elements
+ * @n_dims: the number of dimensions, 0 for a single element
+ * @shape: (array length=n_dims) (nullable): the extent of each dimension
+ * @strides: (array length=n_dims) (nullable): the stride of each dimension
+ *           in bytes, or NULL for a contiguous array in row-major order
+ *
+ * Creates a descriptor for an arbitrary layout. Without @strides, the
+ * strides of the dimensions outside of one with an extent of 0 can not be
+ * known and are 0 as well.
+ *
+ * Returns: (transfer full): a new #GtkNodesPayloadType
+ */
+
+GtkNodesPayloadType *
+gtk_nodes_payload_type_new_full (GtkNodesPayloadElement    element,
+                                 GtkNodesPayloadByteOrder  byte_order,
+                                 guint                     n_dims,
+                                 const gsize              *shape,
+                                 const gsize              *strides)
+{
+  GtkNodesPayloadType *type;
+  gsize stride;
+  guint i;
+
+
+  g_return_val_if_fail (element <= GTKNODES_PAYLOAD_ELEMENT_DOUBLE, NULL);
+  g_return_val_if_fail (n_dims <= GTKNODES_PAYLOAD_MAX_DIMS, NULL);
+  g_return_val_if_fail (n_dims == 0 || shape != NULL, NULL);
+
+  type = g_slice_new0 (GtkNodesPayloadType);
+
+  type->ref_count  = 1;
+  type->element    = element;
+  type->byte_order = byte_order;
+  type->n_dims     = n_dims;
+
+  if (n_dims)
+    memcpy (type->shape, shape, n_dims * sizeof (gsize));
+
+  if (strides)
+    {
+      memcpy (type->strides, strides, n_dims * sizeof (gsize));
+      return type;
+    }
+
+  stride = element_size[element];
+
+  for (i = n_dims; i > 0; i--)
+    {
+      type->strides[i - 1] = stride;
+      stride *= type->shape[i - 1];
+    }
+
+  return type;
+}
+
+/**
+ * gtk_nodes_payload_type_ref:
+ * @type: a #GtkNodesPayloadType
+ *
+ * Returns: (transfer full): @type
+ */
+
+GtkNodesPayloadType *
+gtk_nodes_payload_type_ref (GtkNodesPayloadType *type)
+{
+  g_return_val_if_fail (type != NULL, NULL);
+
+  g_atomic_int_inc (&type->ref_count);
+
+  return type;
+}
+
+/**
+ * gtk_nodes_payload_type_unref:
+ * @type: a #GtkNodesPayloadType
+ */
+
+void
+gtk_nodes_payload_type_unref (GtkNodesPayloadType *type)
+{
+  g_return_if_fail (type != NULL);
+
+  if (g_atomic_int_dec_and_test (&type->ref_count))
+    g_slice_free (GtkNodesPayloadType, type);
+}
+
+/**
+ * gtk_nodes_payload_type_get_element:
+ * @type: a #GtkNodesPayloadType
+ *
+ * Returns: the type of the elements
+ */
+
+GtkNodesPayloadElement
+gtk_nodes_payload_type_get_element (const GtkNodesPayloadType *type)
+{
+  g_return_val_if_fail (type != NULL, GTKNODES_PAYLOAD_ELEMENT_BYTE);
+
+  return type->element;
+}
+
+/**
+ * gtk_nodes_payload_type_get_element_size:
+ * @type: a #GtkNodesPayloadType
+ *
+ * Returns: the size of one element in bytes
+ */
+
+gsize
+gtk_nodes_payload_type_get_element_size (const GtkNodesPayloadType *type)
+{
+  g_return_val_if_fail (type != NULL, 0);
+
+  return element_size[type->element];
+}
+
+/**
+ * gtk_nodes_payload_type_get_byte_order:
+ * @type: a #GtkNodesPayloadType
+ *
+ * Returns: the byte order of the elements
+ */
+
+GtkNodesPayloadByteOrder
+gtk_nodes_payload_type_get_byte_order (const GtkNodesPayloadType *type)
+{
+  g_return_val_if_fail (type != NULL, GTKNODES_PAYLOAD_NATIVE_ENDIAN);
+
+  return type->byte_order;
+}
+
+/**
+ * gtk_nodes_payload_type_get_n_dims:
+ * @type: a #GtkNodesPayloadType
+ *
+ * Returns: the number of dimensions
+ */
+
+guint
+gtk_nodes_payload_type_get_n_dims (const GtkNodesPayloadType *type)
+{
+  g_return_val_if_fail (type != NULL, 0);
+
+  return type->n_dims;
+}
+
+/**
+ * gtk_nodes_payload_type_get_shape:
+ * @type: a #GtkNodesPayloadType
+ * @dim: the dimension
+ *
+ * Returns: the extent of the dimension, 0 if it is variable
+ */
+
+gsize
+gtk_nodes_payload_type_get_shape (const GtkNodesPayloadType *type,
+                                  guint                      dim)
+{
+  g_return_val_if_fail (type != NULL, 0);
+  g_return_val_if_fail (dim < type->n_dims, 0);
+
+  return type->shape[dim];
+}
+
+/**
+ * gtk_nodes_payload_type_get_stride:
+ * @type: a #GtkNodesPayloadType
+ * @dim: the dimension
+ *
+ * Returns: the distance between two elements along the dimension in bytes,
+ *          0 if it is not known
+ */
+
+gsize
+gtk_nodes_payload_type_get_stride (const GtkNodesPayloadType *type,
+                                   guint                      dim)
+{
+  g_return_val_if_fail (type != NULL, 0);
+  g_return_val_if_fail (dim < type->n_dims, 0);
+
+  return type->strides[dim];
+}
+
+/**
+ * gtk_nodes_payload_type_get_size:
+ * @type: a #GtkNodesPayloadType
+ *
+ * Returns: the size of a payload in bytes, 0 if it varies
+ */
+
+gsize
+gtk_nodes_payload_type_get_size (const GtkNodesPayloadType *type)
+{
+  gsize size;
+  guint i;
+
+
+  g_return_val_if_fail (type != NULL, 0);
+
+  size = element_size[type->element];
+
+  /* the byte after the last element */
+  for (i = 0; i < type->n_dims; i++)
+    {
+      if (type->shape[i] == 0 || type->strides[i] == 0)
+        return 0;
+
+      size += (type->shape[i] - 1) * type->strides[i];
+    }
+
+  return size;
+}
+
+/**
+ * gtk_nodes_payload_type_accepts:
+ * @sink: the #GtkNodesPayloadType of a sink
+ * @source: the #GtkNodesPayloadType of a source
+ *
+ * Checks whether the payloads described by @source can be read as
+ * described by @sink. The element types and the number of dimensions must
+ * be the same, and so must be the byte order of elements larger than one
+ * byte. Extents and strides must match where @sink has no wildcard. A
+ * varying extent of @source only matches a wildcard.
+ *
+ * Returns: TRUE if @sink accepts the payloads of @source
+ */
+
+gboolean
+gtk_nodes_payload_type_accepts (const GtkNodesPayloadType *sink,
+                                const GtkNodesPayloadType *source)
+{
+  guint i;
+
+
+  g_return_val_if_fail (sink != NULL, FALSE);
+  g_return_val_if_fail (source != NULL, FALSE);
+
+  if (sink->element != source->element || sink->n_dims != source->n_dims)
+    return FALSE;
+
+  if (element_size[sink->element] > 1 && sink->byte_order != source->byte_order)
+    return FALSE;
+
+  for (i = 0; i < sink->n_dims; i++)
+    {
+      if (sink->shape[i] && sink->shape[i] != source->shape[i])
+        return FALSE;
+
+      if (sink->strides[i] && sink->strides[i] != source->strides[i])
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/**
+ * gtk_nodes_payload_type_check:
+ * @type: a #GtkNodesPayloadType
+ * @payload: a payload
+ *
+ * Checks whether the size of @payload fits the descriptor. Sources with a
+ * payload type run this on everything written to them, sinks can rely on
+ * their connection check.
+ *
+ * Returns: TRUE if @payload holds the array described by @type
+ */
+
+gboolean
+gtk_nodes_payload_type_check (const GtkNodesPayloadType *type,
+                              GBytes                    *payload)
+{
+  gsize size;
+  gsize row;
+
+
+  g_return_val_if_fail (type != NULL, FALSE);
+  g_return_val_if_fail (payload != NULL, FALSE);
+
+  size = gtk_nodes_payload_type_get_size (type);
+
+  if (size)
+    return g_bytes_get_size (payload) >= size;
+
+  /* a varying number of rows, each a stride long */
+  if (type->n_dims == 0 || type->strides[0] == 0)
+    return TRUE;
+
+  row = type->strides[0];
+
+  return (g_bytes_get_size (payload) % row) == 0;
+}
+
+/**
+ * gtk_nodes_payload_type_get_element_at:
+ * @type: a #GtkNodesPayloadType
+ * @payload: a payload described by @type
+ * @index: (array): the index of the element along each dimension
+ *
+ * Finds an element of a payload in place. The element is in the byte
+ * order of @type.
+ *
+ * Returns: (transfer none) (nullable): the address of the element, or NULL
+ *          if it lies outside of @payload
+ */
+
+gconstpointer
+gtk_nodes_payload_type_get_element_at (const GtkNodesPayloadType *type,
+                                       GBytes                    *payload,
+                                       const gsize               *index)
+{
+  const guint8 *data;
+  gsize offset = 0;
+  gsize size;
+  guint i;
+
+
+  g_return_val_if_fail (type != NULL, NULL);
+  g_return_val_if_fail (payload != NULL, NULL);
+  g_return_val_if_fail (type->n_dims == 0 || index != NULL, NULL);
+
+  data = g_bytes_get_data (payload, &size);
+
+  for (i = 0; i < type->n_dims; i++)
+    {
+      if (type->shape[i] && index[i] >= type->shape[i])
+        return NULL;
+
+      offset += index[i] * type->strides[i];
+    }
+
+  if (offset + element_size[type->element] > size)
+    return NULL;
+
+  return data + offset;
+}
+
+/**
+ * gtk_nodes_payload_type_to_string:
+ * @type: a #GtkNodesPayloadType
+ *
+ * Describes a payload type for messages, e.g. "uint16[480,640] le".
+ * Varying extents are written as "*".
+ *
+ * Returns: (transfer full): the description
+ */
+
+gchar *
+gtk_nodes_payload_type_to_string (const GtkNodesPayloadType *type)
+{
+  GString *str;
+  guint i;
+
+
+  g_return_val_if_fail (type != NULL, NULL);
+
+  str = g_string_new (element_name[type->element]);
+
+  if (type->n_dims)
+    {
+      g_string_append_c (str, '[');
+
+      for (i = 0; i < type->n_dims; i++)
+        {
+          if (i)
+            g_string_append_c (str, ',');
+
+          if (type->shape[i])
+            g_string_append_printf (str, "%" G_GSIZE_FORMAT, type->shape[i]);
+          else
+            g_string_append_c (str, '*');
+        }
+
+      g_string_append_c (str, ']');
+    }
+
+  if (element_size[type->element] > 1)
+    g_string_append (str, type->byte_order == GTKNODES_PAYLOAD_LITTLE_ENDIAN ?
+                          " le" : " be");
+
+  return g_string_free (str, FALSE);
+}
+
+/* our enum-based element type */
+GType
+gtk_nodes_payload_element_get_type (void)
+{
+  static gsize g_define_type_id__ = 0;
+
+  if (g_once_init_enter (&g_define_type_id__))
+    {
+      static const GEnumValue values[] = {
+        { GTKNODES_PAYLOAD_ELEMENT_BYTE,   "GTKNODES_PAYLOAD_ELEMENT_BYTE",   "byte" },
+        { GTKNODES_PAYLOAD_ELEMENT_INT8,   "GTKNODES_PAYLOAD_ELEMENT_INT8",   "int8" },
+        { GTKNODES_PAYLOAD_ELEMENT_UINT8,  "GTKNODES_PAYLOAD_ELEMENT_UINT8",  "uint8" },
+        { GTKNODES_PAYLOAD_ELEMENT_INT16,  "GTKNODES_PAYLOAD_ELEMENT_INT16",  "int16" },
+        { GTKNODES_PAYLOAD_ELEMENT_UINT16, "GTKNODES_PAYLOAD_ELEMENT_UINT16", "uint16" },
+        { GTKNODES_PAYLOAD_ELEMENT_INT32,  "GTKNODES_PAYLOAD_ELEMENT_INT32",  "int32" },
+        { GTKNODES_PAYLOAD_ELEMENT_UINT32, "GTKNODES_PAYLOAD_ELEMENT_UINT32", "uint32" },
+        { GTKNODES_PAYLOAD_ELEMENT_INT64,  "GTKNODES_PAYLOAD_ELEMENT_INT64",  "int64" },
+        { GTKNODES_PAYLOAD_ELEMENT_UINT64, "GTKNODES_PAYLOAD_ELEMENT_UINT64", "uint64" },
+        { GTKNODES_PAYLOAD_ELEMENT_FLOAT,  "GTKNODES_PAYLOAD_ELEMENT_FLOAT",  "float" },
+        { GTKNODES_PAYLOAD_ELEMENT_DOUBLE, "GTKNODES_PAYLOAD_ELEMENT_DOUBLE", "double" },
+        { 0, NULL, NULL }
+      };
+      GType g_define_type_id =
+        g_enum_register_static (g_intern_static_string ("GtkNodesPayloadElement"), values);
+      g_once_init_leave (&g_define_type_id__, g_define_type_id);
+    }
+
+  return g_define_type_id__;
+}
+
+/* our enum-based byte order type */
+GType
+gtk_nodes_payload_byte_order_get_type (void)
+{
+  static gsize g_define_type_id__ = 0;
+
+  if (g_once_init_enter (&g_define_type_id__))
+    {
+      static const GEnumValue values[] = {
+        { GTKNODES_PAYLOAD_LITTLE_ENDIAN, "GTKNODES_PAYLOAD_LITTLE_ENDIAN", "little-endian" },
+        { GTKNODES_PAYLOAD_BIG_ENDIAN,    "GTKNODES_PAYLOAD_BIG_ENDIAN",    "big-endian" },
+        { 0, NULL, NULL }
+      };
+      GType g_define_type_id =
+        g_enum_register_static (g_intern_static_string ("GtkNodesPayloadByteOrder"), values);
+      g_once_init_leave (&g_define_type_id__, g_define_type_id);
+    }
+
+  return g_define_type_id__;
+}
@@ -0,0 +1,155 @@
+/* # vim: tabstop=2 shiftwidth=2 expandtab
+ *
+ * Copyright (C) 2019 Armin Luntzer (armin.luntzer@univie.ac.at)
+ *               Department of Astrophysics, University of Vienna
+ *
+ * The initial version of this project was developed as part of the
+ * activities under ESA/PRODEX contract number C4000126224.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __GTK_NODE_PAYLOAD_H__
+#define __GTK_NODE_PAYLOAD_H__
+
+#include <glib-object.h>
+#include <gdk/gdk.h>
+
+G_BEGIN_DECLS
+
+
+#define GTKNODES_TYPE_PAYLOAD_TYPE        (gtk_nodes_payload_type_get_type ())
+#define GTKNODES_TYPE_PAYLOAD_ELEMENT     (gtk_nodes_payload_element_get_type ())
+#define GTKNODES_TYPE_PAYLOAD_BYTE_ORDER  (gtk_nodes_payload_byte_order_get_type ())
+
+#define GTKNODES_PAYLOAD_MAX_DIMS         8
+
+
+/**
+ * GtkNodesPayloadElement:
+ * @GTKNODES_PAYLOAD_ELEMENT_BYTE:   opaque bytes
+ * @GTKNODES_PAYLOAD_ELEMENT_INT8:   signed 8 bit integers
+ * @GTKNODES_PAYLOAD_ELEMENT_UINT8:  unsigned 8 bit integers
+ * @GTKNODES_PAYLOAD_ELEMENT_INT16:  signed 16 bit integers
+ * @GTKNODES_PAYLOAD_ELEMENT_UINT16: unsigned 16 bit integers
+ * @GTKNODES_PAYLOAD_ELEMENT_INT32:  signed 32 bit integers
+ * @GTKNODES_PAYLOAD_ELEMENT_UINT32: unsigned 32 bit integers
+ * @GTKNODES_PAYLOAD_ELEMENT_INT64:  signed 64 bit integers
+ * @GTKNODES_PAYLOAD_ELEMENT_UINT64: unsigned 64 bit integers
+ * @GTKNODES_PAYLOAD_ELEMENT_FLOAT:  single precision floating point
+ * @GTKNODES_PAYLOAD_ELEMENT_DOUBLE: double precision floating point
+ *
+ * The type of the elements of a payload
+ */
+
+typedef enum
+{
+  GTKNODES_PAYLOAD_ELEMENT_BYTE,
+  GTKNODES_PAYLOAD_ELEMENT_INT8,
+  GTKNODES_PAYLOAD_ELEMENT_UINT8,
+  GTKNODES_PAYLOAD_ELEMENT_INT16,
+  GTKNODES_PAYLOAD_ELEMENT_UINT16,
+  GTKNODES_PAYLOAD_ELEMENT_INT32,
+  GTKNODES_PAYLOAD_ELEMENT_UINT32,
+  GTKNODES_PAYLOAD_ELEMENT_INT64,
+  GTKNODES_PAYLOAD_ELEMENT_UINT64,
+  GTKNODES_PAYLOAD_ELEMENT_FLOAT,
+  GTKNODES_PAYLOAD_ELEMENT_DOUBLE,
+} GtkNodesPayloadElement;
+
+/**
+ * GtkNodesPayloadByteOrder:
+ * @GTKNODES_PAYLOAD_LITTLE_ENDIAN: least significant byte first
+ * @GTKNODES_PAYLOAD_BIG_ENDIAN:    most significant byte first
+ *
+ * The byte order of the elements of a payload
+ */
+
+typedef enum
+{
+  GTKNODES_PAYLOAD_LITTLE_ENDIAN,
+  GTKNODES_PAYLOAD_BIG_ENDIAN,
+} GtkNodesPayloadByteOrder;
+
+/**
+ * GTKNODES_PAYLOAD_NATIVE_ENDIAN:
+ *
+ * The byte order of the host
+ */
+
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define GTKNODES_PAYLOAD_NATIVE_ENDIAN GTKNODES_PAYLOAD_LITTLE_ENDIAN
+#else
+#define GTKNODES_PAYLOAD_NATIVE_ENDIAN GTKNODES_PAYLOAD_BIG_ENDIAN
+#endif
+
+typedef struct _GtkNodesPayloadType GtkNodesPayloadType;
+
+
+GDK_AVAILABLE_IN_ALL
+GType                    gtk_nodes_payload_type_get_type       (void) G_GNUC_CONST;
+GDK_AVAILABLE_IN_ALL
+GType                    gtk_nodes_payload_element_get_type    (void) G_GNUC_CONST;
+GDK_AVAILABLE_IN_ALL
+GType                    gtk_nodes_payload_byte_order_get_type (void) G_GNUC_CONST;
+
+GDK_AVAILABLE_IN_ALL
+GtkNodesPayloadType*     gtk_nodes_payload_type_new            (GtkNodesPayloadElement    element,
+                                                                guint                     n_dims,
+                                                                const gsize              *shape);
+GDK_AVAILABLE_IN_ALL
+GtkNodesPayloadType*     gtk_nodes_payload_type_new_full       (GtkNodesPayloadElement    element,
+                                                                GtkNodesPayloadByteOrder  byte_order,
+                                                                guint                     n_dims,
+                                                                const gsize              *shape,
+                                                                const gsize              *strides);
+GDK_AVAILABLE_IN_ALL
+GtkNodesPayloadType*     gtk_nodes_payload_type_ref            (GtkNodesPayloadType      *type);
+GDK_AVAILABLE_IN_ALL
+void                     gtk_nodes_payload_type_unref          (GtkNodesPayloadType      *type);
+
+GDK_AVAILABLE_IN_ALL
+GtkNodesPayloadElement   gtk_nodes_payload_type_get_element    (const GtkNodesPayloadType *type);
+GDK_AVAILABLE_IN_ALL
+gsize                    gtk_nodes_payload_type_get_element_size (const GtkNodesPayloadType *type);
+GDK_AVAILABLE_IN_ALL
+GtkNodesPayloadByteOrder gtk_nodes_payload_type_get_byte_order (const GtkNodesPayloadType *type);
+GDK_AVAILABLE_IN_ALL
+guint                    gtk_nodes_payload_type_get_n_dims     (const GtkNodesPayloadType *type);
+GDK_AVAILABLE_IN_ALL
+gsize                    gtk_nodes_payload_type_get_shape      (const GtkNodesPayloadType *type,
+                                                                guint                      dim);
+GDK_AVAILABLE_IN_ALL
+gsize                    gtk_nodes_payload_type_get_stride     (const GtkNodesPayloadType *type,
+                                                                guint                      dim);
+GDK_AVAILABLE_IN_ALL
+gsize                    gtk_nodes_payload_type_get_size       (const GtkNodesPayloadType *type);
+
+GDK_AVAILABLE_IN_ALL
+gboolean                 gtk_nodes_payload_type_accepts        (const GtkNodesPayloadType *sink,
+                                                                const GtkNodesPayloadType *source);
+GDK_AVAILABLE_IN_ALL
+gboolean                 gtk_nodes_payload_type_check          (const GtkNodesPayloadType *type,
+                                                                GBytes                    *payload);
+GDK_AVAILABLE_IN_ALL
+gconstpointer            gtk_nodes_payload_type_get_element_at (const GtkNodesPayloadType *type,
+                                                                GBytes                    *payload,
+                                                                const gsize               *index);
+GDK_AVAILABLE_IN_ALL
+gchar*                   gtk_nodes_payload_type_to_string      (const GtkNodesPayloadType *type);
+
+G_END_DECLS
+
+#endif /* __GTK_NODE_PAYLOAD_H__ */
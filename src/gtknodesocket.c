@@ -22,11 +22,15 @@
 
 
 #include "gtknodesocket.h"
+#include "gtknodesocketprivate.h"
+#include "gtknodeview.h"
+#include "gtknodeviewprivate.h"
 
 #include "gtk/gtkdnd.h"
 #include "gtk/gtkdragdest.h"
 #include "gtk/gtkdragsource.h"
 #include "gtk/gtkgesturemultipress.h"
+#include "gio/gio.h"
 
 
 /* gtkprivate.h */
@@ -63,13 +67,132 @@
  *
  * # Connections and data transport #
  *
- * Connections on sinks are established by connecting to the :socket-outgoing
- * signal of the source. This means that the source is not aware of the number
- * of connected sinks, as all data is transported by the GType signal system.
+ * A source keeps a list of the sinks connected to it and hands each payload
+ * written to it to them by a direct call, so passing a payload on does not
+ * go through the signal system. The ::socket-outgoing and
+ * ::socket-outgoing-bytes signals are only emitted if anybody connected to
+ * them.
  *
  * The user can push output from a source by calling
  * @gtk_nodes_node_socket_write() on the socket. To get data received by a sink,
- * the user must connect to the ::socket-incoming signal.
+ * the user must connect to the ::socket-incoming signal, or, cheaper still,
+ * add a plain function with gtk_nodes_node_socket_add_incoming_func(), which
+ * is called with the shared payload before any signal is emitted. Like the
+ * outgoing signals, the incoming ones cost nothing if nobody listens.
+ *
+ * # Shared payloads #
+ *
+ * As an alternative to the #GByteArray interface, payloads can be written as
+ * immutable, reference counted #GBytes with gtk_nodes_node_socket_write_bytes()
+ * and received by connecting to the ::socket-incoming-bytes signal. The same
+ * #GBytes instance is handed to every connected sink, so a payload is never
+ * copied on its way through the graph. A sink may keep a reference for as long
+ * as it likes, but it must never modify the data. Sinks which need to work on
+ * the data in place can call gtk_nodes_node_socket_bytes_make_writable(), which
+ * only copies the payload if anybody else still holds a reference to it.
+ *
+ * Producers can avoid the initial copy by filling a #GByteArray and converting
+ * it with g_byte_array_free_to_bytes().
+ *
+ * Payloads are only converted between the two representations if a sink has
+ * handlers connected for the other one, which costs one copy per sink.
+ *
+ * # Loops #
+ *
+ * Within a #GtkNodesNodeView, a sink refuses to connect to a source if the
+ * connection would close a loop in the graph. Sinks meant to close a loop
+ * must be marked with the #GtkNodesNodeSocket:feedback property, the view
+ * then delays every payload arriving on them by one tick of its scheduler.
+ * A sink receiving a new payload while it still dispatches the previous one
+ * drops it with a warning.
+ *
+ * # Delivery policies #
+ *
+ * A sink normally processes every payload its source writes, right when it
+ * is written. Slow sinks which only care about the most recent value, like
+ * a plot fed by a fast pulse, can choose another
+ * #GtkNodesNodeSocket:delivery policy so they don't hold up the rest of the
+ * pipeline:
+ *
+ * - %GTKNODES_NODE_SOCKET_DELIVER_ALL: every payload is delivered
+ * - %GTKNODES_NODE_SOCKET_DELIVER_LATEST: payloads are held back and
+ *   replace one another until the main loop is idle, then only the newest
+ *   is delivered, so the sink runs at most once per main loop iteration
+ * - %GTKNODES_NODE_SOCKET_DELIVER_DECIMATE: only the first of every
+ *   #GtkNodesNodeSocket:decimation payloads is delivered
+ *
+ * The policy is applied on arrival, before the transport of a
+ * #GtkNodesNodeView takes over.
+ *
+ * # Flow control #
+ *
+ * With the queued transport of #GtkNodesNodeView, a source writing faster
+ * than its sinks are processing fills up the queue without bound. A sink
+ * can limit that by granting its source a number of
+ * #GtkNodesNodeSocket:credits: every payload waiting in a queue for the
+ * sink uses up one of them, every delivery returns one. A source checks
+ * with gtk_nodes_node_socket_is_writable() whether all of its sinks have
+ * credit left, gtk_nodes_node_socket_try_write_bytes() fails with
+ * %G_IO_ERROR_WOULD_BLOCK rather than writing if they don't, and
+ * gtk_nodes_node_socket_wait_writable_async() waits until they do.
+ * A payload written regardless is dropped for the sinks without credit, so
+ * the memory taken by the queues stays bounded either way. The write then
+ * returns FALSE, and gtk_nodes_node_socket_get_dropped() counts the
+ * payloads each sink lost like this.
+ *
+ * Sinks without credits, the default, accept any number of payloads.
+ * Synchronous delivery and the scheduled transport, which keeps only the
+ * latest payload per sink, never use up credit.
+ * gtk_nodes_node_view_get_queue_depth() tells how many payloads wait for a
+ * sink.
+ *
+ * # Value cache #
+ *
+ * A socket with the #GtkNodesNodeSocket:cache property set remembers what
+ * passed it last by its SHA-256 digest. A source also keeps the payload
+ * itself. A payload identical to the last one is not passed on, so nodes
+ * downstream of an input which did not change are not bothered with it.
+ *
+ * The cached values are saved with the nodes by #GtkNodesNodeView and
+ * restored when they are loaded. Sinks connected to a caching source then
+ * receive its cached payload, unless they are caching themselves and have
+ * seen the very same payload before they were saved. A pipeline loaded
+ * with unchanged inputs therefore does not need to recompute anything.
+ *
+ * # Payload types #
+ *
+ * Where a key only tells whether two sockets belong together, a
+ * #GtkNodesPayloadType describes the layout of the payloads themselves: the
+ * type, byte order and strides of their elements and the shape of the
+ * array. A sink with a #GtkNodesNodeSocket:payload-type rejects sources
+ * without one and sources whose payload type it does not accept, see
+ * gtk_nodes_payload_type_accepts(). The check happens once when the sockets
+ * are connected and again if either one changes its payload type. A source
+ * with a payload type in turn refuses to send payloads whose size does not
+ * fit it, see gtk_nodes_payload_type_check(), so the payloads received
+ * later are known to match and can be read in place with
+ * gtk_nodes_payload_type_get_element_at() without validating them first.
+ * A sink without a payload type accepts any source.
+ *
+ * The descriptor is carried by the socket, not by the payloads, so they
+ * stay plain arrays a producer can hand over without wrapping them.
+ *
+ * # Streams #
+ *
+ * Writing one payload per value suits occasional values, but not continuous
+ * sample data arriving at high rates. A source given a #GtkNodesStream with
+ * gtk_nodes_node_socket_set_stream() instead commits its samples to that
+ * ring buffer, see gtk_nodes_stream_write(), without any allocation or
+ * signal emission per chunk. Each connected sink reads at its own pace
+ * through the #GtkNodesStreamReader returned by
+ * gtk_nodes_node_socket_get_stream_reader(), which is created when the sink
+ * connects. The ::socket-stream-ready signal tells a sink there is new data
+ * to read; it is emitted at most once per main loop iteration, no matter
+ * how many chunks were committed, and the producer may run in a thread of
+ * its own.
+ *
+ * Streamed data bypasses the scheduler and value cache of #GtkNodesNodeView,
+ * both of which deal in discrete payloads.
  *
  * # Cleanup #
  *
@@ -88,18 +211,55 @@ struct _GtkNodesNodeSocketPrivate
   GtkNodesNodeSocketIO  io;              /* the socket IO mode */
   guint                 id;              /* the numeric identifier of the socket */
   guint                 key;             /* the compatibility key of the socket */
+  GtkNodesPayloadType  *payload_type;    /* the layout of the payloads */
   GdkRGBA               rgba;            /* the socket colour */
   gdouble               radius;          /* the socket radius */
 
   GtkNodesNodeSocket   *input;           /* the connected input source for SINK IO */
-  gulong                input_handler;
   gulong                disconnect_handler;
   gulong                key_change_handler;
   gulong                destroyed_handler;
 
+  GtkNodesStream       *stream;          /* the ring buffer of a streaming source */
+  GtkNodesStreamReader *reader;          /* the cursor of a sink into its input stream */
+  gulong                stream_ready_handler;
+
+  GtkNodesNodeSocketDelivery delivery;   /* how payloads reach a sink */
+  guint                 decimation;      /* deliver one in this many */
+  guint                 decimated;       /* payloads since the last delivered */
+  GBytes               *latest;          /* the newest undelivered payload */
+  guint                 latest_id;       /* idle source delivering it */
+
+  guint                 credits;         /* payloads a sink may have queued, 0 == any */
+  guint                 queued;          /* payloads queued for a sink */
+  guint                 connection;      /* serial of the input of a sink */
+  guint64               dropped;         /* payloads a sink lost for lack of credit */
+  guint64               lost;            /* payloads sinks of a source dropped */
+  GPtrArray            *outputs;         /* the sinks connected to a source */
+  guint                 dispatching;     /* a source is handing out a payload */
+
+  GArray               *subscribers;     /* GtkNodesNodeSocketSubscriber of a sink */
+  guint                 last_subscriber; /* the last subscriber id handed out */
+  GList                *writers;         /* GTasks waiting for the sinks */
+
+  GBytes               *cached;          /* the last payload of a source */
+  gchar                *digest;          /* SHA-256 of the last payload, hex */
+
   guint                 in_node_socket:1;
+  guint                 feedback:1;      /* sink closes a loop */
+  guint                 delivering:1;    /* sink is emitting a payload */
+  guint                 cache:1;         /* remember the last payload */
+  guint                 unsubscribed:1;  /* subscribers removed while delivering */
 };
 
+typedef struct
+{
+  guint                          id;
+  GtkNodesNodeSocketIncomingFunc func; /* NULL once removed */
+  gpointer                       user_data;
+  GDestroyNotify                 destroy;
+} GtkNodesNodeSocketSubscriber;
+
 /* Properties */
 enum
 {
@@ -110,6 +270,12 @@ enum
   PROP_KEY,
   PROP_ID,
   PROP_INPUT_ID,
+  PROP_FEEDBACK,
+  PROP_CACHE,
+  PROP_PAYLOAD_TYPE,
+  PROP_DELIVERY,
+  PROP_DECIMATION,
+  PROP_CREDITS,
   NUM_PROPERTIES
 };
 
@@ -123,6 +289,9 @@ enum
   SOCKET_KEY_CHANGE,
   SOCKET_INCOMING,
   SOCKET_OUTGOING,
+  SOCKET_INCOMING_BYTES,
+  SOCKET_OUTGOING_BYTES,
+  SOCKET_STREAM_READY,
   SOCKET_DESTROYED,
   LAST_SIGNAL
 };
@@ -137,6 +306,7 @@ static void     gtk_nodes_node_socket_get_property         (GObject           *o
                                                             guint              param_id,
                                                             GValue            *value,
                                                             GParamSpec        *pspec);
+static void     gtk_nodes_node_socket_finalize             (GObject           *object);
 
 /* widget class basics */
 static void     gtk_nodes_node_socket_destroy              (GtkWidget         *widget);
@@ -196,6 +366,15 @@ static void     gtk_nodes_node_socket_drag_end            (GtkWidget          *w
 static void     gtk_nodes_node_socket_input_incoming      (GtkWidget          *widget,
                                                            GByteArray         *data,
                                                            GtkNodesNodeSocket *socket);
+static void     gtk_nodes_node_socket_input_incoming_bytes (GtkWidget         *widget,
+                                                           GBytes             *payload,
+                                                           GtkNodesNodeSocket *socket);
+static void     gtk_nodes_node_socket_drop_latest         (GtkNodesNodeSocket *socket);
+static void     gtk_nodes_node_socket_drop_input          (GtkNodesNodeSocket *socket);
+static void     gtk_nodes_node_socket_wake_writers        (GtkNodesNodeSocket *socket);
+static void     gtk_nodes_node_socket_fail_writers        (GtkNodesNodeSocket *socket);
+static void     gtk_nodes_node_socket_input_stream_ready  (GtkWidget          *widget,
+                                                           GtkNodesNodeSocket *socket);
 static void     gtk_nodes_node_socket_disconnect_signal   (GtkWidget          *widget,
                                                            GtkNodesNodeSocket *socket,
                                                            GtkNodesNodeSocket *sink);
@@ -207,6 +386,7 @@ static void     gtk_nodes_node_socket_destroyed_signal    (GtkWidget          *w
 static void     gtk_nodes_node_socket_set_drag_icon       (GdkDragContext     *context,
                                                            GtkNodesNodeSocket *node);
 static void     gtk_nodes_node_socket_drag_src_redirect   (GtkWidget          *widget);
+static GtkNodesNodeView *gtk_nodes_node_socket_get_node_view (GtkNodesNodeSocket *socket);
 
 
 static guint node_socket_signals[LAST_SIGNAL] = { 0 };
@@ -229,6 +409,7 @@ gtk_nodes_node_socket_class_init (GtkNodesNodeSocketClass *class)
   /* gobject methods */
   gobject_class->get_property = gtk_nodes_node_socket_get_property;
   gobject_class->set_property = gtk_nodes_node_socket_set_property;
+  gobject_class->finalize     = gtk_nodes_node_socket_finalize;
 
   /* widget basics */
   widget_class->destroy       = gtk_nodes_node_socket_destroy;
@@ -322,6 +503,95 @@ gtk_nodes_node_socket_class_init (GtkNodesNodeSocketClass *class)
                                                       0,
                                                       GTK_NODES_VIEW_PARAM_RW));
 
+  /**
+   * GtkNodesNodeSocket:feedback:
+   *
+   * Whether the sink may close a loop in the graph of a #GtkNodesNodeView
+   */
+
+  g_object_class_install_property (gobject_class,
+                                   PROP_FEEDBACK,
+                                   g_param_spec_boolean ("feedback",
+                                                         "Feedback Sink",
+                                                         "Whether the sink may close a loop, its payloads are delayed by one tick",
+                                                         FALSE,
+                                                         GTK_NODES_VIEW_PARAM_RW));
+
+  /**
+   * GtkNodesNodeSocket:cache:
+   *
+   * Whether the socket remembers its last payload and drops identical ones
+   */
+
+  g_object_class_install_property (gobject_class,
+                                   PROP_CACHE,
+                                   g_param_spec_boolean ("cache",
+                                                         "Cache Payload",
+                                                         "Whether the last payload is kept, identical payloads are not passed on",
+                                                         FALSE,
+                                                         GTK_NODES_VIEW_PARAM_RW));
+
+  /**
+   * GtkNodesNodeSocket:payload-type:
+   *
+   * The layout of the payloads passing the socket
+   */
+
+  g_object_class_install_property (gobject_class,
+                                   PROP_PAYLOAD_TYPE,
+                                   g_param_spec_boxed ("payload-type",
+                                                       "Payload Type",
+                                                       "The layout of the payloads, checked when connecting",
+                                                       GTKNODES_TYPE_PAYLOAD_TYPE,
+                                                       GTK_NODES_VIEW_PARAM_RW));
+
+  /**
+   * GtkNodesNodeSocket:delivery:
+   *
+   * How payloads arriving on a sink are delivered
+   */
+
+  g_object_class_install_property (gobject_class,
+                                   PROP_DELIVERY,
+                                   g_param_spec_enum ("delivery",
+                                                      "Delivery Policy",
+                                                      "Whether a sink receives all, only the latest or every n-th payload",
+                                                      GTKNODES_TYPE_NODE_SOCKET_DELIVERY,
+                                                      GTKNODES_NODE_SOCKET_DELIVER_ALL,
+                                                      GTK_NODES_VIEW_PARAM_RW));
+
+  /**
+   * GtkNodesNodeSocket:decimation:
+   *
+   * The number of payloads a decimating sink delivers one of
+   */
+
+  g_object_class_install_property (gobject_class,
+                                   PROP_DECIMATION,
+                                   g_param_spec_uint ("decimation",
+                                                      "Decimation",
+                                                      "A decimating sink delivers one in this many payloads",
+                                                      1,
+                                                      G_MAXUINT,
+                                                      1,
+                                                      GTK_NODES_VIEW_PARAM_RW));
+
+  /**
+   * GtkNodesNodeSocket:credits:
+   *
+   * The number of queued payloads a sink accepts, 0 for any
+   */
+
+  g_object_class_install_property (gobject_class,
+                                   PROP_CREDITS,
+                                   g_param_spec_uint ("credits",
+                                                      "Credits",
+                                                      "The number of payloads a sink lets its source queue, 0 for any",
+                                                      0,
+                                                      G_MAXUINT,
+                                                      0,
+                                                      GTK_NODES_VIEW_PARAM_RW));
+
   /**
    * GtkNodesNodeSocket::socket-drag-begin:
    * @widget: the object which received the signal.
@@ -459,6 +729,68 @@ gtk_nodes_node_socket_class_init (GtkNodesNodeSocketClass *class)
                   G_TYPE_NONE,
                   1, G_TYPE_BYTE_ARRAY);
 
+  /**
+   * GtkNodesNodeSocket::socket-incoming-bytes:
+   * @widget:  the object which received the signal.
+   * @payload: the immutable payload
+   *
+   * The ::socket-incoming-bytes signal is emitted when data is incoming on the
+   * socket. The payload is shared with all other sinks of the same source,
+   * take a reference if it must be kept beyond the callback, but never
+   * modify its contents, see gtk_nodes_node_socket_bytes_make_writable().
+   *
+   * The signal has no slot in #GtkNodesNodeSocketClass, so the class layout
+   * stays compatible with existing subclasses. Subclasses receive the
+   * payloads with gtk_nodes_node_socket_add_incoming_func() instead.
+   */
+
+  node_socket_signals[SOCKET_INCOMING_BYTES] =
+    g_signal_new ("socket-incoming-bytes",
+                  G_TYPE_FROM_CLASS (gobject_class),
+                  G_SIGNAL_RUN_FIRST,
+                  0,
+                  NULL, NULL,
+                  NULL,
+                  G_TYPE_NONE,
+                  1, G_TYPE_BYTES);
+
+  /**
+   * GtkNodesNodeSocket::socket-outgoing-bytes:
+   * @widget:  the object which received the signal.
+   * @payload: the immutable payload
+   *
+   * The ::socket-outgoing-bytes signal is emitted when a payload is written
+   * to the socket with gtk_nodes_node_socket_write_bytes()
+   */
+
+  node_socket_signals[SOCKET_OUTGOING_BYTES] =
+    g_signal_new ("socket-outgoing-bytes",
+                  G_TYPE_FROM_CLASS (gobject_class),
+                  G_SIGNAL_RUN_FIRST,
+                  0,
+                  NULL, NULL,
+                  NULL,
+                  G_TYPE_NONE,
+                  1, G_TYPE_BYTES);
+
+  /**
+   * GtkNodesNodeSocket::socket-stream-ready:
+   * @widget: the object which received the signal.
+   *
+   * The ::socket-stream-ready signal is emitted on a streaming source after
+   * data was committed to its stream, and on the sinks connected to it.
+   * Commits in between two emissions are folded into one.
+   */
+
+  node_socket_signals[SOCKET_STREAM_READY] =
+    g_signal_new ("socket-stream-ready",
+                  G_TYPE_FROM_CLASS (gobject_class),
+                  G_SIGNAL_RUN_FIRST,
+                  0,
+                  NULL, NULL,
+                  NULL,
+                  G_TYPE_NONE, 0);
+
   /**
    * GtkNodesNodeSocket::socket-destroyed:
    * @widget: the object which received the signal.
@@ -503,6 +835,11 @@ gtk_nodes_node_socket_init (GtkNodesNodeSocket *socket)
 
   priv->key = 0; /* accept any connection by default */
 
+  priv->delivery   = GTKNODES_NODE_SOCKET_DELIVER_ALL;
+  priv->decimation = 1;
+
+  priv->outputs = g_ptr_array_new ();
+
   priv->in_node_socket = FALSE;
 
   priv->input = NULL;
@@ -565,6 +902,24 @@ gtk_nodes_node_socket_get_property (GObject    *object,
     case PROP_ID:
       g_value_set_uint (value, gtk_nodes_node_socket_get_id(socket));
       break;
+    case PROP_FEEDBACK:
+      g_value_set_boolean (value, gtk_nodes_node_socket_get_feedback(socket));
+      break;
+    case PROP_CACHE:
+      g_value_set_boolean (value, gtk_nodes_node_socket_get_cache(socket));
+      break;
+    case PROP_PAYLOAD_TYPE:
+      g_value_set_boxed (value, gtk_nodes_node_socket_get_payload_type(socket));
+      break;
+    case PROP_DELIVERY:
+      g_value_set_enum (value, gtk_nodes_node_socket_get_delivery(socket));
+      break;
+    case PROP_DECIMATION:
+      g_value_set_uint (value, gtk_nodes_node_socket_get_decimation(socket));
+      break;
+    case PROP_CREDITS:
+      g_value_set_uint (value, gtk_nodes_node_socket_get_credits(socket));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, param_id, pspec);
       break;
@@ -599,12 +954,73 @@ gtk_nodes_node_socket_set_property (GObject      *object,
     case PROP_ID:
       gtk_nodes_node_socket_set_id (socket, g_value_get_uint (value));
       break;
+    case PROP_FEEDBACK:
+      gtk_nodes_node_socket_set_feedback (socket, g_value_get_boolean (value));
+      break;
+    case PROP_CACHE:
+      gtk_nodes_node_socket_set_cache (socket, g_value_get_boolean (value));
+      break;
+    case PROP_PAYLOAD_TYPE:
+      gtk_nodes_node_socket_set_payload_type (socket, g_value_get_boxed (value));
+      break;
+    case PROP_DELIVERY:
+      gtk_nodes_node_socket_set_delivery (socket, g_value_get_enum (value));
+      break;
+    case PROP_DECIMATION:
+      gtk_nodes_node_socket_set_decimation (socket, g_value_get_uint (value));
+      break;
+    case PROP_CREDITS:
+      gtk_nodes_node_socket_set_credits (socket, g_value_get_uint (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, param_id, pspec);
       break;
     }
 }
 
+static void
+gtk_nodes_node_socket_finalize (GObject *object)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+
+  priv = gtk_nodes_node_socket_get_instance_private (GTKNODES_NODE_SOCKET (object));
+
+  g_clear_pointer (&priv->cached, g_bytes_unref);
+  g_clear_pointer (&priv->digest, g_free);
+  g_clear_pointer (&priv->payload_type, gtk_nodes_payload_type_unref);
+  g_clear_pointer (&priv->reader, gtk_nodes_stream_reader_free);
+
+  gtk_nodes_node_socket_drop_latest (GTKNODES_NODE_SOCKET (object));
+
+  g_ptr_array_unref (priv->outputs);
+
+  if (priv->subscribers)
+    {
+      guint i;
+
+      for (i = 0; i < priv->subscribers->len; i++)
+        {
+          GtkNodesNodeSocketSubscriber *sub;
+
+          sub = &g_array_index (priv->subscribers, GtkNodesNodeSocketSubscriber, i);
+
+          if (sub->func && sub->destroy)
+            sub->destroy (sub->user_data);
+        }
+
+      g_array_unref (priv->subscribers);
+    }
+
+  if (priv->stream)
+    {
+      gtk_nodes_stream_set_ready_func (priv->stream, NULL, NULL, NULL);
+      g_clear_pointer (&priv->stream, gtk_nodes_stream_unref);
+    }
+
+  G_OBJECT_CLASS (gtk_nodes_node_socket_parent_class)->finalize (object);
+}
+
 /* Widget Methods */
 
 static void
@@ -615,6 +1031,9 @@ gtk_nodes_node_socket_destroy (GtkWidget *widget)
   /* disconnect any inputs */
   gtk_nodes_node_socket_disconnect (GTKNODES_NODE_SOCKET (widget));
 
+  /* nobody will make room for the writers anymore */
+  gtk_nodes_node_socket_fail_writers (GTKNODES_NODE_SOCKET (widget));
+
   GTK_WIDGET_CLASS (gtk_nodes_node_socket_parent_class)->destroy (widget);
 }
 
@@ -869,16 +1288,7 @@ gtk_nodes_node_socket_drag_src_redirect (GtkWidget *widget)
 
   source = GTK_WIDGET (priv->input);
 
-  g_signal_handler_disconnect (source, priv->input_handler);
-  g_signal_handler_disconnect (source, priv->disconnect_handler);
-  g_signal_handler_disconnect (source, priv->key_change_handler);
-  g_signal_handler_disconnect (source, priv->destroyed_handler);
-  priv->input_handler      = 0;
-  priv->disconnect_handler = 0;
-  priv->key_change_handler = 0;
-  priv->destroyed_handler  = 0;
-  g_signal_emit (widget, node_socket_signals[SOCKET_DISCONNECT], 0, source);
-  priv->input = NULL;
+  gtk_nodes_node_socket_drop_input (socket);
 
   /* remove as drag source */
   if (priv->io == GTKNODES_NODE_SOCKET_SINK)
@@ -921,10 +1331,46 @@ gtk_nodes_node_socket_drag_motion (GtkWidget      *widget,
   return GDK_EVENT_PROPAGATE;
 }
 
+/* whether the sink can read the payloads of the source */
+static gboolean
+gtk_nodes_node_socket_payload_compatible (GtkNodesNodeSocket *sink,
+                                          GtkNodesNodeSocket *source)
+{
+  GtkNodesNodeSocketPrivate *priv_sink;
+  GtkNodesNodeSocketPrivate *priv_source;
+  gchar *have;
+  gchar *want;
+
+
+  priv_sink   = gtk_nodes_node_socket_get_instance_private (sink);
+  priv_source = gtk_nodes_node_socket_get_instance_private (source);
+
+  if (!priv_sink->payload_type)
+    return TRUE;
+
+  if (!priv_source->payload_type)
+    return FALSE;
+
+  if (gtk_nodes_payload_type_accepts (priv_sink->payload_type,
+                                      priv_source->payload_type))
+    return TRUE;
+
+  want = gtk_nodes_payload_type_to_string (priv_sink->payload_type);
+  have = gtk_nodes_payload_type_to_string (priv_source->payload_type);
+
+  g_debug ("Node Socket expects %s, source provides %s", want, have);
+
+  g_free (want);
+  g_free (have);
+
+  return FALSE;
+}
+
 static void
 gtk_nodes_node_socket_connect_sockets_internal (GtkNodesNodeSocket *sink,
                                                 GtkNodesNodeSocket *source)
 {
+  GtkNodesNodeView *node_view;
   GtkNodesNodeSocketPrivate *priv_sink;
   GtkNodesNodeSocketPrivate *priv_source;
 
@@ -954,16 +1400,31 @@ gtk_nodes_node_socket_connect_sockets_internal (GtkNodesNodeSocket *sink,
       return;
     }
 
+  if (!gtk_nodes_node_socket_payload_compatible (sink, source))
+    {
+      g_message("Node Socket payload types incompatible, source rejected");
+      return;
+    }
+
+  /* the view must not be able to send a payload around in circles */
+  node_view = gtk_nodes_node_socket_get_node_view (sink);
+
+  if (node_view && !priv_sink->feedback)
+    {
+      if (!_gtk_nodes_node_view_insert_edge (node_view, source, sink))
+        {
+          g_message("Node Socket connection would close a loop, source rejected");
+          return;
+        }
+    }
+
   /* if there is an input source, disconnect it */
   gtk_nodes_node_socket_disconnect (sink);
 
   priv_sink->input = source;
 
-  priv_sink->input_handler =
-    g_signal_connect (G_OBJECT (priv_sink->input), "socket-outgoing",
-                      G_CALLBACK (gtk_nodes_node_socket_input_incoming),
-                      sink);
-
+  /* payloads are handed over directly, see gtk_nodes_node_socket_dispatch () */
+  g_ptr_array_add (priv_source->outputs, sink);
 
   priv_sink->disconnect_handler =
     g_signal_connect (G_OBJECT (priv_sink->input), "socket-disconnect",
@@ -981,6 +1442,15 @@ gtk_nodes_node_socket_connect_sockets_internal (GtkNodesNodeSocket *sink,
                       G_CALLBACK (gtk_nodes_node_socket_destroyed_signal),
                       sink);
 
+  priv_sink->stream_ready_handler =
+    g_signal_connect (G_OBJECT (priv_sink->input), "socket-stream-ready",
+                      G_CALLBACK (gtk_nodes_node_socket_input_stream_ready),
+                      sink);
+
+  /* start reading the stream right away, not when first asked to */
+  if (priv_source->stream)
+    priv_sink->reader = gtk_nodes_stream_reader_new (priv_source->stream);
+
 
 
   /* become a drag source, so the user can disconnect from the sink */
@@ -1065,97 +1535,275 @@ gtk_nodes_node_socket_drag_end (GtkWidget      *widget,
     g_signal_emit (widget, node_socket_signals[SOCKET_DRAG_END], 0);
 }
 
-static void
-gtk_nodes_node_socket_input_incoming (GtkWidget          *widget,
-                                      GByteArray         *payload,
-                                      GtkNodesNodeSocket *socket)
+static GtkNodesNodeView *
+gtk_nodes_node_socket_get_node_view (GtkNodesNodeSocket *socket)
 {
-  gtk_nodes_node_socket_write(socket, payload);
+  GtkWidget *node_view;
+
+  node_view = gtk_widget_get_ancestor (GTK_WIDGET (socket),
+                                       GTKNODES_TYPE_NODE_VIEW);
+  if (node_view == NULL)
+    return NULL;
+
+  return GTKNODES_NODE_VIEW (node_view);
 }
 
+/* hands a payload from the input source to the view or delivers it */
 static void
-gtk_nodes_node_socket_disconnect_signal (GtkWidget          *widget,
-                                         GtkNodesNodeSocket *source,
-                                         GtkNodesNodeSocket *sink)
+gtk_nodes_node_socket_receive (GtkNodesNodeSocket *socket,
+                               GBytes             *payload)
 {
-  gtk_nodes_node_socket_disconnect (sink);
+  GtkNodesNodeView *node_view;
+
+
+  node_view = gtk_nodes_node_socket_get_node_view (socket);
+
+  if (node_view != NULL)
+    if (_gtk_nodes_node_view_route_payload (node_view, socket, payload))
+      return;
+
+  gtk_nodes_node_socket_write_bytes (socket, payload);
 }
 
-static void
-gtk_nodes_node_socket_key_change_signal (GtkWidget          *widget,
-                                         GtkNodesNodeSocket *source,
-                                         GtkNodesNodeSocket *sink)
+static gboolean
+gtk_nodes_node_socket_deliver_latest (gpointer data)
 {
+  GtkNodesNodeSocket *socket = data;
   GtkNodesNodeSocketPrivate *priv;
+  GBytes *payload;
 
-  priv = gtk_nodes_node_socket_get_instance_private (sink);
 
-  /* we disconnect if our key does not match */
-  if (priv->key != gtk_nodes_node_socket_get_remote_key (sink))
-    gtk_nodes_node_socket_disconnect (sink);
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  payload = priv->latest;
+
+  priv->latest    = NULL;
+  priv->latest_id = 0;
+
+  if (payload)
+    {
+      gtk_nodes_node_socket_receive (socket, payload);
+      g_bytes_unref (payload);
+    }
+
+  return G_SOURCE_REMOVE;
 }
 
+/* keep the payload until the main loop is idle, replacing any older one */
 static void
-gtk_nodes_node_socket_destroyed_signal (GtkWidget          *widget,
-                                        GtkNodesNodeSocket *sink)
+gtk_nodes_node_socket_hold_latest (GtkNodesNodeSocket *socket,
+                                   GBytes             *payload)
 {
-  /* technically, this is not necessary right now, because our signal
-   * callbacks will be disconnect on destruction of a source anyways, but
-   * we may want to do other things in the future, so we'll handle that signa
-   * alyways
-   */
-  gtk_nodes_node_socket_disconnect (sink);
-}
+  GtkNodesNodeSocketPrivate *priv;
 
 
-/* public methods */
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
 
+  g_bytes_ref (payload);
+  g_clear_pointer (&priv->latest, g_bytes_unref);
 
-/**
- * gtk_nodes_node_socket_set_rgba:
- * @socket: a #GtkNodesNodeSocket
- * @rgba: the #GdkRGBA colour to set
- *
- * Sets the GdkRGBA colour of the socket
- */
+  priv->latest = payload;
 
-void
-gtk_nodes_node_socket_set_rgba (GtkNodesNodeSocket *socket,
-                                const GdkRGBA      *rgba)
+  /* idle priority, so redraws and input events go first */
+  if (!priv->latest_id)
+    priv->latest_id = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+                                       gtk_nodes_node_socket_deliver_latest,
+                                       socket, NULL);
+}
+
+static void
+gtk_nodes_node_socket_drop_latest (GtkNodesNodeSocket *socket)
 {
   GtkNodesNodeSocketPrivate *priv;
 
 
-  g_return_if_fail (GTKNODES_IS_NODE_SOCKET (socket));
-  g_return_if_fail (rgba != NULL);
-
   priv = gtk_nodes_node_socket_get_instance_private (socket);
 
-  priv->rgba = (* rgba);
+  if (priv->latest_id)
+    g_source_remove (priv->latest_id);
 
-  g_object_notify (G_OBJECT (socket), "rgba");
+  priv->latest_id = 0;
 
-  gtk_widget_queue_draw (GTK_WIDGET (socket));
+  g_clear_pointer (&priv->latest, g_bytes_unref);
 }
 
-/**
- * gtk_nodes_node_socket_get_rgba:
- * @socket: a #GtkNodesNodeSocket
- * @rgba: the #GdkRGBA colour to get
- *
- * Sets the GdkRGBA colour of the socket
- */
-
-void
-gtk_nodes_node_socket_get_rgba (GtkNodesNodeSocket *socket,
-                                GdkRGBA            *rgba)
+/* whether a decimating sink lets the payload through */
+static gboolean
+gtk_nodes_node_socket_decimate (GtkNodesNodeSocket *socket)
 {
   GtkNodesNodeSocketPrivate *priv;
+  gboolean deliver;
 
 
-  g_return_if_fail (GTKNODES_IS_NODE_SOCKET (socket));
-  g_return_if_fail (rgba != NULL);
-
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  if (priv->delivery != GTKNODES_NODE_SOCKET_DELIVER_DECIMATE)
+    return TRUE;
+
+  deliver = (priv->decimated == 0);
+
+  if (++priv->decimated >= priv->decimation)
+    priv->decimated = 0;
+
+  return deliver;
+}
+
+static void
+gtk_nodes_node_socket_input_incoming (GtkWidget          *widget,
+                                      GByteArray         *payload,
+                                      GtkNodesNodeSocket *socket)
+{
+  GtkNodesNodeSocketPrivate *priv;
+  GtkNodesNodeView *node_view;
+  GBytes *bytes;
+
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  if (priv->delivery == GTKNODES_NODE_SOCKET_DELIVER_LATEST)
+    {
+      bytes = g_bytes_new (payload->data, payload->len);
+      gtk_nodes_node_socket_hold_latest (socket, bytes);
+      g_bytes_unref (bytes);
+      return;
+    }
+
+  if (!gtk_nodes_node_socket_decimate (socket))
+    return;
+
+  node_view = gtk_nodes_node_socket_get_node_view (socket);
+
+  if (node_view == NULL ||
+      (gtk_nodes_node_view_get_transport (node_view) == GTKNODES_NODE_VIEW_TRANSPORT_SYNC &&
+       !gtk_nodes_node_socket_get_feedback (socket)))
+    {
+      gtk_nodes_node_socket_write(socket, payload);
+      return;
+    }
+
+  /* the array belongs to the writer, so we must copy if delivery is deferred */
+  bytes = g_bytes_new (payload->data, payload->len);
+
+  if (!_gtk_nodes_node_view_route_payload (node_view, socket, bytes))
+    gtk_nodes_node_socket_write_bytes (socket, bytes);
+
+  g_bytes_unref (bytes);
+}
+
+static void
+gtk_nodes_node_socket_input_incoming_bytes (GtkWidget          *widget,
+                                            GBytes             *payload,
+                                            GtkNodesNodeSocket *socket)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  if (priv->delivery == GTKNODES_NODE_SOCKET_DELIVER_LATEST)
+    {
+      gtk_nodes_node_socket_hold_latest (socket, payload);
+      return;
+    }
+
+  if (!gtk_nodes_node_socket_decimate (socket))
+    return;
+
+  gtk_nodes_node_socket_receive (socket, payload);
+}
+
+static void
+gtk_nodes_node_socket_input_stream_ready (GtkWidget          *widget,
+                                          GtkNodesNodeSocket *socket)
+{
+  g_signal_emit (socket, node_socket_signals[SOCKET_STREAM_READY], 0);
+}
+
+static void
+gtk_nodes_node_socket_disconnect_signal (GtkWidget          *widget,
+                                         GtkNodesNodeSocket *source,
+                                         GtkNodesNodeSocket *sink)
+{
+  gtk_nodes_node_socket_disconnect (sink);
+}
+
+static void
+gtk_nodes_node_socket_key_change_signal (GtkWidget          *widget,
+                                         GtkNodesNodeSocket *source,
+                                         GtkNodesNodeSocket *sink)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+  priv = gtk_nodes_node_socket_get_instance_private (sink);
+
+  /* we disconnect if our key or payload type does not match */
+  if (priv->key != gtk_nodes_node_socket_get_remote_key (sink))
+    gtk_nodes_node_socket_disconnect (sink);
+  else if (!gtk_nodes_node_socket_payload_compatible (sink, source))
+    gtk_nodes_node_socket_disconnect (sink);
+}
+
+static void
+gtk_nodes_node_socket_destroyed_signal (GtkWidget          *widget,
+                                        GtkNodesNodeSocket *sink)
+{
+  /* technically, this is not necessary right now, because our signal
+   * callbacks will be disconnect on destruction of a source anyways, but
+   * we may want to do other things in the future, so we'll handle that signa
+   * alyways
+   */
+  gtk_nodes_node_socket_disconnect (sink);
+}
+
+
+/* public methods */
+
+
+/**
+ * gtk_nodes_node_socket_set_rgba:
+ * @socket: a #GtkNodesNodeSocket
+ * @rgba: the #GdkRGBA colour to set
+ *
+ * Sets the GdkRGBA colour of the socket
+ */
+
+void
+gtk_nodes_node_socket_set_rgba (GtkNodesNodeSocket *socket,
+                                const GdkRGBA      *rgba)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+
+  g_return_if_fail (GTKNODES_IS_NODE_SOCKET (socket));
+  g_return_if_fail (rgba != NULL);
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  priv->rgba = (* rgba);
+
+  g_object_notify (G_OBJECT (socket), "rgba");
+
+  gtk_widget_queue_draw (GTK_WIDGET (socket));
+}
+
+/**
+ * gtk_nodes_node_socket_get_rgba:
+ * @socket: a #GtkNodesNodeSocket
+ * @rgba: the #GdkRGBA colour to get
+ *
+ * Sets the GdkRGBA colour of the socket
+ */
+
+void
+gtk_nodes_node_socket_get_rgba (GtkNodesNodeSocket *socket,
+                                GdkRGBA            *rgba)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+
+  g_return_if_fail (GTKNODES_IS_NODE_SOCKET (socket));
+  g_return_if_fail (rgba != NULL);
+
   priv = gtk_nodes_node_socket_get_instance_private (socket);
 
   (* rgba) = priv->rgba;
@@ -1381,6 +2029,91 @@ gtk_nodes_node_socket_get_remote_key (GtkNodesNodeSocket *socket)
   return 0;
 }
 
+/**
+ * gtk_nodes_node_socket_set_payload_type
+ * @socket: a #GtkNodesNodeSocket
+ * @payload_type: (nullable): the layout of the payloads, or NULL for any
+ *
+ * Sets the payload type of the socket, see the description of payload
+ * types above. A sink drops its input source if it does not provide a
+ * compatible payload type; sinks connected to a source re-check theirs.
+ */
+
+void
+gtk_nodes_node_socket_set_payload_type (GtkNodesNodeSocket  *socket,
+                                        GtkNodesPayloadType *payload_type)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+
+  g_return_if_fail (GTKNODES_IS_NODE_SOCKET (socket));
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  if (priv->payload_type == payload_type)
+    return;
+
+  if (payload_type)
+    gtk_nodes_payload_type_ref (payload_type);
+
+  g_clear_pointer (&priv->payload_type, gtk_nodes_payload_type_unref);
+
+  priv->payload_type = payload_type;
+
+  if (priv->input &&
+      !gtk_nodes_node_socket_payload_compatible (socket, priv->input))
+    gtk_nodes_node_socket_disconnect (socket);
+
+  /* notify any sinks so they can disconnect */
+  g_signal_emit (GTK_WIDGET (socket),
+                 node_socket_signals[SOCKET_KEY_CHANGE], 0, socket);
+
+  g_object_notify (G_OBJECT (socket), "payload-type");
+}
+
+/**
+ * gtk_nodes_node_socket_get_payload_type
+ * @socket: a #GtkNodesNodeSocket
+ *
+ * Returns: (transfer none) (nullable): the payload type of the socket
+ */
+
+GtkNodesPayloadType *
+gtk_nodes_node_socket_get_payload_type (GtkNodesNodeSocket *socket)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+
+  g_return_val_if_fail (GTKNODES_IS_NODE_SOCKET (socket), NULL);
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  return priv->payload_type;
+}
+
+/**
+ * gtk_nodes_node_socket_get_remote_payload_type
+ * @socket: a #GtkNodesNodeSocket
+ *
+ * Returns: (transfer none) (nullable): the payload type of the input socket
+ */
+
+GtkNodesPayloadType *
+gtk_nodes_node_socket_get_remote_payload_type (GtkNodesNodeSocket *socket)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+
+  g_return_val_if_fail (GTKNODES_IS_NODE_SOCKET (socket), NULL);
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  if (priv->input)
+    return gtk_nodes_node_socket_get_payload_type (priv->input);
+
+  return NULL;
+}
+
 /**
  * gtk_nodes_node_socket_set_id
  * @socket: a #GtkNodesNodeSocket
@@ -1428,109 +2161,1466 @@ gtk_nodes_node_socket_get_id (GtkNodesNodeSocket *socket)
 
 
 /**
- * gtk_nodes_node_socket_write:
+ * gtk_nodes_node_socket_set_feedback
  * @socket: a #GtkNodesNodeSocket
- * @payload: the data buffer to write
+ * @feedback: whether the sink may close a loop
  *
- * Emits a signal on the #GtkNodesNodeSocket in incoming our outgoing direction.
- *
- * Returns: TRUE on success, FALSE if GTKNODES_NODE_SOCKET_DISABLE is configured
+ * Marks a sink as closing a loop in the graph of a #GtkNodesNodeView.
+ * Payloads arriving on a feedback sink are delayed by one tick of the
+ * view's scheduler. Changing the setting disconnects the sink from its
+ * current source.
  */
 
-gboolean
-gtk_nodes_node_socket_write (GtkNodesNodeSocket *socket,
-                             GByteArray     *payload)
+void
+gtk_nodes_node_socket_set_feedback (GtkNodesNodeSocket *socket,
+                                    gboolean            feedback)
 {
   GtkNodesNodeSocketPrivate *priv;
 
-  g_return_val_if_fail (GTKNODES_IS_NODE_SOCKET (socket), FALSE);
+
+  g_return_if_fail (GTKNODES_IS_NODE_SOCKET (socket));
 
   priv = gtk_nodes_node_socket_get_instance_private (socket);
 
+  feedback = !!feedback;
 
-  if (priv->io == GTKNODES_NODE_SOCKET_DISABLE)
-    return FALSE;
+  if (priv->feedback == feedback)
+    return;
 
-  if (priv->io == GTKNODES_NODE_SOCKET_SINK)
-    g_signal_emit (socket, node_socket_signals[SOCKET_INCOMING], 0, payload);
+  /* the view must learn about the connection with the old setting */
+  gtk_nodes_node_socket_disconnect (socket);
 
-  if (priv->io == GTKNODES_NODE_SOCKET_SOURCE)
-    g_signal_emit (socket, node_socket_signals[SOCKET_OUTGOING], 0, payload);
+  priv->feedback = feedback;
 
-  return TRUE;
+  g_object_notify (G_OBJECT (socket), "feedback");
 }
 
-
 /**
- * gtk_nodes_node_socket_disconnect:
+ * gtk_nodes_node_socket_get_feedback
  * @socket: a #GtkNodesNodeSocket
  *
- * Drops all connections on a given socket. Attached sink or source sockets
- * will be notified by the respective signals
+ * Returns: TRUE if the sink may close a loop
  */
 
-void
-gtk_nodes_node_socket_disconnect (GtkNodesNodeSocket *socket)
+gboolean
+gtk_nodes_node_socket_get_feedback (GtkNodesNodeSocket *socket)
 {
   GtkNodesNodeSocketPrivate *priv;
 
-  g_return_if_fail (GTKNODES_IS_NODE_SOCKET (socket));
+
+  g_return_val_if_fail (GTKNODES_IS_NODE_SOCKET (socket), FALSE);
 
   priv = gtk_nodes_node_socket_get_instance_private (socket);
 
-  /* if there is an input source, disconnect it */
-  if (priv->input)
-    {
-      g_signal_handler_disconnect (priv->input, priv->input_handler);
-      g_signal_handler_disconnect (priv->input, priv->disconnect_handler);
-      g_signal_handler_disconnect (priv->input, priv->key_change_handler);
-      g_signal_handler_disconnect (priv->input, priv->destroyed_handler);
-      priv->input_handler      = 0;
-      priv->disconnect_handler = 0;
-      priv->key_change_handler = 0;
-      priv->destroyed_handler  = 0;
-      g_signal_emit (GTK_WIDGET (socket),
-                     node_socket_signals[SOCKET_DISCONNECT], 0, priv->input);
-      priv->input = NULL;
-    }
+  return priv->feedback;
 }
 
-
 /**
- * gtk_nodes_node_socket_connect_sockets:
- * @sink: a #GtkNodesNodeSocket in sink mode
- * @source: a #GtkNodesNodeSocket in source mode
+ * gtk_nodes_node_socket_set_delivery
+ * @socket: a #GtkNodesNodeSocket
+ * @delivery: the #GtkNodesNodeSocketDelivery policy
  *
- * Explicitly establishes a connection between two sockets. If the sockets
- * are not in the proper mode, the connection will fail. If the sink is already
- * connected to a source, the source will be disconnected from the sink
- * before connecting to the new source. If the compatibility keys of the
- * sockets do not match, the connection will fail as well.
+ * Sets how payloads arriving on a sink are delivered, see the description
+ * of delivery policies above. A payload held back by the latest-only
+ * policy is still delivered after switching to another one.
  */
 
 void
-gtk_nodes_node_socket_connect_sockets (GtkNodesNodeSocket *sink,
-                                       GtkNodesNodeSocket *source)
+gtk_nodes_node_socket_set_delivery (GtkNodesNodeSocket         *socket,
+                                    GtkNodesNodeSocketDelivery  delivery)
 {
-  g_return_if_fail (GTKNODES_IS_NODE_SOCKET (sink));
-  g_return_if_fail (GTKNODES_IS_NODE_SOCKET (source));
+  GtkNodesNodeSocketPrivate *priv;
 
-  gtk_nodes_node_socket_connect_sockets_internal (sink, source);
 
+  g_return_if_fail (GTKNODES_IS_NODE_SOCKET (socket));
+  g_return_if_fail (delivery <= GTKNODES_NODE_SOCKET_DELIVER_DECIMATE);
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  if (priv->delivery == delivery)
+    return;
+
+  priv->delivery  = delivery;
+  priv->decimated = 0;
+
+  g_object_notify (G_OBJECT (socket), "delivery");
 }
 
 /**
- * gtk_nodes_node_socket_get_input:
+ * gtk_nodes_node_socket_get_delivery
  * @socket: a #GtkNodesNodeSocket
  *
- * Returns the reference of the input #GtkNodesNodeSocket for this input, or
- * NULL if no input is connected or the socket is not in sink mode
- *
- * Returns: (transfer none): the reference to the input socket or NULL if invalid
+ * Returns: the delivery policy of the socket
  */
 
-GtkNodesNodeSocket*
-gtk_nodes_node_socket_get_input (GtkNodesNodeSocket *socket)
+GtkNodesNodeSocketDelivery
+gtk_nodes_node_socket_get_delivery (GtkNodesNodeSocket *socket)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+
+  g_return_val_if_fail (GTKNODES_IS_NODE_SOCKET (socket),
+                        GTKNODES_NODE_SOCKET_DELIVER_ALL);
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  return priv->delivery;
+}
+
+/**
+ * gtk_nodes_node_socket_set_decimation
+ * @socket: a #GtkNodesNodeSocket
+ * @decimation: deliver one in this many payloads, at least 1
+ *
+ * Sets the decimation of a sink with the
+ * %GTKNODES_NODE_SOCKET_DELIVER_DECIMATE policy.
+ */
+
+void
+gtk_nodes_node_socket_set_decimation (GtkNodesNodeSocket *socket,
+                                      guint               decimation)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+
+  g_return_if_fail (GTKNODES_IS_NODE_SOCKET (socket));
+  g_return_if_fail (decimation > 0);
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  if (priv->decimation == decimation)
+    return;
+
+  priv->decimation = decimation;
+  priv->decimated  = 0;
+
+  g_object_notify (G_OBJECT (socket), "decimation");
+}
+
+/**
+ * gtk_nodes_node_socket_get_decimation
+ * @socket: a #GtkNodesNodeSocket
+ *
+ * Returns: the decimation of the socket
+ */
+
+guint
+gtk_nodes_node_socket_get_decimation (GtkNodesNodeSocket *socket)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+
+  g_return_val_if_fail (GTKNODES_IS_NODE_SOCKET (socket), 1);
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  return priv->decimation;
+}
+
+/**
+ * gtk_nodes_node_socket_set_credits
+ * @socket: a #GtkNodesNodeSocket
+ * @credits: the number of payloads the source may queue, 0 for any
+ *
+ * Sets how many payloads may wait in a queue for a sink, see the description
+ * of flow control above.
+ */
+
+void
+gtk_nodes_node_socket_set_credits (GtkNodesNodeSocket *socket,
+                                   guint               credits)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+
+  g_return_if_fail (GTKNODES_IS_NODE_SOCKET (socket));
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  if (priv->credits == credits)
+    return;
+
+  priv->credits = credits;
+
+  if (priv->input)
+    gtk_nodes_node_socket_wake_writers (priv->input);
+
+  g_object_notify (G_OBJECT (socket), "credits");
+}
+
+/**
+ * gtk_nodes_node_socket_get_credits
+ * @socket: a #GtkNodesNodeSocket
+ *
+ * Returns: the credits granted by a sink, 0 if unlimited
+ */
+
+guint
+gtk_nodes_node_socket_get_credits (GtkNodesNodeSocket *socket)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+
+  g_return_val_if_fail (GTKNODES_IS_NODE_SOCKET (socket), 0);
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  return priv->credits;
+}
+
+/**
+ * gtk_nodes_node_socket_get_dropped
+ * @socket: a #GtkNodesNodeSocket in sink mode
+ *
+ * Returns: the number of payloads the sink dropped because it had no
+ *          #GtkNodesNodeSocket:credits left when they arrived
+ */
+
+guint64
+gtk_nodes_node_socket_get_dropped (GtkNodesNodeSocket *socket)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+
+  g_return_val_if_fail (GTKNODES_IS_NODE_SOCKET (socket), 0);
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  return priv->dropped;
+}
+
+/* whether the sink has credit for another queued payload */
+static gboolean
+gtk_nodes_node_socket_has_credit (GtkNodesNodeSocket *sink)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+
+  priv = gtk_nodes_node_socket_get_instance_private (sink);
+
+  return !priv->credits || priv->queued < priv->credits;
+}
+
+/**
+ * gtk_nodes_node_socket_is_writable
+ * @socket: a #GtkNodesNodeSocket in source mode
+ *
+ * Returns: TRUE if all sinks connected to the source have credit for
+ *          another payload
+ */
+
+gboolean
+gtk_nodes_node_socket_is_writable (GtkNodesNodeSocket *socket)
+{
+  GtkNodesNodeSocketPrivate *priv;
+  guint i;
+
+
+  g_return_val_if_fail (GTKNODES_IS_NODE_SOCKET (socket), FALSE);
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  for (i = 0; i < priv->outputs->len; i++)
+    {
+      GtkNodesNodeSocket *sink = g_ptr_array_index (priv->outputs, i);
+
+      if (sink && !gtk_nodes_node_socket_has_credit (sink))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/**
+ * gtk_nodes_node_socket_try_write_bytes
+ * @socket: a #GtkNodesNodeSocket in source mode
+ * @payload: the payload to write
+ * @error: return location for a #GError, or NULL
+ *
+ * Writes a payload like gtk_nodes_node_socket_write_bytes(), but only if
+ * all connected sinks have credit for it.
+ *
+ * Returns: TRUE if the payload was written, FALSE with
+ *          %G_IO_ERROR_WOULD_BLOCK if a sink has no credit left
+ */
+
+gboolean
+gtk_nodes_node_socket_try_write_bytes (GtkNodesNodeSocket  *socket,
+                                       GBytes              *payload,
+                                       GError             **error)
+{
+  g_return_val_if_fail (GTKNODES_IS_NODE_SOCKET (socket), FALSE);
+  g_return_val_if_fail (payload != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  if (!gtk_nodes_node_socket_is_writable (socket))
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK,
+                           "A sink has no credit left");
+      return FALSE;
+    }
+
+  if (!gtk_nodes_node_socket_write_bytes (socket, payload))
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                           "The socket can not be written to");
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+gtk_nodes_node_socket_wait_cancelled (GCancellable *cancellable,
+                                      gpointer      user_data)
+{
+  GTask *task = user_data;
+  GtkNodesNodeSocketPrivate *priv;
+  GList *link;
+
+
+  priv = gtk_nodes_node_socket_get_instance_private (g_task_get_source_object (task));
+
+  link = g_list_find (priv->writers, task);
+
+  if (link)
+    {
+      priv->writers = g_list_delete_link (priv->writers, link);
+      g_task_return_error_if_cancelled (task);
+      g_object_unref (task);
+    }
+
+  return G_SOURCE_REMOVE;
+}
+
+/* completes the writers waiting for credit if there is some */
+static void
+gtk_nodes_node_socket_wake_writers (GtkNodesNodeSocket *socket)
+{
+  GtkNodesNodeSocketPrivate *priv;
+  GList *writers;
+  GList *l;
+
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  if (!priv->writers || !gtk_nodes_node_socket_is_writable (socket))
+    return;
+
+  writers = priv->writers;
+  priv->writers = NULL;
+
+  for (l = writers; l; l = l->next)
+    {
+      GSource *cancel = g_task_get_task_data (l->data);
+
+      if (cancel)
+        g_source_destroy (cancel);
+
+      g_task_return_boolean (l->data, TRUE);
+      g_object_unref (l->data);
+    }
+
+  g_list_free (writers);
+}
+
+static void
+gtk_nodes_node_socket_fail_writers (GtkNodesNodeSocket *socket)
+{
+  GtkNodesNodeSocketPrivate *priv;
+  GList *writers;
+  GList *l;
+
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  writers = priv->writers;
+  priv->writers = NULL;
+
+  for (l = writers; l; l = l->next)
+    {
+      GSource *cancel = g_task_get_task_data (l->data);
+
+      if (cancel)
+        g_source_destroy (cancel);
+
+      g_task_return_new_error (l->data, G_IO_ERROR, G_IO_ERROR_CLOSED,
+                               "The socket was destroyed");
+      g_object_unref (l->data);
+    }
+
+  g_list_free (writers);
+}
+
+/**
+ * gtk_nodes_node_socket_wait_writable_async:
+ * @socket: a #GtkNodesNodeSocket in source mode
+ * @cancellable: (nullable): a #GCancellable
+ * @callback: called once all sinks have credit for another payload
+ * @user_data: data passed to @callback
+ *
+ * Waits until gtk_nodes_node_socket_is_writable() holds, which may be right
+ * away. Complete the wait with gtk_nodes_node_socket_wait_writable_finish().
+ */
+
+void
+gtk_nodes_node_socket_wait_writable_async (GtkNodesNodeSocket  *socket,
+                                           GCancellable        *cancellable,
+                                           GAsyncReadyCallback  callback,
+                                           gpointer             user_data)
+{
+  GtkNodesNodeSocketPrivate *priv;
+  GTask *task;
+
+
+  g_return_if_fail (GTKNODES_IS_NODE_SOCKET (socket));
+  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  task = g_task_new (socket, cancellable, callback, user_data);
+  g_task_set_source_tag (task, gtk_nodes_node_socket_wait_writable_async);
+
+  if (gtk_nodes_node_socket_is_writable (socket))
+    {
+      g_task_return_boolean (task, TRUE);
+      g_object_unref (task);
+      return;
+    }
+
+  if (cancellable)
+    {
+      GSource *cancel = g_cancellable_source_new (cancellable);
+
+      g_task_set_task_data (task, g_source_ref (cancel),
+                            (GDestroyNotify) g_source_unref);
+      g_task_attach_source (task, cancel,
+                            (GSourceFunc) gtk_nodes_node_socket_wait_cancelled);
+      g_source_unref (cancel);
+    }
+
+  priv->writers = g_list_append (priv->writers, task);
+}
+
+/**
+ * gtk_nodes_node_socket_wait_writable_finish:
+ * @socket: a #GtkNodesNodeSocket
+ * @result: the #GAsyncResult passed to the callback
+ * @error: return location for a #GError, or NULL
+ *
+ * Returns: TRUE if the sinks have credit, FALSE if the wait was cancelled
+ *          or the socket destroyed
+ */
+
+gboolean
+gtk_nodes_node_socket_wait_writable_finish (GtkNodesNodeSocket  *socket,
+                                            GAsyncResult        *result,
+                                            GError             **error)
+{
+  g_return_val_if_fail (GTKNODES_IS_NODE_SOCKET (socket), FALSE);
+  g_return_val_if_fail (g_task_is_valid (result, socket), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+/**
+ * _gtk_nodes_node_socket_queue_push:
+ * @sink: a #GtkNodesNodeSocket in sink mode
+ * @connection: (out): returns the connection the payload was queued on
+ *
+ * Called by the view when it queues a payload for the sink.
+ *
+ * Returns: FALSE if the sink has no credit left and the payload must be
+ *          dropped
+ */
+
+gboolean
+_gtk_nodes_node_socket_queue_push (GtkNodesNodeSocket *sink,
+                                   guint              *connection)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+
+  priv = gtk_nodes_node_socket_get_instance_private (sink);
+
+  if (!gtk_nodes_node_socket_has_credit (sink))
+    {
+      priv->dropped++;
+
+      /* tell the source writing it */
+      if (priv->input)
+        {
+          GtkNodesNodeSocketPrivate *priv_source;
+
+          priv_source = gtk_nodes_node_socket_get_instance_private (priv->input);
+          priv_source->lost++;
+        }
+
+      return FALSE;
+    }
+
+  priv->queued++;
+
+  *connection = priv->connection;
+
+  return TRUE;
+}
+
+/**
+ * _gtk_nodes_node_socket_queue_pop:
+ * @sink: a #GtkNodesNodeSocket in sink mode
+ * @connection: the connection returned when the payload was queued
+ *
+ * Called by the view when a payload queued for the sink is gone, which
+ * returns its credit to the source. Payloads queued on an earlier
+ * connection were written off when the sink was disconnected, they are
+ * not credited to whatever source it is connected to now.
+ */
+
+void
+_gtk_nodes_node_socket_queue_pop (GtkNodesNodeSocket *sink,
+                                  guint               connection)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+
+  priv = gtk_nodes_node_socket_get_instance_private (sink);
+
+  if (connection != priv->connection)
+    return;
+
+  g_return_if_fail (priv->queued > 0);
+
+  priv->queued--;
+
+  if (priv->input)
+    gtk_nodes_node_socket_wake_writers (priv->input);
+}
+
+/**
+ * _gtk_nodes_node_socket_get_queued:
+ * @sink: a #GtkNodesNodeSocket in sink mode
+ *
+ * Returns: the number of payloads queued for the sink
+ */
+
+guint
+_gtk_nodes_node_socket_get_queued (GtkNodesNodeSocket *sink)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+
+  priv = gtk_nodes_node_socket_get_instance_private (sink);
+
+  return priv->queued;
+}
+
+/**
+ * _gtk_nodes_node_socket_get_connection:
+ * @sink: a #GtkNodesNodeSocket in sink mode
+ *
+ * Returns: the serial of the current connection of the sink, which changes
+ *          whenever it is disconnected
+ */
+
+guint
+_gtk_nodes_node_socket_get_connection (GtkNodesNodeSocket *sink)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+
+  priv = gtk_nodes_node_socket_get_instance_private (sink);
+
+  return priv->connection;
+}
+
+/**
+ * gtk_nodes_node_socket_set_cache
+ * @socket: a #GtkNodesNodeSocket
+ * @cache: whether to cache the last payload
+ *
+ * Makes the socket remember the last payload passing it, see the
+ * description of the value cache above. Turning the cache off forgets
+ * the cached payload.
+ */
+
+void
+gtk_nodes_node_socket_set_cache (GtkNodesNodeSocket *socket,
+                                 gboolean            cache)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+
+  g_return_if_fail (GTKNODES_IS_NODE_SOCKET (socket));
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  cache = !!cache;
+
+  if (priv->cache == cache)
+    return;
+
+  priv->cache = cache;
+
+  if (!cache)
+    {
+      g_clear_pointer (&priv->cached, g_bytes_unref);
+      g_clear_pointer (&priv->digest, g_free);
+    }
+
+  g_object_notify (G_OBJECT (socket), "cache");
+}
+
+/**
+ * gtk_nodes_node_socket_get_cache
+ * @socket: a #GtkNodesNodeSocket
+ *
+ * Returns: TRUE if the socket caches its last payload
+ */
+
+gboolean
+gtk_nodes_node_socket_get_cache (GtkNodesNodeSocket *socket)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+
+  g_return_val_if_fail (GTKNODES_IS_NODE_SOCKET (socket), FALSE);
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  return priv->cache;
+}
+
+/**
+ * gtk_nodes_node_socket_get_cached:
+ * @socket: a #GtkNodesNodeSocket in source mode
+ *
+ * Returns: (transfer none) (nullable): the last payload written to a
+ *          caching source, or NULL if there is none
+ */
+
+GBytes *
+gtk_nodes_node_socket_get_cached (GtkNodesNodeSocket *socket)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+
+  g_return_val_if_fail (GTKNODES_IS_NODE_SOCKET (socket), NULL);
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  return priv->cached;
+}
+
+/**
+ * gtk_nodes_node_socket_get_cached_digest:
+ * @socket: a #GtkNodesNodeSocket
+ *
+ * Returns: (transfer none) (nullable): the SHA-256 digest of the last
+ *          payload passing a caching socket in hexadecimal, or NULL
+ */
+
+const gchar *
+gtk_nodes_node_socket_get_cached_digest (GtkNodesNodeSocket *socket)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+
+  g_return_val_if_fail (GTKNODES_IS_NODE_SOCKET (socket), NULL);
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  /* restored payloads are only hashed once they are compared */
+  if (priv->digest == NULL && priv->cached)
+    priv->digest = g_compute_checksum_for_bytes (G_CHECKSUM_SHA256,
+                                                 priv->cached);
+
+  return priv->digest;
+}
+
+/**
+ * gtk_nodes_node_socket_restore_cache:
+ * @socket: a #GtkNodesNodeSocket
+ * @payload: (nullable): the payload to cache on a source
+ * @digest: (nullable): the digest to remember on a sink
+ *
+ * Puts a previously cached value back in place without passing it on and
+ * turns the cache of the socket on. Sources take the @payload, sinks only
+ * its @digest as returned by gtk_nodes_node_socket_get_cached_digest().
+ */
+
+void
+gtk_nodes_node_socket_restore_cache (GtkNodesNodeSocket *socket,
+                                     GBytes             *payload,
+                                     const gchar        *digest)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+
+  g_return_if_fail (GTKNODES_IS_NODE_SOCKET (socket));
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  gtk_nodes_node_socket_set_cache (socket, TRUE);
+
+  g_clear_pointer (&priv->cached, g_bytes_unref);
+  g_clear_pointer (&priv->digest, g_free);
+
+  if (priv->io == GTKNODES_NODE_SOCKET_SOURCE)
+    {
+      if (payload)
+        priv->cached = g_bytes_ref (payload);
+    }
+  else
+    {
+      priv->digest = g_strdup (digest);
+    }
+}
+
+
+/* remember a payload, returns FALSE if it is the same as the last one */
+
+static gboolean
+gtk_nodes_node_socket_cache_update (GtkNodesNodeSocket *socket,
+                                    gconstpointer       data,
+                                    gsize               size,
+                                    GBytes             *payload)
+{
+  GtkNodesNodeSocketPrivate *priv;
+  gchar *digest;
+
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  digest = g_compute_checksum_for_data (G_CHECKSUM_SHA256, data, size);
+
+  if (!g_strcmp0 (digest, gtk_nodes_node_socket_get_cached_digest (socket)))
+    {
+      g_free (digest);
+      return FALSE;
+    }
+
+  g_free (priv->digest);
+  priv->digest = digest;
+
+  /* a sink only needs to recognise the payload */
+  if (priv->io != GTKNODES_NODE_SOCKET_SOURCE)
+    return TRUE;
+
+  g_clear_pointer (&priv->cached, g_bytes_unref);
+
+  if (payload)
+    priv->cached = g_bytes_ref (payload);
+  else
+    priv->cached = g_bytes_new (data, size);
+
+  return TRUE;
+}
+
+/* whether emitting the signal would run anything, class handlers included */
+static gboolean
+gtk_nodes_node_socket_has_listeners (GtkNodesNodeSocket *socket,
+                                     guint               signal)
+{
+  GtkNodesNodeSocketClass *class;
+
+
+  class = GTKNODES_NODE_SOCKET_GET_CLASS (socket);
+
+  if (signal == SOCKET_INCOMING && class->socket_incoming)
+    return TRUE;
+
+  return g_signal_has_handler_pending (socket, node_socket_signals[signal],
+                                       0, FALSE);
+}
+
+/* hands a payload written to a source to each of its sinks, returns FALSE
+ * if any of them dropped it for lack of credit
+ */
+static gboolean
+gtk_nodes_node_socket_dispatch (GtkNodesNodeSocket *source,
+                                GByteArray         *array,
+                                GBytes             *payload)
+{
+  GtkNodesNodeSocketPrivate *priv;
+  guint64 lost;
+  guint n;
+  guint i;
+
+
+  priv = gtk_nodes_node_socket_get_instance_private (source);
+
+  /* sinks connecting meanwhile only get the next payload */
+  n = priv->outputs->len;
+
+  if (!n)
+    return TRUE;
+
+  lost = priv->lost;
+
+  g_object_ref (source);
+
+  priv->dispatching++;
+
+  for (i = 0; i < n; i++)
+    {
+      GtkNodesNodeSocket *sink = g_ptr_array_index (priv->outputs, i);
+
+      /* disconnected while we were at it */
+      if (sink == NULL)
+        continue;
+
+      if (array)
+        gtk_nodes_node_socket_input_incoming (GTK_WIDGET (source), array, sink);
+      else
+        gtk_nodes_node_socket_input_incoming_bytes (GTK_WIDGET (source),
+                                                    payload, sink);
+    }
+
+  /* close the holes left by sinks which disconnected */
+  if (--priv->dispatching == 0)
+    while (g_ptr_array_remove (priv->outputs, NULL))
+      ;
+
+  lost = priv->lost - lost;
+
+  g_object_unref (source);
+
+  return lost == 0;
+}
+
+static gboolean
+gtk_nodes_node_socket_has_subscribers (GtkNodesNodeSocket *socket)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  return priv->subscribers && priv->subscribers->len;
+}
+
+static void
+gtk_nodes_node_socket_call_subscribers (GtkNodesNodeSocket *socket,
+                                        GBytes             *payload)
+{
+  GtkNodesNodeSocketPrivate *priv;
+  guint n;
+  guint i;
+
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  if (!priv->subscribers)
+    return;
+
+  /* a subscriber may add another one, which moves the array */
+  n = priv->subscribers->len;
+
+  for (i = 0; i < n; i++)
+    {
+      GtkNodesNodeSocketSubscriber sub;
+
+      sub = g_array_index (priv->subscribers, GtkNodesNodeSocketSubscriber, i);
+
+      if (sub.func)
+        sub.func (socket, payload, sub.user_data);
+    }
+}
+
+/* drops subscribers removed while a payload was delivered */
+static void
+gtk_nodes_node_socket_prune_subscribers (GtkNodesNodeSocket *socket)
+{
+  GtkNodesNodeSocketPrivate *priv;
+  guint i;
+
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  if (!priv->unsubscribed)
+    return;
+
+  priv->unsubscribed = FALSE;
+
+  for (i = priv->subscribers->len; i > 0; i--)
+    {
+      GtkNodesNodeSocketSubscriber *sub;
+
+      sub = &g_array_index (priv->subscribers, GtkNodesNodeSocketSubscriber, i - 1);
+
+      if (sub->func)
+        continue;
+
+      if (sub->destroy)
+        sub->destroy (sub->user_data);
+
+      g_array_remove_index (priv->subscribers, i - 1);
+    }
+}
+
+/**
+ * gtk_nodes_node_socket_add_incoming_func:
+ * @socket: a #GtkNodesNodeSocket in sink mode
+ * @func: the function to call with each payload delivered to the sink
+ * @user_data: data passed to @func
+ * @destroy: (nullable): called on @user_data when @func is removed
+ *
+ * Adds a function receiving the payloads delivered to the sink, like a
+ * handler of ::socket-incoming-bytes, but without the cost of a signal
+ * emission. Functions are called in the order they were added, before
+ * the signal handlers.
+ *
+ * Returns: an id for gtk_nodes_node_socket_remove_incoming_func()
+ */
+
+guint
+gtk_nodes_node_socket_add_incoming_func (GtkNodesNodeSocket             *socket,
+                                         GtkNodesNodeSocketIncomingFunc  func,
+                                         gpointer                        user_data,
+                                         GDestroyNotify                  destroy)
+{
+  GtkNodesNodeSocketPrivate *priv;
+  GtkNodesNodeSocketSubscriber sub;
+
+
+  g_return_val_if_fail (GTKNODES_IS_NODE_SOCKET (socket), 0);
+  g_return_val_if_fail (func != NULL, 0);
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  if (priv->subscribers == NULL)
+    priv->subscribers = g_array_new (FALSE, FALSE,
+                                     sizeof (GtkNodesNodeSocketSubscriber));
+
+  sub.id        = ++priv->last_subscriber;
+  sub.func      = func;
+  sub.user_data = user_data;
+  sub.destroy   = destroy;
+
+  g_array_append_val (priv->subscribers, sub);
+
+  return sub.id;
+}
+
+/**
+ * gtk_nodes_node_socket_remove_incoming_func:
+ * @socket: a #GtkNodesNodeSocket
+ * @id: the id returned by gtk_nodes_node_socket_add_incoming_func()
+ *
+ * Removes a function added with gtk_nodes_node_socket_add_incoming_func().
+ * It may be called from within the function itself.
+ */
+
+void
+gtk_nodes_node_socket_remove_incoming_func (GtkNodesNodeSocket *socket,
+                                            guint               id)
+{
+  GtkNodesNodeSocketPrivate *priv;
+  guint i;
+
+
+  g_return_if_fail (GTKNODES_IS_NODE_SOCKET (socket));
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  if (priv->subscribers == NULL)
+    return;
+
+  for (i = 0; i < priv->subscribers->len; i++)
+    {
+      GtkNodesNodeSocketSubscriber *sub;
+
+      sub = &g_array_index (priv->subscribers, GtkNodesNodeSocketSubscriber, i);
+
+      if (sub->id != id || sub->func == NULL)
+        continue;
+
+      /* the array is being walked, leave a hole */
+      sub->func = NULL;
+      priv->unsubscribed = TRUE;
+
+      if (!priv->delivering)
+        gtk_nodes_node_socket_prune_subscribers (socket);
+
+      return;
+    }
+
+  g_warning ("Node Socket %p has no incoming function %u", (void *) socket, id);
+}
+
+/* whether a source may send a payload of this size, warns if not */
+static gboolean
+gtk_nodes_node_socket_payload_fits (GtkNodesNodeSocket *socket,
+                                    GBytes             *payload)
+{
+  GtkNodesNodeSocketPrivate *priv;
+  gchar *want;
+
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  if (priv->io != GTKNODES_NODE_SOCKET_SOURCE || !priv->payload_type)
+    return TRUE;
+
+  if (gtk_nodes_payload_type_check (priv->payload_type, payload))
+    return TRUE;
+
+  want = gtk_nodes_payload_type_to_string (priv->payload_type);
+
+  g_warning ("Node Socket %p: payload of %" G_GSIZE_FORMAT " bytes does not "
+             "fit payload type %s, dropped",
+             (void *) socket, g_bytes_get_size (payload), want);
+
+  g_free (want);
+
+  return FALSE;
+}
+
+/**
+ * gtk_nodes_node_socket_write:
+ * @socket: a #GtkNodesNodeSocket
+ * @payload: the data buffer to write
+ *
+ * Emits a signal on the #GtkNodesNodeSocket in incoming our outgoing direction.
+ * If the socket caches its payloads and @payload is the same as the last
+ * one, nothing is emitted.
+ *
+ * Returns: TRUE on success, FALSE if GTKNODES_NODE_SOCKET_DISABLE is configured,
+ *          a sink is still busy with its previous payload, @payload does not
+ *          fit the payload type of a source or a sink without credit dropped
+ *          it, see gtk_nodes_node_socket_get_dropped()
+ */
+
+gboolean
+gtk_nodes_node_socket_write (GtkNodesNodeSocket *socket,
+                             GByteArray     *payload)
+{
+  GtkNodesNodeSocketPrivate *priv;
+  gboolean delivered = TRUE;
+
+  g_return_val_if_fail (GTKNODES_IS_NODE_SOCKET (socket), FALSE);
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+
+  if (priv->io == GTKNODES_NODE_SOCKET_DISABLE)
+    return FALSE;
+
+  if (priv->io == GTKNODES_NODE_SOCKET_SINK)
+    {
+      if (priv->delivering)
+        {
+          g_warning ("Node Socket %p: payload looped back to sink, dropped",
+                     (void *) socket);
+          return FALSE;
+        }
+    }
+
+  if (priv->io == GTKNODES_NODE_SOCKET_SOURCE && priv->payload_type)
+    {
+      GBytes *bytes;
+      gboolean fits;
+
+      bytes = g_bytes_new_static (payload->data, payload->len);
+      fits  = gtk_nodes_node_socket_payload_fits (socket, bytes);
+
+      g_bytes_unref (bytes);
+
+      if (!fits)
+        return FALSE;
+    }
+
+  if (priv->cache &&
+      !gtk_nodes_node_socket_cache_update (socket, payload->data, payload->len,
+                                           NULL))
+    return TRUE;
+
+  if (priv->io == GTKNODES_NODE_SOCKET_SINK)
+    {
+      priv->delivering = TRUE;
+
+      if (gtk_nodes_node_socket_has_listeners (socket, SOCKET_INCOMING))
+        g_signal_emit (socket, node_socket_signals[SOCKET_INCOMING], 0, payload);
+
+      /* only convert if someone actually wants the shared representation */
+      if (gtk_nodes_node_socket_has_subscribers (socket) ||
+          gtk_nodes_node_socket_has_listeners (socket, SOCKET_INCOMING_BYTES))
+        {
+          GBytes *bytes;
+
+          bytes = g_bytes_new (payload->data, payload->len);
+
+          gtk_nodes_node_socket_call_subscribers (socket, bytes);
+
+          if (gtk_nodes_node_socket_has_listeners (socket, SOCKET_INCOMING_BYTES))
+            g_signal_emit (socket, node_socket_signals[SOCKET_INCOMING_BYTES], 0,
+                           bytes);
+
+          g_bytes_unref (bytes);
+        }
+
+      priv->delivering = FALSE;
+
+      gtk_nodes_node_socket_prune_subscribers (socket);
+    }
+
+  if (priv->io == GTKNODES_NODE_SOCKET_SOURCE)
+    {
+      delivered = gtk_nodes_node_socket_dispatch (socket, payload, NULL);
+
+      if (gtk_nodes_node_socket_has_listeners (socket, SOCKET_OUTGOING))
+        g_signal_emit (socket, node_socket_signals[SOCKET_OUTGOING], 0, payload);
+    }
+
+  return delivered;
+}
+
+/**
+ * gtk_nodes_node_socket_write_bytes:
+ * @socket: a #GtkNodesNodeSocket
+ * @payload: the immutable payload to write
+ *
+ * Emits a signal on the #GtkNodesNodeSocket in incoming our outgoing direction.
+ * The payload is passed on to all connected sinks by reference, the data
+ * must therefore not be modified after it was written. The caller keeps its
+ * reference to @payload. A caching socket drops @payload if it is the same
+ * as the last one.
+ *
+ * Returns: TRUE on success, FALSE if GTKNODES_NODE_SOCKET_DISABLE is configured,
+ *          a sink is still busy with its previous payload, @payload does not
+ *          fit the payload type of a source or a sink without credit dropped
+ *          it, see gtk_nodes_node_socket_get_dropped(). The other sinks still
+ *          received @payload in the latter case.
+ */
+
+gboolean
+gtk_nodes_node_socket_write_bytes (GtkNodesNodeSocket *socket,
+                                   GBytes             *payload)
+{
+  GtkNodesNodeSocketPrivate *priv;
+  gboolean delivered = TRUE;
+
+  g_return_val_if_fail (GTKNODES_IS_NODE_SOCKET (socket), FALSE);
+  g_return_val_if_fail (payload != NULL, FALSE);
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+
+  if (priv->io == GTKNODES_NODE_SOCKET_DISABLE)
+    return FALSE;
+
+  if (priv->io == GTKNODES_NODE_SOCKET_SINK)
+    {
+      if (priv->delivering)
+        {
+          g_warning ("Node Socket %p: payload looped back to sink, dropped",
+                     (void *) socket);
+          return FALSE;
+        }
+    }
+
+  if (!gtk_nodes_node_socket_payload_fits (socket, payload))
+    return FALSE;
+
+  if (priv->cache &&
+      !gtk_nodes_node_socket_cache_update (socket,
+                                           g_bytes_get_data (payload, NULL),
+                                           g_bytes_get_size (payload),
+                                           payload))
+    return TRUE;
+
+  if (priv->io == GTKNODES_NODE_SOCKET_SINK)
+    {
+      priv->delivering = TRUE;
+
+      gtk_nodes_node_socket_call_subscribers (socket, payload);
+
+      if (gtk_nodes_node_socket_has_listeners (socket, SOCKET_INCOMING_BYTES))
+        g_signal_emit (socket, node_socket_signals[SOCKET_INCOMING_BYTES], 0,
+                       payload);
+
+      /* legacy handlers get their own copy, they may modify it */
+      if (gtk_nodes_node_socket_has_listeners (socket, SOCKET_INCOMING))
+        {
+          GByteArray *array;
+          gconstpointer data;
+          gsize size;
+
+          data  = g_bytes_get_data (payload, &size);
+          array = g_byte_array_sized_new (size);
+          g_byte_array_append (array, data, size);
+
+          g_signal_emit (socket, node_socket_signals[SOCKET_INCOMING], 0,
+                         array);
+
+          g_byte_array_unref (array);
+        }
+
+      priv->delivering = FALSE;
+
+      gtk_nodes_node_socket_prune_subscribers (socket);
+    }
+
+  if (priv->io == GTKNODES_NODE_SOCKET_SOURCE)
+    {
+      delivered = gtk_nodes_node_socket_dispatch (socket, NULL, payload);
+
+      if (gtk_nodes_node_socket_has_listeners (socket, SOCKET_OUTGOING_BYTES))
+        g_signal_emit (socket, node_socket_signals[SOCKET_OUTGOING_BYTES], 0,
+                       payload);
+    }
+
+  return delivered;
+}
+
+/* forwards the ready notification of the stream of a source */
+static void
+gtk_nodes_node_socket_stream_ready (GtkNodesStream *stream,
+                                    gpointer        user_data)
+{
+  g_signal_emit (user_data, node_socket_signals[SOCKET_STREAM_READY], 0);
+}
+
+/**
+ * gtk_nodes_node_socket_set_stream:
+ * @socket: a #GtkNodesNodeSocket in source mode
+ * @stream: (nullable): the stream to provide, or NULL to stop streaming
+ *
+ * Puts a source into streaming mode, see the description of streams above.
+ * The producer writes to @stream directly. Sinks connected afterwards read
+ * it from the start of their connection, sinks connected already switch
+ * over when they next call gtk_nodes_node_socket_get_stream_reader().
+ */
+
+void
+gtk_nodes_node_socket_set_stream (GtkNodesNodeSocket *socket,
+                                  GtkNodesStream     *stream)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+
+  g_return_if_fail (GTKNODES_IS_NODE_SOCKET (socket));
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  if (stream && priv->io != GTKNODES_NODE_SOCKET_SOURCE)
+    {
+      g_warning("Node Socket %p not in source mode.", (void *) socket);
+      return;
+    }
+
+  if (priv->stream == stream)
+    return;
+
+  if (stream)
+    gtk_nodes_stream_ref (stream);
+
+  if (priv->stream)
+    {
+      gtk_nodes_stream_set_ready_func (priv->stream, NULL, NULL, NULL);
+      gtk_nodes_stream_unref (priv->stream);
+    }
+
+  priv->stream = stream;
+
+  if (stream)
+    gtk_nodes_stream_set_ready_func (stream,
+                                     gtk_nodes_node_socket_stream_ready,
+                                     socket, NULL);
+}
+
+/**
+ * gtk_nodes_node_socket_get_stream:
+ * @socket: a #GtkNodesNodeSocket
+ *
+ * Returns: (transfer none) (nullable): the stream of a streaming source
+ */
+
+GtkNodesStream *
+gtk_nodes_node_socket_get_stream (GtkNodesNodeSocket *socket)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+
+  g_return_val_if_fail (GTKNODES_IS_NODE_SOCKET (socket), NULL);
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  return priv->stream;
+}
+
+/**
+ * gtk_nodes_node_socket_get_stream_reader:
+ * @socket: a #GtkNodesNodeSocket in sink mode
+ *
+ * Returns: (transfer none) (nullable): the reader of the stream of the input
+ *          source, or NULL if the input is not streaming
+ */
+
+GtkNodesStreamReader *
+gtk_nodes_node_socket_get_stream_reader (GtkNodesNodeSocket *socket)
+{
+  GtkNodesNodeSocketPrivate *priv;
+  GtkNodesStream *stream = NULL;
+
+
+  g_return_val_if_fail (GTKNODES_IS_NODE_SOCKET (socket), NULL);
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  if (priv->input)
+    stream = gtk_nodes_node_socket_get_stream (priv->input);
+
+  /* the source switched streams since we connected */
+  if (priv->reader && gtk_nodes_stream_reader_get_stream (priv->reader) != stream)
+    g_clear_pointer (&priv->reader, gtk_nodes_stream_reader_free);
+
+  if (!priv->reader && stream)
+    priv->reader = gtk_nodes_stream_reader_new (stream);
+
+  return priv->reader;
+}
+
+/**
+ * gtk_nodes_node_socket_bytes_make_writable:
+ * @payload: (transfer full): a payload received on a socket
+ *
+ * Converts a shared payload into a mutable #GByteArray. This consumes the
+ * reference to @payload the caller holds. If it was the last reference, the
+ * data is taken over without a copy, otherwise a private copy is made.
+ *
+ * Sinks wanting to modify a payload received on ::socket-incoming-bytes must
+ * take a reference with g_bytes_ref() first.
+ *
+ * Returns: (transfer full): a #GByteArray holding the payload data
+ */
+
+GByteArray *
+gtk_nodes_node_socket_bytes_make_writable (GBytes *payload)
+{
+  g_return_val_if_fail (payload != NULL, NULL);
+
+  return g_bytes_unref_to_array (payload);
+}
+
+
+/* forgets the sink on its input source, which may be writable now */
+static void
+gtk_nodes_node_socket_leave_source (GtkNodesNodeSocket *sink)
+{
+  GtkNodesNodeSocketPrivate *priv;
+  GtkNodesNodeSocketPrivate *priv_source;
+
+
+  priv = gtk_nodes_node_socket_get_instance_private (sink);
+
+  priv_source = gtk_nodes_node_socket_get_instance_private (priv->input);
+
+  /* the source is walking the array, it cleans up once done */
+  if (priv_source->dispatching)
+    {
+      guint i;
+
+      for (i = 0; i < priv_source->outputs->len; i++)
+        if (g_ptr_array_index (priv_source->outputs, i) == sink)
+          g_ptr_array_index (priv_source->outputs, i) = NULL;
+    }
+  else
+    {
+      g_ptr_array_remove (priv_source->outputs, sink);
+    }
+
+  gtk_nodes_node_socket_wake_writers (priv->input);
+}
+
+/* cuts the sink off its input source */
+static void
+gtk_nodes_node_socket_drop_input (GtkNodesNodeSocket *socket)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  g_signal_handler_disconnect (priv->input, priv->disconnect_handler);
+  g_signal_handler_disconnect (priv->input, priv->key_change_handler);
+  g_signal_handler_disconnect (priv->input, priv->destroyed_handler);
+  g_signal_handler_disconnect (priv->input, priv->stream_ready_handler);
+  g_clear_pointer (&priv->reader, gtk_nodes_stream_reader_free);
+  gtk_nodes_node_socket_drop_latest (socket);
+  priv->decimated = 0;
+  /* payloads still queued were credited by this source, not the next one */
+  priv->queued = 0;
+  priv->connection++;
+  gtk_nodes_node_socket_leave_source (socket);
+  priv->disconnect_handler = 0;
+  priv->key_change_handler = 0;
+  priv->destroyed_handler  = 0;
+  priv->stream_ready_handler = 0;
+  g_signal_emit (GTK_WIDGET (socket),
+                 node_socket_signals[SOCKET_DISCONNECT], 0, priv->input);
+  priv->input = NULL;
+}
+
+/**
+ * gtk_nodes_node_socket_disconnect:
+ * @socket: a #GtkNodesNodeSocket
+ *
+ * Drops all connections on a given socket. Attached sink or source sockets
+ * will be notified by the respective signals
+ */
+
+void
+gtk_nodes_node_socket_disconnect (GtkNodesNodeSocket *socket)
+{
+  GtkNodesNodeSocketPrivate *priv;
+
+  g_return_if_fail (GTKNODES_IS_NODE_SOCKET (socket));
+
+  priv = gtk_nodes_node_socket_get_instance_private (socket);
+
+  /* if there is an input source, disconnect it */
+  if (priv->input)
+    gtk_nodes_node_socket_drop_input (socket);
+}
+
+
+/**
+ * gtk_nodes_node_socket_connect_sockets:
+ * @sink: a #GtkNodesNodeSocket in sink mode
+ * @source: a #GtkNodesNodeSocket in source mode
+ *
+ * Explicitly establishes a connection between two sockets. If the sockets
+ * are not in the proper mode, the connection will fail. If the sink is already
+ * connected to a source, the source will be disconnected from the sink
+ * before connecting to the new source. If the compatibility keys of the
+ * sockets do not match, the connection will fail as well.
+ */
+
+void
+gtk_nodes_node_socket_connect_sockets (GtkNodesNodeSocket *sink,
+                                       GtkNodesNodeSocket *source)
+{
+  g_return_if_fail (GTKNODES_IS_NODE_SOCKET (sink));
+  g_return_if_fail (GTKNODES_IS_NODE_SOCKET (source));
+
+  gtk_nodes_node_socket_connect_sockets_internal (sink, source);
+
+}
+
+/**
+ * gtk_nodes_node_socket_get_input:
+ * @socket: a #GtkNodesNodeSocket
+ *
+ * Returns the reference of the input #GtkNodesNodeSocket for this input, or
+ * NULL if no input is connected or the socket is not in sink mode
+ *
+ * Returns: (transfer none): the reference to the input socket or NULL if invalid
+ */
+
+GtkNodesNodeSocket*
+gtk_nodes_node_socket_get_input (GtkNodesNodeSocket *socket)
 {
   GtkNodesNodeSocketPrivate *priv;
 
@@ -1591,3 +3681,25 @@ gtk_nodes_node_socket_io_get_type (void)
 
   return g_define_type_id__;
 }
+
+/* our enum-based delivery policy type */
+GType
+gtk_nodes_node_socket_delivery_get_type (void)
+{
+  static gsize g_define_type_id__ = 0;
+
+  if (g_once_init_enter (&g_define_type_id__))
+    {
+      static const GEnumValue values[] = {
+        { GTKNODES_NODE_SOCKET_DELIVER_ALL,      "GTKNODES_NODE_SOCKET_DELIVER_ALL",      "all" },
+        { GTKNODES_NODE_SOCKET_DELIVER_LATEST,   "GTKNODES_NODE_SOCKET_DELIVER_LATEST",   "latest" },
+        { GTKNODES_NODE_SOCKET_DELIVER_DECIMATE, "GTKNODES_NODE_SOCKET_DELIVER_DECIMATE", "decimate" },
+        { 0, NULL, NULL }
+      };
+      GType g_define_type_id =
+        g_enum_register_static (g_intern_static_string ("GtkNodesNodeSocketDelivery"), values);
+      g_once_init_leave (&g_define_type_id__, g_define_type_id);
+    }
+
+  return g_define_type_id__;
+}
@@ -30,6 +30,8 @@
 #endif
 
 #include <gtk/gtkwidget.h>
+#include "gtknodepayload.h"
+#include "gtknodestream.h"
 
 
 G_BEGIN_DECLS
@@ -37,6 +39,7 @@ G_BEGIN_DECLS
 
 #define GTKNODES_TYPE_NODE_SOCKET            (gtk_nodes_node_socket_get_type ())
 #define GTKNODES_TYPE_NODE_SOCKET_IO         (gtk_nodes_node_socket_io_get_type ())
+#define GTKNODES_TYPE_NODE_SOCKET_DELIVERY   (gtk_nodes_node_socket_delivery_get_type ())
 #define GTKNODES_NODE_SOCKET(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), GTKNODES_TYPE_NODE_SOCKET, GtkNodesNodeSocket))
 #define GTKNODES_NODE_SOCKET_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), GTKNODES_TYPE_NODE_SOCKET, GtkNodesNodeSocketClass))
 #define GTKNODES_IS_NODE_SOCKET(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GTKNODES_TYPE_NODE_SOCKET))
@@ -61,11 +64,42 @@ typedef enum
   GTKNODES_NODE_SOCKET_SOURCE,
 } GtkNodesNodeSocketIO;
 
+/**
+ * GtkNodesNodeSocketDelivery:
+ * @GTKNODES_NODE_SOCKET_DELIVER_ALL:      every payload is delivered
+ * @GTKNODES_NODE_SOCKET_DELIVER_LATEST:   only the newest payload is delivered
+ *                                         once the main loop is idle
+ * @GTKNODES_NODE_SOCKET_DELIVER_DECIMATE: one in every #GtkNodesNodeSocket:decimation
+ *                                         payloads is delivered
+ *
+ * How a sink delivers the payloads arriving from its source
+ */
+
+typedef enum
+{
+  GTKNODES_NODE_SOCKET_DELIVER_ALL,
+  GTKNODES_NODE_SOCKET_DELIVER_LATEST,
+  GTKNODES_NODE_SOCKET_DELIVER_DECIMATE,
+} GtkNodesNodeSocketDelivery;
+
 
 typedef struct _GtkNodesNodeSocket              GtkNodesNodeSocket;
 typedef struct _GtkNodesNodeSocketPrivate       GtkNodesNodeSocketPrivate;
 typedef struct _GtkNodesNodeSocketClass         GtkNodesNodeSocketClass;
 
+/**
+ * GtkNodesNodeSocketIncomingFunc:
+ * @socket: the sink the payload was delivered to
+ * @payload: the immutable payload, shared with all other sinks
+ * @user_data: the data passed to gtk_nodes_node_socket_add_incoming_func()
+ *
+ * Receives the payloads delivered to a sink
+ */
+
+typedef void (* GtkNodesNodeSocketIncomingFunc) (GtkNodesNodeSocket *socket,
+                                                 GBytes             *payload,
+                                                 gpointer            user_data);
+
 struct _GtkNodesNodeSocket
 {
   GtkWidget socket;
@@ -90,8 +124,6 @@ struct _GtkNodesNodeSocketClass
   void (* socket_outgoing)   (GtkWidget            *widget,
                               GByteArray            data);
   void (* socket_destroyed)  (GtkWidget            *widget);
-
-
 };
 
 
@@ -101,6 +133,9 @@ GType               gtk_nodes_node_socket_get_type            (void) G_GNUC_CONS
 GDK_AVAILABLE_IN_ALL
 GType               gtk_nodes_node_socket_io_get_type         (void) G_GNUC_CONST;
 
+GDK_AVAILABLE_IN_ALL
+GType               gtk_nodes_node_socket_delivery_get_type   (void) G_GNUC_CONST;
+
 GDK_AVAILABLE_IN_ALL
 GtkWidget*          gtk_nodes_node_socket_new                 (void);
 
@@ -134,15 +169,106 @@ GtkNodesNodeSocketIO gtk_nodes_node_socket_get_key             (GtkNodesNodeSock
 GDK_AVAILABLE_IN_ALL
 GtkNodesNodeSocketIO gtk_nodes_node_socket_get_remote_key      (GtkNodesNodeSocket         *socket);
 
+GDK_AVAILABLE_IN_ALL
+void                gtk_nodes_node_socket_set_payload_type    (GtkNodesNodeSocket         *socket,
+                                                               GtkNodesPayloadType        *payload_type);
+GDK_AVAILABLE_IN_ALL
+GtkNodesPayloadType* gtk_nodes_node_socket_get_payload_type   (GtkNodesNodeSocket         *socket);
+
+GDK_AVAILABLE_IN_ALL
+GtkNodesPayloadType* gtk_nodes_node_socket_get_remote_payload_type (GtkNodesNodeSocket    *socket);
+
 GDK_AVAILABLE_IN_ALL
 void                gtk_nodes_node_socket_set_id              (GtkNodesNodeSocket         *socket,
 						                                                   guint                       id);
 GDK_AVAILABLE_IN_ALL
 GtkNodesNodeSocketIO gtk_nodes_node_socket_get_id              (GtkNodesNodeSocket         *socket);
 
+GDK_AVAILABLE_IN_ALL
+void                gtk_nodes_node_socket_set_feedback        (GtkNodesNodeSocket         *socket,
+                                                               gboolean                    feedback);
+GDK_AVAILABLE_IN_ALL
+gboolean            gtk_nodes_node_socket_get_feedback        (GtkNodesNodeSocket         *socket);
+
+GDK_AVAILABLE_IN_ALL
+void                gtk_nodes_node_socket_set_delivery        (GtkNodesNodeSocket         *socket,
+                                                               GtkNodesNodeSocketDelivery  delivery);
+GDK_AVAILABLE_IN_ALL
+GtkNodesNodeSocketDelivery gtk_nodes_node_socket_get_delivery (GtkNodesNodeSocket         *socket);
+
+GDK_AVAILABLE_IN_ALL
+void                gtk_nodes_node_socket_set_decimation      (GtkNodesNodeSocket         *socket,
+                                                               guint                       decimation);
+GDK_AVAILABLE_IN_ALL
+guint               gtk_nodes_node_socket_get_decimation      (GtkNodesNodeSocket         *socket);
+
+GDK_AVAILABLE_IN_ALL
+void                gtk_nodes_node_socket_set_credits         (GtkNodesNodeSocket         *socket,
+                                                               guint                       credits);
+GDK_AVAILABLE_IN_ALL
+guint               gtk_nodes_node_socket_get_credits         (GtkNodesNodeSocket         *socket);
+GDK_AVAILABLE_IN_ALL
+guint64             gtk_nodes_node_socket_get_dropped         (GtkNodesNodeSocket         *socket);
+
+GDK_AVAILABLE_IN_ALL
+gboolean            gtk_nodes_node_socket_is_writable         (GtkNodesNodeSocket         *socket);
+GDK_AVAILABLE_IN_ALL
+gboolean            gtk_nodes_node_socket_try_write_bytes     (GtkNodesNodeSocket         *socket,
+                                                               GBytes                     *payload,
+                                                               GError                    **error);
+GDK_AVAILABLE_IN_ALL
+void                gtk_nodes_node_socket_wait_writable_async (GtkNodesNodeSocket         *socket,
+                                                               GCancellable               *cancellable,
+                                                               GAsyncReadyCallback         callback,
+                                                               gpointer                    user_data);
+GDK_AVAILABLE_IN_ALL
+gboolean            gtk_nodes_node_socket_wait_writable_finish (GtkNodesNodeSocket        *socket,
+                                                               GAsyncResult               *result,
+                                                               GError                    **error);
+
+GDK_AVAILABLE_IN_ALL
+void                gtk_nodes_node_socket_set_cache           (GtkNodesNodeSocket         *socket,
+                                                               gboolean                    cache);
+GDK_AVAILABLE_IN_ALL
+gboolean            gtk_nodes_node_socket_get_cache           (GtkNodesNodeSocket         *socket);
+
+GDK_AVAILABLE_IN_ALL
+GBytes*             gtk_nodes_node_socket_get_cached          (GtkNodesNodeSocket         *socket);
+
+GDK_AVAILABLE_IN_ALL
+const gchar*        gtk_nodes_node_socket_get_cached_digest   (GtkNodesNodeSocket         *socket);
+
+GDK_AVAILABLE_IN_ALL
+void                gtk_nodes_node_socket_restore_cache       (GtkNodesNodeSocket         *socket,
+                                                               GBytes                     *payload,
+                                                               const gchar                *digest);
+
 GDK_AVAILABLE_IN_ALL
 gboolean            gtk_nodes_node_socket_write               (GtkNodesNodeSocket         *socket,
                                                                GByteArray                 *payload);
+GDK_AVAILABLE_IN_ALL
+gboolean            gtk_nodes_node_socket_write_bytes         (GtkNodesNodeSocket         *socket,
+                                                               GBytes                     *payload);
+GDK_AVAILABLE_IN_ALL
+void                gtk_nodes_node_socket_set_stream          (GtkNodesNodeSocket         *socket,
+                                                               GtkNodesStream             *stream);
+GDK_AVAILABLE_IN_ALL
+GtkNodesStream*     gtk_nodes_node_socket_get_stream          (GtkNodesNodeSocket         *socket);
+GDK_AVAILABLE_IN_ALL
+GtkNodesStreamReader* gtk_nodes_node_socket_get_stream_reader (GtkNodesNodeSocket         *socket);
+
+GDK_AVAILABLE_IN_ALL
+guint               gtk_nodes_node_socket_add_incoming_func   (GtkNodesNodeSocket             *socket,
+                                                               GtkNodesNodeSocketIncomingFunc  func,
+                                                               gpointer                        user_data,
+                                                               GDestroyNotify                  destroy);
+GDK_AVAILABLE_IN_ALL
+void                gtk_nodes_node_socket_remove_incoming_func (GtkNodesNodeSocket            *socket,
+                                                               guint                           id);
+
+GDK_AVAILABLE_IN_ALL
+GByteArray*         gtk_nodes_node_socket_bytes_make_writable (GBytes                     *payload);
+
 GDK_AVAILABLE_IN_ALL
 void                gtk_nodes_node_socket_disconnect          (GtkNodesNodeSocket         *socket);
 
@@ -0,0 +1,44 @@
+/* # vim: tabstop=2 shiftwidth=2 expandtab
+ *
+ * Copyright (C) 2019 Armin Luntzer (armin.luntzer@univie.ac.at)
+ *               Department of Astrophysics, University of Vienna
+ *
+ * The initial version of this project was developed as part of the
+ * activities under ESA/PRODEX contract number C4000126224.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GTK_NODE_SOCKET_PRIVATE_H__
+#define __GTK_NODE_SOCKET_PRIVATE_H__
+
+#include "gtknodesocket.h"
+
+G_BEGIN_DECLS
+
+/* internal interface of the sinks for the queue of their node view */
+
+gboolean _gtk_nodes_node_socket_queue_push     (GtkNodesNodeSocket *sink,
+                                                guint              *connection);
+
+void     _gtk_nodes_node_socket_queue_pop      (GtkNodesNodeSocket *sink,
+                                                guint               connection);
+
+guint    _gtk_nodes_node_socket_get_queued     (GtkNodesNodeSocket *sink);
+
+guint    _gtk_nodes_node_socket_get_connection (GtkNodesNodeSocket *sink);
+
+G_END_DECLS
+
+#endif /* __GTK_NODE_SOCKET_PRIVATE_H__ */
@@ -0,0 +1,675 @@
+/* # vim: tabstop=2 shiftwidth=2 expandtab
+ *
+ * Copyright (C) 2019 Armin Luntzer (armin.luntzer@univie.ac.at)
+ *               Department of Astrophysics, University of Vienna
+ *
+ * The initial version of this project was developed as part of the
+ * activities under ESA/PRODEX contract number C4000126224.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "gtknodestream.h"
+
+#include <string.h>
+
+
+/**
+ * SECTION:gtknodestream
+ * @Short_description: A ring buffer for continuous data
+ * @Title: GtkNodesStream
+ *
+ * A #GtkNodesStream carries a continuous stream of samples from one producer
+ * to any number of consumers. It is a ring buffer of fixed capacity the
+ * producer commits data to as it arrives, either by copying it with
+ * gtk_nodes_stream_write() or by filling the space returned by
+ * gtk_nodes_stream_reserve() in place and passing it on with
+ * gtk_nodes_stream_commit(). Nothing is allocated and no signal is emitted
+ * per commit.
+ *
+ * Every consumer reads through its own #GtkNodesStreamReader at its own
+ * pace. Readers never hold back the producer: a reader which falls behind
+ * by more than the capacity of the stream loses the oldest data, which is
+ * counted by gtk_nodes_stream_reader_get_dropped(). Data is read either by
+ * copying it with gtk_nodes_stream_reader_read() or in place with
+ * gtk_nodes_stream_reader_peek() and gtk_nodes_stream_reader_consume(), the
+ * latter tells if the producer overwrote the data while it was looked at.
+ *
+ * The stream takes no locks. There must only be one producer, but it may
+ * run in any thread, and so may each of the readers. The positions are
+ * accessed with the GLib atomic operations, the data in between is fenced
+ * off from them explicitly.
+ *
+ * A consumer which does not poll can be told about new data with
+ * gtk_nodes_stream_set_ready_func(). The function is called in the main
+ * context which was the thread-default one when the stream was created, and
+ * any number of commits in between are folded into a single call.
+ *
+ * Sources of a #GtkNodesNodeSocket are put into streaming mode with
+ * gtk_nodes_node_socket_set_stream().
+ */
+
+struct _GtkNodesStream
+{
+  gint                     ref_count;
+
+  guint8                  *data;
+  gsize                    capacity;   /* a power of two */
+  gsize                    mask;
+
+  volatile gsize           head;       /* bytes committed so far */
+  volatile gsize           limit;      /* bytes which may have been written */
+  gsize                    reserved;   /* size of the last reservation */
+
+  volatile gint            pending;    /* a ready notification is queued */
+  GMainContext            *context;
+
+  GtkNodesStreamReadyFunc  func;
+  gpointer                 user_data;
+  GDestroyNotify           destroy;
+};
+
+struct _GtkNodesStreamReader
+{
+  GtkNodesStream          *stream;
+
+  gsize                    tail;       /* bytes consumed so far */
+  guint64                  dropped;    /* bytes lost to the producer */
+};
+
+G_DEFINE_BOXED_TYPE (GtkNodesStream, gtk_nodes_stream,
+                     gtk_nodes_stream_ref,
+                     gtk_nodes_stream_unref)
+
+G_DEFINE_BOXED_TYPE (GtkNodesStreamReader, gtk_nodes_stream_reader,
+                     gtk_nodes_stream_reader_copy,
+                     gtk_nodes_stream_reader_free)
+
+
+#define STREAM_HEAD(stream)  ((gsize) g_atomic_pointer_get (&(stream)->head))
+#define STREAM_LIMIT(stream) ((gsize) g_atomic_pointer_get (&(stream)->limit))
+
+/* The data itself is copied with plain accesses, which the atomic loads and
+ * stores of head and limit do not order on their own: the producer must not
+ * write to a reservation before the new limit is visible, and a reader must
+ * finish copying before it loads the limit again to validate the copy.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define STREAM_RELEASE_FENCE() __atomic_thread_fence (__ATOMIC_RELEASE)
+#define STREAM_ACQUIRE_FENCE() __atomic_thread_fence (__ATOMIC_ACQUIRE)
+#else
+/* read-modify-write operations of GLib are full barriers */
+static volatile gint stream_fence;
+#define STREAM_RELEASE_FENCE() g_atomic_int_add (&stream_fence, 0)
+#define STREAM_ACQUIRE_FENCE() g_atomic_int_add (&stream_fence, 0)
+#endif
+
+
+/**
+ * gtk_nodes_stream_new:
+ * @capacity: the minimum size of the ring buffer in bytes
+ *
+ * Creates a stream. The capacity is rounded up to the next power of two.
+ *
+ * Returns: (transfer full): a new #GtkNodesStream
+ */
+
+GtkNodesStream *
+gtk_nodes_stream_new (gsize capacity)
+{
+  GtkNodesStream *stream;
+
+
+  g_return_val_if_fail (capacity > 0, NULL);
+  g_return_val_if_fail (capacity <= G_MAXSIZE / 2 + 1, NULL);
+
+  stream = g_slice_new0 (GtkNodesStream);
+
+  stream->ref_count = 1;
+  stream->capacity  = (gsize) 1 << g_bit_storage (capacity - 1);
+  stream->mask      = stream->capacity - 1;
+  stream->data      = g_malloc (stream->capacity);
+  stream->context   = g_main_context_ref_thread_default ();
+
+  return stream;
+}
+
+/**
+ * gtk_nodes_stream_ref:
+ * @stream: a #GtkNodesStream
+ *
+ * Returns: (transfer full): @stream
+ */
+
+GtkNodesStream *
+gtk_nodes_stream_ref (GtkNodesStream *stream)
+{
+  g_return_val_if_fail (stream != NULL, NULL);
+
+  g_atomic_int_inc (&stream->ref_count);
+
+  return stream;
+}
+
+/**
+ * gtk_nodes_stream_unref:
+ * @stream: a #GtkNodesStream
+ */
+
+void
+gtk_nodes_stream_unref (GtkNodesStream *stream)
+{
+  g_return_if_fail (stream != NULL);
+
+  if (!g_atomic_int_dec_and_test (&stream->ref_count))
+    return;
+
+  if (stream->destroy)
+    stream->destroy (stream->user_data);
+
+  g_main_context_unref (stream->context);
+  g_free (stream->data);
+
+  g_slice_free (GtkNodesStream, stream);
+}
+
+/**
+ * gtk_nodes_stream_get_capacity:
+ * @stream: a #GtkNodesStream
+ *
+ * Returns: the size of the ring buffer in bytes
+ */
+
+gsize
+gtk_nodes_stream_get_capacity (GtkNodesStream *stream)
+{
+  g_return_val_if_fail (stream != NULL, 0);
+
+  return stream->capacity;
+}
+
+/**
+ * gtk_nodes_stream_get_position:
+ * @stream: a #GtkNodesStream
+ *
+ * Returns: the number of bytes committed so far, wrapping around at the
+ *          size of a #gsize
+ */
+
+gsize
+gtk_nodes_stream_get_position (GtkNodesStream *stream)
+{
+  g_return_val_if_fail (stream != NULL, 0);
+
+  return STREAM_HEAD (stream);
+}
+
+/**
+ * gtk_nodes_stream_set_ready_func:
+ * @stream: a #GtkNodesStream
+ * @func: (nullable): the function to call when data was committed
+ * @user_data: data passed to @func
+ * @destroy: (nullable): called on @user_data when it is no longer needed
+ *
+ * Sets the function to call in the main context of the stream after data
+ * was committed, replacing any previous one. Must be called from that
+ * context.
+ */
+
+void
+gtk_nodes_stream_set_ready_func (GtkNodesStream          *stream,
+                                 GtkNodesStreamReadyFunc  func,
+                                 gpointer                 user_data,
+                                 GDestroyNotify           destroy)
+{
+  g_return_if_fail (stream != NULL);
+
+  if (stream->destroy)
+    stream->destroy (stream->user_data);
+
+  stream->func      = func;
+  stream->user_data = user_data;
+  stream->destroy   = destroy;
+}
+
+/* runs the ready function in the main context of the stream */
+static gboolean
+gtk_nodes_stream_dispatch (gpointer data)
+{
+  GtkNodesStream *stream = data;
+
+
+  g_atomic_int_set (&stream->pending, 0);
+
+  if (stream->func)
+    stream->func (stream, stream->user_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* queues a ready notification unless one is pending already */
+static void
+gtk_nodes_stream_notify (GtkNodesStream *stream)
+{
+  GSource *source;
+
+
+  if (!g_atomic_int_compare_and_exchange (&stream->pending, 0, 1))
+    return;
+
+  source = g_idle_source_new ();
+
+  g_source_set_callback (source, gtk_nodes_stream_dispatch,
+                         gtk_nodes_stream_ref (stream),
+                         (GDestroyNotify) gtk_nodes_stream_unref);
+
+  g_source_attach (source, stream->context);
+  g_source_unref (source);
+}
+
+/**
+ * gtk_nodes_stream_reserve:
+ * @stream: a #GtkNodesStream
+ * @size: (inout): the number of bytes wanted, returns the number granted
+ *
+ * Hands out space for the producer to write to in place. The space is
+ * contiguous, so less than asked for is granted where the ring buffer
+ * wraps around. The oldest data in the stream is given up for it, readers
+ * which have not consumed it yet will skip it. Pass the number of bytes
+ * actually written to gtk_nodes_stream_commit().
+ *
+ * Returns: (transfer none): the space to write to
+ */
+
+gpointer
+gtk_nodes_stream_reserve (GtkNodesStream *stream,
+                          gsize          *size)
+{
+  gsize head;
+  gsize offset;
+  gsize limit;
+
+
+  g_return_val_if_fail (stream != NULL, NULL);
+  g_return_val_if_fail (size != NULL && *size > 0, NULL);
+
+  head   = stream->head;
+  offset = head & stream->mask;
+
+  *size = MIN (*size, stream->capacity - offset);
+
+  stream->reserved = *size;
+
+  /* announce the overwrite before it happens, the limit never goes back */
+  limit = head + *size;
+
+  if (limit - STREAM_LIMIT (stream) <= stream->capacity)
+    {
+      g_atomic_pointer_set (&stream->limit, limit);
+      STREAM_RELEASE_FENCE ();
+    }
+
+  return stream->data + offset;
+}
+
+/* publishes reserved data without notifying anybody */
+static void
+gtk_nodes_stream_advance (GtkNodesStream *stream,
+                          gsize           size)
+{
+  g_atomic_pointer_set (&stream->head, stream->head + size);
+
+  stream->reserved = 0;
+}
+
+/**
+ * gtk_nodes_stream_commit:
+ * @stream: a #GtkNodesStream
+ * @size: the number of bytes written to the last reservation
+ *
+ * Makes data written to the space returned by gtk_nodes_stream_reserve()
+ * available to the readers.
+ */
+
+void
+gtk_nodes_stream_commit (GtkNodesStream *stream,
+                         gsize           size)
+{
+  g_return_if_fail (stream != NULL);
+  g_return_if_fail (size <= stream->reserved);
+
+  if (!size)
+    return;
+
+  gtk_nodes_stream_advance (stream, size);
+  gtk_nodes_stream_notify (stream);
+}
+
+/**
+ * gtk_nodes_stream_write:
+ * @stream: a #GtkNodesStream
+ * @data: (array length=size) (element-type guint8): the data to commit
+ * @size: the size of @data in bytes
+ *
+ * Copies data into the stream and commits it. Writing more than the
+ * capacity of the stream leaves only the end of @data in it.
+ */
+
+void
+gtk_nodes_stream_write (GtkNodesStream *stream,
+                        gconstpointer   data,
+                        gsize           size)
+{
+  const guint8 *p = data;
+  gpointer dst;
+  gsize n;
+
+
+  g_return_if_fail (stream != NULL);
+  g_return_if_fail (data != NULL || size == 0);
+
+  if (!size)
+    return;
+
+  while (size)
+    {
+      n   = size;
+      dst = gtk_nodes_stream_reserve (stream, &n);
+
+      memcpy (dst, p, n);
+
+      gtk_nodes_stream_advance (stream, n);
+
+      p    += n;
+      size -= n;
+    }
+
+  gtk_nodes_stream_notify (stream);
+}
+
+/**
+ * gtk_nodes_stream_reader_new:
+ * @stream: a #GtkNodesStream
+ *
+ * Creates a reader which starts with the next data committed to @stream.
+ *
+ * Returns: (transfer full): a new #GtkNodesStreamReader
+ */
+
+GtkNodesStreamReader *
+gtk_nodes_stream_reader_new (GtkNodesStream *stream)
+{
+  GtkNodesStreamReader *reader;
+
+
+  g_return_val_if_fail (stream != NULL, NULL);
+
+  reader = g_slice_new0 (GtkNodesStreamReader);
+
+  reader->stream = gtk_nodes_stream_ref (stream);
+  reader->tail   = STREAM_HEAD (stream);
+
+  return reader;
+}
+
+/**
+ * gtk_nodes_stream_reader_copy:
+ * @reader: a #GtkNodesStreamReader
+ *
+ * Returns: (transfer full): a new reader at the same position as @reader
+ */
+
+GtkNodesStreamReader *
+gtk_nodes_stream_reader_copy (GtkNodesStreamReader *reader)
+{
+  GtkNodesStreamReader *copy;
+
+
+  g_return_val_if_fail (reader != NULL, NULL);
+
+  copy = g_slice_dup (GtkNodesStreamReader, reader);
+
+  gtk_nodes_stream_ref (copy->stream);
+
+  return copy;
+}
+
+/**
+ * gtk_nodes_stream_reader_free:
+ * @reader: a #GtkNodesStreamReader
+ */
+
+void
+gtk_nodes_stream_reader_free (GtkNodesStreamReader *reader)
+{
+  g_return_if_fail (reader != NULL);
+
+  gtk_nodes_stream_unref (reader->stream);
+
+  g_slice_free (GtkNodesStreamReader, reader);
+}
+
+/**
+ * gtk_nodes_stream_reader_get_stream:
+ * @reader: a #GtkNodesStreamReader
+ *
+ * Returns: (transfer none): the stream @reader reads from
+ */
+
+GtkNodesStream *
+gtk_nodes_stream_reader_get_stream (GtkNodesStreamReader *reader)
+{
+  g_return_val_if_fail (reader != NULL, NULL);
+
+  return reader->stream;
+}
+
+/* skips whatever the producer may have overwritten up to limit */
+static void
+gtk_nodes_stream_reader_catch_up (GtkNodesStreamReader *reader,
+                                  gsize                 limit)
+{
+  gsize skip;
+
+
+  if (limit - reader->tail <= reader->stream->capacity)
+    return;
+
+  skip = limit - reader->stream->capacity - reader->tail;
+
+  reader->tail    += skip;
+  reader->dropped += skip;
+}
+
+/* catches up with the producer, then returns the number of bytes committed
+ * past the tail. The limit has to come first: the head may only be compared
+ * with a tail which already skipped what was overwritten before it was loaded,
+ * and a producer lapping the reader in between can still leave the tail ahead
+ * of an earlier head.
+ */
+static gsize
+gtk_nodes_stream_reader_sync (GtkNodesStreamReader *reader)
+{
+  gsize head;
+
+
+  gtk_nodes_stream_reader_catch_up (reader, STREAM_LIMIT (reader->stream));
+
+  head = STREAM_HEAD (reader->stream);
+
+  if ((gssize) (head - reader->tail) <= 0)
+    return 0;
+
+  return head - reader->tail;
+}
+
+/**
+ * gtk_nodes_stream_reader_get_available:
+ * @reader: a #GtkNodesStreamReader
+ *
+ * Returns: the number of bytes which can be read right now
+ */
+
+gsize
+gtk_nodes_stream_reader_get_available (GtkNodesStreamReader *reader)
+{
+  g_return_val_if_fail (reader != NULL, 0);
+
+  return gtk_nodes_stream_reader_sync (reader);
+}
+
+/**
+ * gtk_nodes_stream_reader_get_dropped:
+ * @reader: a #GtkNodesStreamReader
+ *
+ * Returns: the number of bytes the reader lost because it fell behind
+ */
+
+guint64
+gtk_nodes_stream_reader_get_dropped (GtkNodesStreamReader *reader)
+{
+  g_return_val_if_fail (reader != NULL, 0);
+
+  return reader->dropped;
+}
+
+/**
+ * gtk_nodes_stream_reader_read:
+ * @reader: a #GtkNodesStreamReader
+ * @data: (out caller-allocates) (array length=size) (element-type guint8):
+ *        the buffer to copy to
+ * @size: the size of @data in bytes
+ *
+ * Copies the next data from the stream and consumes it. Data the producer
+ * overwrites while it is copied is skipped and the copy is repeated.
+ *
+ * Returns: the number of bytes copied, 0 if there was nothing to read
+ */
+
+gsize
+gtk_nodes_stream_reader_read (GtkNodesStreamReader *reader,
+                              gpointer              data,
+                              gsize                 size)
+{
+  GtkNodesStream *stream;
+  gsize offset;
+  gsize part;
+  gsize n;
+
+
+  g_return_val_if_fail (reader != NULL, 0);
+  g_return_val_if_fail (data != NULL || size == 0, 0);
+
+  stream = reader->stream;
+
+  while (TRUE)
+    {
+      n = MIN (size, gtk_nodes_stream_reader_sync (reader));
+
+      if (!n)
+        return 0;
+
+      offset = reader->tail & stream->mask;
+      part   = MIN (n, stream->capacity - offset);
+
+      memcpy (data, stream->data + offset, part);
+      memcpy ((guint8 *) data + part, stream->data, n - part);
+
+      /* still valid if nothing was reserved over it meanwhile */
+      STREAM_ACQUIRE_FENCE ();
+
+      if (STREAM_LIMIT (stream) - reader->tail <= stream->capacity)
+        break;
+    }
+
+  reader->tail += n;
+
+  return n;
+}
+
+/**
+ * gtk_nodes_stream_reader_peek:
+ * @reader: a #GtkNodesStreamReader
+ * @size: (out): the number of bytes which can be read in place
+ *
+ * Finds the next data in the stream without copying or consuming it. The
+ * data is contiguous, so less than available may be returned where the
+ * ring buffer wraps around. Pass the number of bytes used to
+ * gtk_nodes_stream_reader_consume() to learn whether the data stayed intact.
+ *
+ * Returns: (transfer none) (nullable): the data, or NULL if there is none
+ */
+
+gconstpointer
+gtk_nodes_stream_reader_peek (GtkNodesStreamReader *reader,
+                              gsize                *size)
+{
+  GtkNodesStream *stream;
+  gsize offset;
+  gsize n;
+
+
+  g_return_val_if_fail (reader != NULL, NULL);
+  g_return_val_if_fail (size != NULL, NULL);
+
+  stream = reader->stream;
+  n      = gtk_nodes_stream_reader_sync (reader);
+
+  offset = reader->tail & stream->mask;
+  *size  = MIN (n, stream->capacity - offset);
+
+  if (!*size)
+    return NULL;
+
+  return stream->data + offset;
+}
+
+/**
+ * gtk_nodes_stream_reader_consume:
+ * @reader: a #GtkNodesStreamReader
+ * @size: the number of bytes used since the last peek
+ *
+ * Moves past data returned by gtk_nodes_stream_reader_peek().
+ *
+ * Returns: TRUE if the data was intact, FALSE if the producer overwrote it
+ *          while it was used; the reader then skips past the damage
+ */
+
+gboolean
+gtk_nodes_stream_reader_consume (GtkNodesStreamReader *reader,
+                                 gsize                 size)
+{
+  gsize limit;
+
+
+  g_return_val_if_fail (reader != NULL, FALSE);
+  g_return_val_if_fail (size <= STREAM_HEAD (reader->stream) - reader->tail,
+                        FALSE);
+
+  /* the caller is done with the data, validate it like a copy */
+  STREAM_ACQUIRE_FENCE ();
+
+  limit = STREAM_LIMIT (reader->stream);
+
+  if (limit - reader->tail > reader->stream->capacity)
+    {
+      gtk_nodes_stream_reader_catch_up (reader, limit);
+      return FALSE;
+    }
+
+  reader->tail += size;
+
+  return TRUE;
+}
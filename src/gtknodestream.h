@@ -0,0 +1,114 @@
+/* # vim: tabstop=2 shiftwidth=2 expandtab
+ *
+ * Copyright (C) 2019 Armin Luntzer (armin.luntzer@univie.ac.at)
+ *               Department of Astrophysics, University of Vienna
+ *
+ * The initial version of this project was developed as part of the
+ * activities under ESA/PRODEX contract number C4000126224.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __GTK_NODE_STREAM_H__
+#define __GTK_NODE_STREAM_H__
+
+#include <glib-object.h>
+#include <gdk/gdk.h>
+
+G_BEGIN_DECLS
+
+
+#define GTKNODES_TYPE_STREAM              (gtk_nodes_stream_get_type ())
+#define GTKNODES_TYPE_STREAM_READER       (gtk_nodes_stream_reader_get_type ())
+
+
+typedef struct _GtkNodesStream       GtkNodesStream;
+typedef struct _GtkNodesStreamReader GtkNodesStreamReader;
+
+/**
+ * GtkNodesStreamReadyFunc:
+ * @stream: the #GtkNodesStream
+ * @user_data: the data passed to gtk_nodes_stream_set_ready_func()
+ *
+ * Called in the main context the stream was created in after data was
+ * committed. Any number of commits are folded into a single call.
+ */
+
+typedef void (* GtkNodesStreamReadyFunc) (GtkNodesStream *stream,
+                                          gpointer        user_data);
+
+
+GDK_AVAILABLE_IN_ALL
+GType                 gtk_nodes_stream_get_type            (void) G_GNUC_CONST;
+GDK_AVAILABLE_IN_ALL
+GType                 gtk_nodes_stream_reader_get_type     (void) G_GNUC_CONST;
+
+GDK_AVAILABLE_IN_ALL
+GtkNodesStream*       gtk_nodes_stream_new                 (gsize                    capacity);
+GDK_AVAILABLE_IN_ALL
+GtkNodesStream*       gtk_nodes_stream_ref                 (GtkNodesStream          *stream);
+GDK_AVAILABLE_IN_ALL
+void                  gtk_nodes_stream_unref               (GtkNodesStream          *stream);
+
+GDK_AVAILABLE_IN_ALL
+gsize                 gtk_nodes_stream_get_capacity        (GtkNodesStream          *stream);
+GDK_AVAILABLE_IN_ALL
+gsize                 gtk_nodes_stream_get_position        (GtkNodesStream          *stream);
+
+GDK_AVAILABLE_IN_ALL
+void                  gtk_nodes_stream_set_ready_func      (GtkNodesStream          *stream,
+                                                            GtkNodesStreamReadyFunc  func,
+                                                            gpointer                 user_data,
+                                                            GDestroyNotify           destroy);
+
+GDK_AVAILABLE_IN_ALL
+gpointer              gtk_nodes_stream_reserve             (GtkNodesStream          *stream,
+                                                            gsize                   *size);
+GDK_AVAILABLE_IN_ALL
+void                  gtk_nodes_stream_commit              (GtkNodesStream          *stream,
+                                                            gsize                    size);
+GDK_AVAILABLE_IN_ALL
+void                  gtk_nodes_stream_write               (GtkNodesStream          *stream,
+                                                            gconstpointer            data,
+                                                            gsize                    size);
+
+GDK_AVAILABLE_IN_ALL
+GtkNodesStreamReader* gtk_nodes_stream_reader_new          (GtkNodesStream          *stream);
+GDK_AVAILABLE_IN_ALL
+GtkNodesStreamReader* gtk_nodes_stream_reader_copy         (GtkNodesStreamReader    *reader);
+GDK_AVAILABLE_IN_ALL
+void                  gtk_nodes_stream_reader_free         (GtkNodesStreamReader    *reader);
+
+GDK_AVAILABLE_IN_ALL
+GtkNodesStream*       gtk_nodes_stream_reader_get_stream   (GtkNodesStreamReader    *reader);
+GDK_AVAILABLE_IN_ALL
+gsize                 gtk_nodes_stream_reader_get_available (GtkNodesStreamReader   *reader);
+GDK_AVAILABLE_IN_ALL
+guint64               gtk_nodes_stream_reader_get_dropped  (GtkNodesStreamReader    *reader);
+
+GDK_AVAILABLE_IN_ALL
+gsize                 gtk_nodes_stream_reader_read         (GtkNodesStreamReader    *reader,
+                                                            gpointer                 data,
+                                                            gsize                    size);
+GDK_AVAILABLE_IN_ALL
+gconstpointer         gtk_nodes_stream_reader_peek         (GtkNodesStreamReader    *reader,
+                                                            gsize                   *size);
+GDK_AVAILABLE_IN_ALL
+gboolean              gtk_nodes_stream_reader_consume      (GtkNodesStreamReader    *reader,
+                                                            gsize                    size);
+
+G_END_DECLS
+
+#endif /* __GTK_NODE_STREAM_H__ */
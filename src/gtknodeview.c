@@ -23,7 +23,11 @@
 
 #include "gtknode.h"
 #include "gtknodesocket.h"
+#include "gtknodesocketprivate.h"
 #include "gtknodeview.h"
+#include "gtknodeviewprivate.h"
+#include "gtknodegrid.h"
+#include "gtknodegraph.h"
 
 #include "gtk/gtkdragdest.h"
 
@@ -31,6 +35,10 @@
 #include "glib/gprintf.h"
 #include "glib/gstdio.h"
 
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
 /* gtkprivate.h */
 #include "glib-object.h"
 #define GTK_NODES_VIEW_PARAM_RW G_PARAM_READWRITE|G_PARAM_STATIC_NAME|G_PARAM_STATIC_NICK|G_PARAM_STATIC_BLURB
@@ -40,6 +48,24 @@
 
 #define RESIZE_RECTANGLE 16
 
+#define QUEUE_BUDGET_DEFAULT 5000       /* microseconds per main loop iteration */
+
+#define GRID_CELL_SIZE 256              /* edge length of the spatial index cells */
+
+#define SAVE_BUFFER_SIZE (256 * 1024)   /* output buffer when saving */
+
+#define JOURNAL_THRESHOLD_DEFAULT 1000  /* records until the journal is compacted */
+
+#define LAZY_NODE_SIZE 100              /* assumed extent of nodes not built yet */
+
+#define LOAD_BUDGET 8000                /* microseconds spent building nodes per idle */
+
+/* run the scheduler right before GDK redraws */
+#define SCHEDULER_PRIORITY   (G_PRIORITY_HIGH_IDLE + 10)
+
+/* a round of a feedback loop in a hidden view waits for everything else */
+#define FEEDBACK_PRIORITY    G_PRIORITY_DEFAULT_IDLE
+
 /**
  * SECTION:gtknodeview
  * @Short_description: A node viewer
@@ -47,10 +73,97 @@
  *
  * The #GtkNodesNodeView widget is a viewer and connection manager for
  * #GtkNodesNode widgets.
+ *
+ * # Transport #
+ *
+ * By default, a payload written to a source socket is passed on to all
+ * connected sinks before the write call returns, so a write on the first
+ * node of a chain runs through the whole chain synchronously.
+ *
+ * If the transport is set to %GTKNODES_NODE_VIEW_TRANSPORT_QUEUED, payloads
+ * arriving at a sink are put into a queue instead, which is drained from an
+ * idle handler of the main loop. Each iteration of the main loop delivers
+ * payloads for at most #GtkNodesNodeView:queue-budget microseconds, so
+ * redraws and user input are handled in between, even if data are constantly
+ * flowing through the graph.
+ *
+ * With %GTKNODES_NODE_VIEW_TRANSPORT_SCHEDULED, a payload arriving at a sink
+ * only marks the node owning the sink as dirty, while the payload is kept
+ * until the next tick of the scheduler. If another payload arrives at the same
+ * sink in the meantime, it replaces the previous one. On each tick, the dirty
+ * nodes are evaluated in topological order of the connection graph, so a node
+ * receives the payloads for all of its sinks only after all of its upstream
+ * nodes were evaluated. Evaluating a node delivers the latest payload of each
+ * of its sinks, then emits #GtkNodesNode::node-evaluate once. Payloads written
+ * by a node while it is evaluated mark its downstream nodes dirty, which are
+ * then evaluated further on in the same tick. In a graph where multiple paths
+ * merge into one node, a node computing its outputs in ::node-evaluate
+ * therefore does so only once per tick and never sees stale data, while the
+ * handlers of its sinks still run once per payload delivered.
+ * The scheduler ticks once per main loop iteration, just before the view is
+ * redrawn.
+ *
+ * Sinks can bound the number of payloads queued for them with
+ * #GtkNodesNodeSocket:credits, payloads beyond that are dropped, so their
+ * sources should check gtk_nodes_node_socket_is_writable() first. The number
+ * of payloads waiting for a sink is returned by
+ * gtk_nodes_node_view_get_queue_depth().
+ *
+ * # Loops #
+ *
+ * A connection which would close a loop in the graph is rejected, as
+ * payloads would otherwise travel around it forever. Loops can still be
+ * built deliberately by enabling #GtkNodesNodeSocket:feedback on the sink
+ * closing the loop. Payloads arriving on a feedback sink are always held
+ * back until the next tick of the scheduler, whatever the transport mode
+ * of the view is. A loop therefore runs one round per frame of the view,
+ * the rest of the main loop, drawing included, keeps running in between.
+ *
+ * # Spatial index #
+ *
+ * The areas covered by the nodes and connections are kept in a spatial
+ * index, so drawing only visits what is inside the exposed area and
+ * gtk_nodes_node_view_get_node_at() and
+ * gtk_nodes_node_view_get_nodes_in_rect() only look at the part of the
+ * view they are asked about.
+ *
+ * # Lazy loading #
+ *
+ * If #GtkNodesNodeView:lazy-load is set, the nodes of a graph being loaded
+ * are not built right away. Each is kept as a record of its type, position,
+ * properties and connections, which takes a fraction of the memory of a
+ * node widget. A node is built once it comes close to the exposed area of
+ * the view, is looked up by its id or position, or a payload is written to
+ * one of its sinks. Its direct neighbours are built along with it, so its
+ * connections are always complete. Nodes which produce data on their own,
+ * e.g. from a timer, therefore stay idle until they are built, use
+ * gtk_nodes_node_view_instantiate() to build them explicitly.
+ *
+ * # Asynchronous loading #
+ *
+ * gtk_nodes_node_view_load_async() reads and checks a file in a worker
+ * thread, while the main loop keeps running. The nodes are then built on
+ * the main thread from an idle handler, a few milliseconds worth of nodes
+ * per iteration, and the ::load-progress signal reports how far it got.
+ * The nodes appear in the view as they are built and are connected once
+ * all of them exist. Cancelling the load removes the nodes built so far.
  */
 
 typedef struct _GtkNodesNodeViewChild        GtkNodesNodeViewChild;
 typedef struct _GtkNodesNodeViewConnection   GtkNodesNodeViewConnection;
+typedef struct _GtkNodesNodeViewDelivery     GtkNodesNodeViewDelivery;
+typedef struct _GtkNodesNodeViewVertex       GtkNodesNodeViewVertex;
+typedef struct _GtkNodesNodeViewRecord       GtkNodesNodeViewRecord;
+typedef struct _GtkNodesNodeViewEdge         GtkNodesNodeViewEdge;
+
+enum {
+  PROP_0,
+  PROP_TRANSPORT,
+  PROP_QUEUE_BUDGET,
+  PROP_JOURNAL_THRESHOLD,
+  PROP_LAZY_LOAD,
+  NUM_PROPERTIES
+};
 
 enum {
   CHILD_PROP_0,
@@ -74,16 +187,28 @@ enum
 {
   NODE_DRAG_BEGIN,
   NODE_DRAG_END,
+  LOAD_PROGRESS,
   LAST_SIGNAL
 };
 
 
 struct _GtkNodesNodeViewPrivate
 {
-  GList     *children;
-  GList     *connections;
+  GQueue     children;          /* in stacking order, topmost last */
   GdkWindow *event_window;
 
+  GHashTable *child_index;      /* widget -> child */
+  GHashTable *id_index;         /* node id -> child */
+  GHashTable *connections;      /* sink -> connection */
+  GHashTable *fanout;           /* source -> set of connections */
+
+  /* the spatial indexes are kept in child coordinates, see
+   * gtk_nodes_node_view_to_child_coords()
+   */
+  GtkNodesNodeGrid *node_grid;  /* spatial index of the children */
+  GtkNodesNodeGrid *con_grid;   /* spatial index of the connection curves */
+  guint             stack_serial; /* stacking counter, topmost is highest */
+
   GdkCursor *cursor_default;
   GdkCursor *cursor_se_resize;
 
@@ -94,12 +219,51 @@ struct _GtkNodesNodeViewPrivate
 
   gint x0, y0;                  /* connection drag start coordinates */
   gint x1, y1;                  /* current connection drag cursor coordinates */
+
+  GtkNodesNodeViewTransport transport;
+
+  GQueue deliveries;            /* pending payloads in queued transport mode */
+  guint  dispatch_id;           /* idle source draining the deliveries */
+  guint  queue_budget;          /* max. time spent per dispatch in us */
+
+  GHashTable *pending;          /* sink -> latest payload in scheduled mode */
+  GHashTable *dirty;            /* set of nodes to evaluate on the next tick */
+  GPtrArray  *order;            /* nodes in topological order, NULL if stale */
+  guint       tick_id;          /* idle source running the scheduler */
+  guint       frame_id;         /* tick callback arming the next round */
+  GHashTable *feedback;         /* sink -> payload held back for one tick */
+
+  GHashTable *vertices;         /* node -> vertex in the connection graph */
+  guint       next_ord;         /* topological ordinal of the next vertex */
+
+  gboolean    keep_ids;         /* added nodes keep their id if it is free */
+
+  gchar         *journal_base;  /* the snapshot the journal applies to */
+  GOutputStream *journal;       /* the edit journal, NULL if not recording */
+  guint          journal_records; /* records since the last compaction */
+  guint          journal_threshold;
+  gboolean       compacting;    /* a compacted snapshot is being written */
+  guint          compact_id;    /* idle source starting the compaction */
+  gboolean       compact_again; /* compact once the running one is done */
+  gboolean       replaying;     /* don't record what we replay */
+  gboolean       loading;       /* don't record a graph being built */
+
+  gboolean          lazy_load;  /* loaded nodes are built on demand */
+  GHashTable       *lazy_index; /* node id -> record of a node not built yet */
+  GtkNodesNodeGrid *lazy_grid;  /* spatial index of the records */
+  GdkRectangle      lazy_bounds; /* area covered by the records */
+  GdkRectangle      lazy_area;  /* exposed area with records in it */
+  guint             lazy_id;    /* idle source building the nodes there */
+  GHashTable       *lazy_fanout; /* source -> set of ids of records it feeds */
 };
 
 
 struct _GtkNodesNodeViewChild
 {
   GtkWidget *widget;
+  GList     *link;              /* our element in the list of children */
+  guint      id;                /* node id we are indexed with */
+  guint      stack;             /* stacking serial, see raise_child() */
 
   GdkRectangle rectangle;       /* rectangle representing the child */
   GdkRectangle south_east;      /* resize corner */
@@ -113,9 +277,69 @@ struct _GtkNodesNodeViewConnection
 {
   GtkWidget *source;
   GtkWidget *sink;
+
+  gboolean   edge;              /* counted in the vertex graph */
+
+  GdkRectangle extents;         /* bounding box of the curve */
+
+  gint       x0, y0;            /* cached curve end points */
+  gint       x1, y1;
+
+  cairo_pattern_t *pattern;     /* cached gradient, NULL if stale */
+};
+
+
+struct _GtkNodesNodeViewVertex
+{
+  GtkWidget  *node;
+
+  guint       ord;              /* position in topological order */
+  gboolean    visited;          /* search mark while inserting an edge */
+
+  GHashTable *succ;             /* vertex -> number of connections */
+  GHashTable *pred;             /* vertex -> number of connections */
+};
+
+
+struct _GtkNodesNodeViewDelivery
+{
+  GtkNodesNodeSocket *sink;
+  GBytes             *payload;
+  guint               connection;   /* the connection of the sink it came on */
+};
+
+
+struct _GtkNodesNodeViewRecord
+{
+  guint                  id;    /* node id reserved for the node */
+  GtkNodesNodeGraphNode *node;  /* what to build the node from */
+  GdkRectangle           rect;  /* estimated allocation of the node */
+  GArray                *edges; /* GtkNodesNodeViewEdge to and from the node */
+};
+
+
+struct _GtkNodesNodeViewEdge
+{
+  guint node_source;
+  guint source;
+  guint node_sink;
+  guint sink;
 };
 
 
+/* gobject overridable methods */
+static void     gtk_nodes_node_view_set_property        (GObject             *object,
+                                                         guint                param_id,
+                                                         const GValue        *value,
+                                                         GParamSpec          *pspec);
+static void     gtk_nodes_node_view_get_property        (GObject             *object,
+                                                         guint                param_id,
+                                                         GValue              *value,
+                                                         GParamSpec          *pspec);
+static void     gtk_nodes_node_view_dispose             (GObject             *object);
+static void     gtk_nodes_node_view_finalize            (GObject             *object);
+
+
 /* widget class basics */
 
 
@@ -172,6 +396,37 @@ static gboolean gtk_nodes_node_view_drag_motion         (GtkWidget           *wi
 static gboolean gtk_nodes_node_view_point_in_rectangle  (GdkRectangle        *rectangle,
                                                          gint                 x,
                                                          gint                 y);
+static gboolean gtk_nodes_node_view_dispatch            (gpointer             data);
+static void     gtk_nodes_node_view_delivery_free       (gpointer             data);
+static void     gtk_nodes_node_view_invalidate_order    (GtkNodesNodeView    *node_view);
+static gboolean gtk_nodes_node_view_tick                (gpointer             data);
+static void     gtk_nodes_node_view_next_round          (GtkNodesNodeView    *node_view);
+static void     gtk_nodes_node_view_add_vertex          (GtkNodesNodeView    *node_view,
+                                                         GtkWidget           *node);
+static void     gtk_nodes_node_view_vertex_free         (gpointer             data);
+static void     gtk_nodes_node_view_remove_edge         (GtkNodesNodeView    *node_view,
+                                                         GtkWidget           *source,
+                                                         GtkWidget           *sink);
+static void     gtk_nodes_node_view_journal             (GtkNodesNodeView    *node_view,
+                                                         const gchar         *format,
+                                                         ...) G_GNUC_PRINTF (2, 3);
+static void     gtk_nodes_node_view_journal_move        (GtkNodesNodeView    *node_view,
+                                                         GtkNodesNodeViewChild *child);
+static void     gtk_nodes_node_view_journal_add         (GtkNodesNodeView    *node_view,
+                                                         GtkNodesNodeViewChild *child);
+static void     gtk_nodes_node_view_child_update_extents (GtkNodesNodeView      *node_view,
+                                                          GtkNodesNodeViewChild *child,
+                                                          GtkAllocation         *allocation);
+static void     gtk_nodes_node_view_instantiate_area    (GtkNodesNodeView    *node_view,
+                                                         const GdkRectangle  *rect);
+static gboolean gtk_nodes_node_view_instantiate_idle    (gpointer             data);
+static void     gtk_nodes_node_view_lazy_outgoing       (GtkWidget           *socket,
+                                                         GByteArray          *payload,
+                                                         gpointer             user_data);
+static void     gtk_nodes_node_view_lazy_outgoing_bytes (GtkWidget           *socket,
+                                                         GBytes              *payload,
+                                                         gpointer             user_data);
+static void     gtk_nodes_node_view_record_free         (gpointer             data);
 
 static guint node_view_signals[LAST_SIGNAL] = { 0 };
 
@@ -189,6 +444,12 @@ static void gtk_nodes_node_view_class_init(GtkNodesNodeViewClass *class)
   container_class = GTK_CONTAINER_CLASS(class);
   gobject_class   = G_OBJECT_CLASS (class);
 
+  /* gobject methods */
+  gobject_class->get_property = gtk_nodes_node_view_get_property;
+  gobject_class->set_property = gtk_nodes_node_view_set_property;
+  gobject_class->dispose      = gtk_nodes_node_view_dispose;
+  gobject_class->finalize     = gtk_nodes_node_view_finalize;
+
   /* widget basics */
   widget_class->map           = gtk_nodes_node_view_map;
   widget_class->unmap         = gtk_nodes_node_view_unmap;
@@ -243,6 +504,69 @@ static void gtk_nodes_node_view_class_init(GtkNodesNodeViewClass *class)
                                                                 G_MININT, G_MAXINT, 0,
                                                                 GTK_NODES_VIEW_PARAM_RW));
 
+  /**
+   * GtkNodesNodeView:transport:
+   *
+   * The transport mode used to pass payloads between the nodes in the view
+   */
+
+  g_object_class_install_property (gobject_class,
+                                   PROP_TRANSPORT,
+                                   g_param_spec_enum ("transport",
+                                                      "Transport Mode",
+                                                      "The payload transport mode",
+                                                      GTKNODES_TYPE_NODE_VIEW_TRANSPORT,
+                                                      GTKNODES_NODE_VIEW_TRANSPORT_SYNC,
+                                                      GTK_NODES_VIEW_PARAM_RW));
+
+  /**
+   * GtkNodesNodeView:queue-budget:
+   *
+   * The maximum time in microseconds spent on delivering queued payloads
+   * per main loop iteration. At least one payload is delivered per iteration.
+   */
+
+  g_object_class_install_property (gobject_class,
+                                   PROP_QUEUE_BUDGET,
+                                   g_param_spec_uint ("queue-budget",
+                                                      "Queue Time Budget",
+                                                      "Time budget per main loop iteration in microseconds",
+                                                      0, G_MAXUINT,
+                                                      QUEUE_BUDGET_DEFAULT,
+                                                      GTK_NODES_VIEW_PARAM_RW));
+
+  /**
+   * GtkNodesNodeView:journal-threshold:
+   *
+   * The number of journal records after which the journal is compacted
+   * into a new snapshot, see gtk_nodes_node_view_journal_start().
+   * 0 disables automatic compaction.
+   */
+
+  g_object_class_install_property (gobject_class,
+                                   PROP_JOURNAL_THRESHOLD,
+                                   g_param_spec_uint ("journal-threshold",
+                                                      "Journal Threshold",
+                                                      "Journal records until compaction",
+                                                      0, G_MAXUINT,
+                                                      JOURNAL_THRESHOLD_DEFAULT,
+                                                      GTK_NODES_VIEW_PARAM_RW));
+
+  /**
+   * GtkNodesNodeView:lazy-load:
+   *
+   * Whether the nodes of graphs loaded into the view are only built when
+   * they are needed, see gtk_nodes_node_view_set_lazy_load()
+   */
+
+  g_object_class_install_property (gobject_class,
+                                   PROP_LAZY_LOAD,
+                                   g_param_spec_boolean ("lazy-load",
+                                                         "Lazy Loading",
+                                                         "Build loaded nodes on demand",
+                                                         FALSE,
+                                                         GTK_NODES_VIEW_PARAM_RW));
+
 
     /**
    * GtkNodesNodeSocket::node-drag-begin:
@@ -282,6 +606,26 @@ static void gtk_nodes_node_view_class_init(GtkNodesNodeViewClass *class)
                   G_TYPE_NONE,
                   1, GTKNODES_TYPE_NODE);
 
+  /**
+   * GtkNodesNodeView::load-progress:
+   * @widget: the object which received the signal.
+   * @built: the number of nodes built so far
+   * @total: the number of nodes to build
+   *
+   * The ::load-progress signal is emitted after each batch of nodes built
+   * by gtk_nodes_node_view_load_async().
+   */
+
+  node_view_signals[LOAD_PROGRESS] =
+    g_signal_new ("load-progress",
+                  G_TYPE_FROM_CLASS (gobject_class),
+                  G_SIGNAL_RUN_FIRST,
+                  0,
+                  NULL, NULL,
+                  NULL,
+                  G_TYPE_NONE,
+                  2, G_TYPE_UINT, G_TYPE_UINT);
+
 
 }
 
@@ -295,6 +639,45 @@ gtk_nodes_node_view_init (GtkNodesNodeView *node_view)
 
   gtk_nodes_node_view_cursor_init (node_view);
 
+  g_queue_init (&priv->children);
+
+  priv->transport    = GTKNODES_NODE_VIEW_TRANSPORT_SYNC;
+  priv->queue_budget = QUEUE_BUDGET_DEFAULT;
+
+  priv->journal_threshold = JOURNAL_THRESHOLD_DEFAULT;
+  g_queue_init (&priv->deliveries);
+
+  priv->pending = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                         g_object_unref,
+                                         (GDestroyNotify) g_bytes_unref);
+  priv->dirty   = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                         g_object_unref, NULL);
+  priv->feedback = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                          g_object_unref,
+                                          (GDestroyNotify) g_bytes_unref);
+
+  priv->vertices = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                          NULL,
+                                          gtk_nodes_node_view_vertex_free);
+
+  priv->child_index = g_hash_table_new (g_direct_hash, g_direct_equal);
+  priv->id_index    = g_hash_table_new (g_direct_hash, g_direct_equal);
+  priv->connections = g_hash_table_new (g_direct_hash, g_direct_equal);
+  priv->fanout      = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                             NULL,
+                                             (GDestroyNotify) g_hash_table_unref);
+
+  priv->node_grid = _gtk_nodes_node_grid_new (GRID_CELL_SIZE);
+  priv->con_grid  = _gtk_nodes_node_grid_new (GRID_CELL_SIZE);
+
+  priv->lazy_index  = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                             NULL,
+                                             gtk_nodes_node_view_record_free);
+  priv->lazy_grid   = _gtk_nodes_node_grid_new (GRID_CELL_SIZE);
+  priv->lazy_fanout = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                             NULL,
+                                             (GDestroyNotify) g_hash_table_unref);
+
   gtk_widget_set_has_window (GTK_WIDGET (node_view), FALSE);
   gtk_widget_set_size_request(GTK_WIDGET (node_view), 100, 100);
 
@@ -306,6 +689,143 @@ gtk_nodes_node_view_init (GtkNodesNodeView *node_view)
                     G_CALLBACK (gtk_nodes_node_view_drag_motion), priv);
 }
 
+/* GObject Methods */
+
+static void
+gtk_nodes_node_view_get_property (GObject    *object,
+                                  guint       param_id,
+                                  GValue     *value,
+                                  GParamSpec *pspec)
+{
+  GtkNodesNodeView *node_view;
+
+
+  node_view = GTKNODES_NODE_VIEW (object);
+
+  switch (param_id)
+    {
+    case PROP_TRANSPORT:
+      g_value_set_enum (value, gtk_nodes_node_view_get_transport (node_view));
+      break;
+    case PROP_QUEUE_BUDGET:
+      g_value_set_uint (value, gtk_nodes_node_view_get_queue_budget (node_view));
+      break;
+    case PROP_JOURNAL_THRESHOLD:
+      g_value_set_uint (value, gtk_nodes_node_view_get_journal_threshold (node_view));
+      break;
+    case PROP_LAZY_LOAD:
+      g_value_set_boolean (value, gtk_nodes_node_view_get_lazy_load (node_view));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, param_id, pspec);
+      break;
+    }
+}
+
+static void
+gtk_nodes_node_view_set_property (GObject      *object,
+                                  guint         param_id,
+                                  const GValue *value,
+                                  GParamSpec   *pspec)
+{
+  GtkNodesNodeView *node_view;
+
+
+  node_view = GTKNODES_NODE_VIEW (object);
+
+  switch (param_id)
+    {
+    case PROP_TRANSPORT:
+      gtk_nodes_node_view_set_transport (node_view, g_value_get_enum (value));
+      break;
+    case PROP_QUEUE_BUDGET:
+      gtk_nodes_node_view_set_queue_budget (node_view, g_value_get_uint (value));
+      break;
+    case PROP_JOURNAL_THRESHOLD:
+      gtk_nodes_node_view_set_journal_threshold (node_view, g_value_get_uint (value));
+      break;
+    case PROP_LAZY_LOAD:
+      gtk_nodes_node_view_set_lazy_load (node_view, g_value_get_boolean (value));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, param_id, pspec);
+      break;
+    }
+}
+
+static void
+gtk_nodes_node_view_dispose (GObject *object)
+{
+  GtkNodesNodeViewPrivate *priv;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (GTKNODES_NODE_VIEW (object));
+
+  /* the children are removed when we go away, which is not an edit */
+  gtk_nodes_node_view_journal_stop (GTKNODES_NODE_VIEW (object));
+
+  if (priv->dispatch_id)
+    {
+      g_source_remove (priv->dispatch_id);
+      priv->dispatch_id = 0;
+    }
+
+  g_queue_foreach (&priv->deliveries, (GFunc) gtk_nodes_node_view_delivery_free,
+                   NULL);
+  g_queue_clear (&priv->deliveries);
+
+  if (priv->tick_id)
+    {
+      g_source_remove (priv->tick_id);
+      priv->tick_id = 0;
+    }
+
+  if (priv->frame_id)
+    {
+      gtk_widget_remove_tick_callback (GTK_WIDGET (object), priv->frame_id);
+      priv->frame_id = 0;
+    }
+
+  if (priv->lazy_id)
+    {
+      g_source_remove (priv->lazy_id);
+      priv->lazy_id = 0;
+    }
+
+  g_clear_pointer (&priv->pending, g_hash_table_unref);
+  g_clear_pointer (&priv->dirty,   g_hash_table_unref);
+  g_clear_pointer (&priv->order,   g_ptr_array_unref);
+  g_clear_pointer (&priv->feedback, g_hash_table_unref);
+
+  G_OBJECT_CLASS (gtk_nodes_node_view_parent_class)->dispose (object);
+}
+
+static void
+gtk_nodes_node_view_finalize (GObject *object)
+{
+  GtkNodesNodeViewPrivate *priv;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (GTKNODES_NODE_VIEW (object));
+
+  /* children are removed during dispose, so the graph lives until now */
+  g_hash_table_unref (priv->vertices);
+
+  g_hash_table_unref (priv->child_index);
+  g_hash_table_unref (priv->id_index);
+  g_hash_table_unref (priv->connections);
+  g_hash_table_unref (priv->fanout);
+
+  _gtk_nodes_node_grid_free (priv->node_grid);
+  _gtk_nodes_node_grid_free (priv->con_grid);
+
+  g_hash_table_unref (priv->lazy_index);
+  g_hash_table_unref (priv->lazy_fanout);
+  _gtk_nodes_node_grid_free (priv->lazy_grid);
+
+  G_OBJECT_CLASS (gtk_nodes_node_view_parent_class)->finalize (object);
+}
+
 /* Widget Methods */
 
 static void
@@ -321,7 +841,7 @@ gtk_nodes_node_view_map (GtkWidget *widget)
 
   gtk_widget_set_mapped (widget, TRUE);
 
-  l = priv->children;
+  l = priv->children.head;
 
   while (l)
     {
@@ -353,6 +873,15 @@ gtk_nodes_node_view_unmap (GtkWidget *widget)
     gdk_window_hide (priv->event_window);
 
   GTK_WIDGET_CLASS (gtk_nodes_node_view_parent_class)->unmap (widget);
+
+  /* there are no more frames to wait for */
+  if (priv->frame_id)
+    {
+      gtk_widget_remove_tick_callback (widget, priv->frame_id);
+      priv->frame_id = 0;
+
+      gtk_nodes_node_view_next_round (GTKNODES_NODE_VIEW (widget));
+    }
 }
 
 
@@ -397,7 +926,7 @@ gtk_nodes_node_view_realize (GtkWidget *widget)
   gtk_widget_register_window (widget, priv->event_window);
 
 
-  l = priv->children;
+  l = priv->children.head;
 
   while (l)
     {
@@ -438,7 +967,7 @@ gtk_nodes_node_view_size_allocate (GtkWidget     *widget,
   priv = gtk_nodes_node_view_get_instance_private (GTKNODES_NODE_VIEW (widget));
 
 
-  l = priv->children;
+  l = priv->children.head;
 
   while (l)
     {
@@ -465,6 +994,9 @@ gtk_nodes_node_view_size_allocate (GtkWidget     *widget,
 
       gtk_widget_get_allocation (child->widget, &allocation_child);
 
+      gtk_nodes_node_view_child_update_extents (GTKNODES_NODE_VIEW (widget),
+                                                child, &allocation_child);
+
       if (GTKNODES_IS_NODE (child->widget))
         socket_radius = (gint) gtk_nodes_node_get_socket_radius (GTKNODES_NODE (child->widget));
       else
@@ -483,6 +1015,15 @@ gtk_nodes_node_view_size_allocate (GtkWidget     *widget,
         allocation->height = h;
     }
 
+  /* leave room for the nodes not built yet, so they can be scrolled to */
+  if (g_hash_table_size (priv->lazy_index))
+    {
+      allocation->width  = MAX (allocation->width,
+                                priv->lazy_bounds.x + priv->lazy_bounds.width);
+      allocation->height = MAX (allocation->height,
+                                priv->lazy_bounds.y + priv->lazy_bounds.height);
+    }
+
   gtk_widget_set_allocation (widget, allocation);
   gtk_widget_set_size_request (widget, allocation->width, allocation->height);
 
@@ -499,140 +1040,418 @@ gtk_nodes_node_view_size_allocate (GtkWidget     *widget,
                           allocation->height);
 }
 
+/* Spatial Index */
+
+static gint
+gtk_nodes_node_view_child_stack_cmp (gconstpointer a,
+                                     gconstpointer b)
+{
+  const GtkNodesNodeViewChild *ca = *((GtkNodesNodeViewChild **) a);
+  const GtkNodesNodeViewChild *cb = *((GtkNodesNodeViewChild **) b);
+
+  return (ca->stack > cb->stack) - (ca->stack < cb->stack);
+}
+
+/* the children are allocated in the coordinates of our parent window,
+ * convert from our own
+ */
+
 static void
-gtk_nodes_node_connecting_curve (GtkWidget *widget,
-                                 cairo_t   *cr,
-                                 gint       x0,
-                                 gint       y0,
-                                 gint       x1,
-                                 gint       y1)
+gtk_nodes_node_view_to_child_coords (GtkNodesNodeView *node_view,
+                                     GdkRectangle     *rect)
 {
-  gint x1m, y1m;
-  gint x2m, y2m;
-  gint d;
+  GtkAllocation allocation;
 
 
-  cairo_move_to (cr, x0, y0);
+  gtk_widget_get_allocation (GTK_WIDGET (node_view), &allocation);
 
-  d = abs(x1 - x0) / 2;
+  rect->x += allocation.x;
+  rect->y += allocation.y;
+}
 
-  x1m = x0 + d;
-  y1m = y0;
+/* children intersecting the area given in node view coordinates, from the
+ * bottom to the top of the stack
+ */
 
-  x2m = x1 - d;
-  y2m = y1;
+static GPtrArray *
+gtk_nodes_node_view_query_children (GtkNodesNodeView   *node_view,
+                                    const GdkRectangle *area)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GdkRectangle rect;
+  GPtrArray *children;
 
-  cairo_curve_to (cr, x1m, y1m, x2m, y2m, x1 , y1);
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  rect = (* area);
+
+  gtk_nodes_node_view_to_child_coords (node_view, &rect);
+
+  children = _gtk_nodes_node_grid_query (priv->node_grid, &rect);
+
+  g_ptr_array_sort (children, gtk_nodes_node_view_child_stack_cmp);
+
+  return children;
 }
 
 static void
-gtk_nodes_node_draw_socket_connection (GtkWidget                  *widget,
-                                       cairo_t                    *cr,
-                                       GtkNodesNodeViewConnection *c)
+gtk_nodes_node_view_socket_center (GtkWidget *socket,
+                                   gint      *x,
+                                   gint      *y)
 {
-  cairo_pattern_t *pat;
-  GdkRGBA col_src, col_sink;
-
   GtkAllocation allocation;
   GtkAllocation alloc_parent;
-  gint x0, x1, y0, y1;
 
 
-  gtk_widget_get_allocation (gtk_widget_get_parent (c->source), &alloc_parent);
-  gtk_widget_get_allocation (c->source, &allocation);
-  x0 = allocation.x + allocation.width  / 2 + alloc_parent.x;
-  y0 = allocation.y + allocation.height / 2 + alloc_parent.y;
+  gtk_widget_get_allocation (gtk_widget_get_parent (socket), &alloc_parent);
+  gtk_widget_get_allocation (socket, &allocation);
+
+  (* x) = allocation.x + allocation.width  / 2 + alloc_parent.x;
+  (* y) = allocation.y + allocation.height / 2 + alloc_parent.y;
+}
 
-  gtk_widget_get_allocation (gtk_widget_get_parent (c->sink), &alloc_parent);
-  gtk_widget_get_allocation (c->sink, &allocation);
-  x1 = allocation.x + allocation.width  / 2 + alloc_parent.x;
-  y1 = allocation.y + allocation.height / 2 + alloc_parent.y;
+static void
+gtk_nodes_node_view_connection_update_extents (GtkNodesNodeView           *node_view,
+                                               GtkNodesNodeViewConnection *con)
+{
+  GtkNodesNodeViewPrivate *priv;
+  gint x0, y0, x1, y1, d;
+  gint xmin, xmax, ymin, ymax;
 
 
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
 
-  pat = cairo_pattern_create_linear (x0, y0,  x1, y1);
+  gtk_nodes_node_view_socket_center (con->source, &x0, &y0);
+  gtk_nodes_node_view_socket_center (con->sink,   &x1, &y1);
 
-  gtk_nodes_node_socket_get_rgba (GTKNODES_NODE_SOCKET (c->source), &col_src);
-  gtk_nodes_node_socket_get_rgba (GTKNODES_NODE_SOCKET (c->sink),   &col_sink);
+  if (con->pattern)
+    {
+      /* unchanged as long as the end points stay */
+      if (x0 == con->x0 && y0 == con->y0 && x1 == con->x1 && y1 == con->y1)
+        return;
 
-  cairo_pattern_add_color_stop_rgba (pat, 0, col_src.red,
-                                     col_src.green,
-                                     col_src.blue,
-                                     col_src.alpha);
+      g_clear_pointer (&con->pattern, cairo_pattern_destroy);
+    }
 
-  cairo_pattern_add_color_stop_rgba (pat, 1, col_sink.red,
-                                     col_sink.green,
-                                     col_sink.blue,
-                                     col_sink.alpha);
+  con->x0 = x0;
+  con->y0 = y0;
+  con->x1 = x1;
+  con->y1 = y1;
 
-  cairo_save(cr);
+  /* the curve lies within the hull of its control points,
+   * see gtk_nodes_node_connecting_curve()
+   */
+  d = abs (x1 - x0) / 2;
 
-  gtk_nodes_node_connecting_curve(widget, cr, x0, y0, x1, y1);
+  xmin = MIN (MIN (x0, x0 + d), MIN (x1, x1 - d));
+  xmax = MAX (MAX (x0, x0 + d), MAX (x1, x1 - d));
+  ymin = MIN (y0, y1);
+  ymax = MAX (y0, y1);
 
-  cairo_set_source (cr, pat);
-  cairo_stroke (cr);
-  cairo_pattern_destroy (pat);
+  /* leave room for the line width */
+  con->extents.x      = xmin - 2;
+  con->extents.y      = ymin - 2;
+  con->extents.width  = xmax - xmin + 4;
+  con->extents.height = ymax - ymin + 4;
 
-  cairo_restore(cr);
+  _gtk_nodes_node_grid_insert (priv->con_grid, con, &con->extents);
 }
 
-static gboolean
-gtk_nodes_node_view_draw (GtkWidget *widget,
-                          cairo_t   *cr)
+/* enter the new allocation of a child into the index and move the
+ * connections attached to its sockets along
+ */
+
+static void
+gtk_nodes_node_view_child_update_extents (GtkNodesNodeView      *node_view,
+                                          GtkNodesNodeViewChild *child,
+                                          GtkAllocation         *allocation)
 {
   GtkNodesNodeViewPrivate *priv;
+  GdkRectangle rect;
+  GList *sockets;
   GList *l;
 
 
-  priv = gtk_nodes_node_view_get_instance_private (GTKNODES_NODE_VIEW (widget));
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
 
-  if (priv->action == ACTION_DRAG_CON)
+  if (_gtk_nodes_node_grid_lookup (priv->node_grid, child, &rect))
+    if (gdk_rectangle_equal (&rect, allocation))
+      return;
+
+  _gtk_nodes_node_grid_insert (priv->node_grid, child, allocation);
+
+  if (!GTKNODES_IS_NODE (child->widget))
+    return;
+
+  sockets = gtk_nodes_node_get_sinks (GTKNODES_NODE (child->widget));
+
+  for (l = sockets; l; l = l->next)
     {
-      cairo_save(cr);
-      cairo_set_source_rgba (cr, 1, 0.2, 0.2, 0.6);
+      GtkNodesNodeViewConnection *con;
 
-      gtk_nodes_node_connecting_curve(widget, cr,
-                                      priv->x0, priv->y0,
-                                      priv->x1, priv->y1);
+      con = g_hash_table_lookup (priv->connections, l->data);
 
-      cairo_stroke(cr);
-      cairo_restore(cr);
+      if (con)
+        gtk_nodes_node_view_connection_update_extents (node_view, con);
     }
 
+  g_list_free (sockets);
 
-  l = priv->connections;
+  sockets = gtk_nodes_node_get_sources (GTKNODES_NODE (child->widget));
 
-  while (l)
+  for (l = sockets; l; l = l->next)
     {
-      GtkNodesNodeViewConnection *c = l->data;
-      l = l->next;
+      GHashTable *set;
+      GHashTableIter iter;
+      gpointer con;
 
-      gtk_nodes_node_draw_socket_connection (widget, cr, c);
+      set = g_hash_table_lookup (priv->fanout, l->data);
 
-    }
+      if (set == NULL)
+        continue;
 
-  if (gtk_cairo_should_draw_window (cr, priv->event_window))
-    GTK_WIDGET_CLASS (gtk_nodes_node_view_parent_class)->draw (widget, cr);
+      g_hash_table_iter_init (&iter, set);
 
-  return GDK_EVENT_PROPAGATE;
+      while (g_hash_table_iter_next (&iter, &con, NULL))
+        gtk_nodes_node_view_connection_update_extents (node_view, con);
+    }
+
+  g_list_free (sockets);
 }
 
+/* what GtkContainer would do, but only for the children in the clip area */
+
 static void
-gtk_nodes_node_view_move_child (GtkNodesNodeView      *node_view,
-                                GtkNodesNodeViewChild *child,
-                                gint                   x,
-                                gint                   y)
+gtk_nodes_node_view_draw_children (GtkNodesNodeView *node_view,
+                                   cairo_t          *cr)
 {
-  gint xmax, ymax;
+  GdkRectangle clip;
+  GPtrArray *children;
+  guint i;
 
-  GtkAllocation allocation_view;
-  GtkAllocation allocation_child;
-  GtkNodesNodeViewPrivate *priv;
 
+  if (!gdk_cairo_get_clip_rectangle (cr, &clip))
+    return;
 
-  priv = gtk_nodes_node_view_get_instance_private (node_view);
+  children = gtk_nodes_node_view_query_children (node_view, &clip);
 
-  g_assert (child);
+  for (i = 0; i < children->len; i++)
+    {
+      GtkNodesNodeViewChild *child = g_ptr_array_index (children, i);
+
+      gtk_container_propagate_draw (GTK_CONTAINER (node_view),
+                                    child->widget, cr);
+    }
+
+  g_ptr_array_unref (children);
+}
+
+static void
+gtk_nodes_node_connecting_curve (GtkWidget *widget,
+                                 cairo_t   *cr,
+                                 gint       x0,
+                                 gint       y0,
+                                 gint       x1,
+                                 gint       y1)
+{
+  gint x1m, y1m;
+  gint x2m, y2m;
+  gint d;
+
+
+  cairo_move_to (cr, x0, y0);
+
+  d = abs(x1 - x0) / 2;
+
+  x1m = x0 + d;
+  y1m = y0;
+
+  x2m = x1 - d;
+  y2m = y1;
+
+  cairo_curve_to (cr, x1m, y1m, x2m, y2m, x1 , y1);
+}
+
+static void
+gtk_nodes_node_draw_socket_connection (GtkWidget                  *widget,
+                                       cairo_t                    *cr,
+                                       GtkNodesNodeViewConnection *c)
+{
+  if (c->pattern == NULL)
+    {
+      GdkRGBA col_src, col_sink;
+
+
+      c->pattern = cairo_pattern_create_linear (c->x0, c->y0,  c->x1, c->y1);
+
+      gtk_nodes_node_socket_get_rgba (GTKNODES_NODE_SOCKET (c->source), &col_src);
+      gtk_nodes_node_socket_get_rgba (GTKNODES_NODE_SOCKET (c->sink),   &col_sink);
+
+      cairo_pattern_add_color_stop_rgba (c->pattern, 0, col_src.red,
+                                         col_src.green,
+                                         col_src.blue,
+                                         col_src.alpha);
+
+      cairo_pattern_add_color_stop_rgba (c->pattern, 1, col_sink.red,
+                                         col_sink.green,
+                                         col_sink.blue,
+                                         col_sink.alpha);
+    }
+
+  cairo_save(cr);
+
+  gtk_nodes_node_connecting_curve(widget, cr, c->x0, c->y0, c->x1, c->y1);
+
+  cairo_set_source (cr, c->pattern);
+  cairo_stroke (cr);
+
+  cairo_restore(cr);
+}
+
+/* the colours of the gradient changed */
+
+static void
+gtk_nodes_node_view_connection_rgba_notify (GObject    *socket,
+                                            GParamSpec *pspec,
+                                            gpointer    user_data)
+{
+  GtkNodesNodeViewConnection *con = user_data;
+
+
+  g_clear_pointer (&con->pattern, cairo_pattern_destroy);
+}
+
+static gboolean
+gtk_nodes_node_view_draw (GtkWidget *widget,
+                          cairo_t   *cr)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GdkRectangle clip;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (GTKNODES_NODE_VIEW (widget));
+
+  if (priv->action == ACTION_DRAG_CON)
+    {
+      cairo_save(cr);
+      cairo_set_source_rgba (cr, 1, 0.2, 0.2, 0.6);
+
+      gtk_nodes_node_connecting_curve(widget, cr,
+                                      priv->x0, priv->y0,
+                                      priv->x1, priv->y1);
+
+      cairo_stroke(cr);
+      cairo_restore(cr);
+    }
+
+
+  /* only stroke the curves passing through the exposed area; their end
+   * points are socket centers in child coordinates like the index, so
+   * both the clip and the drawing are moved there
+   */
+  if (gdk_cairo_get_clip_rectangle (cr, &clip))
+    {
+      GtkAllocation allocation;
+      GPtrArray *cons;
+      guint i;
+
+
+      gtk_nodes_node_view_to_child_coords (GTKNODES_NODE_VIEW (widget), &clip);
+
+      cons = _gtk_nodes_node_grid_query (priv->con_grid, &clip);
+
+      gtk_widget_get_allocation (widget, &allocation);
+
+      cairo_save (cr);
+      cairo_translate (cr, -allocation.x, -allocation.y);
+
+      for (i = 0; i < cons->len; i++)
+        gtk_nodes_node_draw_socket_connection (widget, cr,
+                                               g_ptr_array_index (cons, i));
+
+      cairo_restore (cr);
+
+      g_ptr_array_unref (cons);
+    }
+
+  if (gtk_cairo_should_draw_window (cr, priv->event_window))
+    gtk_nodes_node_view_draw_children (GTKNODES_NODE_VIEW (widget), cr);
+
+  /* build the nodes coming into view, a bit ahead of the exposed area */
+  if (g_hash_table_size (priv->lazy_index) &&
+      gdk_cairo_get_clip_rectangle (cr, &clip))
+    {
+      GPtrArray *records;
+      GdkRectangle rect;
+
+
+      clip.x      -= GRID_CELL_SIZE;
+      clip.y      -= GRID_CELL_SIZE;
+      clip.width  += 2 * GRID_CELL_SIZE;
+      clip.height += 2 * GRID_CELL_SIZE;
+
+      rect = clip;
+
+      gtk_nodes_node_view_to_child_coords (GTKNODES_NODE_VIEW (widget), &rect);
+
+      records = _gtk_nodes_node_grid_query (priv->lazy_grid, &rect);
+
+      if (records->len)
+        {
+          /* not while drawing, the view is redrawn once they were added */
+          if (priv->lazy_id)
+            {
+              gdk_rectangle_union (&priv->lazy_area, &clip, &priv->lazy_area);
+            }
+          else
+            {
+              priv->lazy_area = clip;
+              priv->lazy_id   = g_idle_add (gtk_nodes_node_view_instantiate_idle,
+                                            widget);
+            }
+        }
+
+      g_ptr_array_unref (records);
+    }
+
+  return GDK_EVENT_PROPAGATE;
+}
+
+static void
+gtk_nodes_node_view_raise_child (GtkNodesNodeView      *node_view,
+                                 GtkNodesNodeViewChild *child)
+{
+  GtkNodesNodeViewPrivate *priv;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  if (child->link == priv->children.tail)
+    return;
+
+  child->stack = ++priv->stack_serial;
+
+  g_queue_unlink (&priv->children, child->link);
+  g_queue_push_tail_link (&priv->children, child->link);
+}
+
+static void
+gtk_nodes_node_view_move_child (GtkNodesNodeView      *node_view,
+                                GtkNodesNodeViewChild *child,
+                                gint                   x,
+                                gint                   y)
+{
+  gint xmax, ymax;
+
+  GtkAllocation allocation_view;
+  GtkAllocation allocation_child;
+  GtkNodesNodeViewPrivate *priv;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  g_assert (child);
 
   gtk_widget_get_allocation (GTK_WIDGET (node_view), &allocation_view);
   gtk_widget_get_allocation (GTK_WIDGET (child->widget), &allocation_child);
@@ -665,7 +1484,7 @@ gtk_nodes_node_view_move_child (GtkNodesNodeView      *node_view,
     gtk_widget_queue_resize (child->widget);
 
   /* "raise" window, drawing occurs from start -> end of list */
-  priv->children = g_list_append( g_list_remove (priv->children, child), child);
+  gtk_nodes_node_view_raise_child (node_view, child);
 
   /* queue draw for smooth refresh while the drag action is going on */
   gtk_widget_queue_draw (GTK_WIDGET (node_view));
@@ -830,10 +1649,13 @@ gtk_nodes_node_view_child_button_release_event (GtkWidget         *widget,
   if (priv->action == ACTION_DRAG_CHILD)
     g_signal_emit (node_view, node_view_signals[NODE_DRAG_END], 0, child->widget);
 
+  if (priv->action == ACTION_DRAG_CHILD || priv->action == ACTION_RESIZE)
+    gtk_nodes_node_view_journal_move (node_view, child);
+
   priv->action = ACTION_NONE;
 
   /* "raise" last clicked window, drawing occurs from start -> end of list */
-  priv->children = g_list_append( g_list_remove (priv->children, child), child);
+  gtk_nodes_node_view_raise_child (node_view, child);
 
   gtk_widget_queue_draw (GTK_WIDGET (node_view));
 
@@ -863,26 +1685,181 @@ gtk_nodes_node_view_socket_drag_end_event (GtkWidget           *widget,
   return GDK_EVENT_PROPAGATE;
 }
 
+/* the id of the node a socket belongs to */
+
+static guint
+gtk_nodes_node_view_socket_node_id (GtkNodesNodeView *node_view,
+                                    GtkWidget        *socket)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GtkNodesNodeViewChild *child;
+  GtkWidget *node;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  node  = gtk_widget_get_ancestor (socket, GTKNODES_TYPE_NODE);
+  child = g_hash_table_lookup (priv->child_index, node);
+
+  return child ? child->id : G_MAXUINT;
+}
+
+static void
+gtk_nodes_node_view_connection_remove (GtkNodesNodeView           *node_view,
+                                       GtkNodesNodeViewConnection *con)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GHashTable *set;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  if (con->edge)
+    gtk_nodes_node_view_remove_edge (node_view, con->source, con->sink);
+
+  g_hash_table_remove (priv->connections, con->sink);
+
+  _gtk_nodes_node_grid_remove (priv->con_grid, con);
+
+  g_signal_handlers_disconnect_by_func (con->source,
+                                        gtk_nodes_node_view_connection_rgba_notify,
+                                        con);
+  g_signal_handlers_disconnect_by_func (con->sink,
+                                        gtk_nodes_node_view_connection_rgba_notify,
+                                        con);
+
+  g_clear_pointer (&con->pattern, cairo_pattern_destroy);
+
+  set = g_hash_table_lookup (priv->fanout, con->source);
+
+  if (set)
+    {
+      g_hash_table_remove (set, con);
+
+      if (!g_hash_table_size (set))
+        g_hash_table_remove (priv->fanout, con->source);
+    }
+
+  g_slice_free (GtkNodesNodeViewConnection, con);
+}
+
+/* drop all connections the socket takes part in */
+
+static void
+gtk_nodes_node_view_forget_socket (GtkNodesNodeView *node_view,
+                                   GtkWidget        *socket)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GtkNodesNodeViewConnection *con;
+  GHashTable *set;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  con = g_hash_table_lookup (priv->connections, socket);
+
+  if (con)
+    gtk_nodes_node_view_connection_remove (node_view, con);
+
+  set = g_hash_table_lookup (priv->fanout, socket);
+
+  if (set)
+    {
+      GHashTableIter iter;
+      gpointer key;
+
+      /* the set goes away with its last connection */
+      g_hash_table_ref (set);
+
+      g_hash_table_iter_init (&iter, set);
+
+      while (g_hash_table_iter_next (&iter, &key, NULL))
+        {
+          g_hash_table_iter_steal (&iter);
+          gtk_nodes_node_view_connection_remove (node_view, key);
+        }
+
+      g_hash_table_unref (set);
+    }
+
+  /* nodes not built yet can't wait for its payloads anymore */
+  if (g_hash_table_remove (priv->lazy_fanout, socket))
+    {
+      g_signal_handlers_disconnect_by_func (socket,
+                                            gtk_nodes_node_view_lazy_outgoing,
+                                            node_view);
+      g_signal_handlers_disconnect_by_func (socket,
+                                            gtk_nodes_node_view_lazy_outgoing_bytes,
+                                            node_view);
+    }
+}
+
 static gboolean
 gtk_nodes_node_view_socket_connect_event (GtkWidget *node,
                                           GtkWidget *sink,
                                           GtkWidget *source,
                                           gpointer   user_data)
 {
+  GtkNodesNodeView *node_view;
   GtkNodesNodeViewPrivate *priv;
   GtkNodesNodeViewConnection *con;
+  GHashTable *set;
 
 
-  priv = gtk_nodes_node_view_get_instance_private (GTKNODES_NODE_VIEW (user_data) );
+  node_view = GTKNODES_NODE_VIEW (user_data);
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  /* the source side of a connection notifies as well, with itself as
+   * both ends; the connection was already registered by its sink
+   */
+  if (sink == source)
+    return GDK_EVENT_PROPAGATE;
+
+  /* a sink only ever has one source */
+  con = g_hash_table_lookup (priv->connections, sink);
 
-  con = g_slice_new (GtkNodesNodeViewConnection);
+  if (con)
+    gtk_nodes_node_view_connection_remove (node_view, con);
+
+  con = g_slice_new0 (GtkNodesNodeViewConnection);
 
   con->source = source;
   con->sink   = sink;
 
-  priv->connections = g_list_append (priv->connections, con);
+  /* the sink already entered the edge into the graph when it checked for
+   * loops, feedback connections are not part of the graph
+   */
+  con->edge = !gtk_nodes_node_socket_get_feedback (GTKNODES_NODE_SOCKET (sink));
+
+  g_hash_table_insert (priv->connections, sink, con);
+
+  set = g_hash_table_lookup (priv->fanout, source);
+
+  if (set == NULL)
+    {
+      set = g_hash_table_new (g_direct_hash, g_direct_equal);
+      g_hash_table_insert (priv->fanout, source, set);
+    }
+
+  g_hash_table_add (set, con);
+
+  g_signal_connect (source, "notify::rgba",
+                    G_CALLBACK (gtk_nodes_node_view_connection_rgba_notify),
+                    con);
+  g_signal_connect (sink, "notify::rgba",
+                    G_CALLBACK (gtk_nodes_node_view_connection_rgba_notify),
+                    con);
+
+  gtk_nodes_node_view_connection_update_extents (node_view, con);
 
-  gtk_widget_queue_draw (GTK_WIDGET (user_data));
+  if (priv->journal)
+    gtk_nodes_node_view_journal (node_view, "C %u %u %u %u\n",
+                                 gtk_nodes_node_view_socket_node_id (node_view, source),
+                                 (guint) gtk_nodes_node_socket_get_id (GTKNODES_NODE_SOCKET (source)),
+                                 gtk_nodes_node_view_socket_node_id (node_view, sink),
+                                 (guint) gtk_nodes_node_socket_get_id (GTKNODES_NODE_SOCKET (sink)));
+
+  gtk_widget_queue_draw (GTK_WIDGET (node_view));
 
   return GDK_EVENT_PROPAGATE;
 }
@@ -895,26 +1872,22 @@ gtk_nodes_node_view_socket_disconnect_event (GtkWidget *node,
 {
   GtkNodesNodeView *node_view;
   GtkNodesNodeViewPrivate *priv;
-  GList *l;
+  GtkNodesNodeViewConnection *con;
+
 
   node_view = GTKNODES_NODE_VIEW (user_data);
   priv = gtk_nodes_node_view_get_instance_private (node_view);
 
-  l = priv->connections;
-  while (l)
-    {
-      GtkNodesNodeViewConnection *con = l->data;
-
-      if ((con->source == source) && (con->sink == sink)) {
+  con = g_hash_table_lookup (priv->connections, sink);
 
-        priv->connections = g_list_remove_link (priv->connections, l);
-        g_slice_free (GtkNodesNodeViewConnection, con);
-        g_list_free_1 (l);
-
-        break; /* there should only ever be one */
-      }
+  if (con && con->source == source)
+    {
+      gtk_nodes_node_view_connection_remove (node_view, con);
 
-      l = l->next;
+      if (priv->journal)
+        gtk_nodes_node_view_journal (node_view, "D %u %u\n",
+                                     gtk_nodes_node_view_socket_node_id (node_view, sink),
+                                     (guint) gtk_nodes_node_socket_get_id (GTKNODES_NODE_SOCKET (sink)));
     }
 
   gtk_widget_queue_draw (GTK_WIDGET (node_view));
@@ -928,30 +1901,11 @@ gtk_nodes_node_view_socket_destroyed_event (GtkWidget *node,
                                             gpointer  user_data)
 {
   GtkNodesNodeView *node_view;
-  GtkNodesNodeViewPrivate *priv;
-  GList *l;
-  GList *tmp;
 
 
   node_view = GTKNODES_NODE_VIEW (user_data);
-  priv = gtk_nodes_node_view_get_instance_private (node_view);
-
-  l = priv->connections;
-
-  while (l)
-    {
-      GtkNodesNodeViewConnection *con = l->data;
-
-      tmp = l;
-      l = l->next;
 
-      if ((con->source == socket) || (con->sink == socket)) {
-
-        priv->connections = g_list_remove_link (priv->connections, tmp);
-        g_slice_free (GtkNodesNodeViewConnection, con);
-        g_list_free_1 (tmp);
-      }
-    }
+  gtk_nodes_node_view_forget_socket (node_view, socket);
 
   gtk_widget_queue_draw (GTK_WIDGET (node_view));
 
@@ -959,683 +1913,4204 @@ gtk_nodes_node_view_socket_destroyed_event (GtkWidget *node,
 }
 
 
-/* Container Methods */
+/* Transport */
 
 static void
-gtk_nodes_node_view_add (GtkContainer *container,
-                         GtkWidget    *widget)
+gtk_nodes_node_view_delivery_free (gpointer data)
 {
-  GtkNodesNodeView *node_view;
-  GtkNodesNodeViewPrivate *priv;
-  GtkNodesNodeViewChild *child;
+  GtkNodesNodeViewDelivery *d = data;
 
+  /* return the credit to the source */
+  _gtk_nodes_node_socket_queue_pop (d->sink, d->connection);
 
-  g_return_if_fail (GTKNODES_IS_NODE_VIEW (container));
-  g_return_if_fail (GTK_IS_WIDGET (widget));
+  g_object_unref (d->sink);
+  g_bytes_unref (d->payload);
 
-  node_view = GTKNODES_NODE_VIEW (container);
-  priv = gtk_nodes_node_view_get_instance_private (node_view);
+  g_slice_free (GtkNodesNodeViewDelivery, d);
+}
 
-  child = g_slice_new (GtkNodesNodeViewChild);
+static gboolean
+gtk_nodes_node_view_dispatch (gpointer data)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GtkNodesNodeViewDelivery *d;
+  gint64 deadline;
 
-  child->widget = widget;
-  child->rectangle.x      = 100;
-  child->rectangle.y      = 100;
-  child->rectangle.width  = 100;
-  child->rectangle.height = 100;
 
-  child->south_east.x      = child->rectangle.width  - RESIZE_RECTANGLE;
-  child->south_east.y      = child->rectangle.height - RESIZE_RECTANGLE;
-  child->south_east.width  = RESIZE_RECTANGLE;
-  child->south_east.height = RESIZE_RECTANGLE;
+  priv = gtk_nodes_node_view_get_instance_private (GTKNODES_NODE_VIEW (data));
 
+  deadline = g_get_monotonic_time () + priv->queue_budget;
 
-  gtk_widget_add_events(widget, GDK_BUTTON_PRESS_MASK |
-                        GDK_BUTTON_RELEASE_MASK |
-                        GDK_BUTTON1_MOTION_MASK);
+  /* deliveries may queue more payloads further down the graph, these are
+   * appended to the tail and handled in order
+   */
+  do
+    {
+      d = g_queue_pop_head (&priv->deliveries);
 
-  g_signal_connect(G_OBJECT (widget),
-                   "button-press-event",
-                   G_CALLBACK (gtk_nodes_node_view_child_button_press_event),
-                   child);
+      if (d == NULL)
+        break;
 
-  g_signal_connect(G_OBJECT (widget),
-                   "button-release-event",
-                   G_CALLBACK (gtk_nodes_node_view_child_button_release_event),
-                   child);
+      /* the sink may have been disconnected while the payload was queued,
+       * perhaps to be connected to another source
+       */
+      if (d->connection == _gtk_nodes_node_socket_get_connection (d->sink))
+        gtk_nodes_node_socket_write_bytes (d->sink, d->payload);
 
-  g_signal_connect(G_OBJECT (widget),
-                   "motion-notify-event",
-                   G_CALLBACK (gtk_nodes_node_view_child_motion_notify_event),
-                   child);
-#if 0
-  g_signal_connect (G_OBJECT (widget),
-                    "enter-notify-event",
-                    G_CALLBACK (gtk_nodes_node_view_child_pointer_crossing_event),
-                    NULL);
-#endif
-  g_signal_connect (G_OBJECT (widget),
-                    "leave-notify-event",
-                    G_CALLBACK (gtk_nodes_node_view_child_pointer_crossing_event),
-                    NULL);
+      gtk_nodes_node_view_delivery_free (d);
+    }
+  while (g_get_monotonic_time () < deadline);
 
+  if (!g_queue_is_empty (&priv->deliveries))
+    return G_SOURCE_CONTINUE;
 
+  priv->dispatch_id = 0;
 
-  /* the things we do for glade... */
-  if (GTKNODES_IS_NODE (child->widget))
-    {
-      g_signal_connect(G_OBJECT (widget),
-                       "node-socket-drag-begin",
-                       G_CALLBACK (gtk_nodes_node_view_socket_drag_begin_event),
-                       priv);
+  return G_SOURCE_REMOVE;
+}
 
-      g_signal_connect(G_OBJECT (widget),
-                       "node-socket-drag-end",
-                       G_CALLBACK (gtk_nodes_node_view_socket_drag_end_event),
-                       priv);
+/* Connection Graph
+ *
+ * The nodes and their connections form a directed graph, which we keep in
+ * topological order at all times using the incremental algorithm of
+ * Pearce and Kelly: each vertex carries an ordinal, and as long as an edge
+ * points from a lower to a higher ordinal, nothing needs to be done. If not,
+ * only the vertices with ordinals between the two ends of the new edge are
+ * searched for a path closing a loop and shuffled around if there is none.
+ * The cost of an insertion is thus bounded by the part of the graph that is
+ * actually affected, not by the size of the graph.
+ */
 
-      g_signal_connect(G_OBJECT (widget),
-                       "node-socket-connect",
-                       G_CALLBACK (gtk_nodes_node_view_socket_connect_event),
-                       node_view);
+static void
+gtk_nodes_node_view_vertex_free (gpointer data)
+{
+  GtkNodesNodeViewVertex *v = data;
+  GHashTableIter iter;
+  gpointer key;
 
-      g_signal_connect(G_OBJECT (widget),
-                       "node-socket-disconnect",
-                       G_CALLBACK (gtk_nodes_node_view_socket_disconnect_event),
-                       node_view);
 
-      g_signal_connect(G_OBJECT (widget),
-                       "node-socket-destroyed",
-                       G_CALLBACK (gtk_nodes_node_view_socket_destroyed_event),
-                       node_view);
+  /* drop all edges pointing to us */
+  g_hash_table_iter_init (&iter, v->succ);
 
-      g_object_set (G_OBJECT (child->widget), "id", priv->node_id++, NULL);
-    }
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    g_hash_table_remove (((GtkNodesNodeViewVertex *) key)->pred, v);
 
-  priv->children = g_list_append (priv->children, child);
+  g_hash_table_iter_init (&iter, v->pred);
 
-  if (gtk_widget_get_realized (GTK_WIDGET (node_view)))
-    gtk_widget_set_parent_window (child->widget, priv->event_window);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    g_hash_table_remove (((GtkNodesNodeViewVertex *) key)->succ, v);
 
-  gtk_widget_set_parent (widget, GTK_WIDGET (container));
+  g_hash_table_unref (v->succ);
+  g_hash_table_unref (v->pred);
+
+  g_slice_free (GtkNodesNodeViewVertex, v);
 }
 
-static GtkNodesNodeViewChild*
-gtk_nodes_node_view_get_child (GtkNodesNodeView  *node_view,
-                               GtkWidget *widget)
+static void
+gtk_nodes_node_view_add_vertex (GtkNodesNodeView *node_view,
+                                GtkWidget        *node)
 {
   GtkNodesNodeViewPrivate *priv;
-  GList *l;
+  GtkNodesNodeViewVertex *v;
+
 
   priv = gtk_nodes_node_view_get_instance_private (node_view);
 
-  l = priv->children;
+  v = g_slice_new0 (GtkNodesNodeViewVertex);
 
-  while (l)
-    {
-      GtkNodesNodeViewChild *child = l->data;
+  v->node = node;
+  v->ord  = priv->next_ord++;
+  v->succ = g_hash_table_new (g_direct_hash, g_direct_equal);
+  v->pred = g_hash_table_new (g_direct_hash, g_direct_equal);
 
-      l = l->next;
+  g_hash_table_insert (priv->vertices, node, v);
+}
 
-      if (child->widget == widget)
-        return child;
-    }
+static GtkNodesNodeViewVertex *
+gtk_nodes_node_view_socket_get_vertex (GtkNodesNodeView *node_view,
+                                       GtkWidget        *socket)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GtkWidget *node;
 
-  g_warning ("GtkWidget %p is not a child of GtkNodeView %p",
-             (void *) widget, (void *) node_view);
 
-  return NULL;
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  node = gtk_widget_get_ancestor (socket, GTKNODES_TYPE_NODE);
+
+  if (node == NULL)
+    return NULL;
+
+  return g_hash_table_lookup (priv->vertices, node);
 }
 
-static void
-gtk_nodes_node_view_cursor_init (GtkNodesNodeView *node_view)
+/* visit all vertices reachable from start with ordinals up to ub,
+ * returns FALSE if target is reachable
+ */
+
+static gboolean
+gtk_nodes_node_view_search_forward (GtkNodesNodeViewVertex *start,
+                                    GtkNodesNodeViewVertex *target,
+                                    guint                   ub,
+                                    GPtrArray              *visited)
 {
-	GdkDisplay *display;
-  GtkNodesNodeViewPrivate *priv;
+  GPtrArray *stack;
+  gboolean loop = FALSE;
 
-  priv = gtk_nodes_node_view_get_instance_private (node_view);
 
-	display = gtk_widget_get_display (GTK_WIDGET (node_view));
+  stack = g_ptr_array_new ();
 
-  priv->cursor_default   = gdk_cursor_new_from_name (display, "default");
-  priv->cursor_se_resize = gdk_cursor_new_from_name (display, "se-resize");
+  start->visited = TRUE;
+  g_ptr_array_add (visited, start);
+  g_ptr_array_add (stack, start);
+
+  while (stack->len && !loop)
+    {
+      GtkNodesNodeViewVertex *v;
+      GHashTableIter iter;
+      gpointer key;
+
+      v = g_ptr_array_remove_index_fast (stack, stack->len - 1);
+
+      g_hash_table_iter_init (&iter, v->succ);
+
+      while (g_hash_table_iter_next (&iter, &key, NULL))
+        {
+          GtkNodesNodeViewVertex *w = key;
+
+          if (w == target)
+            {
+              loop = TRUE;
+              break;
+            }
+
+          if (w->visited || w->ord > ub)
+            continue;
+
+          w->visited = TRUE;
+          g_ptr_array_add (visited, w);
+          g_ptr_array_add (stack, w);
+        }
+    }
+
+  g_ptr_array_unref (stack);
+
+  return !loop;
 }
 
+/* visit all vertices start is reachable from with ordinals down to lb */
+
 static void
-gtk_nodes_node_cursor_set (GtkNodesNodeView *node_view, Action action)
+gtk_nodes_node_view_search_backward (GtkNodesNodeViewVertex *start,
+                                     guint                   lb,
+                                     GPtrArray              *visited)
 {
-  GdkCursor *cursor;
-	GdkWindow *window;
-  GtkNodesNodeViewPrivate *priv;
+  GPtrArray *stack;
 
 
-  priv = gtk_nodes_node_view_get_instance_private (node_view);
+  stack = g_ptr_array_new ();
 
-	window  = gtk_widget_get_window (GTK_WIDGET (node_view));
+  start->visited = TRUE;
+  g_ptr_array_add (visited, start);
+  g_ptr_array_add (stack, start);
 
-  switch (action)
+  while (stack->len)
     {
-      case ACTION_RESIZE:
-        cursor = priv->cursor_se_resize;
-        break;
-      case ACTION_NONE:
-      default:
-        cursor = priv->cursor_default;
-        break;
+      GtkNodesNodeViewVertex *v;
+      GHashTableIter iter;
+      gpointer key;
+
+      v = g_ptr_array_remove_index_fast (stack, stack->len - 1);
+
+      g_hash_table_iter_init (&iter, v->pred);
+
+      while (g_hash_table_iter_next (&iter, &key, NULL))
+        {
+          GtkNodesNodeViewVertex *w = key;
+
+          if (w->visited || w->ord < lb)
+            continue;
+
+          w->visited = TRUE;
+          g_ptr_array_add (visited, w);
+          g_ptr_array_add (stack, w);
+        }
     }
 
-  gdk_window_set_cursor(window, cursor);
+  g_ptr_array_unref (stack);
 }
 
-static gboolean
-gtk_nodes_node_view_drag_motion (GtkWidget      *widget,
-                                 GdkDragContext *context,
-                                 gint            x,
-                                 gint            y,
-                                 guint           time,
-                                 GtkNodesNodeViewPrivate *priv)
+static gint
+gtk_nodes_node_view_uint_cmp (gconstpointer a,
+                              gconstpointer b)
 {
-  priv->x1 = x;
-  priv->y1 = y;
+  const guint ua = *((const guint *) a);
+  const guint ub = *((const guint *) b);
 
-  gtk_widget_queue_draw(widget);
+  return (ua > ub) - (ua < ub);
+}
 
-  return GDK_EVENT_PROPAGATE;
+static gint
+gtk_nodes_node_view_vertex_cmp (gconstpointer a,
+                                gconstpointer b)
+{
+  const GtkNodesNodeViewVertex *va = *((GtkNodesNodeViewVertex **) a);
+  const GtkNodesNodeViewVertex *vb = *((GtkNodesNodeViewVertex **) b);
 
+  return (va->ord > vb->ord) - (va->ord < vb->ord);
 }
 
-static gboolean
-gtk_nodes_node_view_button_press_event (GtkWidget      *widget,
-                                        GdkEventButton *event)
+/* hand the pool of ordinals of the affected vertices to those which must
+ * come first, then to the rest, keeping their relative order
+ */
+
+static void
+gtk_nodes_node_view_reorder (GPtrArray *fwd,
+                             GPtrArray *bwd)
 {
-  GTK_WIDGET_CLASS (gtk_nodes_node_view_parent_class)->button_press_event (widget, event);
+  GArray *ords;
+  guint i;
 
-  return FALSE;
+
+  g_ptr_array_sort (fwd, gtk_nodes_node_view_vertex_cmp);
+  g_ptr_array_sort (bwd, gtk_nodes_node_view_vertex_cmp);
+
+  ords = g_array_sized_new (FALSE, FALSE, sizeof (guint), fwd->len + bwd->len);
+
+  for (i = 0; i < bwd->len; i++)
+    g_array_append_val (ords, ((GtkNodesNodeViewVertex *) g_ptr_array_index (bwd, i))->ord);
+
+  for (i = 0; i < fwd->len; i++)
+    g_array_append_val (ords, ((GtkNodesNodeViewVertex *) g_ptr_array_index (fwd, i))->ord);
+
+  g_array_sort (ords, gtk_nodes_node_view_uint_cmp);
+
+  for (i = 0; i < bwd->len; i++)
+    ((GtkNodesNodeViewVertex *) g_ptr_array_index (bwd, i))->ord =
+      g_array_index (ords, guint, i);
+
+  for (i = 0; i < fwd->len; i++)
+    ((GtkNodesNodeViewVertex *) g_ptr_array_index (fwd, i))->ord =
+      g_array_index (ords, guint, bwd->len + i);
+
+  g_array_unref (ords);
 }
 
-static gboolean
-gtk_nodes_node_view_motion_notify_event (GtkWidget      *widget,
-                                   GdkEventMotion *event)
+static void
+gtk_nodes_node_view_clear_visited (GPtrArray *visited)
 {
-  GTK_WIDGET_CLASS (gtk_nodes_node_view_parent_class)->motion_notify_event (widget, event);
+  guint i;
 
-  return FALSE;
+  for (i = 0; i < visited->len; i++)
+    ((GtkNodesNodeViewVertex *) g_ptr_array_index (visited, i))->visited = FALSE;
 }
 
-static void
-gtk_nodes_node_view_remove (GtkContainer *container,
-                            GtkWidget    *widget)
+/**
+ * _gtk_nodes_node_view_insert_edge:
+ * @node_view: the #GtkNodesNodeView the sink belongs to
+ * @source: the source #GtkNodesNodeSocket
+ * @sink: the sink #GtkNodesNodeSocket
+ *
+ * Called by sinks before connecting to a source. Enters the connection into
+ * the graph of the view, unless it would close a loop.
+ *
+ * Returns: FALSE if the connection would close a loop
+ */
+
+gboolean
+_gtk_nodes_node_view_insert_edge (GtkNodesNodeView   *node_view,
+                                  GtkNodesNodeSocket *source,
+                                  GtkNodesNodeSocket *sink)
 {
-  GtkNodesNodeView *node_view;
-  GtkNodesNodeViewPrivate *priv;
-  GtkNodesNodeViewChild *child = NULL;
-  GList *l;
+  GtkNodesNodeViewVertex *x;
+  GtkNodesNodeViewVertex *y;
+  guint cnt;
 
 
-  node_view = GTKNODES_NODE_VIEW (container);
-  priv = gtk_nodes_node_view_get_instance_private (node_view);
+  x = gtk_nodes_node_view_socket_get_vertex (node_view, GTK_WIDGET (source));
+  y = gtk_nodes_node_view_socket_get_vertex (node_view, GTK_WIDGET (sink));
 
-  l = priv->children;
+  /* we can only reason about nodes we manage */
+  if (x == NULL || y == NULL)
+    return TRUE;
 
-  while (l)
+  if (x == y)
+    return FALSE;
+
+  cnt = GPOINTER_TO_UINT (g_hash_table_lookup (x->succ, y));
+
+  if (!cnt && x->ord > y->ord)
     {
-      child = l->data;
+      GPtrArray *fwd;
+      GPtrArray *bwd;
 
-      if (child->widget == widget)
-        break;
+      fwd = g_ptr_array_new ();
 
-      l = l->next;
-    }
+      if (!gtk_nodes_node_view_search_forward (y, x, x->ord, fwd))
+        {
+          gtk_nodes_node_view_clear_visited (fwd);
+          g_ptr_array_unref (fwd);
 
-  if (l == NULL)
-    return;
+          return FALSE;
+        }
 
+      bwd = g_ptr_array_new ();
 
-  priv->children = g_list_remove_link (priv->children, l);
+      gtk_nodes_node_view_search_backward (x, y->ord, bwd);
 
-  gtk_widget_unparent (widget);
+      gtk_nodes_node_view_reorder (fwd, bwd);
+
+      gtk_nodes_node_view_clear_visited (fwd);
+      gtk_nodes_node_view_clear_visited (bwd);
+
+      g_ptr_array_unref (fwd);
+      g_ptr_array_unref (bwd);
+
+      gtk_nodes_node_view_invalidate_order (node_view);
+    }
+
+  g_hash_table_insert (x->succ, y, GUINT_TO_POINTER (cnt + 1));
+  g_hash_table_insert (y->pred, x, GUINT_TO_POINTER (cnt + 1));
 
-  g_slice_free (GtkNodesNodeViewChild, l->data);
-  g_list_free_1 (l);
+  return TRUE;
 }
 
 static void
-gtk_nodes_node_view_forall (GtkContainer  *container,
-                            gboolean       include_internals,
-                            GtkCallback    callback,
-                            gpointer       callback_data)
+gtk_nodes_node_view_remove_edge (GtkNodesNodeView *node_view,
+                                 GtkWidget        *source,
+                                 GtkWidget        *sink)
 {
-  GtkNodesNodeView *node_view;
-  GtkNodesNodeViewPrivate *priv;
-  GtkNodesNodeViewChild *c;
-  GtkWidget *w;
-  GList *l;
+  GtkNodesNodeViewVertex *x;
+  GtkNodesNodeViewVertex *y;
+  guint cnt;
 
-  node_view = GTKNODES_NODE_VIEW (container);
-  priv = gtk_nodes_node_view_get_instance_private (node_view);
 
-  l = priv->children;
+  x = gtk_nodes_node_view_socket_get_vertex (node_view, source);
+  y = gtk_nodes_node_view_socket_get_vertex (node_view, sink);
 
-  while (l)
-    {
-      c = l->data;
-      w = c->widget;
-      l = l->next;
+  if (x == NULL || y == NULL)
+    return;
 
-      (* callback) (w, callback_data);
+  cnt = GPOINTER_TO_UINT (g_hash_table_lookup (x->succ, y));
+
+  if (cnt > 1)
+    {
+      g_hash_table_insert (x->succ, y, GUINT_TO_POINTER (cnt - 1));
+      g_hash_table_insert (y->pred, x, GUINT_TO_POINTER (cnt - 1));
+      return;
     }
+
+  /* removing an edge never violates the order */
+  g_hash_table_remove (x->succ, y);
+  g_hash_table_remove (y->pred, x);
 }
 
-static GType
-gtk_nodes_node_view_child_type (GtkContainer *container)
+
+/* Scheduler */
+
+static void
+gtk_nodes_node_view_invalidate_order (GtkNodesNodeView *node_view)
 {
-  return GTKNODES_TYPE_NODE;
+  GtkNodesNodeViewPrivate *priv;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  g_clear_pointer (&priv->order, g_ptr_array_unref);
 }
 
-static void
-gtk_nodes_node_view_set_child_property (GtkContainer *container,
-                                        GtkWidget    *child,
-                                        guint         property_id,
-                                        const GValue *value,
-                                        GParamSpec   *pspec)
+static GtkWidget *
+gtk_nodes_node_view_socket_get_node (GtkWidget *socket)
 {
-  GtkNodesNodeViewChild *node_child;
-  GtkNodesNodeView *node_view = GTKNODES_NODE_VIEW (container);
+  return gtk_widget_get_ancestor (socket, GTKNODES_TYPE_NODE);
+}
 
-  node_child = gtk_nodes_node_view_get_child (node_view, child);
+/* the vertex ordinals are kept in topological order at all times, so we only
+ * need to sort them
+ */
 
-  if (node_child == NULL)
-    return;
+static GPtrArray *
+gtk_nodes_node_view_sort_nodes (GtkNodesNodeView *node_view)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GHashTableIter iter;
+  GPtrArray *order;
+  gpointer value;
+  guint i;
 
-  /* this is kinda stupid, but at the moment I don't see how I can save an
-   * XML description of the node view's contents and restore a (partial)
-   * configuration without tracking the child properties within the
-   * node children as well */
 
-  switch (property_id)
-  {
-  case CHILD_PROP_X:
-    node_child->rectangle.x = g_value_get_int (value);
-    if (GTKNODES_IS_NODE (node_child->widget))
-      g_object_set (G_OBJECT(node_child->widget),
-                    "x", node_child->rectangle.x, NULL);
-    gtk_widget_queue_allocate(child);
-    break;
-  case CHILD_PROP_Y:
-    node_child->rectangle.y = g_value_get_int (value);
-    if (GTKNODES_IS_NODE (node_child->widget))
-      g_object_set (G_OBJECT(node_child->widget),
-                    "y", node_child->rectangle.x, NULL);
-    gtk_widget_queue_allocate(child);
-    break;
-  case CHILD_PROP_WIDTH:
-    node_child->rectangle.width = g_value_get_int (value);
-    if (GTKNODES_IS_NODE (node_child->widget))
-      g_object_set (G_OBJECT(node_child->widget),
-                    "width", node_child->rectangle.width, NULL);
-    gtk_widget_queue_allocate(child);
-    break;
-  case CHILD_PROP_HEIGHT:
-    node_child->rectangle.height = g_value_get_int (value);
-    if (GTKNODES_IS_NODE (node_child->widget))
-      g_object_set (G_OBJECT(node_child->widget),
-                    "height", node_child->rectangle.height, NULL);
-    gtk_widget_queue_allocate(child);
-    break;
-  default:
-    GTK_CONTAINER_WARN_INVALID_CHILD_PROPERTY_ID (container, property_id, pspec);
-      break;
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  order = g_ptr_array_sized_new (g_hash_table_size (priv->vertices));
+
+  g_hash_table_iter_init (&iter, priv->vertices);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    g_ptr_array_add (order, value);
+
+  g_ptr_array_sort (order, gtk_nodes_node_view_vertex_cmp);
+
+  for (i = 0; i < order->len; i++)
+    {
+      GtkNodesNodeViewVertex *v = g_ptr_array_index (order, i);
+
+      g_ptr_array_index (order, i) = v->node;
     }
+
+  return order;
 }
 
 static void
-gtk_nodes_node_view_get_child_property (GtkContainer *container,
-                                        GtkWidget    *child,
-                                        guint         property_id,
-                                        GValue       *value,
-                                        GParamSpec   *pspec)
+gtk_nodes_node_view_start_ticking (GtkNodesNodeView *node_view)
 {
-  GtkNodesNodeViewChild *node_child;
-  GtkNodesNodeView *node_view = GTKNODES_NODE_VIEW (container);
+  GtkNodesNodeViewPrivate *priv;
 
-  node_child = gtk_nodes_node_view_get_child (node_view, child);
 
-  if (node_child == NULL)
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  if (!priv->tick_id)
+    priv->tick_id = g_idle_add_full (SCHEDULER_PRIORITY,
+                                     gtk_nodes_node_view_tick,
+                                     node_view, NULL);
+}
+
+static gboolean
+gtk_nodes_node_view_frame (GtkWidget     *widget,
+                           GdkFrameClock *frame_clock,
+                           gpointer       user_data)
+{
+  GtkNodesNodeViewPrivate *priv;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (GTKNODES_NODE_VIEW (widget));
+
+  priv->frame_id = 0;
+
+  gtk_nodes_node_view_start_ticking (GTKNODES_NODE_VIEW (widget));
+
+  return G_SOURCE_REMOVE;
+}
+
+/* work left over from a tick, i.e. a feedback loop going round, waits for
+ * the next frame, so the loop can not starve redraws and idle handlers
+ */
+static void
+gtk_nodes_node_view_next_round (GtkNodesNodeView *node_view)
+{
+  GtkNodesNodeViewPrivate *priv;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  if (priv->tick_id || priv->frame_id)
     return;
 
-  switch (property_id)
+  if (gtk_widget_get_mapped (GTK_WIDGET (node_view)))
+    priv->frame_id = gtk_widget_add_tick_callback (GTK_WIDGET (node_view),
+                                                   gtk_nodes_node_view_frame,
+                                                   NULL, NULL);
+  else
+    priv->tick_id = g_idle_add_full (FEEDBACK_PRIORITY,
+                                     gtk_nodes_node_view_tick,
+                                     node_view, NULL);
+}
+
+static gboolean
+gtk_nodes_node_view_schedule (GtkNodesNodeView   *node_view,
+                              GtkNodesNodeSocket *sink,
+                              GBytes             *payload)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GtkWidget *node;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  node = gtk_nodes_node_view_socket_get_node (GTK_WIDGET (sink));
+
+  /* only our own nodes are ever evaluated */
+  if (node == NULL || !g_hash_table_contains (priv->vertices, node))
+    return FALSE;
+
+  /* a newer payload replaces one not yet delivered */
+  g_hash_table_insert (priv->pending, g_object_ref (sink),
+                       g_bytes_ref (payload));
+
+  g_hash_table_add (priv->dirty, g_object_ref (node));
+
+  gtk_nodes_node_view_start_ticking (node_view);
+
+  return TRUE;
+}
+
+static gboolean
+gtk_nodes_node_view_tick (gpointer data)
+{
+  GtkNodesNodeView *node_view;
+  GtkNodesNodeViewPrivate *priv;
+  GPtrArray *order;
+  guint i;
+
+
+  node_view = GTKNODES_NODE_VIEW (data);
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  /* payloads on feedback connections written during the last tick are
+   * delivered now, anything they cause to loop back waits for the next one
+   */
+  if (g_hash_table_size (priv->feedback))
     {
-    case CHILD_PROP_X:
-      if (GTKNODES_IS_NODE (node_child->widget))
-        g_object_get (G_OBJECT(node_child->widget),
-                      "x", &node_child->rectangle.x, NULL);
-      g_value_set_int (value, node_child->rectangle.x);
-      break;
-    case CHILD_PROP_Y:
-      if (GTKNODES_IS_NODE (node_child->widget))
-        g_object_get (G_OBJECT(node_child->widget),
-                      "x", &node_child->rectangle.y, NULL);
-      g_value_set_int (value, node_child->rectangle.y);
-      break;
-    case CHILD_PROP_WIDTH:
-      if (GTKNODES_IS_NODE (node_child->widget))
-        g_object_get (G_OBJECT(node_child->widget),
-                      "width", &node_child->rectangle.width, NULL);
-      g_value_set_int (value, node_child->rectangle.width);
-      break;
-    case CHILD_PROP_HEIGHT:
-      if (GTKNODES_IS_NODE (node_child->widget))
-        g_object_get (G_OBJECT(node_child->widget),
-                      "height", &node_child->rectangle.height, NULL);
-      g_value_set_int (value, node_child->rectangle.height);
-      break;
-    default:
-      GTK_CONTAINER_WARN_INVALID_CHILD_PROPERTY_ID (container, property_id, pspec);
-      break;
+      GHashTable *feedback;
+      GHashTableIter iter;
+      gpointer key, value;
+
+      feedback = priv->feedback;
+      priv->feedback = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                              g_object_unref,
+                                              (GDestroyNotify) g_bytes_unref);
+
+      g_hash_table_iter_init (&iter, feedback);
+
+      while (g_hash_table_iter_next (&iter, &key, &value))
+        if (!gtk_nodes_node_view_schedule (node_view, key, value))
+          gtk_nodes_node_socket_write_bytes (key, value);
+
+      g_hash_table_unref (feedback);
+    }
+
+  if (priv->order == NULL)
+    priv->order = gtk_nodes_node_view_sort_nodes (node_view);
+
+  /* evaluation may change the graph, so hold on to the current order */
+  order = g_ptr_array_ref (priv->order);
+
+  for (i = 0; i < order->len; i++)
+    {
+      GtkWidget *node = g_ptr_array_index (order, i);
+      GList *sinks;
+      GList *l;
+
+      if (!g_hash_table_steal (priv->dirty, node))
+        continue;
+
+      /* evaluate the node: latch the latest payload of each of its sinks,
+       * then let it compute its outputs from all of them at once
+       */
+      sinks = gtk_nodes_node_get_sinks (GTKNODES_NODE (node));
+
+      for (l = sinks; l; l = l->next)
+        {
+          GtkNodesNodeSocket *sink = l->data;
+          GBytes *payload;
+
+          if (!g_hash_table_lookup_extended (priv->pending, sink, NULL,
+                                             (gpointer *) &payload))
+            continue;
+
+          g_hash_table_steal (priv->pending, sink);
+
+          /* the sink may have been disconnected while the payload waited */
+          if (gtk_nodes_node_socket_get_input (sink) != NULL)
+            gtk_nodes_node_socket_write_bytes (sink, payload);
+
+          g_bytes_unref (payload);
+          g_object_unref (sink);
+        }
+
+      g_list_free (sinks);
+
+      gtk_nodes_node_evaluate (GTKNODES_NODE (node));
+
+      g_object_unref (node);
+    }
+
+  g_ptr_array_unref (order);
+
+  priv->tick_id = 0;
+
+  /* nodes upstream of one evaluated in this tick are due on the next one */
+  if (g_hash_table_size (priv->dirty) || g_hash_table_size (priv->feedback))
+    gtk_nodes_node_view_next_round (node_view);
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * _gtk_nodes_node_view_route_payload:
+ * @node_view: the #GtkNodesNodeView the sink belongs to
+ * @sink: the receiving #GtkNodesNodeSocket
+ * @payload: the payload
+ *
+ * Called by sinks before delivering a payload from their source.
+ *
+ * Returns: TRUE if the view took over the delivery, FALSE if the sink
+ *          must deliver the payload itself
+ */
+
+gboolean
+_gtk_nodes_node_view_route_payload (GtkNodesNodeView   *node_view,
+                                    GtkNodesNodeSocket *sink,
+                                    GBytes             *payload)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GtkNodesNodeViewDelivery *d;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  /* feedback is always held back until the next tick, so a loop can
+   * never recurse
+   */
+  if (gtk_nodes_node_socket_get_feedback (sink))
+    {
+      g_hash_table_insert (priv->feedback, g_object_ref (sink),
+                           g_bytes_ref (payload));
+
+      gtk_nodes_node_view_start_ticking (node_view);
+
+      return TRUE;
+    }
+
+  if (priv->transport == GTKNODES_NODE_VIEW_TRANSPORT_SYNC)
+    return FALSE;
+
+  if (priv->transport == GTKNODES_NODE_VIEW_TRANSPORT_SCHEDULED)
+    return gtk_nodes_node_view_schedule (node_view, sink, payload);
+
+  d = g_slice_new (GtkNodesNodeViewDelivery);
+
+  /* the source wrote past the credit of the sink */
+  if (!_gtk_nodes_node_socket_queue_push (sink, &d->connection))
+    {
+      g_debug ("Node Socket %p has no credit left, payload dropped",
+               (void *) sink);
+
+      g_slice_free (GtkNodesNodeViewDelivery, d);
+      return TRUE;
     }
+
+  d->sink    = g_object_ref (sink);
+  d->payload = g_bytes_ref (payload);
+
+  g_queue_push_tail (&priv->deliveries, d);
+
+  /* idle priority, so redraws and input events go first */
+  if (!priv->dispatch_id)
+    priv->dispatch_id = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+                                         gtk_nodes_node_view_dispatch,
+                                         node_view, NULL);
+
+  return TRUE;
+}
+
+
+/* Container Methods */
+
+/* the id belongs to a node or is reserved for one not built yet */
+
+static gboolean
+gtk_nodes_node_view_id_taken (GtkNodesNodeView *node_view,
+                              guint             id)
+{
+  GtkNodesNodeViewPrivate *priv;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  return g_hash_table_contains (priv->id_index,   GUINT_TO_POINTER (id)) ||
+         g_hash_table_contains (priv->lazy_index, GUINT_TO_POINTER (id));
 }
 
 static void
-gtk_nodes_node_view_connection_mapper (GtkBuilder    *builder,
-                                       GObject       *object,
-                                       const gchar   *signal_name,
-                                       const gchar   *handler_name,
-                                       GObject       *connect_object,
-                                       GConnectFlags  flags,
-                                       gpointer       user_data)
+gtk_nodes_node_view_child_id_notify (GObject    *object,
+                                     GParamSpec *pspec,
+                                     gpointer    user_data)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GtkNodesNodeViewChild *child;
+  guint id;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (GTKNODES_NODE_VIEW (user_data));
+
+  child = g_hash_table_lookup (priv->child_index, object);
+
+  if (child == NULL)
+    return;
+
+  g_object_get (object, "id", &id, NULL);
+
+  if (g_hash_table_lookup (priv->id_index, GUINT_TO_POINTER (child->id)) == child)
+    g_hash_table_remove (priv->id_index, GUINT_TO_POINTER (child->id));
+
+  child->id = id;
+
+  g_hash_table_insert (priv->id_index, GUINT_TO_POINTER (child->id), child);
+}
+
+static void
+gtk_nodes_node_view_add (GtkContainer *container,
+                         GtkWidget    *widget)
+{
+  GtkNodesNodeView *node_view;
+  GtkNodesNodeViewPrivate *priv;
+  GtkNodesNodeViewChild *child;
+
+
+  g_return_if_fail (GTKNODES_IS_NODE_VIEW (container));
+  g_return_if_fail (GTK_IS_WIDGET (widget));
+
+  node_view = GTKNODES_NODE_VIEW (container);
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  child = g_slice_new (GtkNodesNodeViewChild);
+
+  child->widget = widget;
+  child->rectangle.x      = 100;
+  child->rectangle.y      = 100;
+  child->rectangle.width  = 100;
+  child->rectangle.height = 100;
+
+  child->south_east.x      = child->rectangle.width  - RESIZE_RECTANGLE;
+  child->south_east.y      = child->rectangle.height - RESIZE_RECTANGLE;
+  child->south_east.width  = RESIZE_RECTANGLE;
+  child->south_east.height = RESIZE_RECTANGLE;
+
+
+  gtk_widget_add_events(widget, GDK_BUTTON_PRESS_MASK |
+                        GDK_BUTTON_RELEASE_MASK |
+                        GDK_BUTTON1_MOTION_MASK);
+
+  g_signal_connect(G_OBJECT (widget),
+                   "button-press-event",
+                   G_CALLBACK (gtk_nodes_node_view_child_button_press_event),
+                   child);
+
+  g_signal_connect(G_OBJECT (widget),
+                   "button-release-event",
+                   G_CALLBACK (gtk_nodes_node_view_child_button_release_event),
+                   child);
+
+  g_signal_connect(G_OBJECT (widget),
+                   "motion-notify-event",
+                   G_CALLBACK (gtk_nodes_node_view_child_motion_notify_event),
+                   child);
+#if 0
+  g_signal_connect (G_OBJECT (widget),
+                    "enter-notify-event",
+                    G_CALLBACK (gtk_nodes_node_view_child_pointer_crossing_event),
+                    NULL);
+#endif
+  g_signal_connect (G_OBJECT (widget),
+                    "leave-notify-event",
+                    G_CALLBACK (gtk_nodes_node_view_child_pointer_crossing_event),
+                    NULL);
+
+
+
+  /* the things we do for glade... */
+  if (GTKNODES_IS_NODE (child->widget))
+    {
+      g_signal_connect(G_OBJECT (widget),
+                       "node-socket-drag-begin",
+                       G_CALLBACK (gtk_nodes_node_view_socket_drag_begin_event),
+                       priv);
+
+      g_signal_connect(G_OBJECT (widget),
+                       "node-socket-drag-end",
+                       G_CALLBACK (gtk_nodes_node_view_socket_drag_end_event),
+                       priv);
+
+      g_signal_connect(G_OBJECT (widget),
+                       "node-socket-connect",
+                       G_CALLBACK (gtk_nodes_node_view_socket_connect_event),
+                       node_view);
+
+      g_signal_connect(G_OBJECT (widget),
+                       "node-socket-disconnect",
+                       G_CALLBACK (gtk_nodes_node_view_socket_disconnect_event),
+                       node_view);
+
+      g_signal_connect(G_OBJECT (widget),
+                       "node-socket-destroyed",
+                       G_CALLBACK (gtk_nodes_node_view_socket_destroyed_event),
+                       node_view);
+
+      child->id = priv->node_id++;
+
+      /* nodes restored from a file keep their id unless it is taken */
+      if (priv->keep_ids)
+        {
+          guint id;
+
+          g_object_get (G_OBJECT (widget), "id", &id, NULL);
+
+          if (!gtk_nodes_node_view_id_taken (node_view, id))
+            {
+              priv->node_id--;
+              child->id = id;
+              priv->node_id = MAX (priv->node_id, id + 1);
+            }
+        }
+
+      g_object_set (G_OBJECT (child->widget), "id", child->id, NULL);
+      g_hash_table_insert (priv->id_index, GUINT_TO_POINTER (child->id), child);
+
+      /* keep the index in sync if someone else changes the id */
+      g_signal_connect (G_OBJECT (widget),
+                        "notify::id",
+                        G_CALLBACK (gtk_nodes_node_view_child_id_notify),
+                        node_view);
+
+      gtk_nodes_node_view_add_vertex (node_view, widget);
+
+      gtk_nodes_node_view_journal_add (node_view, child);
+    }
+
+  g_queue_push_tail (&priv->children, child);
+  child->link  = priv->children.tail;
+  child->stack = ++priv->stack_serial;
+
+  g_hash_table_insert (priv->child_index, widget, child);
+
+  gtk_nodes_node_view_invalidate_order (node_view);
+
+  if (gtk_widget_get_realized (GTK_WIDGET (node_view)))
+    gtk_widget_set_parent_window (child->widget, priv->event_window);
+
+  gtk_widget_set_parent (widget, GTK_WIDGET (container));
+}
+
+static GtkNodesNodeViewChild*
+gtk_nodes_node_view_get_child (GtkNodesNodeView  *node_view,
+                               GtkWidget *widget)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GtkNodesNodeViewChild *child;
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  child = g_hash_table_lookup (priv->child_index, widget);
+
+  if (child)
+    return child;
+
+  g_warning ("GtkWidget %p is not a child of GtkNodeView %p",
+             (void *) widget, (void *) node_view);
+
+  return NULL;
+}
+
+static void
+gtk_nodes_node_view_cursor_init (GtkNodesNodeView *node_view)
+{
+	GdkDisplay *display;
+  GtkNodesNodeViewPrivate *priv;
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+	display = gtk_widget_get_display (GTK_WIDGET (node_view));
+
+  priv->cursor_default   = gdk_cursor_new_from_name (display, "default");
+  priv->cursor_se_resize = gdk_cursor_new_from_name (display, "se-resize");
+}
+
+static void
+gtk_nodes_node_cursor_set (GtkNodesNodeView *node_view, Action action)
+{
+  GdkCursor *cursor;
+	GdkWindow *window;
+  GtkNodesNodeViewPrivate *priv;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+	window  = gtk_widget_get_window (GTK_WIDGET (node_view));
+
+  switch (action)
+    {
+      case ACTION_RESIZE:
+        cursor = priv->cursor_se_resize;
+        break;
+      case ACTION_NONE:
+      default:
+        cursor = priv->cursor_default;
+        break;
+    }
+
+  gdk_window_set_cursor(window, cursor);
+}
+
+static gboolean
+gtk_nodes_node_view_drag_motion (GtkWidget      *widget,
+                                 GdkDragContext *context,
+                                 gint            x,
+                                 gint            y,
+                                 guint           time,
+                                 GtkNodesNodeViewPrivate *priv)
+{
+  priv->x1 = x;
+  priv->y1 = y;
+
+  gtk_widget_queue_draw(widget);
+
+  return GDK_EVENT_PROPAGATE;
+
+}
+
+static gboolean
+gtk_nodes_node_view_button_press_event (GtkWidget      *widget,
+                                        GdkEventButton *event)
+{
+  GTK_WIDGET_CLASS (gtk_nodes_node_view_parent_class)->button_press_event (widget, event);
+
+  return FALSE;
+}
+
+static gboolean
+gtk_nodes_node_view_motion_notify_event (GtkWidget      *widget,
+                                   GdkEventMotion *event)
+{
+  GTK_WIDGET_CLASS (gtk_nodes_node_view_parent_class)->motion_notify_event (widget, event);
+
+  return FALSE;
+}
+
+static void
+gtk_nodes_node_view_remove (GtkContainer *container,
+                            GtkWidget    *widget)
+{
+  GtkNodesNodeView *node_view;
+  GtkNodesNodeViewPrivate *priv;
+  GtkNodesNodeViewChild *child;
+
+
+  node_view = GTKNODES_NODE_VIEW (container);
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  child = g_hash_table_lookup (priv->child_index, widget);
+
+  if (child == NULL)
+    return;
+
+  g_hash_table_remove (priv->child_index, widget);
+
+  g_queue_delete_link (&priv->children, child->link);
+
+  _gtk_nodes_node_grid_remove (priv->node_grid, child);
+
+  if (GTKNODES_IS_NODE (widget))
+    {
+      GList *sockets;
+      GList *s;
+
+      if (g_hash_table_lookup (priv->id_index, GUINT_TO_POINTER (child->id)) == child)
+        g_hash_table_remove (priv->id_index, GUINT_TO_POINTER (child->id));
+
+      gtk_nodes_node_view_journal (node_view, "R %u\n", child->id);
+
+      /* the node's sockets will not report to us anymore */
+      sockets = g_list_concat (gtk_nodes_node_get_sinks (GTKNODES_NODE (widget)),
+                               gtk_nodes_node_get_sources (GTKNODES_NODE (widget)));
+
+      for (s = sockets; s; s = s->next)
+        gtk_nodes_node_view_forget_socket (node_view, s->data);
+
+      g_list_free (sockets);
+    }
+
+  g_signal_handlers_disconnect_by_data (widget, node_view);
+  g_signal_handlers_disconnect_by_data (widget, priv);
+  g_signal_handlers_disconnect_by_data (widget, child);
+  g_signal_handlers_disconnect_by_func (widget,
+                                        gtk_nodes_node_view_child_pointer_crossing_event,
+                                        NULL);
+
+  gtk_nodes_node_view_invalidate_order (node_view);
+
+  /* the scheduler must not evaluate a node that is gone */
+  if (priv->dirty && GTKNODES_IS_NODE (widget))
+    {
+      GList *sinks;
+      GList *s;
+
+      g_hash_table_remove (priv->dirty, widget);
+
+      sinks = gtk_nodes_node_get_sinks (GTKNODES_NODE (widget));
+
+      for (s = sinks; s; s = s->next)
+        {
+          g_hash_table_remove (priv->pending,  s->data);
+          g_hash_table_remove (priv->feedback, s->data);
+        }
+
+      g_list_free (sinks);
+    }
+
+  g_hash_table_remove (priv->vertices, widget);
+
+  gtk_widget_unparent (widget);
+
+  g_slice_free (GtkNodesNodeViewChild, child);
+}
+
+static void
+gtk_nodes_node_view_forall (GtkContainer  *container,
+                            gboolean       include_internals,
+                            GtkCallback    callback,
+                            gpointer       callback_data)
+{
+  GtkNodesNodeView *node_view;
+  GtkNodesNodeViewPrivate *priv;
+  GtkNodesNodeViewChild *c;
+  GtkWidget *w;
+  GList *l;
+
+  node_view = GTKNODES_NODE_VIEW (container);
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  l = priv->children.head;
+
+  while (l)
+    {
+      c = l->data;
+      w = c->widget;
+      l = l->next;
+
+      (* callback) (w, callback_data);
+    }
+}
+
+static GType
+gtk_nodes_node_view_child_type (GtkContainer *container)
+{
+  return GTKNODES_TYPE_NODE;
+}
+
+static void
+gtk_nodes_node_view_set_child_property (GtkContainer *container,
+                                        GtkWidget    *child,
+                                        guint         property_id,
+                                        const GValue *value,
+                                        GParamSpec   *pspec)
+{
+  GtkNodesNodeViewChild *node_child;
+  GtkNodesNodeView *node_view = GTKNODES_NODE_VIEW (container);
+
+  node_child = gtk_nodes_node_view_get_child (node_view, child);
+
+  if (node_child == NULL)
+    return;
+
+  /* this is kinda stupid, but at the moment I don't see how I can save an
+   * XML description of the node view's contents and restore a (partial)
+   * configuration without tracking the child properties within the
+   * node children as well */
+
+  switch (property_id)
+  {
+  case CHILD_PROP_X:
+    node_child->rectangle.x = g_value_get_int (value);
+    if (GTKNODES_IS_NODE (node_child->widget))
+      g_object_set (G_OBJECT(node_child->widget),
+                    "x", node_child->rectangle.x, NULL);
+    gtk_widget_queue_allocate(child);
+    break;
+  case CHILD_PROP_Y:
+    node_child->rectangle.y = g_value_get_int (value);
+    if (GTKNODES_IS_NODE (node_child->widget))
+      g_object_set (G_OBJECT(node_child->widget),
+                    "y", node_child->rectangle.x, NULL);
+    gtk_widget_queue_allocate(child);
+    break;
+  case CHILD_PROP_WIDTH:
+    node_child->rectangle.width = g_value_get_int (value);
+    if (GTKNODES_IS_NODE (node_child->widget))
+      g_object_set (G_OBJECT(node_child->widget),
+                    "width", node_child->rectangle.width, NULL);
+    gtk_widget_queue_allocate(child);
+    break;
+  case CHILD_PROP_HEIGHT:
+    node_child->rectangle.height = g_value_get_int (value);
+    if (GTKNODES_IS_NODE (node_child->widget))
+      g_object_set (G_OBJECT(node_child->widget),
+                    "height", node_child->rectangle.height, NULL);
+    gtk_widget_queue_allocate(child);
+    break;
+  default:
+    GTK_CONTAINER_WARN_INVALID_CHILD_PROPERTY_ID (container, property_id, pspec);
+      break;
+    }
+
+  gtk_nodes_node_view_journal_move (node_view, node_child);
+}
+
+static void
+gtk_nodes_node_view_get_child_property (GtkContainer *container,
+                                        GtkWidget    *child,
+                                        guint         property_id,
+                                        GValue       *value,
+                                        GParamSpec   *pspec)
+{
+  GtkNodesNodeViewChild *node_child;
+  GtkNodesNodeView *node_view = GTKNODES_NODE_VIEW (container);
+
+  node_child = gtk_nodes_node_view_get_child (node_view, child);
+
+  if (node_child == NULL)
+    return;
+
+  switch (property_id)
+    {
+    case CHILD_PROP_X:
+      if (GTKNODES_IS_NODE (node_child->widget))
+        g_object_get (G_OBJECT(node_child->widget),
+                      "x", &node_child->rectangle.x, NULL);
+      g_value_set_int (value, node_child->rectangle.x);
+      break;
+    case CHILD_PROP_Y:
+      if (GTKNODES_IS_NODE (node_child->widget))
+        g_object_get (G_OBJECT(node_child->widget),
+                      "x", &node_child->rectangle.y, NULL);
+      g_value_set_int (value, node_child->rectangle.y);
+      break;
+    case CHILD_PROP_WIDTH:
+      if (GTKNODES_IS_NODE (node_child->widget))
+        g_object_get (G_OBJECT(node_child->widget),
+                      "width", &node_child->rectangle.width, NULL);
+      g_value_set_int (value, node_child->rectangle.width);
+      break;
+    case CHILD_PROP_HEIGHT:
+      if (GTKNODES_IS_NODE (node_child->widget))
+        g_object_get (G_OBJECT(node_child->widget),
+                      "height", &node_child->rectangle.height, NULL);
+      g_value_set_int (value, node_child->rectangle.height);
+      break;
+    default:
+      GTK_CONTAINER_WARN_INVALID_CHILD_PROPERTY_ID (container, property_id, pspec);
+      break;
+    }
+}
+
+static void
+gtk_nodes_node_view_connection_mapper (GtkBuilder    *builder,
+                                       GObject       *object,
+                                       const gchar   *signal_name,
+                                       const gchar   *handler_name,
+                                       GObject       *connect_object,
+                                       GConnectFlags  flags,
+                                       gpointer       user_data)
+{
+  GtkNodesNodeSocket *sink = NULL;
+  GtkNodesNodeSocket *source = NULL;
+  GList *l;
+  GList *sockets;
+
+  guint id_source;
+  guint id_sink;
+
+  /* retrieve sink and source ids from handler name */
+  sscanf(handler_name, "%u_%u", &id_source, &id_sink);
+
+  sockets = gtk_nodes_node_get_sources (GTKNODES_NODE (connect_object));
+
+  l = sockets;
+
+  while (l)
+    {
+      guint id;
+
+      g_object_get(GTKNODES_NODE_SOCKET (l->data), "id", &id, NULL);
+
+      if (id == id_source)
+        {
+          source = GTKNODES_NODE_SOCKET (l->data);
+          break;
+        }
+
+      l = l->next;
+    }
+
+
+  sockets = gtk_nodes_node_get_sinks (GTKNODES_NODE (object));
+  l = sockets;
+
+  while (l)
+    {
+      guint id;
+
+      g_object_get(GTKNODES_NODE_SOCKET (l->data), "id", &id, NULL);
+
+      if (id == id_sink)
+        {
+          sink = GTKNODES_NODE_SOCKET (l->data);
+          break;
+        }
+
+      l = l->next;
+    }
+
+  if (source == NULL || sink == NULL)
+    return;
+
+  gtk_nodes_node_socket_connect_sockets (sink, source);
+}
+
+
+
+
+
+
+/* the connection recorded for a node not built yet still holds */
+
+static gboolean
+gtk_nodes_node_view_edge_valid (GtkNodesNodeView     *node_view,
+                                GtkNodesNodeViewEdge *edge)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GtkNodesNodeViewChild *child;
+  GList *sinks;
+  GList *l;
+  gboolean valid = FALSE;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  if (!gtk_nodes_node_view_id_taken (node_view, edge->node_source))
+    return FALSE;
+
+  child = g_hash_table_lookup (priv->id_index, GUINT_TO_POINTER (edge->node_sink));
+
+  if (child == NULL)
+    return g_hash_table_contains (priv->lazy_index,
+                                  GUINT_TO_POINTER (edge->node_sink));
+
+  /* the sink was built and connected to something else in the meantime */
+  sinks = gtk_nodes_node_get_sinks (GTKNODES_NODE (child->widget));
+
+  for (l = sinks; l; l = l->next)
+    {
+      if ((guint) gtk_nodes_node_socket_get_id (l->data) != edge->sink)
+        continue;
+
+      valid = gtk_nodes_node_socket_get_input (l->data) == NULL;
+      break;
+    }
+
+  g_list_free (sinks);
+
+  return valid;
+}
+
+/* describe the nodes not built yet as they were loaded */
+
+static void
+gtk_nodes_node_view_capture_records (GtkNodesNodeView  *node_view,
+                                     GtkNodesNodeGraph *graph)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GHashTableIter iter;
+  gpointer value;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  g_hash_table_iter_init (&iter, priv->lazy_index);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      GtkNodesNodeViewRecord *rec = value;
+      GtkNodesNodeGraphNode *node;
+      gchar id_node[16];
+      guint i;
+
+      g_snprintf (id_node, sizeof (id_node), "%u", rec->id);
+
+      node = _gtk_nodes_node_graph_add_node (graph, rec->node->type_name,
+                                             id_node);
+
+      /* the id may differ from the one in the file it came from */
+      for (i = 0; i + 1 < rec->node->properties->len; i += 2)
+        {
+          const gchar *name = g_ptr_array_index (rec->node->properties, i);
+
+          if (strcmp (name, "id"))
+            _gtk_nodes_node_graph_node_add_property (node, name,
+                                                     g_ptr_array_index (rec->node->properties,
+                                                                        i + 1));
+        }
+
+      _gtk_nodes_node_graph_node_add_property (node, "id", id_node);
+
+      if (rec->node->markup)
+        node->markup = g_string_new_len (rec->node->markup->str,
+                                         rec->node->markup->len);
+
+      if (rec->node->state)
+        node->state = g_bytes_ref (rec->node->state);
+
+      for (i = 0; rec->node->values && i < rec->node->values->len; i++)
+        {
+          GtkNodesNodeGraphValue *value;
+
+          value = g_ptr_array_index (rec->node->values, i);
+
+          _gtk_nodes_node_graph_node_add_value (node, value->socket,
+                                                value->source,
+                                                value->payload,
+                                                value->digest);
+        }
+
+      /* edges between two records are listed with both, take the sink's */
+      for (i = 0; i < rec->edges->len; i++)
+        {
+          GtkNodesNodeViewEdge *edge;
+          gchar id_source[16];
+          gchar id_sink[16];
+
+          edge = &g_array_index (rec->edges, GtkNodesNodeViewEdge, i);
+
+          if (edge->node_sink != rec->id &&
+              g_hash_table_contains (priv->lazy_index,
+                                     GUINT_TO_POINTER (edge->node_sink)))
+            continue;
+
+          if (!gtk_nodes_node_view_edge_valid (node_view, edge))
+            continue;
+
+          g_snprintf (id_source, sizeof (id_source), "%u", edge->node_source);
+          g_snprintf (id_sink,   sizeof (id_sink),   "%u", edge->node_sink);
+
+          _gtk_nodes_node_graph_add_connection (graph, id_source, edge->source,
+                                                id_sink, edge->sink);
+        }
+    }
+}
+
+/* copy the streamed state of a node, so it can be saved without it */
+
+static void
+gtk_nodes_node_view_capture_state (GtkNodesNodeGraphNode *node,
+                                   GtkNodesNode          *widget)
+{
+  GOutputStream *out;
+  GError *error = NULL;
+
+
+  out = g_memory_output_stream_new_resizable ();
+
+  if (gtk_nodes_node_export_state (widget, out, NULL, &error) &&
+      g_output_stream_close (out, NULL, &error))
+    {
+      node->state = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (out));
+    }
+  else
+    {
+      g_warning ("Error exporting state of %s: %s",
+                 G_OBJECT_TYPE_NAME (widget),
+                 error ? error->message : "unknown error");
+      g_clear_error (&error);
+    }
+
+  g_object_unref (out);
+}
+
+/* record the cached values of the sockets of a node */
+
+static void
+gtk_nodes_node_view_capture_values (GtkNodesNodeGraphNode *node,
+                                    GtkNodesNode          *widget)
+{
+  GList *sockets;
+  GList *l;
+
+
+  sockets = gtk_nodes_node_get_sources (widget);
+
+  for (l = sockets; l; l = l->next)
+    {
+      GBytes *payload;
+
+      if (!gtk_nodes_node_socket_get_cache (l->data))
+        continue;
+
+      payload = gtk_nodes_node_socket_get_cached (l->data);
+
+      if (payload)
+        _gtk_nodes_node_graph_node_add_value (node,
+                                              gtk_nodes_node_socket_get_id (l->data),
+                                              TRUE, payload, NULL);
+    }
+
+  g_list_free (sockets);
+
+  sockets = gtk_nodes_node_get_sinks (widget);
+
+  for (l = sockets; l; l = l->next)
+    {
+      const gchar *digest;
+
+      if (!gtk_nodes_node_socket_get_cache (l->data))
+        continue;
+
+      digest = gtk_nodes_node_socket_get_cached_digest (l->data);
+
+      if (digest)
+        _gtk_nodes_node_graph_node_add_value (node,
+                                              gtk_nodes_node_socket_get_id (l->data),
+                                              FALSE, NULL, digest);
+    }
+
+  g_list_free (sockets);
+}
+
+/* describe a node without its connections, if @live is set, its state is
+ * streamed from it when the graph is written
+ */
+
+static GtkNodesNodeGraphNode *
+gtk_nodes_node_view_capture_node (GtkNodesNodeGraph *graph,
+                                  GtkWidget         *widget,
+                                  gboolean           live)
+{
+  GtkNodesNodeGraphNode *node;
+  gchar *internal_cfg;
+  gchar id_node[16];
+  gchar buf[16];
+  guint x, y, width, height, id;
+
+
+  g_object_get(widget, "x", &x, "y", &y,
+               "width", &width, "height", &height,
+               "id", &id, NULL);
+
+  g_snprintf (id_node, sizeof (id_node), "%d", id);
+
+  node = _gtk_nodes_node_graph_add_node (graph,
+                                         G_OBJECT_TYPE_NAME (widget),
+                                         id_node);
+
+  g_snprintf (buf, sizeof (buf), "%d", x);
+  _gtk_nodes_node_graph_node_add_property (node, "x", buf);
+  g_snprintf (buf, sizeof (buf), "%d", y);
+  _gtk_nodes_node_graph_node_add_property (node, "y", buf);
+  g_snprintf (buf, sizeof (buf), "%d", width);
+  _gtk_nodes_node_graph_node_add_property (node, "width", buf);
+  g_snprintf (buf, sizeof (buf), "%d", height);
+  _gtk_nodes_node_graph_node_add_property (node, "height", buf);
+  _gtk_nodes_node_graph_node_add_property (node, "id", id_node);
+
+  /* meh...*/
+  internal_cfg = gtk_nodes_node_export_properties(GTKNODES_NODE (widget));
+
+  if (internal_cfg != NULL)
+    {
+      node->markup = g_string_new (internal_cfg);
+      g_free (internal_cfg);
+    }
+
+  gtk_nodes_node_view_capture_values (node, GTKNODES_NODE (widget));
+
+  if (GTKNODES_NODE_GET_CLASS (widget)->export_state == NULL)
+    return node;
+
+  if (live)
+    node->widget = g_object_ref (widget);
+  else
+    gtk_nodes_node_view_capture_state (node, GTKNODES_NODE (widget));
+
+  return node;
+}
+
+/* describe the nodes and their connections, if @live is set, node states
+ * are streamed from the nodes when the graph is written
+ */
+
+static GtkNodesNodeGraph *
+gtk_nodes_node_view_capture (GtkNodesNodeView *node_view,
+                             gboolean          live)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GtkNodesNodeGraph *graph;
+  GList *l;
+  GList *s;
+  GList *sockets;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  graph = _gtk_nodes_node_graph_new ();
+
+  for (l = priv->children.head; l; l = l->next)
+    {
+      GtkNodesNodeViewChild *child = l->data;
+      GtkNodesNodeGraphNode *node;
+      gchar buf[16];
+
+      if (!GTKNODES_IS_NODE (child->widget))
+        continue;
+
+      node = gtk_nodes_node_view_capture_node (graph, child->widget, live);
+
+      sockets = gtk_nodes_node_get_sinks (GTKNODES_NODE (child->widget));
+
+      for (s = sockets; s; s = s->next)
+        {
+          GtkNodesNodeSocket *input;
+          GtkWidget *source;
+          guint id_source;
+          guint id_sink;
+          guint id;
+
+          input = gtk_nodes_node_socket_get_input (GTKNODES_NODE_SOCKET (s->data));
+
+          if (input == NULL)
+            continue;
+
+          g_object_get(GTK_WIDGET (input), "id", &id_source, NULL);
+          g_object_get(GTK_WIDGET (s->data), "id", &id_sink, NULL);
+          source = gtk_widget_get_ancestor (GTK_WIDGET (input), GTKNODES_TYPE_NODE);
+          g_object_get(source, "id", &id, NULL);
+
+          g_snprintf (buf, sizeof (buf), "%d", id);
+
+          _gtk_nodes_node_graph_add_connection (graph, buf, id_source,
+                                                node->id, id_sink);
+        }
+
+      g_list_free (sockets);
+    }
+
+  gtk_nodes_node_view_capture_records (node_view, graph);
+
+  return graph;
+}
+
+struct _GtkNodesNodeViewSnapshot
+{
+  gint               ref_count;
+
+  GtkNodesNodeGraph *graph;     /* never modified once captured */
+};
+
+G_DEFINE_BOXED_TYPE (GtkNodesNodeViewSnapshot, gtk_nodes_node_view_snapshot,
+                     gtk_nodes_node_view_snapshot_ref,
+                     gtk_nodes_node_view_snapshot_unref)
+
+/**
+ * gtk_nodes_node_view_snapshot:
+ * @node_view: a GtkNodesNodeView
+ *
+ * Captures the placement of the nodes, their connections and their
+ * exported properties and states. The snapshot does not refer to any
+ * widgets, so it may be saved from another thread while the view is
+ * changed further.
+ *
+ * Returns: (transfer full): a new #GtkNodesNodeViewSnapshot
+ */
+
+GtkNodesNodeViewSnapshot *
+gtk_nodes_node_view_snapshot (GtkNodesNodeView *node_view)
+{
+  GtkNodesNodeViewSnapshot *snapshot;
+
+
+  g_return_val_if_fail (GTKNODES_IS_NODE_VIEW (node_view), NULL);
+
+  snapshot = g_slice_new (GtkNodesNodeViewSnapshot);
+
+  snapshot->ref_count = 1;
+  snapshot->graph     = gtk_nodes_node_view_capture (node_view, FALSE);
+
+  return snapshot;
+}
+
+/**
+ * gtk_nodes_node_view_snapshot_ref:
+ * @snapshot: a #GtkNodesNodeViewSnapshot
+ *
+ * Returns: (transfer full): @snapshot
+ */
+
+GtkNodesNodeViewSnapshot *
+gtk_nodes_node_view_snapshot_ref (GtkNodesNodeViewSnapshot *snapshot)
+{
+  g_return_val_if_fail (snapshot != NULL, NULL);
+
+  g_atomic_int_inc (&snapshot->ref_count);
+
+  return snapshot;
+}
+
+/**
+ * gtk_nodes_node_view_snapshot_unref:
+ * @snapshot: a #GtkNodesNodeViewSnapshot
+ */
+
+void
+gtk_nodes_node_view_snapshot_unref (GtkNodesNodeViewSnapshot *snapshot)
+{
+  g_return_if_fail (snapshot != NULL);
+
+  if (!g_atomic_int_dec_and_test (&snapshot->ref_count))
+    return;
+
+  _gtk_nodes_node_graph_free (snapshot->graph);
+
+  g_slice_free (GtkNodesNodeViewSnapshot, snapshot);
+}
+
+/* write a graph to a file, replacing it only on success */
+
+static gboolean
+gtk_nodes_node_view_write_graph (GtkNodesNodeGraph         *graph,
+                                 const gchar               *filename,
+                                 GtkNodesNodeViewFormat     format,
+                                 GCancellable              *cancellable,
+                                 GError                   **error)
+{
+  GFile *file;
+  GFileOutputStream *stream;
+  GOutputStream *base;
+  GOutputStream *out;
+  gboolean ok;
+
+
+  file = g_file_new_for_path (filename);
+
+  stream = g_file_replace (file, NULL, FALSE, G_FILE_CREATE_NONE,
+                           cancellable, error);
+
+  g_object_unref (file);
+
+  if (stream == NULL)
+    return FALSE;
+
+  /* the file stream is closed separately, so we can decide whether
+   * the target is replaced
+   */
+  if (g_str_has_suffix (filename, ".gz"))
+    {
+      GConverter *compressor;
+
+      compressor = G_CONVERTER (g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1));
+
+      base = g_converter_output_stream_new (G_OUTPUT_STREAM (stream), compressor);
+      g_filter_output_stream_set_close_base_stream (G_FILTER_OUTPUT_STREAM (base),
+                                                    FALSE);
+      g_object_unref (compressor);
+    }
+  else
+    {
+      base = g_object_ref (stream);
+    }
+
+  /* closing the buffer closes the compressor, which writes its trailer */
+  out = g_buffered_output_stream_new_sized (base, SAVE_BUFFER_SIZE);
+
+  if (base == G_OUTPUT_STREAM (stream))
+    g_filter_output_stream_set_close_base_stream (G_FILTER_OUTPUT_STREAM (out),
+                                                  FALSE);
+
+  g_object_unref (base);
+
+  if (format == GTKNODES_NODE_VIEW_FORMAT_BINARY)
+    ok = _gtk_nodes_node_graph_write_binary (graph, out, error);
+  else
+    ok = _gtk_nodes_node_graph_write_xml (graph, out, error);
+
+  if (ok)
+    ok = g_output_stream_close (out, cancellable, error);
+
+  if (ok)
+    ok = g_output_stream_close (G_OUTPUT_STREAM (stream), cancellable, error);
+
+  if (!ok)
+    {
+      GCancellable *cancel;
+
+      /* closing with a cancelled cancellable drops the temporary file
+       * and keeps the original
+       */
+      cancel = g_cancellable_new ();
+      g_cancellable_cancel (cancel);
+
+      g_output_stream_close (G_OUTPUT_STREAM (stream), cancel, NULL);
+
+      g_object_unref (cancel);
+    }
+
+  g_object_unref (out);
+  g_object_unref (stream);
+
+  return ok;
+}
+
+/**
+ * gtk_nodes_node_view_snapshot_save:
+ * @snapshot: a #GtkNodesNodeViewSnapshot
+ * @filename: the name of the file to save, if the file exists, it will be overwritten
+ * @format: the #GtkNodesNodeViewFormat to save in
+ * @cancellable: (nullable): a #GCancellable
+ * @error: return location for an error
+ *
+ * Saves a snapshot as gtk_nodes_node_view_save() or
+ * gtk_nodes_node_view_save_binary() would. This may be called from any
+ * thread. The file is only replaced if the snapshot was written completely
+ * and saving was not cancelled.
+ *
+ * If @filename ends in ".gz", the file is compressed with gzip as it is
+ * written.
+ *
+ * Returns: FALSE on error
+ */
+
+gboolean
+gtk_nodes_node_view_snapshot_save (GtkNodesNodeViewSnapshot  *snapshot,
+                                   const gchar               *filename,
+                                   GtkNodesNodeViewFormat     format,
+                                   GCancellable              *cancellable,
+                                   GError                   **error)
+{
+  g_return_val_if_fail (snapshot != NULL, FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+
+  return gtk_nodes_node_view_write_graph (snapshot->graph, filename, format,
+                                          cancellable, error);
+}
+
+static gboolean
+gtk_nodes_node_view_save_graph (GtkNodesNodeView       *node_view,
+                                const gchar            *filename,
+                                GtkNodesNodeViewFormat  format)
+{
+  GtkNodesNodeGraph *graph;
+  GError *error = NULL;
+  gboolean ok;
+
+
+  if (filename == NULL)
+    {
+      g_warning ("No filename specified");
+      return FALSE;
+    }
+
+  /* the nodes are still around, let them stream their state directly */
+  graph = gtk_nodes_node_view_capture (node_view, TRUE);
+
+  ok = gtk_nodes_node_view_write_graph (graph, filename, format, NULL, &error);
+
+  if (!ok)
+    {
+      g_warning ("Error saving nodes to file %s: %s", filename, error->message);
+      g_clear_error (&error);
+    }
+
+  _gtk_nodes_node_graph_free (graph);
+
+  return ok;
+}
+
+/**
+ * gtk_nodes_node_view_save:
+ * @node_view: a GtkNodesNodeView
+ * @filename: the name of the file to save, if the file exists, it will be overwritten
+ *
+ * Saves a representation of the current node view setup as XML so
+ * it can be recreated with gtkbuilder
+ * This only works properly for nodes which are their own widget types, as we
+ * don't (and can't) in-depth clone the nodes
+ *
+ * The description is written to a temporary file which replaces @filename
+ * only once it is complete, so an existing file is left intact if saving
+ * fails. If @filename ends in ".gz", it is compressed with gzip.
+ *
+ * Nodes implementing #GtkNodesNodeClass.export_state() write their state
+ * straight into the file, base64 encoded in a <state> element. The values
+ * cached on sockets with the #GtkNodesNodeSocket:cache property set are
+ * saved in <value> elements.
+ *
+ * Returns: 0 on error
+ */
+
+gboolean
+gtk_nodes_node_view_save (GtkNodesNodeView *node_view,
+                          const gchar      *filename)
+{
+  g_return_val_if_fail (GTKNODES_IS_NODE_VIEW (node_view), FALSE);
+
+  return gtk_nodes_node_view_save_graph (node_view, filename,
+                                         GTKNODES_NODE_VIEW_FORMAT_XML);
+}
+
+/**
+ * gtk_nodes_node_view_save_binary:
+ * @node_view: a GtkNodesNodeView
+ * @filename: the name of the file to save, if the file exists, it will be overwritten
+ *
+ * Saves the same description as gtk_nodes_node_view_save() in a compact,
+ * versioned binary format, which gtk_nodes_node_view_load_binary() reads
+ * much faster than XML. The nodes, their properties, the connected sockets
+ * and the connections are stored as tables of fixed width records, type
+ * names and exported properties in a string table. Node states follow the
+ * tables as raw chunks. A state written in a single chunk is handed to its
+ * node straight from the mapped file, one written in several chunks is
+ * joined in memory first.
+ *
+ * Returns: 0 on error
+ */
+
+gboolean
+gtk_nodes_node_view_save_binary (GtkNodesNodeView *node_view,
+                                 const gchar      *filename)
+{
+  g_return_val_if_fail (GTKNODES_IS_NODE_VIEW (node_view), FALSE);
+
+  return gtk_nodes_node_view_save_graph (node_view, filename,
+                                         GTKNODES_NODE_VIEW_FORMAT_BINARY);
+}
+
+typedef struct
+{
+  GtkNodesNodeViewSnapshot *snapshot;
+  gchar                    *filename;
+  GtkNodesNodeViewFormat    format;
+} GtkNodesNodeViewSaveData;
+
+static void
+gtk_nodes_node_view_save_data_free (gpointer data)
+{
+  GtkNodesNodeViewSaveData *d = data;
+
+
+  gtk_nodes_node_view_snapshot_unref (d->snapshot);
+  g_free (d->filename);
+
+  g_slice_free (GtkNodesNodeViewSaveData, d);
+}
+
+static void
+gtk_nodes_node_view_save_thread (GTask        *task,
+                                 gpointer      source_object,
+                                 gpointer      task_data,
+                                 GCancellable *cancellable)
+{
+  GtkNodesNodeViewSaveData *d = task_data;
+  GError *error = NULL;
+
+
+  if (gtk_nodes_node_view_snapshot_save (d->snapshot, d->filename, d->format,
+                                         cancellable, &error))
+    g_task_return_boolean (task, TRUE);
+  else
+    g_task_return_error (task, error);
+}
+
+static void
+gtk_nodes_node_view_save_snapshot_async (GtkNodesNodeView          *node_view,
+                                         GtkNodesNodeViewSnapshot  *snapshot,
+                                         const gchar               *filename,
+                                         GtkNodesNodeViewFormat     format,
+                                         GCancellable              *cancellable,
+                                         GAsyncReadyCallback        callback,
+                                         gpointer                   user_data)
+{
+  GtkNodesNodeViewSaveData *d;
+  GTask *task;
+
+
+  d = g_slice_new (GtkNodesNodeViewSaveData);
+
+  d->snapshot = gtk_nodes_node_view_snapshot_ref (snapshot);
+  d->filename = g_strdup (filename);
+  d->format   = format;
+
+  task = g_task_new (node_view, cancellable, callback, user_data);
+  g_task_set_source_tag (task, gtk_nodes_node_view_save_async);
+  g_task_set_task_data (task, d, gtk_nodes_node_view_save_data_free);
+
+  g_task_run_in_thread (task, gtk_nodes_node_view_save_thread);
+
+  g_object_unref (task);
+}
+
+/**
+ * gtk_nodes_node_view_save_async:
+ * @node_view: a GtkNodesNodeView
+ * @filename: the name of the file to save, if the file exists, it will be overwritten
+ * @format: the #GtkNodesNodeViewFormat to save in
+ * @cancellable: (nullable): a #GCancellable
+ * @callback: (scope async): called when the file was written
+ * @user_data: (closure): data for @callback
+ *
+ * Takes a snapshot of the node view and writes it to @filename in a
+ * worker thread, so saving large views does not block the main loop.
+ * Call gtk_nodes_node_view_save_finish() from @callback to get the
+ * result.
+ */
+
+void
+gtk_nodes_node_view_save_async (GtkNodesNodeView       *node_view,
+                                const gchar            *filename,
+                                GtkNodesNodeViewFormat  format,
+                                GCancellable           *cancellable,
+                                GAsyncReadyCallback     callback,
+                                gpointer                user_data)
+{
+  GtkNodesNodeViewSnapshot *snapshot;
+
+
+  g_return_if_fail (GTKNODES_IS_NODE_VIEW (node_view));
+  g_return_if_fail (filename != NULL);
+
+  snapshot = gtk_nodes_node_view_snapshot (node_view);
+
+  gtk_nodes_node_view_save_snapshot_async (node_view, snapshot, filename,
+                                           format, cancellable,
+                                           callback, user_data);
+
+  gtk_nodes_node_view_snapshot_unref (snapshot);
+}
+
+/**
+ * gtk_nodes_node_view_save_finish:
+ * @node_view: a GtkNodesNodeView
+ * @result: the #GAsyncResult passed to the callback
+ * @error: return location for an error
+ *
+ * Returns: FALSE if saving failed or was cancelled
+ */
+
+gboolean
+gtk_nodes_node_view_save_finish (GtkNodesNodeView  *node_view,
+                                 GAsyncResult      *result,
+                                 GError           **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, node_view), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+/* Edit Journal
+ *
+ * While a journal is kept, every edit is appended as one line of text:
+ *
+ *   A <id> <markup>                           node added
+ *   R <id>                                    node removed
+ *   M <id> <x> <y> <width> <height>           node moved or resized
+ *   C <node> <socket> <node> <socket>         source connected to sink
+ *   D <node> <socket>                         sink disconnected
+ *
+ * The markup of an added node is the base64 encoded description a snapshot
+ * holds of it, so it is rebuilt with its properties and state.
+ *
+ * The records are absolute and replaying one which already took effect
+ * changes nothing, so a journal may safely be replayed over a snapshot
+ * that already contains some of its edits.
+ *
+ * Graphs being loaded are not recorded node by node, the journal is
+ * compacted once they are complete instead.
+ */
+
+static gchar *
+gtk_nodes_node_view_journal_path (const gchar *base,
+                                  gboolean     old)
+{
+  return g_strconcat (base, old ? ".journal.old" : ".journal", NULL);
+}
+
+static gboolean
+gtk_nodes_node_view_journal_open (GtkNodesNodeView  *node_view,
+                                  GError           **error)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GFileOutputStream *stream;
+  GFile *file;
+  gchar *path;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  path = gtk_nodes_node_view_journal_path (priv->journal_base, FALSE);
+  file = g_file_new_for_path (path);
+  g_free (path);
+
+  /* records go to disk right away, there is no temporary file */
+  stream = g_file_append_to (file, G_FILE_CREATE_NONE, NULL, error);
+
+  g_object_unref (file);
+
+  if (stream == NULL)
+    return FALSE;
+
+  priv->journal         = G_OUTPUT_STREAM (stream);
+  priv->journal_records = 0;
+
+  return TRUE;
+}
+
+static void
+gtk_nodes_node_view_compact_done (GObject      *source_object,
+                                  GAsyncResult *result,
+                                  gpointer      user_data)
+{
+  GtkNodesNodeView *node_view;
+  GtkNodesNodeViewPrivate *priv;
+  GError *error = NULL;
+  gchar *base = user_data;
+  gchar *path;
+
+
+  node_view = GTKNODES_NODE_VIEW (source_object);
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  priv->compacting = FALSE;
+
+  if (gtk_nodes_node_view_save_finish (node_view, result, &error))
+    {
+      path = gtk_nodes_node_view_journal_path (base, TRUE);
+      g_unlink (path);
+      g_free (path);
+    }
+  else
+    {
+      /* the rotated records stay around for the next attempt */
+      g_warning ("Error compacting journal of %s: %s", base, error->message);
+      g_clear_error (&error);
+    }
+
+  g_free (base);
+
+  /* a graph was loaded after this snapshot was taken */
+  if (priv->compact_again)
+    {
+      priv->compact_again = FALSE;
+      gtk_nodes_node_view_journal_compact (node_view);
+    }
+}
+
+/* move the records of the current journal to the old one */
+
+static gboolean
+gtk_nodes_node_view_journal_rotate (const gchar  *base,
+                                    GError      **error)
+{
+  GFile *journal;
+  GFile *old;
+  gchar *path;
+  gboolean ok = TRUE;
+
+
+  path    = gtk_nodes_node_view_journal_path (base, FALSE);
+  journal = g_file_new_for_path (path);
+  g_free (path);
+
+  path = gtk_nodes_node_view_journal_path (base, TRUE);
+  old  = g_file_new_for_path (path);
+  g_free (path);
+
+  if (!g_file_query_exists (old, NULL))
+    {
+      ok = g_file_move (journal, old, G_FILE_COPY_NONE, NULL, NULL, NULL, error);
+    }
+  else
+    {
+      GFileInputStream *in;
+      GFileOutputStream *out;
+
+      /* an earlier compaction failed, its records are still needed */
+      in  = g_file_read (journal, NULL, error);
+      out = in ? g_file_append_to (old, G_FILE_CREATE_NONE, NULL, error) : NULL;
+
+      if (out)
+        ok = g_output_stream_splice (G_OUTPUT_STREAM (out), G_INPUT_STREAM (in),
+                                     G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+                                     G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+                                     NULL, error) >= 0;
+      else
+        ok = FALSE;
+
+      if (ok)
+        ok = g_file_delete (journal, NULL, error);
+
+      g_clear_object (&in);
+      g_clear_object (&out);
+    }
+
+  g_object_unref (journal);
+  g_object_unref (old);
+
+  return ok;
+}
+
+/**
+ * gtk_nodes_node_view_journal_compact:
+ * @node_view: a GtkNodesNodeView
+ *
+ * Writes a new snapshot of the node view to the file given to
+ * gtk_nodes_node_view_journal_start() and starts a new, empty journal.
+ * The snapshot is written in the background; until it is complete, the
+ * previous records are kept in a file ending in ".journal.old".
+ *
+ * This is done automatically once the number of records reaches the
+ * #GtkNodesNodeView:journal-threshold.
+ */
+
+void
+gtk_nodes_node_view_journal_compact (GtkNodesNodeView *node_view)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GtkNodesNodeViewSnapshot *snapshot;
+  GError *error = NULL;
+
+
+  g_return_if_fail (GTKNODES_IS_NODE_VIEW (node_view));
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  if (!priv->journal || priv->compacting)
+    return;
+
+  /* everything recorded so far is in the snapshot */
+  snapshot = gtk_nodes_node_view_snapshot (node_view);
+
+  g_output_stream_close (priv->journal, NULL, NULL);
+  g_clear_object (&priv->journal);
+
+  if (!gtk_nodes_node_view_journal_rotate (priv->journal_base, &error) ||
+      !gtk_nodes_node_view_journal_open (node_view, &error))
+    {
+      g_warning ("Error compacting journal of %s: %s",
+                 priv->journal_base, error->message);
+      g_clear_error (&error);
+
+      /* keep recording in any case */
+      if (!priv->journal)
+        gtk_nodes_node_view_journal_open (node_view, NULL);
+
+      gtk_nodes_node_view_snapshot_unref (snapshot);
+      return;
+    }
+
+  priv->compacting = TRUE;
+
+  gtk_nodes_node_view_save_snapshot_async (node_view, snapshot,
+                                           priv->journal_base,
+                                           GTKNODES_NODE_VIEW_FORMAT_XML,
+                                           NULL,
+                                           gtk_nodes_node_view_compact_done,
+                                           g_strdup (priv->journal_base));
+
+  gtk_nodes_node_view_snapshot_unref (snapshot);
+}
+
+static gboolean
+gtk_nodes_node_view_journal_compact_idle (gpointer data)
+{
+  GtkNodesNodeView *node_view;
+  GtkNodesNodeViewPrivate *priv;
+
+
+  node_view = GTKNODES_NODE_VIEW (data);
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  priv->compact_id = 0;
+
+  gtk_nodes_node_view_journal_compact (node_view);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+gtk_nodes_node_view_journal (GtkNodesNodeView *node_view,
+                             const gchar      *format,
+                             ...)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GError *error = NULL;
+  gchar *record;
+  va_list args;
+  gboolean ok;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  if (!priv->journal || priv->replaying || priv->loading)
+    return;
+
+  va_start (args, format);
+  record = g_strdup_vprintf (format, args);
+  va_end (args);
+
+  ok = g_output_stream_write_all (priv->journal, record, strlen (record),
+                                  NULL, NULL, &error);
+
+  g_free (record);
+
+  if (!ok)
+    {
+      g_warning ("Error writing journal of %s, journal stopped: %s",
+                 priv->journal_base, error->message);
+      g_clear_error (&error);
+
+      gtk_nodes_node_view_journal_stop (node_view);
+      return;
+    }
+
+  priv->journal_records++;
+
+  /* compact once the edit in progress is complete */
+  if (priv->journal_threshold && !priv->compact_id &&
+      priv->journal_records >= priv->journal_threshold)
+    priv->compact_id = g_idle_add (gtk_nodes_node_view_journal_compact_idle,
+                                   node_view);
+}
+
+static void
+gtk_nodes_node_view_journal_move (GtkNodesNodeView      *node_view,
+                                  GtkNodesNodeViewChild *child)
+{
+  GtkNodesNodeViewPrivate *priv;
+  gint x, y;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  if (!priv->journal || !GTKNODES_IS_NODE (child->widget))
+    return;
+
+  g_object_get (G_OBJECT (child->widget), "x", &x, "y", &y, NULL);
+
+  gtk_nodes_node_view_journal (node_view, "M %u %d %d %d %d\n", child->id,
+                               x, y,
+                               child->rectangle.width,
+                               child->rectangle.height);
+}
+
+/* record a node as a snapshot would describe it, so it comes back with its
+ * properties and state rather than just its type and geometry
+ */
+static void
+gtk_nodes_node_view_journal_add (GtkNodesNodeView      *node_view,
+                                 GtkNodesNodeViewChild *child)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GtkNodesNodeGraph *graph;
+  GOutputStream *out;
+  GError *error = NULL;
+  gchar *markup;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  /* don't serialize what would not be recorded anyway */
+  if (!priv->journal || priv->replaying || priv->loading)
+    return;
+
+  graph = _gtk_nodes_node_graph_new ();
+  gtk_nodes_node_view_capture_node (graph, child->widget, FALSE);
+
+  out = g_memory_output_stream_new_resizable ();
+
+  if (!_gtk_nodes_node_graph_write_xml (graph, out, &error) ||
+      !g_output_stream_close (out, NULL, &error))
+    {
+      g_warning ("Error journaling node %u: %s", child->id, error->message);
+      g_clear_error (&error);
+
+      g_object_unref (out);
+      _gtk_nodes_node_graph_free (graph);
+      return;
+    }
+
+  markup = g_base64_encode (g_memory_output_stream_get_data (G_MEMORY_OUTPUT_STREAM (out)),
+                            g_memory_output_stream_get_data_size (G_MEMORY_OUTPUT_STREAM (out)));
+
+  gtk_nodes_node_view_journal (node_view, "A %u %s\n", child->id, markup);
+
+  g_free (markup);
+  g_object_unref (out);
+  _gtk_nodes_node_graph_free (graph);
+}
+
+/* the nodes of a loaded graph were not recorded one by one, take them into
+ * a new snapshot at once
+ */
+static void
+gtk_nodes_node_view_journal_loaded (GtkNodesNodeView *node_view)
+{
+  GtkNodesNodeViewPrivate *priv;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  if (!priv->journal)
+    return;
+
+  if (priv->compacting)
+    priv->compact_again = TRUE;
+  else
+    gtk_nodes_node_view_journal_compact (node_view);
+}
+
+/**
+ * gtk_nodes_node_view_journal_start:
+ * @node_view: a GtkNodesNodeView
+ * @filename: the name of the file to save the node view to
+ * @error: return location for an error
+ *
+ * Saves the node view to @filename like gtk_nodes_node_view_save() and
+ * from then on appends every edit of the view to a journal file next to
+ * it, with ".journal" appended to the name. Adding, removing, moving and
+ * resizing nodes and connecting and disconnecting sockets is recorded.
+ * The cost of keeping the files up to date thus depends on the rate of
+ * edits rather than the size of the view. Loading a graph into the view
+ * is not an edit in that sense, the journal is compacted once it is
+ * complete, see gtk_nodes_node_view_journal_compact().
+ *
+ * Node ids are kept stable while the journal is recorded, they are not
+ * renumbered when saving.
+ *
+ * Use gtk_nodes_node_view_recover() to restore the view from the files.
+ *
+ * Returns: FALSE on error
+ */
+
+gboolean
+gtk_nodes_node_view_journal_start (GtkNodesNodeView  *node_view,
+                                   const gchar       *filename,
+                                   GError           **error)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GtkNodesNodeViewSnapshot *snapshot;
+  gchar *path;
+  gboolean ok;
+
+
+  g_return_val_if_fail (GTKNODES_IS_NODE_VIEW (node_view), FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  gtk_nodes_node_view_journal_stop (node_view);
+
+  snapshot = gtk_nodes_node_view_snapshot (node_view);
+
+  ok = gtk_nodes_node_view_snapshot_save (snapshot, filename,
+                                          GTKNODES_NODE_VIEW_FORMAT_XML,
+                                          NULL, error);
+
+  gtk_nodes_node_view_snapshot_unref (snapshot);
+
+  if (!ok)
+    return FALSE;
+
+  /* the snapshot holds everything, previous records are obsolete */
+  path = gtk_nodes_node_view_journal_path (filename, TRUE);
+  g_unlink (path);
+  g_free (path);
+
+  path = gtk_nodes_node_view_journal_path (filename, FALSE);
+  g_unlink (path);
+  g_free (path);
+
+  priv->journal_base = g_strdup (filename);
+
+  if (!gtk_nodes_node_view_journal_open (node_view, error))
+    {
+      g_clear_pointer (&priv->journal_base, g_free);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/**
+ * gtk_nodes_node_view_journal_stop:
+ * @node_view: a GtkNodesNodeView
+ *
+ * Stops recording edits to the journal. The files are left as they are.
+ */
+
+void
+gtk_nodes_node_view_journal_stop (GtkNodesNodeView *node_view)
+{
+  GtkNodesNodeViewPrivate *priv;
+
+
+  g_return_if_fail (GTKNODES_IS_NODE_VIEW (node_view));
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  if (priv->compact_id)
+    {
+      g_source_remove (priv->compact_id);
+      priv->compact_id = 0;
+    }
+
+  priv->compact_again = FALSE;
+
+  if (priv->journal)
+    {
+      g_output_stream_close (priv->journal, NULL, NULL);
+      g_clear_object (&priv->journal);
+    }
+
+  g_clear_pointer (&priv->journal_base, g_free);
+}
+
+static GtkNodesNodeSocket *
+gtk_nodes_node_view_find_socket (GtkNodesNodeView *node_view,
+                                 guint             node_id,
+                                 guint             socket_id,
+                                 gboolean          source)
+{
+  GtkNodesNodeSocket *socket = NULL;
+  GtkWidget *node;
+  GList *sockets;
+  GList *l;
+
+
+  node = gtk_nodes_node_view_get_node (node_view, node_id);
+
+  if (node == NULL)
+    return NULL;
+
+  if (source)
+    sockets = gtk_nodes_node_get_sources (GTKNODES_NODE (node));
+  else
+    sockets = gtk_nodes_node_get_sinks (GTKNODES_NODE (node));
+
+  for (l = sockets; l; l = l->next)
+    {
+      if ((guint) gtk_nodes_node_socket_get_id (l->data) == socket_id)
+        {
+          socket = l->data;
+          break;
+        }
+    }
+
+  g_list_free (sockets);
+
+  return socket;
+}
+
+/* the numbers in a record, anything else in their place makes it invalid */
+
+static gboolean
+gtk_nodes_node_view_journal_uint (const gchar *field,
+                                  guint       *value)
+{
+  guint64 v;
+  gchar *end;
+
+
+  if (!g_ascii_isdigit (field[0]))
+    return FALSE;
+
+  errno = 0;
+  v = g_ascii_strtoull (field, &end, 10);
+
+  if (errno || *end != '\0' || v > G_MAXUINT)
+    return FALSE;
+
+  *value = (guint) v;
+
+  return TRUE;
+}
+
+static gboolean
+gtk_nodes_node_view_journal_int (const gchar *field,
+                                 gint        *value)
+{
+  gint64 v;
+  gchar *end;
+
+
+  if (!g_ascii_isdigit (field[0]) &&
+      !(field[0] == '-' && g_ascii_isdigit (field[1])))
+    return FALSE;
+
+  errno = 0;
+  v = g_ascii_strtoll (field, &end, 10);
+
+  if (errno || *end != '\0' || v < G_MININT || v > G_MAXINT)
+    return FALSE;
+
+  *value = (gint) v;
+
+  return TRUE;
+}
+
+/* rebuild an added node from its markup the way a snapshot is loaded */
+
+static void
+gtk_nodes_node_view_replay_add (GtkNodesNodeView *node_view,
+                                guint             id,
+                                const gchar      *markup)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GtkNodesNodeGraph *graph;
+  GtkBuilder *builder;
+  GInputStream *in;
+  GtkWidget *node = NULL;
+  GError *error = NULL;
+  guchar *data;
+  gsize size;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  data = g_base64_decode (markup, &size);
+  in   = g_memory_input_stream_new_from_data (data, size, g_free);
+
+  graph = _gtk_nodes_node_graph_parse_stream (in, &error);
+
+  g_object_unref (in);
+
+  if (graph && graph->nodes->len != 1)
+    {
+      g_set_error (&error, G_MARKUP_ERROR, G_MARKUP_ERROR_INVALID_CONTENT,
+                   "Expected one node, found %u", graph->nodes->len);
+      g_clear_pointer (&graph, _gtk_nodes_node_graph_free);
+    }
+
+  if (graph)
+    {
+      builder = gtk_builder_new ();
+
+      node = _gtk_nodes_node_graph_build_node (g_ptr_array_index (graph->nodes, 0),
+                                               builder, &error);
+
+      g_object_unref (builder);
+      _gtk_nodes_node_graph_free (graph);
+    }
+
+  if (node == NULL)
+    {
+      g_warning ("Error replaying node %u from journal: %s", id,
+                 error->message);
+      g_clear_error (&error);
+      return;
+    }
+
+  g_object_set (G_OBJECT (node), "id", id, NULL);
+
+  priv->keep_ids = TRUE;
+  gtk_container_add (GTK_CONTAINER (node_view), node);
+  priv->keep_ids = FALSE;
+
+  gtk_widget_show_all (node);
+}
+
+static void
+gtk_nodes_node_view_replay_record (GtkNodesNodeView  *node_view,
+                                   gchar            **f)
+{
+  GtkNodesNodeSocket *source;
+  GtkNodesNodeSocket *sink;
+  GtkWidget *node;
+  guint id[4];
+  gint geometry[4];
+  guint n;
+  guint i;
+
+
+  n = g_strv_length (f);
+
+  switch (f[0][0])
+    {
+    case 'A':
+      if (n != 3 || !gtk_nodes_node_view_journal_uint (f[1], &id[0]))
+        break;
+
+      if (!gtk_nodes_node_view_get_node (node_view, id[0]))
+        gtk_nodes_node_view_replay_add (node_view, id[0], f[2]);
+      return;
+
+    case 'R':
+      if (n != 2 || !gtk_nodes_node_view_journal_uint (f[1], &id[0]))
+        break;
+
+      node = gtk_nodes_node_view_get_node (node_view, id[0]);
+
+      if (node)
+        gtk_widget_destroy (node);
+      return;
+
+    case 'M':
+      if (n != 6 || !gtk_nodes_node_view_journal_uint (f[1], &id[0]))
+        break;
+
+      for (i = 0; i < 4; i++)
+        if (!gtk_nodes_node_view_journal_int (f[i + 2], &geometry[i]))
+          break;
+
+      if (i < 4)
+        break;
+
+      node = gtk_nodes_node_view_get_node (node_view, id[0]);
+
+      if (node)
+        gtk_container_child_set (GTK_CONTAINER (node_view), node,
+                                 "x", geometry[0], "y", geometry[1],
+                                 "width", geometry[2], "height", geometry[3],
+                                 NULL);
+      return;
+
+    case 'C':
+      if (n != 5)
+        break;
+
+      for (i = 0; i < 4; i++)
+        if (!gtk_nodes_node_view_journal_uint (f[i + 1], &id[i]))
+          break;
+
+      if (i < 4)
+        break;
+
+      source = gtk_nodes_node_view_find_socket (node_view, id[0], id[1], TRUE);
+      sink   = gtk_nodes_node_view_find_socket (node_view, id[2], id[3], FALSE);
+
+      if (source && sink)
+        gtk_nodes_node_socket_connect_sockets (sink, source);
+      return;
+
+    case 'D':
+      if (n != 3 ||
+          !gtk_nodes_node_view_journal_uint (f[1], &id[0]) ||
+          !gtk_nodes_node_view_journal_uint (f[2], &id[1]))
+        break;
+
+      sink = gtk_nodes_node_view_find_socket (node_view, id[0], id[1], FALSE);
+
+      if (sink)
+        gtk_nodes_node_socket_disconnect (sink);
+      return;
+
+    default:
+      break;
+    }
+
+  g_warning ("Invalid journal record: %s", f[0]);
+}
+
+static gboolean
+gtk_nodes_node_view_replay (GtkNodesNodeView  *node_view,
+                            const gchar       *path)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GError *error = NULL;
+  gchar *contents;
+  gchar **lines;
+  guint i;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  if (!g_file_test (path, G_FILE_TEST_EXISTS))
+    return TRUE;
+
+  if (!g_file_get_contents (path, &contents, NULL, &error))
+    {
+      g_warning ("Error reading journal %s: %s", path, error->message);
+      g_clear_error (&error);
+      return FALSE;
+    }
+
+  lines = g_strsplit (contents, "\n", -1);
+  g_free (contents);
+
+  priv->replaying = TRUE;
+
+  for (i = 0; lines[i]; i++)
+    {
+      gchar **f;
+
+      /* a record cut short by a crash is ignored */
+      if (lines[i][0] == '\0' || lines[i + 1] == NULL)
+        continue;
+
+      f = g_strsplit (lines[i], " ", -1);
+      gtk_nodes_node_view_replay_record (node_view, f);
+      g_strfreev (f);
+    }
+
+  priv->replaying = FALSE;
+
+  g_strfreev (lines);
+
+  return TRUE;
+}
+
+/**
+ * gtk_nodes_node_view_recover:
+ * @node_view: a GtkNodesNodeView
+ * @filename: the name of the file given to gtk_nodes_node_view_journal_start()
+ *
+ * Loads the last snapshot saved to @filename and replays the edits
+ * recorded in its journal since, e.g. after a crash. Call
+ * gtk_nodes_node_view_journal_start() afterwards to continue recording.
+ *
+ * Returns: 0 if an error occured
+ */
+
+gboolean
+gtk_nodes_node_view_recover (GtkNodesNodeView *node_view,
+                             const gchar      *filename)
+{
+  gchar *path;
+  gboolean ok;
+
+
+  g_return_val_if_fail (GTKNODES_IS_NODE_VIEW (node_view), FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+
+  if (!gtk_nodes_node_view_load (node_view, filename))
+    return FALSE;
+
+  path = gtk_nodes_node_view_journal_path (filename, TRUE);
+  ok = gtk_nodes_node_view_replay (node_view, path);
+  g_free (path);
+
+  path = gtk_nodes_node_view_journal_path (filename, FALSE);
+  ok = gtk_nodes_node_view_replay (node_view, path) && ok;
+  g_free (path);
+
+  return ok;
+}
+
+/**
+ * gtk_nodes_node_view_set_journal_threshold:
+ * @node_view: a GtkNodesNodeView
+ * @threshold: the number of records, 0 to disable
+ *
+ * Sets the number of journal records after which the journal is compacted
+ */
+
+void
+gtk_nodes_node_view_set_journal_threshold (GtkNodesNodeView *node_view,
+                                           guint             threshold)
+{
+  GtkNodesNodeViewPrivate *priv;
+
+
+  g_return_if_fail (GTKNODES_IS_NODE_VIEW (node_view));
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  if (priv->journal_threshold == threshold)
+    return;
+
+  priv->journal_threshold = threshold;
+
+  g_object_notify (G_OBJECT (node_view), "journal-threshold");
+}
+
+/**
+ * gtk_nodes_node_view_get_journal_threshold:
+ * @node_view: a GtkNodesNodeView
+ *
+ * Returns: the number of journal records after which it is compacted
+ */
+
+guint
+gtk_nodes_node_view_get_journal_threshold (GtkNodesNodeView *node_view)
+{
+  GtkNodesNodeViewPrivate *priv;
+
+
+  g_return_val_if_fail (GTKNODES_IS_NODE_VIEW (node_view), 0);
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  return priv->journal_threshold;
+}
+
+/* Value Cache */
+
+/* hand the sinks of freshly loaded nodes what their sources have cached */
+
+static void
+gtk_nodes_node_view_replay_cached (GtkNodesNodeView *node_view,
+                                   GPtrArray        *nodes)
+{
+  guint i;
+
+
+  for (i = 0; i < nodes->len; i++)
+    {
+      GList *sinks;
+      GList *l;
+
+      sinks = gtk_nodes_node_get_sinks (g_ptr_array_index (nodes, i));
+
+      for (l = sinks; l; l = l->next)
+        {
+          GtkNodesNodeSocket *input;
+          GBytes *payload;
+
+          input = gtk_nodes_node_socket_get_input (l->data);
+
+          if (input == NULL)
+            continue;
+
+          payload = gtk_nodes_node_socket_get_cached (input);
+
+          if (payload == NULL)
+            continue;
+
+          /* a caching sink which saw the payload before ignores it */
+          if (!_gtk_nodes_node_view_route_payload (node_view, l->data, payload))
+            gtk_nodes_node_socket_write_bytes (l->data, payload);
+        }
+
+      g_list_free (sinks);
+    }
+}
+
+/* Lazy Loading */
+
+static void
+gtk_nodes_node_view_record_free (gpointer data)
+{
+  GtkNodesNodeViewRecord *rec = data;
+
+
+  _gtk_nodes_node_graph_node_free (rec->node);
+  g_array_unref (rec->edges);
+
+  g_slice_free (GtkNodesNodeViewRecord, rec);
+}
+
+static gint
+gtk_nodes_node_view_record_int (GtkNodesNodeGraphNode *node,
+                                const gchar           *name)
+{
+  const gchar *value;
+
+
+  value = _gtk_nodes_node_graph_node_get_property (node, name);
+
+  if (value == NULL)
+    return 0;
+
+  return (gint) strtol (value, NULL, 10);
+}
+
+/* keep the nodes of a graph as records until they are needed */
+
+static void
+gtk_nodes_node_view_defer_graph (GtkNodesNodeView  *node_view,
+                                 GtkNodesNodeGraph *graph)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GHashTable *records;
+  guint i;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  /* object id in the file -> record */
+  records = g_hash_table_new (g_str_hash, g_str_equal);
+
+  for (i = 0; i < graph->nodes->len; i++)
+    {
+      GtkNodesNodeViewRecord *rec;
+      const gchar *value;
+      guint saved;
+
+      rec = g_slice_new (GtkNodesNodeViewRecord);
+
+      rec->node  = _gtk_nodes_node_graph_steal_node (graph, i);
+      rec->edges = g_array_new (FALSE, FALSE, sizeof (GtkNodesNodeViewEdge));
+
+      /* like gtk_nodes_node_view_add() does for nodes restored from a file */
+      value = _gtk_nodes_node_graph_node_get_property (rec->node, "id");
+
+      rec->id = priv->node_id;
+
+      if (value)
+        {
+          saved = (guint) strtoul (value, NULL, 10);
+
+          if (!gtk_nodes_node_view_id_taken (node_view, saved))
+            rec->id = saved;
+        }
+
+      priv->node_id = MAX (priv->node_id, rec->id + 1);
+
+      /* the real size is only known once the node is built */
+      rec->rect.x      = gtk_nodes_node_view_record_int (rec->node, "x");
+      rec->rect.y      = gtk_nodes_node_view_record_int (rec->node, "y");
+      rec->rect.width  = MAX (gtk_nodes_node_view_record_int (rec->node, "width"),
+                              LAZY_NODE_SIZE);
+      rec->rect.height = MAX (gtk_nodes_node_view_record_int (rec->node, "height"),
+                              LAZY_NODE_SIZE);
+
+      g_hash_table_insert (priv->lazy_index, GUINT_TO_POINTER (rec->id), rec);
+      _gtk_nodes_node_grid_insert (priv->lazy_grid, rec, &rec->rect);
+
+      gdk_rectangle_union (&priv->lazy_bounds, &rec->rect, &priv->lazy_bounds);
+
+      g_hash_table_insert (records, rec->node->id, rec);
+    }
+
+  for (i = 0; i < graph->connections->len; i++)
+    {
+      GtkNodesNodeGraphConnection *con;
+      GtkNodesNodeViewRecord *source;
+      GtkNodesNodeViewRecord *sink;
+      GtkNodesNodeViewEdge edge;
+
+      con = g_ptr_array_index (graph->connections, i);
+
+      source = g_hash_table_lookup (records, con->node_source);
+      sink   = g_hash_table_lookup (records, con->node_sink);
+
+      if (source == NULL || sink == NULL)
+        continue;
+
+      edge.node_source = source->id;
+      edge.source      = con->source;
+      edge.node_sink   = sink->id;
+      edge.sink        = con->sink;
+
+      g_array_append_val (sink->edges, edge);
+
+      if (source != sink)
+        g_array_append_val (source->edges, edge);
+    }
+
+  g_hash_table_unref (records);
+
+  gtk_widget_queue_resize (GTK_WIDGET (node_view));
+}
+
+/* connect a recorded edge of a node which was just built */
+
+static void
+gtk_nodes_node_view_restore_edge (GtkNodesNodeView     *node_view,
+                                  GtkNodesNodeViewEdge *edge)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GtkNodesNodeSocket *source;
+  GtkNodesNodeSocket *sink;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  /* made when the source is built */
+  if (g_hash_table_contains (priv->lazy_index, GUINT_TO_POINTER (edge->node_source)))
+    return;
+
+  source = gtk_nodes_node_view_find_socket (node_view, edge->node_source,
+                                            edge->source, TRUE);
+
+  if (source == NULL)
+    return;
+
+  /* the sink is built as soon as a payload is written to the source */
+  if (g_hash_table_contains (priv->lazy_index, GUINT_TO_POINTER (edge->node_sink)))
+    {
+      GHashTable *set;
+
+      set = g_hash_table_lookup (priv->lazy_fanout, source);
+
+      if (set == NULL)
+        {
+          set = g_hash_table_new (g_direct_hash, g_direct_equal);
+          g_hash_table_insert (priv->lazy_fanout, source, set);
+
+          g_signal_connect (source, "socket-outgoing",
+                            G_CALLBACK (gtk_nodes_node_view_lazy_outgoing),
+                            node_view);
+          g_signal_connect (source, "socket-outgoing-bytes",
+                            G_CALLBACK (gtk_nodes_node_view_lazy_outgoing_bytes),
+                            node_view);
+        }
+
+      g_hash_table_add (set, GUINT_TO_POINTER (edge->node_sink));
+
+      return;
+    }
+
+  sink = gtk_nodes_node_view_find_socket (node_view, edge->node_sink,
+                                          edge->sink, FALSE);
+
+  if (sink == NULL)
+    return;
+
+  /* already made from the other end, or replaced by the user */
+  if (gtk_nodes_node_socket_get_input (sink) != NULL)
+    return;
+
+  gtk_nodes_node_socket_connect_sockets (sink, source);
+}
+
+/* build the nodes of some records, the records are consumed */
+
+static void
+gtk_nodes_node_view_instantiate_records (GtkNodesNodeView *node_view,
+                                         GPtrArray        *records)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GPtrArray *batch;
+  GPtrArray *built;
+  gboolean replaying;
+  gboolean keep_ids;
+  guint n;
+  guint i, j;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  batch = g_ptr_array_new_with_free_func (gtk_nodes_node_view_record_free);
+
+  for (i = 0; i < records->len; i++)
+    {
+      GtkNodesNodeViewRecord *rec = g_ptr_array_index (records, i);
+
+      if (g_hash_table_steal (priv->lazy_index, GUINT_TO_POINTER (rec->id)))
+        g_ptr_array_add (batch, rec);
+    }
+
+  /* the direct neighbours come along, so the connections are complete */
+  n = batch->len;
+
+  for (i = 0; i < n; i++)
+    {
+      GtkNodesNodeViewRecord *rec = g_ptr_array_index (batch, i);
+
+      for (j = 0; j < rec->edges->len; j++)
+        {
+          GtkNodesNodeViewEdge *edge;
+          gpointer other;
+
+          edge = &g_array_index (rec->edges, GtkNodesNodeViewEdge, j);
+
+          if (edge->node_source == rec->id)
+            other = GUINT_TO_POINTER (edge->node_sink);
+          else
+            other = GUINT_TO_POINTER (edge->node_source);
+
+          other = g_hash_table_lookup (priv->lazy_index, other);
+
+          if (other == NULL)
+            continue;
+
+          g_hash_table_steal (priv->lazy_index,
+                              GUINT_TO_POINTER (((GtkNodesNodeViewRecord *) other)->id));
+          g_ptr_array_add (batch, other);
+        }
+    }
+
+  /* this is not an edit of the view */
+  replaying = priv->replaying;
+  keep_ids  = priv->keep_ids;
+
+  priv->replaying = TRUE;
+  priv->keep_ids  = TRUE;
+
+  built = g_ptr_array_new_with_free_func (g_object_unref);
+
+  for (i = 0; i < batch->len; i++)
+    {
+      GtkNodesNodeViewRecord *rec = g_ptr_array_index (batch, i);
+      GtkBuilder *builder;
+      GtkWidget *node;
+      GError *error = NULL;
+
+      _gtk_nodes_node_grid_remove (priv->lazy_grid, rec);
+
+      /* object ids from different files may clash within one builder */
+      builder = gtk_builder_new ();
+
+      node = _gtk_nodes_node_graph_build_node (rec->node, builder, &error);
+
+      g_object_unref (builder);
+
+      if (node == NULL)
+        {
+          g_warning ("Error occured loading node %s: %s",
+                     rec->node->id, error->message);
+          g_clear_error (&error);
+          continue;
+        }
+
+      g_object_set (G_OBJECT (node), "id", rec->id, NULL);
+
+      gtk_container_add (GTK_CONTAINER (node_view), node);
+      gtk_widget_show_all (node);
+
+      g_ptr_array_add (built, node);
+    }
+
+  priv->keep_ids = keep_ids;
+
+  for (i = 0; i < batch->len; i++)
+    {
+      GtkNodesNodeViewRecord *rec = g_ptr_array_index (batch, i);
+
+      for (j = 0; j < rec->edges->len; j++)
+        gtk_nodes_node_view_restore_edge (node_view,
+                                          &g_array_index (rec->edges,
+                                                          GtkNodesNodeViewEdge,
+                                                          j));
+    }
+
+  priv->replaying = replaying;
+
+  if (!g_hash_table_size (priv->lazy_index))
+    memset (&priv->lazy_bounds, 0, sizeof (GdkRectangle));
+
+  gtk_nodes_node_view_replay_cached (node_view, built);
+
+  g_ptr_array_unref (built);
+  g_ptr_array_unref (batch);
+}
+
+/* build the nodes of the records in an area given in node view coordinates */
+
+static void
+gtk_nodes_node_view_instantiate_area (GtkNodesNodeView   *node_view,
+                                      const GdkRectangle *area)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GPtrArray *records;
+  GdkRectangle rect;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  if (!g_hash_table_size (priv->lazy_index))
+    return;
+
+  rect = (* area);
+
+  gtk_nodes_node_view_to_child_coords (node_view, &rect);
+
+  records = _gtk_nodes_node_grid_query (priv->lazy_grid, &rect);
+
+  if (records->len)
+    gtk_nodes_node_view_instantiate_records (node_view, records);
+
+  g_ptr_array_unref (records);
+}
+
+static gboolean
+gtk_nodes_node_view_instantiate_idle (gpointer data)
+{
+  GtkNodesNodeView *node_view;
+  GtkNodesNodeViewPrivate *priv;
+
+
+  node_view = GTKNODES_NODE_VIEW (data);
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  priv->lazy_id = 0;
+
+  gtk_nodes_node_view_instantiate_area (node_view, &priv->lazy_area);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* a payload was written to a source feeding nodes not built yet */
+
+static void
+gtk_nodes_node_view_lazy_outgoing_bytes (GtkWidget *socket,
+                                         GBytes    *payload,
+                                         gpointer   user_data)
+{
+  GtkNodesNodeView *node_view;
+  GtkNodesNodeViewPrivate *priv;
+  GHashTable *set;
+  GHashTableIter iter;
+  GPtrArray *records;
+  GArray *ids;
+  gpointer key;
+  guint i;
+
+
+  node_view = GTKNODES_NODE_VIEW (user_data);
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  set = g_hash_table_lookup (priv->lazy_fanout, socket);
+
+  if (set == NULL)
+    return;
+
+  records = g_ptr_array_new ();
+  ids     = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  g_hash_table_iter_init (&iter, set);
+
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      GtkNodesNodeViewRecord *rec;
+
+      rec = g_hash_table_lookup (priv->lazy_index, key);
+
+      if (rec == NULL)
+        continue;
+
+      g_ptr_array_add (records, rec);
+      g_array_append_val (ids, rec->id);
+    }
+
+  /* the sinks are connected while the payload is already on its way */
+  g_hash_table_remove (priv->lazy_fanout, socket);
+
+  g_signal_handlers_disconnect_by_func (socket,
+                                        gtk_nodes_node_view_lazy_outgoing,
+                                        node_view);
+  g_signal_handlers_disconnect_by_func (socket,
+                                        gtk_nodes_node_view_lazy_outgoing_bytes,
+                                        node_view);
+
+  gtk_nodes_node_view_instantiate_records (node_view, records);
+
+  g_ptr_array_unref (records);
+
+  /* so deliver it to the new sinks of the source like they would */
+  for (i = 0; i < ids->len; i++)
+    {
+      GtkNodesNodeViewChild *child;
+      GList *sinks;
+      GList *l;
+
+      child = g_hash_table_lookup (priv->id_index,
+                                   GUINT_TO_POINTER (g_array_index (ids, guint, i)));
+
+      if (child == NULL)
+        continue;
+
+      sinks = gtk_nodes_node_get_sinks (GTKNODES_NODE (child->widget));
+
+      for (l = sinks; l; l = l->next)
+        {
+          GtkNodesNodeSocket *sink = l->data;
+
+          if (gtk_nodes_node_socket_get_input (sink) != GTKNODES_NODE_SOCKET (socket))
+            continue;
+
+          if (!_gtk_nodes_node_view_route_payload (node_view, sink, payload))
+            gtk_nodes_node_socket_write_bytes (sink, payload);
+        }
+
+      g_list_free (sinks);
+    }
+
+  g_array_unref (ids);
+}
+
+static void
+gtk_nodes_node_view_lazy_outgoing (GtkWidget  *socket,
+                                   GByteArray *payload,
+                                   gpointer    user_data)
+{
+  GBytes *bytes;
+
+
+  bytes = g_bytes_new (payload->data, payload->len);
+
+  gtk_nodes_node_view_lazy_outgoing_bytes (socket, bytes, user_data);
+
+  g_bytes_unref (bytes);
+}
+
+/**
+ * gtk_nodes_node_view_instantiate:
+ * @node_view: a GtkNodesNodeView
+ * @rect: (nullable): an area in node view coordinates or NULL
+ *
+ * Builds the nodes in @rect, or all nodes if @rect is NULL, which were
+ * not built yet because of #GtkNodesNodeView:lazy-load.
+ */
+
+void
+gtk_nodes_node_view_instantiate (GtkNodesNodeView   *node_view,
+                                 const GdkRectangle *rect)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GPtrArray *records;
+  GHashTableIter iter;
+  gpointer value;
+
+
+  g_return_if_fail (GTKNODES_IS_NODE_VIEW (node_view));
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  if (rect)
+    {
+      gtk_nodes_node_view_instantiate_area (node_view, rect);
+      return;
+    }
+
+  records = g_ptr_array_sized_new (g_hash_table_size (priv->lazy_index));
+
+  g_hash_table_iter_init (&iter, priv->lazy_index);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    g_ptr_array_add (records, value);
+
+  gtk_nodes_node_view_instantiate_records (node_view, records);
+
+  g_ptr_array_unref (records);
+}
+
+/**
+ * gtk_nodes_node_view_set_lazy_load:
+ * @node_view: a GtkNodesNodeView
+ * @lazy_load: whether to build loaded nodes on demand
+ *
+ * If enabled, the nodes of graphs loaded by gtk_nodes_node_view_load() and
+ * gtk_nodes_node_view_load_binary() are only built when they come into
+ * view or are otherwise needed, see the section on lazy loading above.
+ * Files only #GtkBuilder understands are always loaded completely.
+ *
+ * Disabling it builds all nodes which are still pending.
+ */
+
+void
+gtk_nodes_node_view_set_lazy_load (GtkNodesNodeView *node_view,
+                                   gboolean          lazy_load)
+{
+  GtkNodesNodeViewPrivate *priv;
+
+
+  g_return_if_fail (GTKNODES_IS_NODE_VIEW (node_view));
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  lazy_load = !!lazy_load;
+
+  if (priv->lazy_load == lazy_load)
+    return;
+
+  priv->lazy_load = lazy_load;
+
+  if (!lazy_load)
+    gtk_nodes_node_view_instantiate (node_view, NULL);
+
+  g_object_notify (G_OBJECT (node_view), "lazy-load");
+}
+
+/**
+ * gtk_nodes_node_view_get_lazy_load:
+ * @node_view: a GtkNodesNodeView
+ *
+ * Returns: TRUE if loaded nodes are built on demand
+ */
+
+gboolean
+gtk_nodes_node_view_get_lazy_load (GtkNodesNodeView *node_view)
+{
+  GtkNodesNodeViewPrivate *priv;
+
+
+  g_return_val_if_fail (GTKNODES_IS_NODE_VIEW (node_view), FALSE);
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  return priv->lazy_load;
+}
+
+/* load a file with content we do not understand ourselves */
+
+static gboolean
+gtk_nodes_node_view_load_builder (GtkNodesNodeView *node_view,
+                                  const gchar      *filename)
+{
+  GtkNodesNodeViewPrivate *priv;
+	GtkBuilder* builder;
+  GError *error = NULL;
+  GInputStream *in;
+  GOutputStream *out;
+  GSList *l;
+  gboolean ok = FALSE;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  builder = gtk_builder_new();
+
+  /* the file may be compressed */
+  in  = _gtk_nodes_node_graph_open (filename, &error);
+  out = g_memory_output_stream_new_resizable ();
+
+  if (in && g_output_stream_splice (out, in,
+                                    G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+                                    G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+                                    NULL, &error) >= 0)
+    ok = gtk_builder_add_from_string (builder,
+                                      g_memory_output_stream_get_data (G_MEMORY_OUTPUT_STREAM (out)),
+                                      g_memory_output_stream_get_data_size (G_MEMORY_OUTPUT_STREAM (out)),
+                                      &error);
+
+  g_clear_object (&in);
+  g_object_unref (out);
+
+  if (!ok)
+    {
+      g_warning ("Error occured loading nodes from file: %s", error->message);
+      g_clear_error(&error);
+
+      return FALSE;
+    }
+
+  l = gtk_builder_get_objects(builder);
+
+  priv->loading = TRUE;
+
+	while (l)
+    {
+ 	 	 GObject *n = l->data;
+
+	   l = l->next;
+
+     if (gtk_widget_get_parent(GTK_WIDGET(n)) == NULL)
+       gtk_container_add(GTK_CONTAINER(node_view), GTK_WIDGET(n));
+ 	 }
+
+	gtk_builder_connect_signals_full (builder,
+                                    gtk_nodes_node_view_connection_mapper,
+                                    node_view);
+
+  priv->loading = FALSE;
+
+	gtk_widget_show_all(GTK_WIDGET (node_view));
+
+  gtk_nodes_node_view_journal_loaded (node_view);
+
+  return TRUE;
+}
+
+/* create the nodes of a graph and connect them */
+
+static gboolean
+gtk_nodes_node_view_build_graph (GtkNodesNodeView  *node_view,
+                                 GtkNodesNodeGraph *graph)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GtkBuilder *builder;
+  GHashTable *nodes;
+  GPtrArray *widgets;
+  GError *error = NULL;
+  guint i;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  if (priv->lazy_load)
+    {
+      gtk_nodes_node_view_defer_graph (node_view, graph);
+      gtk_nodes_node_view_journal_loaded (node_view);
+      return TRUE;
+    }
+
+  builder = gtk_builder_new ();
+  widgets = g_ptr_array_new_with_free_func (g_object_unref);
+
+  /* build all nodes before adding any, so we don't leave a partial graph */
+  for (i = 0; i < graph->nodes->len; i++)
+    {
+      GtkWidget *node;
+
+      node = _gtk_nodes_node_graph_build_node (g_ptr_array_index (graph->nodes, i),
+                                               builder, &error);
+
+      if (node == NULL)
+        {
+          g_warning ("Error occured loading nodes from file: %s", error->message);
+          g_clear_error (&error);
+
+          g_ptr_array_foreach (widgets, (GFunc) gtk_widget_destroy, NULL);
+          g_ptr_array_unref (widgets);
+          g_object_unref (builder);
+
+          return FALSE;
+        }
+
+      g_ptr_array_add (widgets, node);
+    }
+
+  nodes = g_hash_table_new (g_str_hash, g_str_equal);
+
+  /* the saved ids remain valid, as long as they are free in this view */
+  priv->keep_ids = TRUE;
+  priv->loading  = TRUE;
+
+  for (i = 0; i < widgets->len; i++)
+    {
+      GtkNodesNodeGraphNode *n = g_ptr_array_index (graph->nodes, i);
+      GtkWidget *node = g_ptr_array_index (widgets, i);
+
+      gtk_container_add (GTK_CONTAINER (node_view), node);
+      g_hash_table_insert (nodes, n->id, node);
+    }
+
+  priv->keep_ids = FALSE;
+
+  _gtk_nodes_node_graph_connect (graph, nodes);
+
+  priv->loading = FALSE;
+
+  gtk_widget_show_all (GTK_WIDGET (node_view));
+
+  gtk_nodes_node_view_replay_cached (node_view, widgets);
+
+  gtk_nodes_node_view_journal_loaded (node_view);
+
+  g_hash_table_unref (nodes);
+  g_ptr_array_unref (widgets);
+  g_object_unref (builder);
+
+  return TRUE;
+}
+
+/**
+ * gtk_nodes_node_view_load:
+ * @node_view: a GtkNodesNodeView
+ * @filename: the name of the file to load
+ *
+ * Loads an XML description parseable by #GtkBuilder and reconstructs
+ * a node configuration. Note that this will not restore the internal
+ * state of any nodes, but only their placement and the connections
+ * between sockets.
+ *
+ * This only works properly for nodes which are their own widget types.
+ *
+ * Files written by gtk_nodes_node_view_save() are read directly, nodes
+ * and sockets are looked up by their ids while connecting. Files with
+ * other top level content are handed to #GtkBuilder as a whole.
+ *
+ * Files compressed with gzip are recognised by their first bytes and
+ * decompressed while they are read.
+ *
+ * Sockets which cached their payloads when the file was saved get them
+ * back, and the sinks connected to caching sources receive the cached
+ * payloads, see #GtkNodesNodeSocket:cache.
+ *
+ * Returns: 0 if and error occured
+ */
+
+gboolean
+gtk_nodes_node_view_load (GtkNodesNodeView *node_view,
+                          const gchar      *filename)
+{
+  GtkNodesNodeGraph *graph;
+  GError *error = NULL;
+  gboolean ret;
+
+
+  g_return_val_if_fail (GTKNODES_IS_NODE_VIEW (node_view), FALSE);
+
+  if (filename == NULL)
+    {
+      g_warning ("No filename specified");
+      return FALSE;
+    }
+
+  graph = _gtk_nodes_node_graph_parse_file (filename, &error);
+
+  if (graph == NULL)
+    {
+      if (g_error_matches (error, G_MARKUP_ERROR, G_MARKUP_ERROR_UNKNOWN_ELEMENT))
+        {
+          g_clear_error (&error);
+          return gtk_nodes_node_view_load_builder (node_view, filename);
+        }
+
+      g_warning ("Error occured loading nodes from file: %s", error->message);
+      g_clear_error (&error);
+
+      return FALSE;
+    }
+
+  ret = gtk_nodes_node_view_build_graph (node_view, graph);
+
+  _gtk_nodes_node_graph_free (graph);
+
+  return ret;
+}
+
+/**
+ * gtk_nodes_node_view_load_binary:
+ * @node_view: a GtkNodesNodeView
+ * @filename: the name of the file to load
+ *
+ * Loads a node configuration saved by gtk_nodes_node_view_save_binary().
+ * The file is mapped into memory rather than read and parsed. The same
+ * restrictions as for gtk_nodes_node_view_load() apply.
+ *
+ * Returns: 0 if and error occured
+ */
+
+gboolean
+gtk_nodes_node_view_load_binary (GtkNodesNodeView *node_view,
+                                 const gchar      *filename)
+{
+  GtkNodesNodeGraph *graph;
+  GError *error = NULL;
+  gboolean ret;
+
+
+  g_return_val_if_fail (GTKNODES_IS_NODE_VIEW (node_view), FALSE);
+
+  if (filename == NULL)
+    {
+      g_warning ("No filename specified");
+      return FALSE;
+    }
+
+  graph = _gtk_nodes_node_graph_parse_binary (filename, &error);
+
+  if (graph == NULL)
+    {
+      g_warning ("Error occured loading nodes from file: %s", error->message);
+      g_clear_error (&error);
+
+      return FALSE;
+    }
+
+  ret = gtk_nodes_node_view_build_graph (node_view, graph);
+
+  _gtk_nodes_node_graph_free (graph);
+
+  return ret;
+}
+
+typedef struct
+{
+  gchar                  *filename;
+  GtkNodesNodeViewFormat  format;
+
+  GtkNodesNodeGraph      *graph;
+  GtkBuilder             *builder;
+  GHashTable             *nodes;    /* object id in the file -> node */
+  GPtrArray              *widgets;  /* the nodes built so far */
+} GtkNodesNodeViewLoadData;
+
+static void
+gtk_nodes_node_view_load_data_free (gpointer data)
+{
+  GtkNodesNodeViewLoadData *d = data;
+
+
+  g_clear_pointer (&d->nodes, g_hash_table_unref);
+  g_clear_pointer (&d->widgets, g_ptr_array_unref);
+  g_clear_object (&d->builder);
+  _gtk_nodes_node_graph_free (d->graph);
+  g_free (d->filename);
+
+  g_slice_free (GtkNodesNodeViewLoadData, d);
+}
+
+/* read and check the file, off the main thread */
+
+static void
+gtk_nodes_node_view_load_thread (GTask        *task,
+                                 gpointer      source_object,
+                                 gpointer      task_data,
+                                 GCancellable *cancellable)
+{
+  GtkNodesNodeViewLoadData *d = task_data;
+  GtkNodesNodeGraph *graph;
+  GError *error = NULL;
+
+
+  if (d->format == GTKNODES_NODE_VIEW_FORMAT_BINARY)
+    graph = _gtk_nodes_node_graph_parse_binary (d->filename, &error);
+  else
+    graph = _gtk_nodes_node_graph_parse_file (d->filename, &error);
+
+  if (graph && !_gtk_nodes_node_graph_validate (graph, &error))
+    g_clear_pointer (&graph, _gtk_nodes_node_graph_free);
+
+  if (graph == NULL)
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  g_task_return_pointer (task, graph,
+                         (GDestroyNotify) _gtk_nodes_node_graph_free);
+}
+
+/* drop the nodes of a load which did not complete */
+
+static void
+gtk_nodes_node_view_load_abort (GTask  *task,
+                                GError *error)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GtkNodesNodeViewLoadData *d;
+
+
+  priv = gtk_nodes_node_view_get_instance_private (g_task_get_source_object (task));
+  d = g_task_get_task_data (task);
+
+  /* the nodes were never recorded, neither is their removal */
+  priv->loading = TRUE;
+
+  if (d->widgets)
+    g_ptr_array_foreach (d->widgets, (GFunc) gtk_widget_destroy, NULL);
+
+  priv->loading = FALSE;
+
+  g_task_return_error (task, error);
+  g_object_unref (task);
+}
+
+/* build the nodes in batches, so the main loop stays responsive */
+
+static gboolean
+gtk_nodes_node_view_load_idle (gpointer data)
 {
-  GtkNodesNodeSocket *sink = NULL;
-  GtkNodesNodeSocket *source = NULL;
-  GList *l;
-  GList *sockets;
+  GTask *task = data;
+  GtkNodesNodeView *node_view;
+  GtkNodesNodeViewPrivate *priv;
+  GtkNodesNodeViewLoadData *d;
+  GError *error = NULL;
+  gint64 end;
 
-  guint id_source;
-  guint id_sink;
 
-  /* retrieve sink and source ids from handler name */
-  sscanf(handler_name, "%u_%u", &id_source, &id_sink);
+  node_view = g_task_get_source_object (task);
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+  d = g_task_get_task_data (task);
 
-  sockets = gtk_nodes_node_get_sources (GTKNODES_NODE (connect_object));
+  if (g_cancellable_set_error_if_cancelled (g_task_get_cancellable (task),
+                                            &error))
+    {
+      gtk_nodes_node_view_load_abort (task, error);
+      return G_SOURCE_REMOVE;
+    }
 
-  l = sockets;
+  end = g_get_monotonic_time () + LOAD_BUDGET;
 
-  while (l)
+  while (d->widgets->len < d->graph->nodes->len &&
+         g_get_monotonic_time () < end)
     {
-      guint id;
+      GtkNodesNodeGraphNode *n;
+      GtkWidget *node;
 
-      g_object_get(GTKNODES_NODE_SOCKET (l->data), "id", &id, NULL);
+      n = g_ptr_array_index (d->graph->nodes, d->widgets->len);
 
-      if (id == id_source)
+      node = _gtk_nodes_node_graph_build_node (n, d->builder, &error);
+
+      if (node == NULL)
         {
-          source = GTKNODES_NODE_SOCKET (l->data);
-          break;
+          gtk_nodes_node_view_load_abort (task, error);
+          return G_SOURCE_REMOVE;
         }
 
-      l = l->next;
+      /* the saved ids remain valid, as long as they are free in this view */
+      priv->keep_ids = TRUE;
+      priv->loading  = TRUE;
+      gtk_container_add (GTK_CONTAINER (node_view), node);
+      priv->keep_ids = FALSE;
+      priv->loading  = FALSE;
+
+      gtk_widget_show_all (node);
+
+      g_hash_table_insert (d->nodes, n->id, node);
+      g_ptr_array_add (d->widgets, node);
     }
 
+  g_signal_emit (node_view, node_view_signals[LOAD_PROGRESS], 0,
+                 d->widgets->len, d->graph->nodes->len);
 
-  sockets = gtk_nodes_node_get_sinks (GTKNODES_NODE (object));
-  l = sockets;
+  if (d->widgets->len < d->graph->nodes->len)
+    return G_SOURCE_CONTINUE;
 
-  while (l)
+  priv->loading = TRUE;
+  _gtk_nodes_node_graph_connect (d->graph, d->nodes);
+  priv->loading = FALSE;
+
+  gtk_nodes_node_view_replay_cached (node_view, d->widgets);
+
+  gtk_nodes_node_view_journal_loaded (node_view);
+
+  g_task_return_boolean (task, TRUE);
+  g_object_unref (task);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+gtk_nodes_node_view_load_parsed (GObject      *source_object,
+                                 GAsyncResult *result,
+                                 gpointer      user_data)
+{
+  GTask *task = user_data;
+  GtkNodesNodeView *node_view;
+  GtkNodesNodeViewPrivate *priv;
+  GtkNodesNodeViewLoadData *d;
+  GError *error = NULL;
+
+
+  node_view = GTKNODES_NODE_VIEW (source_object);
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+  d = g_task_get_task_data (task);
+
+  d->graph = g_task_propagate_pointer (G_TASK (result), &error);
+
+  if (d->graph == NULL ||
+      g_cancellable_set_error_if_cancelled (g_task_get_cancellable (task),
+                                            &error))
     {
-      guint id;
+      gtk_nodes_node_view_load_abort (task, error);
+      return;
+    }
 
-      g_object_get(GTKNODES_NODE_SOCKET (l->data), "id", &id, NULL);
+  /* records are cheap, there is nothing to spread out */
+  if (priv->lazy_load)
+    {
+      gtk_nodes_node_view_defer_graph (node_view, d->graph);
+      gtk_nodes_node_view_journal_loaded (node_view);
 
-      if (id == id_sink)
-        {
-          sink = GTKNODES_NODE_SOCKET (l->data);
-          break;
-        }
+      g_signal_emit (node_view, node_view_signals[LOAD_PROGRESS], 0,
+                     d->graph->nodes->len, d->graph->nodes->len);
 
-      l = l->next;
+      g_task_return_boolean (task, TRUE);
+      g_object_unref (task);
+      return;
     }
 
-  if (source == NULL || sink == NULL)
-    return;
+  d->builder = gtk_builder_new ();
+  d->nodes   = g_hash_table_new (g_str_hash, g_str_equal);
+  d->widgets = g_ptr_array_new_with_free_func (g_object_unref);
 
-  gtk_nodes_node_socket_connect_sockets (sink, source);
+  g_idle_add_full (G_PRIORITY_DEFAULT_IDLE, gtk_nodes_node_view_load_idle,
+                   task, NULL);
 }
 
+/**
+ * gtk_nodes_node_view_load_async:
+ * @node_view: a GtkNodesNodeView
+ * @filename: the name of the file to load
+ * @format: the #GtkNodesNodeViewFormat of the file
+ * @cancellable: (nullable): a #GCancellable
+ * @callback: (scope async): called when all nodes were built and connected
+ * @user_data: (closure): data for @callback
+ *
+ * Loads a file saved by gtk_nodes_node_view_save() or
+ * gtk_nodes_node_view_save_binary() without blocking the main loop. The
+ * file is read and checked for consistency in a worker thread, the nodes
+ * are then built in batches from an idle handler, see the description of
+ * asynchronous loading above. Files only #GtkBuilder understands can not
+ * be loaded this way. Call gtk_nodes_node_view_load_finish() from
+ * @callback to get the result.
+ */
+
+void
+gtk_nodes_node_view_load_async (GtkNodesNodeView       *node_view,
+                                const gchar            *filename,
+                                GtkNodesNodeViewFormat  format,
+                                GCancellable           *cancellable,
+                                GAsyncReadyCallback     callback,
+                                gpointer                user_data)
+{
+  GtkNodesNodeViewLoadData *d;
+  GTask *task;
+  GTask *parse;
+
+
+  g_return_if_fail (GTKNODES_IS_NODE_VIEW (node_view));
+  g_return_if_fail (filename != NULL);
+
+  d = g_slice_new0 (GtkNodesNodeViewLoadData);
 
+  d->filename = g_strdup (filename);
+  d->format   = format;
 
+  task = g_task_new (node_view, cancellable, callback, user_data);
+  g_task_set_source_tag (task, gtk_nodes_node_view_load_async);
+  g_task_set_task_data (task, d, gtk_nodes_node_view_load_data_free);
 
+  /* the parse only hands over the graph, the load is done when it is built */
+  parse = g_task_new (node_view, cancellable, gtk_nodes_node_view_load_parsed,
+                      task);
+  g_task_set_task_data (parse, d, NULL);
 
+  g_task_run_in_thread (parse, gtk_nodes_node_view_load_thread);
+
+  g_object_unref (parse);
+}
 
 /**
- * gtk_nodes_node_view_save:
+ * gtk_nodes_node_view_load_finish:
  * @node_view: a GtkNodesNodeView
- * @filename: the name of the file to save, if the file exists, it will be overwritten
- *
- * Saves a representation of the current node view setup as XML so
- * it can be recreated with gtkbuilder
- * This only works properly for nodes which are their own widget types, as we
- * don't (and can't) in-depth clone the nodes
+ * @result: the #GAsyncResult passed to the callback
+ * @error: return location for an error
  *
- * Returns: 0 on error
+ * Returns: FALSE if loading failed or was cancelled
  */
 
 gboolean
-gtk_nodes_node_view_save (GtkNodesNodeView *node_view,
-                          const gchar      *filename)
+gtk_nodes_node_view_load_finish (GtkNodesNodeView  *node_view,
+                                 GAsyncResult      *result,
+                                 GError           **error)
 {
-  GtkNodesNodeViewPrivate *priv;
-  GList *l;
-  GList *s;
-  GList *sockets;
+  g_return_val_if_fail (g_task_is_valid (result, node_view), FALSE);
 
-  priv = gtk_nodes_node_view_get_instance_private (node_view);
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+/**
+ * gtk_nodes_node_view_set_transport:
+ * @node_view: a GtkNodesNodeView
+ * @transport: the #GtkNodesNodeViewTransport mode
+ *
+ * Sets the mode of payload transport between the nodes of the view.
+ * Payloads already queued or scheduled are still delivered when switching
+ * to %GTKNODES_NODE_VIEW_TRANSPORT_SYNC.
+ */
 
-	FILE *f;
+void
+gtk_nodes_node_view_set_transport (GtkNodesNodeView          *node_view,
+                                   GtkNodesNodeViewTransport  transport)
+{
+  GtkNodesNodeViewPrivate *priv;
 
 
-  g_return_val_if_fail (GTKNODES_IS_NODE_VIEW (node_view), FALSE);
+  g_return_if_fail (GTKNODES_IS_NODE_VIEW (node_view));
 
-  if (filename == NULL)
-    {
-      g_warning ("No filename specified");
-      return FALSE;
-    }
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
 
-	f = g_fopen(filename, "w+");
+  if (priv->transport == transport)
+    return;
 
-  if (f == NULL)
-    {
-      g_warning ("Error opening file %s for writing", filename);
-      return FALSE;
-    }
+  priv->transport = transport;
 
+  g_object_notify (G_OBJECT (node_view), "transport");
+}
 
-  /* lead in */
-  g_fprintf (f, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
-  g_fprintf (f, "<interface>\n");
+/**
+ * gtk_nodes_node_view_get_transport:
+ * @node_view: a GtkNodesNodeView
+ *
+ * Returns: the #GtkNodesNodeViewTransport mode of the view
+ */
 
+GtkNodesNodeViewTransport
+gtk_nodes_node_view_get_transport (GtkNodesNodeView *node_view)
+{
+  GtkNodesNodeViewPrivate *priv;
 
 
-  /* fixup the IDs so we can properly load, add and save again
-   * XXX I really need to think of a better method for unique IDs
-   */
-  priv->node_id = 0;
-  l = priv->children;
-  while (l)
-    {
-      GtkNodesNodeViewChild *child = l->data;
+  g_return_val_if_fail (GTKNODES_IS_NODE_VIEW (node_view),
+                        GTKNODES_NODE_VIEW_TRANSPORT_SYNC);
 
-      l = l->next;
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
 
-      if (!GTKNODES_IS_NODE (child->widget))
-        continue;
+  return priv->transport;
+}
 
-      g_object_set(child->widget, "id", priv->node_id, NULL);
-      priv->node_id++;
-    }
+/**
+ * gtk_nodes_node_view_set_queue_budget:
+ * @node_view: a GtkNodesNodeView
+ * @budget: the time budget in microseconds
+ *
+ * Sets the maximum time spent on delivering queued payloads per main loop
+ * iteration in %GTKNODES_NODE_VIEW_TRANSPORT_QUEUED mode
+ */
 
+void
+gtk_nodes_node_view_set_queue_budget (GtkNodesNodeView *node_view,
+                                      guint             budget)
+{
+  GtkNodesNodeViewPrivate *priv;
 
-  l = priv->children;
 
-  while (l)
-    {
-      gchar *internal_cfg;
-      GtkNodesNodeSocket *input;
-      guint x, y, width, height, id;
+  g_return_if_fail (GTKNODES_IS_NODE_VIEW (node_view));
 
-      GtkNodesNodeViewChild *child = l->data;
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
 
-      l = l->next;
+  if (priv->queue_budget == budget)
+    return;
 
-      if (!GTKNODES_IS_NODE (child->widget))
-        continue;
+  priv->queue_budget = budget;
 
-      g_object_get(child->widget, "x", &x, "y", &y,
-                   "width", &width, "height", &height,
-                   "id", &id, NULL);
+  g_object_notify (G_OBJECT (node_view), "queue-budget");
+}
 
-      g_fprintf (f, "<object class=\"%s\" id=\"%d\">\n",
-                 G_OBJECT_TYPE_NAME(child->widget), id);
+/**
+ * gtk_nodes_node_view_get_queue_budget:
+ * @node_view: a GtkNodesNodeView
+ *
+ * Returns: the queue time budget in microseconds
+ */
 
-      g_fprintf (f, "<property name=\"x\">%d</property>\n", x);
-      g_fprintf (f, "<property name=\"y\">%d</property>\n", y);
-      g_fprintf (f, "<property name=\"width\">%d</property>\n", width);
-      g_fprintf (f, "<property name=\"height\">%d</property>\n", height);
-      g_fprintf (f, "<property name=\"id\">%d</property>\n", id);
+guint
+gtk_nodes_node_view_get_queue_budget (GtkNodesNodeView *node_view)
+{
+  GtkNodesNodeViewPrivate *priv;
 
 
+  g_return_val_if_fail (GTKNODES_IS_NODE_VIEW (node_view), 0);
 
-      sockets = gtk_nodes_node_get_sinks (GTKNODES_NODE (child->widget));
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
 
-      if (sockets == NULL)
-        {
-          /* meh...*/
-          internal_cfg = gtk_nodes_node_export_properties(GTKNODES_NODE (child->widget));
+  return priv->queue_budget;
+}
 
-          if (internal_cfg != NULL)
-          {
-            g_fprintf (f, "%s", internal_cfg);
-            g_free (internal_cfg);
-          }
+/**
+ * gtk_nodes_node_view_get_queue_depth:
+ * @node_view: a GtkNodesNodeView
+ * @sink: a #GtkNodesNodeSocket in sink mode
+ *
+ * Tells how many payloads wait for delivery on the connection to @sink,
+ * in the queue of %GTKNODES_NODE_VIEW_TRANSPORT_QUEUED or held back by the
+ * scheduler.
+ *
+ * Returns: the number of payloads waiting for @sink
+ */
 
+guint
+gtk_nodes_node_view_get_queue_depth (GtkNodesNodeView   *node_view,
+                                     GtkNodesNodeSocket *sink)
+{
+  GtkNodesNodeViewPrivate *priv;
+  guint depth;
 
-          g_fprintf (f, "</object>\n");
-          continue;
-        }
 
-      s = sockets;
+  g_return_val_if_fail (GTKNODES_IS_NODE_VIEW (node_view), 0);
+  g_return_val_if_fail (GTKNODES_IS_NODE_SOCKET (sink), 0);
 
-      while (s)
-        {
-          GtkWidget *node;
-          guint id_source;
-          guint id_sink;
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
 
-          input = gtk_nodes_node_socket_get_input (GTKNODES_NODE_SOCKET (s->data));
+  depth = _gtk_nodes_node_socket_get_queued (sink);
 
-          if (input == NULL)
-            {
-              s = s->next;
-              continue;
-            }
+  if (priv->pending && g_hash_table_contains (priv->pending, sink))
+    depth++;
 
-          g_object_get(GTK_WIDGET (input), "id", &id_source, NULL);
-          g_object_get(GTK_WIDGET (s->data), "id", &id_sink, NULL);
-          node = gtk_widget_get_ancestor (GTK_WIDGET (input), GTKNODES_TYPE_NODE);
-          g_object_get(node, "id", &id, NULL);
+  return depth;
+}
 
-          /* we'll save the socket ids in the name of the handler and
-           * reconstruct them in gtk_nodes_node_view_connection_mapper()
-           * this way we can (ab)use GtkBuilder to do most of the work for us
-           */
-          g_fprintf (f, "<signal name=\"node-socket-connect\" handler=\"%d_%d\" "
-                        "object=\"%d\"/>\n", id_source, id_sink, id);
+/**
+ * gtk_nodes_node_view_get_nodes_in_rect:
+ * @node_view: a GtkNodesNodeView
+ * @rect: the area in node view coordinates
+ *
+ * Finds the nodes overlapping an area of the node view, e.g. for
+ * box selection. Only the part of the view covered by @rect is searched.
+ * Nodes in @rect not built yet because of #GtkNodesNodeView:lazy-load
+ * are built now.
+ *
+ * Returns: (element-type GtkWidget) (transfer container): the nodes
+ *          overlapping @rect from the bottom to the top of the stack
+ */
 
-          s = s->next;
-        }
+GList *
+gtk_nodes_node_view_get_nodes_in_rect (GtkNodesNodeView   *node_view,
+                                       const GdkRectangle *rect)
+{
+  GPtrArray *children;
+  GList *nodes = NULL;
+  guint i;
 
-          /* meh...*/
-      internal_cfg = gtk_nodes_node_export_properties(GTKNODES_NODE (child->widget));
 
-      if (internal_cfg != NULL)
-        {
-         g_fprintf (f, "%s", internal_cfg);
-         g_free (internal_cfg);
-        }
+  g_return_val_if_fail (GTKNODES_IS_NODE_VIEW (node_view), NULL);
+  g_return_val_if_fail (rect != NULL, NULL);
 
-      g_fprintf (f, "</object>\n");
+  gtk_nodes_node_view_instantiate_area (node_view, rect);
 
-      g_list_free (sockets);
-    }
+  children = gtk_nodes_node_view_query_children (node_view, rect);
 
+  for (i = children->len; i > 0; i--)
+    {
+      GtkNodesNodeViewChild *child = g_ptr_array_index (children, i - 1);
 
-  /*lead out */
-  g_fprintf (f, "</interface>\n");
+      nodes = g_list_prepend (nodes, child->widget);
+    }
 
-  fclose(f);
+  g_ptr_array_unref (children);
 
-  return TRUE;
+  return nodes;
 }
 
 /**
- * gtk_nodes_node_view_load:
+ * gtk_nodes_node_view_get_node_at:
  * @node_view: a GtkNodesNodeView
- * @filename: the name of the file to load
- *
- * Loads an XML description parseable by #GtkBuilder and reconstructs
- * a node configuration. Note that this will not restore the internal
- * state of any nodes, but only their placement and the connections
- * between sockets.
- *
- * This only works properly for nodes which are their own widget types.
+ * @x: x position in node view coordinates
+ * @y: y position in node view coordinates
  *
- * Returns: 0 if and error occured
+ * Returns: (transfer none) (nullable): the topmost node at the position or
+ *          NULL if there is none
  */
 
-gboolean
-gtk_nodes_node_view_load (GtkNodesNodeView *node_view,
-                          const gchar      *filename)
+GtkWidget *
+gtk_nodes_node_view_get_node_at (GtkNodesNodeView *node_view,
+                                 gint              x,
+                                 gint              y)
 {
-	GtkBuilder* builder;
-  GError *error = NULL;
-  GSList *l;
+  GdkRectangle point = {x, y, 1, 1};
+  GPtrArray *children;
+  GtkWidget *node = NULL;
 
 
-  g_return_val_if_fail (GTKNODES_IS_NODE_VIEW (node_view), FALSE);
+  g_return_val_if_fail (GTKNODES_IS_NODE_VIEW (node_view), NULL);
 
-  if (filename == NULL)
-    {
-      g_warning ("No filename specified");
-      return FALSE;
-    }
+  gtk_nodes_node_view_instantiate_area (node_view, &point);
 
-  builder = gtk_builder_new();
+  children = gtk_nodes_node_view_query_children (node_view, &point);
 
-  if (!gtk_builder_add_from_file(builder, filename, &error))
-    {
-      g_warning ("Error occured loading nodes from file: %s", error->message);
-      g_clear_error(&error);
+  if (children->len)
+    node = ((GtkNodesNodeViewChild *)
+            g_ptr_array_index (children, children->len - 1))->widget;
 
-      return FALSE;
-    }
+  g_ptr_array_unref (children);
 
-  l = gtk_builder_get_objects(builder);
+  return node;
+}
 
-	while (l)
+/**
+ * gtk_nodes_node_view_get_node:
+ * @node_view: a GtkNodesNodeView
+ * @id: the id of the node
+ *
+ * Looks up a node by its #GtkNodesNode:id. A node not built yet because
+ * of #GtkNodesNodeView:lazy-load is built now.
+ *
+ * Returns: (transfer none) (nullable): the node or NULL if there is none
+ *          with this id
+ */
+
+GtkWidget *
+gtk_nodes_node_view_get_node (GtkNodesNodeView *node_view,
+                              guint             id)
+{
+  GtkNodesNodeViewPrivate *priv;
+  GtkNodesNodeViewChild *child;
+
+
+  g_return_val_if_fail (GTKNODES_IS_NODE_VIEW (node_view), NULL);
+
+  priv = gtk_nodes_node_view_get_instance_private (node_view);
+
+  /* someone wants it, so it must exist now */
+  if (g_hash_table_contains (priv->lazy_index, GUINT_TO_POINTER (id)))
     {
- 	 	 GObject *n = l->data;
+      GPtrArray *records;
 
-	   l = l->next;
+      records = g_ptr_array_new ();
+      g_ptr_array_add (records, g_hash_table_lookup (priv->lazy_index,
+                                                     GUINT_TO_POINTER (id)));
 
-     if (gtk_widget_get_parent(GTK_WIDGET(n)) == NULL)
-       gtk_container_add(GTK_CONTAINER(node_view), GTK_WIDGET(n));
- 	 }
+      gtk_nodes_node_view_instantiate_records (node_view, records);
 
-	gtk_builder_connect_signals_full (builder,
-                                    gtk_nodes_node_view_connection_mapper,
-                                    node_view);
+      g_ptr_array_unref (records);
+    }
 
-	gtk_widget_show_all(GTK_WIDGET (node_view));
+  child = g_hash_table_lookup (priv->id_index, GUINT_TO_POINTER (id));
 
-  return TRUE;
+  if (child == NULL)
+    return NULL;
+
+  return child->widget;
 }
 
 /**
@@ -1651,3 +6126,46 @@ gtk_nodes_node_view_new (void)
 {
   return g_object_new (GTKNODES_TYPE_NODE_VIEW, NULL);
 }
+
+/* our enum-based file format type */
+GType
+gtk_nodes_node_view_format_get_type (void)
+{
+  static gsize g_define_type_id__ = 0;
+
+  if (g_once_init_enter (&g_define_type_id__))
+    {
+      static const GEnumValue values[] = {
+        { GTKNODES_NODE_VIEW_FORMAT_XML,    "GTKNODES_NODE_VIEW_FORMAT_XML",    "xml" },
+        { GTKNODES_NODE_VIEW_FORMAT_BINARY, "GTKNODES_NODE_VIEW_FORMAT_BINARY", "binary" },
+        { 0, NULL, NULL }
+      };
+      GType g_define_type_id =
+        g_enum_register_static (g_intern_static_string ("GtkNodesNodeViewFormat"), values);
+      g_once_init_leave (&g_define_type_id__, g_define_type_id);
+    }
+
+  return g_define_type_id__;
+}
+
+/* our enum-based transport type */
+GType
+gtk_nodes_node_view_transport_get_type (void)
+{
+  static gsize g_define_type_id__ = 0;
+
+  if (g_once_init_enter (&g_define_type_id__))
+    {
+      static const GEnumValue values[] = {
+        { GTKNODES_NODE_VIEW_TRANSPORT_SYNC,   "GTKNODES_NODE_VIEW_TRANSPORT_SYNC",   "sync" },
+        { GTKNODES_NODE_VIEW_TRANSPORT_QUEUED, "GTKNODES_NODE_VIEW_TRANSPORT_QUEUED", "queued" },
+        { GTKNODES_NODE_VIEW_TRANSPORT_SCHEDULED, "GTKNODES_NODE_VIEW_TRANSPORT_SCHEDULED", "scheduled" },
+        { 0, NULL, NULL }
+      };
+      GType g_define_type_id =
+        g_enum_register_static (g_intern_static_string ("GtkNodesNodeViewTransport"), values);
+      g_once_init_leave (&g_define_type_id__, g_define_type_id);
+    }
+
+  return g_define_type_id__;
+}
@@ -30,6 +30,7 @@
 #endif
 
 #include <gtk/gtkcontainer.h>
+#include "gtknodesocket.h"
 
 
 G_BEGIN_DECLS
@@ -41,6 +42,49 @@ G_BEGIN_DECLS
 #define GTKNODES_IS_NODE_VIEW(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GTKNODES_TYPE_NODE_VIEW))
 #define GTKNODES_IS_NODE_VIEW_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), GTKNODES_TYPE_NODE_VIEW))
 #define GTKNODES_NODE_VIEW_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), GTKNODES_TYPE_NODE_VIEW, GtkNodesNodeViewClass))
+#define GTKNODES_TYPE_NODE_VIEW_TRANSPORT  (gtk_nodes_node_view_transport_get_type ())
+#define GTKNODES_TYPE_NODE_VIEW_FORMAT     (gtk_nodes_node_view_format_get_type ())
+#define GTKNODES_TYPE_NODE_VIEW_SNAPSHOT   (gtk_nodes_node_view_snapshot_get_type ())
+
+
+/**
+ * GtkNodesNodeViewTransport:
+ * @GTKNODES_NODE_VIEW_TRANSPORT_SYNC:   payloads are delivered to sinks
+ *                                       immediately from within the write call
+ * @GTKNODES_NODE_VIEW_TRANSPORT_QUEUED: payloads are queued and delivered from
+ *                                       the main loop within a time budget
+ * @GTKNODES_NODE_VIEW_TRANSPORT_SCHEDULED: payloads are collected, then
+ *                                          delivered and evaluated once per
+ *                                          node and tick in topological order,
+ *                                          see #GtkNodesNode::node-evaluate
+ *
+ * The transport mode determines how payloads travel between the sockets of
+ * the nodes in a #GtkNodesNodeView
+ */
+
+typedef enum
+{
+  GTKNODES_NODE_VIEW_TRANSPORT_SYNC,
+  GTKNODES_NODE_VIEW_TRANSPORT_QUEUED,
+  GTKNODES_NODE_VIEW_TRANSPORT_SCHEDULED,
+} GtkNodesNodeViewTransport;
+
+/**
+ * GtkNodesNodeViewFormat:
+ * @GTKNODES_NODE_VIEW_FORMAT_XML:    XML, as read by #GtkBuilder
+ * @GTKNODES_NODE_VIEW_FORMAT_BINARY: the binary format of
+ *                                    gtk_nodes_node_view_save_binary()
+ *
+ * The file formats a #GtkNodesNodeView can be saved in
+ */
+
+typedef enum
+{
+  GTKNODES_NODE_VIEW_FORMAT_XML,
+  GTKNODES_NODE_VIEW_FORMAT_BINARY,
+} GtkNodesNodeViewFormat;
+
+typedef struct _GtkNodesNodeViewSnapshot    GtkNodesNodeViewSnapshot;
 
 typedef struct _GtkNodesNodeView            GtkNodesNodeView;
 typedef struct _GtkNodesNodeViewPrivate     GtkNodesNodeViewPrivate;
@@ -69,9 +113,45 @@ struct _GtkNodesNodeViewClass
 GDK_AVAILABLE_IN_ALL
 GType gtk_nodes_node_view_get_type          (void) G_GNUC_CONST;
 
+GDK_AVAILABLE_IN_ALL
+GType gtk_nodes_node_view_transport_get_type (void) G_GNUC_CONST;
+
+GDK_AVAILABLE_IN_ALL
+GType gtk_nodes_node_view_format_get_type   (void) G_GNUC_CONST;
+
+GDK_AVAILABLE_IN_ALL
+GType gtk_nodes_node_view_snapshot_get_type (void) G_GNUC_CONST;
+
 GDK_AVAILABLE_IN_ALL
 GtkWidget*     gtk_nodes_node_view_new      (void);
 
+GDK_AVAILABLE_IN_ALL
+void           gtk_nodes_node_view_set_transport (GtkNodesNodeView          *node_view,
+                                                  GtkNodesNodeViewTransport  transport);
+GDK_AVAILABLE_IN_ALL
+GtkNodesNodeViewTransport gtk_nodes_node_view_get_transport (GtkNodesNodeView *node_view);
+
+GDK_AVAILABLE_IN_ALL
+void           gtk_nodes_node_view_set_queue_budget (GtkNodesNodeView *node_view,
+                                                     guint             budget);
+GDK_AVAILABLE_IN_ALL
+guint          gtk_nodes_node_view_get_queue_budget (GtkNodesNodeView *node_view);
+
+GDK_AVAILABLE_IN_ALL
+guint          gtk_nodes_node_view_get_queue_depth (GtkNodesNodeView   *node_view,
+                                                    GtkNodesNodeSocket *sink);
+
+GDK_AVAILABLE_IN_ALL
+GList*         gtk_nodes_node_view_get_nodes_in_rect (GtkNodesNodeView   *node_view,
+                                                      const GdkRectangle *rect);
+GDK_AVAILABLE_IN_ALL
+GtkWidget*     gtk_nodes_node_view_get_node_at (GtkNodesNodeView *node_view,
+                                                gint              x,
+                                                gint              y);
+GDK_AVAILABLE_IN_ALL
+GtkWidget*     gtk_nodes_node_view_get_node (GtkNodesNodeView *node_view,
+                                             guint             id);
+
 GDK_AVAILABLE_IN_ALL
 gboolean       gtk_nodes_node_view_save (GtkNodesNodeView *node_view,
                                          const gchar      *filename);
@@ -80,6 +160,77 @@ GDK_AVAILABLE_IN_ALL
 gboolean       gtk_nodes_node_view_load (GtkNodesNodeView *node_view,
                                          const gchar      *filename);
 
+GDK_AVAILABLE_IN_ALL
+gboolean       gtk_nodes_node_view_save_binary (GtkNodesNodeView *node_view,
+                                                const gchar      *filename);
+
+GDK_AVAILABLE_IN_ALL
+gboolean       gtk_nodes_node_view_load_binary (GtkNodesNodeView *node_view,
+                                                const gchar      *filename);
+
+GDK_AVAILABLE_IN_ALL
+void           gtk_nodes_node_view_load_async  (GtkNodesNodeView        *node_view,
+                                                const gchar             *filename,
+                                                GtkNodesNodeViewFormat   format,
+                                                GCancellable            *cancellable,
+                                                GAsyncReadyCallback      callback,
+                                                gpointer                 user_data);
+GDK_AVAILABLE_IN_ALL
+gboolean       gtk_nodes_node_view_load_finish (GtkNodesNodeView  *node_view,
+                                                GAsyncResult      *result,
+                                                GError           **error);
+
+GDK_AVAILABLE_IN_ALL
+GtkNodesNodeViewSnapshot * gtk_nodes_node_view_snapshot       (GtkNodesNodeView         *node_view);
+GDK_AVAILABLE_IN_ALL
+GtkNodesNodeViewSnapshot * gtk_nodes_node_view_snapshot_ref   (GtkNodesNodeViewSnapshot *snapshot);
+GDK_AVAILABLE_IN_ALL
+void                       gtk_nodes_node_view_snapshot_unref (GtkNodesNodeViewSnapshot *snapshot);
+GDK_AVAILABLE_IN_ALL
+gboolean                   gtk_nodes_node_view_snapshot_save  (GtkNodesNodeViewSnapshot  *snapshot,
+                                                               const gchar               *filename,
+                                                               GtkNodesNodeViewFormat     format,
+                                                               GCancellable              *cancellable,
+                                                               GError                   **error);
+
+GDK_AVAILABLE_IN_ALL
+void           gtk_nodes_node_view_save_async  (GtkNodesNodeView        *node_view,
+                                                const gchar             *filename,
+                                                GtkNodesNodeViewFormat   format,
+                                                GCancellable            *cancellable,
+                                                GAsyncReadyCallback      callback,
+                                                gpointer                 user_data);
+GDK_AVAILABLE_IN_ALL
+gboolean       gtk_nodes_node_view_save_finish (GtkNodesNodeView  *node_view,
+                                                GAsyncResult      *result,
+                                                GError           **error);
+
+GDK_AVAILABLE_IN_ALL
+gboolean       gtk_nodes_node_view_journal_start   (GtkNodesNodeView  *node_view,
+                                                    const gchar       *filename,
+                                                    GError           **error);
+GDK_AVAILABLE_IN_ALL
+void           gtk_nodes_node_view_journal_stop    (GtkNodesNodeView  *node_view);
+GDK_AVAILABLE_IN_ALL
+void           gtk_nodes_node_view_journal_compact (GtkNodesNodeView  *node_view);
+GDK_AVAILABLE_IN_ALL
+gboolean       gtk_nodes_node_view_recover         (GtkNodesNodeView  *node_view,
+                                                    const gchar       *filename);
+GDK_AVAILABLE_IN_ALL
+void           gtk_nodes_node_view_set_journal_threshold (GtkNodesNodeView *node_view,
+                                                          guint             threshold);
+GDK_AVAILABLE_IN_ALL
+guint          gtk_nodes_node_view_get_journal_threshold (GtkNodesNodeView *node_view);
+
+GDK_AVAILABLE_IN_ALL
+void           gtk_nodes_node_view_set_lazy_load (GtkNodesNodeView *node_view,
+                                                  gboolean          lazy_load);
+GDK_AVAILABLE_IN_ALL
+gboolean       gtk_nodes_node_view_get_lazy_load (GtkNodesNodeView *node_view);
+GDK_AVAILABLE_IN_ALL
+void           gtk_nodes_node_view_instantiate   (GtkNodesNodeView   *node_view,
+                                                  const GdkRectangle *rect);
+
 G_END_DECLS
 
 
@@ -0,0 +1,43 @@
+/* # vim: tabstop=2 shiftwidth=2 expandtab
+ *
+ * Copyright (C) 2019 Armin Luntzer (armin.luntzer@univie.ac.at)
+ *               Department of Astrophysics, University of Vienna
+ *
+ * The initial version of this project was developed as part of the
+ * activities under ESA/PRODEX contract number C4000126224.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GTK_NODE_VIEW_PRIVATE_H__
+#define __GTK_NODE_VIEW_PRIVATE_H__
+
+#include "gtknodeview.h"
+#include "gtknodesocket.h"
+
+G_BEGIN_DECLS
+
+/* internal interface between the sockets and their node view */
+
+gboolean _gtk_nodes_node_view_route_payload (GtkNodesNodeView   *node_view,
+                                             GtkNodesNodeSocket *sink,
+                                             GBytes             *payload);
+
+gboolean _gtk_nodes_node_view_insert_edge   (GtkNodesNodeView   *node_view,
+                                             GtkNodesNodeSocket *source,
+                                             GtkNodesNodeSocket *sink);
+
+G_END_DECLS
+
+#endif /* __GTK_NODE_VIEW_PRIVATE_H__ */